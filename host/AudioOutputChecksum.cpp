@@ -0,0 +1,36 @@
+/*
+ * AudioOutputChecksum
+ * Null output that counts frames and computes a checksum 
+ * (FNV-1a) over the PCM data; used to benchmark decoding
+ * and to detect changes in decoder output (dec_regress).
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#include "AudioOutputChecksum.h"
+
+// With one channel, the R slot is undefined and not summed
+size_t AudioOutputChecksum::ConsumeSample(int16_t sL, int16_t sR)
+{
+    int16_t s[2] = { sL, sR };
+
+    return ConsumeSamples(s, 1) ? sizeof(uint32_t) : 0;
+}
+
+uint16_t AudioOutputChecksum::ConsumeSamples(int16_t *samples, uint16_t count)
+{
+    uint32_t h = sum;
+    int n = count << 1;
+    int step = (channels == 1) ? 2 : 1;
+
+    for(int i = 0; i < n; i += step) {
+        uint16_t s = samples[i];
+        h = (h ^ (s & 0xff)) * 16777619U;
+        h = (h ^ (s >> 8)) * 16777619U;
+    }
+    sum = h;
+    frames += count;
+
+    return count;
+}
@@ -0,0 +1,36 @@
+/*
+ * AudioOutputChecksum
+ * Null output that counts frames and computes a checksum 
+ * (FNV-1a) over the PCM data; used to benchmark decoding
+ * and to detect changes in decoder output (dec_regress).
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#ifndef _AudioOutputChecksum_H
+#define _AudioOutputChecksum_H
+
+#include "src/ESP8266Audio/AudioOutput.h"
+
+class AudioOutputChecksum : public AudioOutput
+{
+  public:
+    AudioOutputChecksum() { bps = 16; channels = 2; hertz = 44100; reset(); }
+
+    void reset()                          { sum = 2166136261U; frames = 0; }
+    virtual bool begin() override         { return true; }
+    virtual size_t ConsumeSample(int16_t sL, int16_t sR) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override;
+    virtual bool stop() override          { return true; }
+
+    uint32_t getSum()                     { return sum; }
+    uint32_t getFrames()                  { return frames; }
+    int      getRate()                    { return hertz; }
+
+  protected:
+    uint32_t sum;
+    uint32_t frames;
+};
+
+#endif
@@ -0,0 +1,285 @@
+/*
+ * AudioGeneratorWAVLoop: IMA-ADPCM
+ *
+ * ADPCM WAV files are made here, by an encoder whose own
+ * reconstruction is the expected output.
+ * 1) Mono and stereo, small and large blocks, with and without
+ *    a partial block at the end, played once into an output
+ *    taking an odd-sized piece per loop: Output must be the
+ *    reconstruction, frame for frame.
+ * 2) The same files looped with AudioFileSourceFSLoop, as
+ *    PA_LOOP plays them: Three rounds must be the reconstruction
+ *    three times, so the loop seam is continuous; also for
+ *    files shorter than the generator's buffer.
+ * 3) CPU time and bytes read per second of audio, 44.1kHz
+ *    stereo: 16 bit PCM, ADPCM, and MP3 (xing44 from the corpus).
+ */
+#include <stdlib.h>
+#include <math.h>
+#include "Arduino.h"
+#include "FS.h"
+#include "LittleFS.h"
+#include "audiohost.h"
+#include "AudioFileSourceLoop.h"
+#include "AudioGeneratorWAVLoop.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const int16_t stepTab[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int idxAdj[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+struct Encoder {
+    int32_t pred = 0;
+    int     idx = 0;
+
+    // Returns the nibble; pred is what a decoder makes of it
+    int enc(int x)
+    {
+        int step = stepTab[idx], diff = x - pred, n = 0;
+        int dq = step >> 3;
+        if(diff < 0) { n = 8; diff = -diff; }
+        if(diff >= step)      { n |= 4; diff -= step; dq += step; }
+        if(diff >= step >> 1) { n |= 2; diff -= step >> 1; dq += step >> 1; }
+        if(diff >= step >> 2) { n |= 1; dq += step >> 2; }
+        pred += (n & 8) ? -dq : dq;
+        if(pred > 32767) pred = 32767;
+        else if(pred < -32768) pred = -32768;
+        idx += idxAdj[n & 7];
+        if(idx < 0) idx = 0;
+        else if(idx > 88) idx = 88;
+        return n;
+    }
+};
+
+static void put16(std::vector<uint8_t> &d, uint16_t v) { d.push_back(v); d.push_back(v >> 8); }
+static void put32(std::vector<uint8_t> &d, uint32_t v) { put16(d, v); put16(d, v >> 16); }
+
+// Encode pcm (interleaved) into an ADPCM WAV; the last block
+// has "groups" groups (full if groups < 0). ref gets the decode.
+static std::vector<uint8_t> mkADPCM(const std::vector<int16_t> &pcm, int chnls, int rate, int blockAlign,
+                                    int groups, std::vector<int16_t> &ref)
+{
+    const int spb = (blockAlign - 4 * chnls) * 2 / chnls + 1;
+    const size_t frames = pcm.size() / chnls;
+    std::vector<uint8_t> data;
+    Encoder e[2];
+
+    ref.clear();
+    for(size_t f = 0; f < frames; ) {
+        int n = (frames - f < (size_t)spb) ? (int)(frames - f) : spb;
+        bool last = (f + n == frames);
+        if(last && groups >= 0 && 1 + 8 * groups < n) n = 1 + 8 * groups;
+        int g = (n - 1) / 8;
+        // Header: First sample as is
+        for(int c = 0; c < chnls; c++) {
+            e[c].pred = pcm[f * chnls + c];
+            put16(data, e[c].pred);
+            data.push_back(e[c].idx);
+            data.push_back(0);
+            ref.push_back(e[c].pred);
+        }
+        size_t r0 = ref.size();
+        ref.resize(r0 + 8 * g * chnls);
+        for(int k = 0; k < g; k++) {
+            for(int c = 0; c < chnls; c++) {
+                for(int i = 0; i < 8; i += 2) {
+                    size_t s = f + 1 + 8 * k + i;
+                    int lo = e[c].enc(pcm[s * chnls + c]);
+                    ref[r0 + ((8 * k + i) * chnls) + c] = e[c].pred;
+                    int hi = e[c].enc(pcm[(s + 1) * chnls + c]);
+                    ref[r0 + ((8 * k + i + 1) * chnls) + c] = e[c].pred;
+                    data.push_back(lo | (hi << 4));
+                }
+            }
+        }
+        // Frames that do not fill a group are not encoded
+        if(last || g * 8 + 1 < n) break;
+        f += n;
+    }
+
+    std::vector<uint8_t> w;
+    put32(w, 0x46464952); put32(w, 40 + data.size()); put32(w, 0x45564157);
+    put32(w, 0x20746d66); put32(w, 20);
+    put16(w, WAV_FMT_ADPCM); put16(w, chnls); put32(w, rate);
+    put32(w, (uint32_t)((uint64_t)rate * blockAlign / spb)); put16(w, blockAlign); put16(w, 4);
+    put16(w, 2); put16(w, spb);
+    put32(w, 0x61746164); put32(w, data.size());
+    w.insert(w.end(), data.begin(), data.end());
+    return w;
+}
+
+static std::vector<int16_t> mkSignal(int chnls, int frames)
+{
+    std::vector<int16_t> v(frames * chnls);
+    for(int i = 0; i < frames; i++) {
+        for(int c = 0; c < chnls; c++) {
+            v[i * chnls + c] = (int16_t)(12000 * sin(i * (0.03 + 0.011 * c)) + 6000 * sin(i * 0.0007) + rand() % 1500 - 750);
+        }
+    }
+    return v;
+}
+
+// Output as it comes out of the generator: R only if stereo
+static void take(PCMSink &s, int chnls, std::vector<int16_t> &out)
+{
+    out.clear();
+    for(size_t i = 0; i < s.frames(); i++) {
+        out.push_back(s.pcm[2 * i]);
+        if(chnls == 2) out.push_back(s.pcm[2 * i + 1]);
+    }
+}
+
+static std::string dir;
+
+static bool writeFile(const char *fn, const std::vector<uint8_t> &d)
+{
+    FILE *f = fopen((dir + fn).c_str(), "wb");
+    return f && fwrite(d.data(), 1, d.size(), f) == d.size() && !fclose(f);
+}
+
+// Source that counts bytes read
+class CountSource : public MemSource
+{
+  public:
+    virtual uint32_t read(void *d, uint32_t len) override
+    {
+        len = MemSource::read(d, len);
+        bytes += len;
+        return len;
+    }
+    uint64_t bytes = 0;
+};
+
+// CPU us and bytes per second of audio
+template<class Gen> static void bench(const char *what, CountSource &src)
+{
+    PCMSink sink;
+    uint64_t frames = 0;
+    int runs = 0, rate = 0;
+    unsigned long t0 = micros(), t;
+
+    sink.keep = false;
+    src.bytes = 0;
+    do {
+        Gen gen;
+        sink.clear();
+        src.rewind();
+        decodeAll(gen, &src, &sink);
+        frames += sink.frames();
+        rate = sink.getRate();
+        runs++;
+    } while((t = micros() - t0) < 500000);
+
+    double secs = (double)frames / rate;
+    printf("%-6s %8zu %10.0f %11.0f\n", what, (size_t)src.getSize(), t / secs, src.bytes / secs);
+}
+
+int main()
+{
+    int fails = 0;
+    char tmpl[] = "/tmp/adpcm_testXXXXXX";
+
+    srand(1);
+    if(!mkdtemp(tmpl)) {
+        printf("FAIL: No temp dir\n");
+        return 1;
+    }
+    dir = tmpl;
+    LittleFS.setRoot(tmpl);
+
+    // 1) and 2); 37 blocks, or 2 (with small blocks, shorter
+    // than the buffer). Then half a block, or only part of it.
+    for(int chnls = 1; chnls <= 2; chnls++) {
+        for(int ba : { 256 * chnls, 1024 }) {
+            for(int blocks : { 37, 2 }) {
+                for(int groups : { -1, 0, 5 }) {
+                    int spb = (ba - 4 * chnls) * 2 / chnls + 1;
+                    std::vector<int16_t> ref, out;
+                    std::vector<uint8_t> w = mkADPCM(mkSignal(chnls, blocks * spb + spb / 2), chnls, 22050, ba, groups, ref);
+                    char what[80];
+                    sprintf(what, "%s, block %d, %d blocks, last %d groups", chnls == 1 ? "mono" : "stereo", ba, blocks,
+                        (groups < 0) ? (spb / 2 - 1) / 8 : groups);
+
+                    MemSource m(w);
+                    AudioGeneratorWAVLoop g;
+                    PCMSink once;
+                    int it = 0;
+                    if(!g.begin(&m, &once)) {
+                        printf("FAIL: %s: Not accepted\n", what);
+                        fails++;
+                        continue;
+                    }
+                    while(g.isRunning()) {
+                        once.room = 97 + (it++ % 50);
+                        if(!g.loop()) break;
+                    }
+                    g.stop();
+                    take(once, chnls, out);
+                    if(out != ref) {
+                        printf("FAIL: %s: Once: %zu of %zu samples, differ\n", what, out.size(), ref.size());
+                        fails++;
+                    }
+
+                    writeFile("/loop.wav", w);
+                    AudioFileSourceFSLoop src;
+                    AudioGeneratorWAVLoop gl;
+                    PCMSink looped;
+                    src.open("/loop.wav");
+                    src.setPlayLoop(true);
+                    gl.begin(&src, &looped);
+                    src.setStartPos(gl.startPos);
+                    it = 0;
+                    while(looped.frames() * chnls < 3 * ref.size() && it < 100000) {
+                        looped.room = 97 + (it++ % 50);
+                        gl.loop();
+                    }
+                    gl.stop();
+                    take(looped, chnls, out);
+                    out.resize(3 * ref.size());
+                    size_t bad = 0, first = 0;
+                    for(size_t i = 0; i < out.size(); i++) {
+                        if(out[i] != ref[i % ref.size()] && !bad++) first = i;
+                    }
+                    if(bad) {
+                        printf("FAIL: %s: Looped: %zu samples differ, first at %zu (round %zu)\n", what, bad, first,
+                            first / ref.size() + 1);
+                        fails++;
+                    }
+                }
+            }
+        }
+    }
+    if(!fails) printf("ADPCM once and looped: all cases match the encoder\n");
+
+    // 3) 10s of 44.1kHz stereo
+    {
+        std::vector<int16_t> pcm = mkSignal(2, 441000), ref;
+        writeWAV((dir + "/pcm.wav").c_str(), pcm, 2, 44100);
+        CountSource p, a, m;
+        p.open((dir + "/pcm.wav").c_str());
+        a.data = mkADPCM(pcm, 2, 44100, 1024, -1, ref);
+        if(!m.open(corpusPath("xing44").c_str())) {
+            printf("FAIL: xing44 missing\n");
+            fails++;
+        } else {
+            printf("format     bytes  us/s audio  bytes/s audio\n");
+            bench<AudioGeneratorWAVLoop>("PCM", p);
+            bench<AudioGeneratorWAVLoop>("ADPCM", a);
+            bench<AudioGeneratorMP3>("MP3", m);
+        }
+    }
+
+    std::string rm = "rm -rf " + dir;
+    if(system(rm.c_str())) { }
+
+    printf("%s\n", fails ? "adpcm_test: FAILED" : "adpcm_test: OK");
+    return fails ? 1 : 0;
+}
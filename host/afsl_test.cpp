@@ -0,0 +1,217 @@
+/*
+ * AudioFileSourceLoop: Chunk buffering, seek and loop
+ *
+ * 1) Random reads, seeks (SET/CUR/END) and loop() calls on files
+ *    of various sizes, with and without loop mode and startPos,
+ *    against a plain model of the file; data and position must
+ *    match.
+ * 2) File reads per second of audio for a 16 bit stereo stream
+ *    read in WAV generator sized pieces, vs. one file read per
+ *    request as before.
+ * 3) Time the reading (decoder) thread spends waiting for the
+ *    card (1ms per file read), 10x realtime. Built with
+ *    VSR_AUDIO_TASK (afsl_task), a second thread does the read-
+ *    ahead in refill(), like the feed task; data is checked.
+ */
+#include <unistd.h>
+#include <random>
+#include <vector>
+#ifdef VSR_AUDIO_TASK
+#include <thread>
+#define NAME "afsl_task"
+#else
+#define NAME "afsl_test"
+#endif
+#include "Arduino.h"
+#include "FS.h"
+#include "AudioFileSourceLoop.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static std::string dir;
+
+static std::vector<uint8_t> mkFile(const char *name, uint32_t size)
+{
+    std::vector<uint8_t> d(size);
+    for(uint32_t i = 0; i < size; i++) d[i] = (uint8_t)((i * 2654435761u) >> 24);
+    FILE *f = fopen((dir + name).c_str(), "wb");
+    fwrite(d.data(), 1, size, f);
+    fclose(f);
+    return d;
+}
+
+static int modelTest(uint32_t size, bool loop, uint32_t startPos, uint32_t seed)
+{
+    std::vector<uint8_t> d = mkFile("/t.bin", size);
+    AudioFileSourceSDLoop src;
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> buf(3 * AFSL_CHUNK);
+    uint32_t pos = 0, bytes = 0;
+    int fails = 0;
+
+    src.open("/t.bin");
+    src.setPlayLoop(loop);
+    src.setStartPos(startPos);
+
+    for(int op = 0; op < 20000 && !fails; op++) {
+        switch(rng() % 8) {
+        case 0: {
+            int32_t p = rng() % (size + 1);
+            src.seek(p, SEEK_SET);
+            pos = p;
+            break;
+        }
+        case 1: {
+            int32_t off = (int32_t)(rng() % (2 * AFSL_CHUNK)) - AFSL_CHUNK;
+            bool ok = src.seek(off, SEEK_CUR);
+            bool mok = ((int32_t)pos + off >= 0 && pos + off <= size);
+            if(ok != mok) {
+                printf("FAIL: seek(%d, SEEK_CUR) at %u: %d, expected %d\n", off, pos, ok, mok);
+                fails++;
+            }
+            if(mok) pos += off;
+            break;
+        }
+        case 2: {
+            int32_t off = -(int32_t)(rng() % (size + 1));
+            src.seek(off, SEEK_END);
+            pos = size + off;
+            break;
+        }
+        case 3:
+            src.loop();
+            break;
+        default: {
+            uint32_t len = 1 + rng() % buf.size();
+            uint32_t got = src.read(buf.data(), len);
+            // Model
+            std::vector<uint8_t> exp;
+            while(exp.size() < len) {
+                if(pos >= size) {
+                    if(!loop || startPos >= size) break;
+                    pos = startPos;
+                }
+                uint32_t n = std::min(size - pos, len - (uint32_t)exp.size());
+                exp.insert(exp.end(), d.begin() + pos, d.begin() + pos + n);
+                pos += n;
+            }
+            if(got != exp.size() || memcmp(buf.data(), exp.data(), got)) {
+                printf("FAIL: Size %u: read(%u) returned %u bytes, expected %zu, or data differs\n",
+                    size, len, got, exp.size());
+                fails++;
+            }
+            bytes += got;
+            break;
+        }
+        }
+        if(src.getPos() != pos) {
+            printf("FAIL: Size %u: getPos() %u, expected %u\n", size, src.getPos(), pos);
+            fails++;
+        }
+    }
+
+    printf("Size %6u, %s, startPos %5u: 20000 ops, %8u bytes, %s\n", size, loop ? "loop   " : "no loop",
+        startPos, bytes, fails ? "FAILED" : "same as file");
+    return fails;
+}
+
+// Stream at 44.1kHz 16 bit stereo, read like the WAV generator
+static void readsPerSecond()
+{
+    const uint32_t SIZE = 2 * 1024 * 1024, PIECE = 128;
+    AudioFileSourceSDLoop src;
+    uint8_t buf[PIECE];
+    uint32_t calls = 0;
+
+    mkFile("/s.bin", SIZE);
+    src.open("/s.bin");
+    uint32_t r0 = fs::fsStats.reads;
+    while(src.read(buf, PIECE) == PIECE) {
+        calls++;
+        src.loop();
+    }
+    double secs = SIZE / 176400.0;
+    printf("\n16 bit stereo stream, %u byte reads: %.0f file reads per second of audio, was %.0f\n",
+        PIECE, (fs::fsStats.reads - r0) / secs, calls / secs);
+}
+
+#ifdef VSR_AUDIO_TASK
+static volatile bool feeding;
+#endif
+
+static int decoderWait()
+{
+    const uint32_t SIZE = 1024 * 1024, PIECE = 1024;
+    AudioFileSourceSDLoop src;
+    uint8_t buf[PIECE];
+    unsigned long waited = 0;
+    int fails = 0;
+
+    std::vector<uint8_t> d = mkFile("/w.bin", SIZE);
+    src.open("/w.bin");
+    src.setPlayLoop(true);
+
+    #ifdef VSR_AUDIO_TASK
+    feeding = true;
+    std::thread feeder([&] {
+        while(feeding) {
+            src.refill();
+            usleep(200);
+        }
+    });
+    #endif
+
+    fs::fsStats.readDelayUs = 1000;
+    unsigned long t0 = micros();
+    for(uint32_t n = 0; n < 2 * SIZE; n += PIECE) {
+        unsigned long t = micros();
+        uint32_t got = src.read(buf, PIECE);
+        src.loop();
+        waited += micros() - t;
+        if(got != PIECE || memcmp(buf, d.data() + n % SIZE, PIECE)) {
+            if(!fails++) printf("FAIL: Data at %u differs\n", n);
+        }
+        usleep(PIECE * 1000000 / 176400 / 10);
+    }
+    double audio = 2.0 * SIZE / 176400;
+    printf("Decoder waits for card, %s: %.1f ms per second of audio (%.1fs of audio in %.1fs)\n",
+        #ifdef VSR_AUDIO_TASK
+        "refill() in feeder",
+        #else
+        "read-ahead in loop()",
+        #endif
+        waited / 1000.0 / audio, audio, (micros() - t0) / 1e6);
+    fs::fsStats.readDelayUs = 0;
+
+    #ifdef VSR_AUDIO_TASK
+    feeding = false;
+    feeder.join();
+    #endif
+
+    return fails;
+}
+
+int main()
+{
+    int fails = 0;
+    char tmpl[] = "/tmp/afslXXXXXX";
+
+    if(!mkdtemp(tmpl)) return 1;
+    dir = tmpl;
+    SD.setRoot(tmpl);
+
+    const uint32_t C = AFSL_CHUNK;
+    uint32_t seed = 1;
+    for(uint32_t size : { 1000u, C, 2 * C, 3 * C + 123, 20 * C + 7 }) {
+        fails += modelTest(size, false, 0, seed++);
+        fails += modelTest(size, true, 0, seed++);
+        fails += modelTest(size, true, 44, seed++);
+        fails += modelTest(size, true, size / 2 + 1, seed++);
+    }
+
+    readsPerSecond();
+    fails += decoderWait();
+
+    printf("%s: %s\n", NAME, fails ? "FAILED" : "OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,143 @@
+/*
+ * Audio helpers for host tests
+ *
+ * PCMSink:   AudioOutput that keeps everything as interleaved
+ *            stereo (mono: R = L). Like the I2S stand-in, it
+ *            takes up to "room" frames (no limit if negative).
+ * MemSource: AudioFileSource over a file loaded into memory,
+ *            so decoder timing does not include file I/O.
+ * writeWAV:  Canonical 44-byte header PCM WAV file.
+ */
+#pragma once
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include "src/ESP8266Audio/AudioOutput.h"
+#include "src/ESP8266Audio/AudioFileSource.h"
+
+class PCMSink : public AudioOutput
+{
+  public:
+    PCMSink() { bps = 16; channels = 2; hertz = 44100; }
+
+    virtual bool begin() override         { return true; }
+    virtual bool stop() override          { return true; }
+    virtual bool SetRate(int hz) override { hertz = hz; rates.push_back({ frames(), hz }); return true; }
+    virtual size_t ConsumeSample(int16_t sL, int16_t sR) override
+    {
+        int16_t s[2] = { sL, sR };
+        return ConsumeSamples(s, 1) ? sizeof(uint32_t) : 0;
+    }
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override
+    {
+        if(room >= 0 && count > room) count = room;
+        if(room >= 0) room -= count;
+        calls++;
+        if(!keep) { n += count; return count; }
+        for(int i = 0; i < count; i++, samples += 2) {
+            pcm.push_back(samples[0]);
+            pcm.push_back(channels == 1 ? samples[0] : samples[1]);
+        }
+        return count;
+    }
+
+    size_t frames()                       { return keep ? pcm.size() / 2 : n; }
+    int    getRate()                      { return hertz; }
+    void   clear()                        { pcm.clear(); rates.clear(); n = 0; calls = 0; }
+
+    std::vector<int16_t> pcm;
+    std::vector<std::pair<size_t, int>> rates;  // frames() at each SetRate()
+    bool     keep = true;
+    int      room = -1;
+    uint32_t calls = 0;
+
+  private:
+    size_t   n = 0;
+};
+
+class MemSource : public AudioFileSource
+{
+  public:
+    MemSource() {}
+    MemSource(const std::vector<uint8_t> &d) : data(d) {}
+
+    virtual bool open(const char *filename) override
+    {
+        FILE *f = fopen(filename, "rb");
+        if(!f) return false;
+        data.clear();
+        int c;
+        while((c = getc(f)) != EOF) data.push_back(c);
+        fclose(f);
+        pos = 0;
+        return (opened = true);
+    }
+    virtual uint32_t read(void *d, uint32_t len) override
+    {
+        if(len > data.size() - pos) len = data.size() - pos;
+        memcpy(d, data.data() + pos, len);
+        pos += len;
+        reads++;
+        return len;
+    }
+    virtual bool seek(int32_t p, int dir) override
+    {
+        if(dir == SEEK_CUR) p += pos;
+        else if(dir == SEEK_END) p += data.size();
+        if(p < 0 || (size_t)p > data.size()) return false;
+        pos = p;
+        return true;
+    }
+    virtual bool close() override         { return true; }
+    virtual bool isOpen() override        { return opened || !data.empty(); }
+    virtual uint32_t getSize() override   { return data.size(); }
+    virtual uint32_t getPos() override    { return pos; }
+
+    void rewind()                         { pos = 0; }
+
+    std::vector<uint8_t> data;
+    uint32_t reads = 0;
+
+  private:
+    uint32_t pos = 0;
+    bool     opened = false;
+};
+
+// Decode a whole stream into sink; returns number of loop() calls
+template<class Gen> static uint32_t decodeAll(Gen &gen, AudioFileSource *src, AudioOutput *sink)
+{
+    uint32_t loops = 0;
+
+    if(!gen.begin(src, sink)) return 0;
+    while(gen.isRunning()) {
+        loops++;
+        if(!gen.loop()) break;
+    }
+    gen.stop();
+
+    return loops;
+}
+
+static inline std::string corpusPath(const char *name, const char *ext = ".mp3")
+{
+    return std::string("mp3/") + name + ext;
+}
+
+// pcm: Interleaved if stereo; 8 bit data is taken from the high byte
+static inline bool writeWAV(const char *fn, const std::vector<int16_t> &pcm, int chnls, int rate, int bits = 16)
+{
+    FILE *f = fopen(fn, "wb");
+    if(!f) return false;
+    uint32_t bytes = pcm.size() * bits / 8;
+    uint32_t hdr[11] = { 0x46464952, 36 + bytes, 0x45564157, 0x20746d66, 16,
+                         (uint32_t)(1 | (chnls << 16)), (uint32_t)rate,
+                         (uint32_t)(rate * chnls * bits / 8), (uint32_t)(chnls * bits / 8 | (bits << 16)),
+                         0x61746164, bytes };
+    fwrite(hdr, 4, 11, f);
+    for(int16_t s : pcm) {
+        if(bits == 16) fwrite(&s, 2, 1, f);
+        else putc((s >> 8) + 128, f);
+    }
+    return !fclose(f);
+}
@@ -0,0 +1,136 @@
+/*
+ * BTTFN client against a simulated TCD over loopback
+ *
+ * Runs BTTFNClient (as used by the sketch) in real time and
+ * checks DISCOVER, notifications, sequence checks, loss
+ * recovery, lost-TCD detection and NOT_DATA push, and how 
+ * late packets are time-stamped while the main loop is busy.
+ * Built twice: Polled (WiFiUDP) and with VSR_BTTFN_ASYNC.
+ */
+#include <time.h>
+#include "Arduino.h"
+#include "tcdsim.h"
+
+static uint64_t usNow()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ull + t.tv_nsec / 1000;
+}
+static uint64_t t0 = usNow();
+unsigned long millis() { return (usNow() - t0) / 1000 + 1; }
+
+#ifdef VSR_BTTFN_ASYNC
+static BTTFNAsyncUDP u, mu;
+#else
+static SockUDP u("127.0.0.1", "127.0.0.2"), mu("127.0.0.1", "127.0.0.2");
+#endif
+static BTTFNClient bt(u, mu);
+
+static uint64_t flagAt = 0;
+static unsigned long stampAt = 0;
+static int lastSpd = -1;
+static int dataCnt = 0;
+
+static void notCB(uint8_t *b)
+{
+    if(!flagAt) {
+        flagAt = usNow();
+        stampAt = bt.packetMillis();
+    }
+    if(b[5] == BTTFN_NOT_SPD) lastSpd = b[6];
+}
+static void dataCB(uint8_t *) { dataCnt++; }
+
+static const int loopUs = 1000;
+
+// Our "main loop"
+static void run(TCD &t, unsigned long ms, bool (*until)() = NULL)
+{
+    unsigned long e = millis() + ms;
+    while(millis() < e) {
+        t.poll();
+        bt.loop();
+        if(until && until()) return;
+        usleep(loopUs);
+    }
+}
+
+int main()
+{
+    TCD tcd("TCD");
+    unsigned long st;
+
+    bt.setCallbacks(notCB, dataCB);
+
+    st = millis();
+    bt.begin("tcd", "vsr", BTTFN_TYPE_VSR);
+    run(tcd, 3000, [] { return bt.connected(); });
+    printf("DISCOVER: connected=%d after %lu ms\n", bt.connected(), millis() - st);
+
+    // Notifications, unicast and multicast
+    for(int mc = 0; mc < 2; mc++) {
+        int got = 0, n = 20;
+        for(int i = 0; i < n; i++) {
+            flagAt = 0;
+            tcd.notify(BTTFN_NOT_ALARM, mc);
+            run(tcd, 200, [] { return flagAt != 0; });
+            if(flagAt) got++;
+        }
+        printf("%s notifications: %d of %d delivered\n", mc ? "Multicast" : "Unicast", got, n);
+    }
+
+    // Time stamp error with the main loop blocked for 50ms
+    // (eg a display sequence) when the packet comes in
+    {
+        long sum = 0, mx = 0;
+        int n = 40;
+        for(int i = 0; i < n; i++) {
+            unsigned long sent;
+            long err;
+            flagAt = 0;
+            usleep((rand() % 50) * 1000);       // Random phase
+            sent = millis();
+            tcd.notify(BTTFN_NOT_ALARM, i & 1);
+            usleep(50000);
+            run(tcd, 200, [] { return flagAt != 0; });
+            err = (long)(stampAt - sent); sum += err; if(err > mx) mx = err;
+        }
+        printf("Arrival stamp error, loop blocked 50ms: avg %ld ms, max %ld ms\n", sum / n, mx);
+    }
+
+    // Sequence check: Older NOT_SPD must be dropped
+    tcd.notify(BTTFN_NOT_SPD, 1, 42, BTTFN_SSRC_GPS); run(tcd, 50);
+    tcd.notSeq -= 2;
+    tcd.notify(BTTFN_NOT_SPD, 1, 7, BTTFN_SSRC_GPS); run(tcd, 50);
+    printf("Sequence check: speed=%d (expect 42)\n", lastSpd);
+
+    // Loss recovery: Drop 3 responses
+    {
+        static int before;
+        run(tcd, 1500);
+        before = dataCnt;
+        tcd.dropResp = 3;
+        st = millis();
+        run(tcd, 10000, [] { return dataCnt > before; });
+        printf("Loss recovery (3 drops): %lu ms to next data\n", millis() - st);
+    }
+
+    // TCD gone
+    tcd.dropResp = 1 << 30;
+    run(tcd, 31000);
+    printf("Lost after 31s silence: %d (expect 1)\n", bt.checkLost(0));
+    tcd.dropResp = 0;
+
+    // NOT_DATA: No more polling
+    {
+        int sv;
+        tcd.nd = true;
+        run(tcd, 5000);
+        sv = tcd.served;
+        run(tcd, 5000);
+        printf("NOT_DATA: requests in 5s while pushed: %d (expect 0), data %d\n", tcd.served - sv, dataCnt);
+    }
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+/*
+ * Time travel sync against a TCD with network delay
+ *
+ * The TCD runs on its own thread and delays every packet by
+ * D +/- J ms each way. After a warm-up (RTT samples), NOT_TT
+ * arrives while the main loop is busy; the anchor the client
+ * computes (arrival stamp minus OWD) is compared to when the
+ * TCD actually sent the packet.
+ * Built twice: Polled (WiFiUDP) and with VSR_BTTFN_ASYNC.
+ */
+#include <time.h>
+#include <mutex>
+#include <thread>
+#include <random>
+#include <vector>
+#include "Arduino.h"
+#include "tcdsim.h"
+
+static uint64_t usNow()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000ull + t.tv_nsec / 1000;
+}
+static uint64_t t0 = usNow();
+unsigned long millis() { return (usNow() - t0) / 1000 + 1; }
+
+#ifdef VSR_BTTFN_ASYNC
+static BTTFNAsyncUDP u, mu;
+#else
+static SockUDP u("127.0.0.1", "127.0.0.2"), mu("127.0.0.1", "127.0.0.2");
+#endif
+static BTTFNClient bt(u, mu);
+
+static const int D = 10, J = 3;
+static std::mt19937 rng(1);
+static std::mutex rngLock;
+static int ts;
+
+static int owd()
+{
+    std::lock_guard<std::mutex> l(rngLock);
+    return D - J + (int)(rng() % (2 * J + 1));
+}
+
+static void sendLater(const uint8_t *b, int port, int delayMs)
+{
+    std::vector<uint8_t> v(b, b + 48);
+    std::thread([v, port, delayMs] {
+        sockaddr_in a = {};
+        usleep(delayMs * 1000);
+        a.sin_family = AF_INET; a.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+        sendto(ts, v.data(), 48, 0, (sockaddr *)&a, sizeof(a));
+    }).detach();
+}
+
+static void tcdThread()
+{
+    int sd = mksock("127.0.0.2", 1339);
+    for(;;) {
+        uint8_t b[64]; sockaddr_in a; socklen_t al = sizeof(a);
+        for(int sk : { ts, sd }) {
+            while(recvfrom(sk, b, 64, 0, (sockaddr *)&a, &al) == 48) {
+                b[4] = BTTFN_VERSION | 0x80;
+                b[31] = (b[5] & 0x40) ? 0x01 : 0;
+                tcd_csum(b);
+                sendLater(b, ntohs(a.sin_port), owd() + owd());   // Up + down
+            }
+        }
+        usleep(200);
+    }
+}
+
+static unsigned long anchor = 0;
+
+static void notCB(uint8_t *b)
+{
+    if(b[5] == BTTFN_NOT_TT) anchor = bt.packetMillis() - bt.getOWD();
+}
+
+static void run(unsigned long ms, bool (*until)() = NULL)
+{
+    unsigned long e = millis() + ms;
+    while(millis() < e) {
+        bt.loop();
+        if(until && until()) return;
+        usleep(1000);
+    }
+}
+
+int main()
+{
+    long mx = 0, sum = 0;
+    int n = 40;
+
+    ts = mksock("127.0.0.2", 1338);
+    std::thread(tcdThread).detach();
+
+    bt.setCallbacks(notCB, NULL);
+    bt.begin("127.0.0.2", "vsr", BTTFN_TYPE_VSR);
+
+    run(15000);
+    printf("RTT %u var %u min %u OWD %u samples %u\n", bt.getRTT(), bt.getRTTVar(), 
+        bt.getRTTMin(), bt.getOWD(), bt.getRTTSamples());
+
+    for(int i = 0; i < n; i++) {
+        uint8_t nb[48] = { 'B', 'T', 'T', 'F' };
+        unsigned long sent = millis();
+        long err;
+        anchor = 0;
+        nb[4] = BTTFN_VERSION | 0x40; nb[5] = BTTFN_NOT_TT;
+        nb[6] = 5000 & 0xff; nb[7] = 5000 >> 8;
+        tcd_csum(nb);
+        sendLater(nb, 1338, owd());
+        usleep((20 + rand() % 40) * 1000);      // Main loop busy
+        run(300, [] { return anchor != 0; });
+        err = (long)anchor - (long)sent;
+        if(err < 0) err = -err;
+        sum += err; if(err > mx) mx = err;
+        run(1200);
+    }
+    printf("Anchor error over %d time travels: avg %ld ms, max %ld ms\n", n, sum / n, mx);
+
+    return 0;
+}
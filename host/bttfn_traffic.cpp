@@ -0,0 +1,69 @@
+/*
+ * BTTFN traffic per scenario
+ *
+ * Runs the polled client against the simulated TCD on a 
+ * simulated clock (1 ms per loop pass), so minutes of traffic 
+ * take seconds, and reports packets per minute.
+ */
+#include "Arduino.h"
+#include "tcdsim.h"
+
+static unsigned long vms = 1;
+unsigned long millis() { return vms; }
+
+static SockUDP u("127.0.0.1", "127.0.0.2"), mu("127.0.0.1", "127.0.0.2");
+static BTTFNClient bt(u, mu);
+
+static void notCB(uint8_t *) {}
+static void dataCB(uint8_t *) {}
+
+static void run(TCD &t, unsigned long ms)
+{
+    unsigned long e = millis() + ms;
+    while(millis() < e) {
+        t.poll();
+        bt.loop();
+        usleep(20);         // Let loopback deliver
+        vms++;
+    }
+}
+
+static void scenario(TCD &t, const char *name, unsigned long ms)
+{
+    uint32_t tx = bt.getTxPackets();
+    uint32_t rx = bt.getRxPackets() + bt.getRxMcPackets();
+    uint32_t to = bt.getTimeouts();
+
+    run(t, ms);
+
+    printf("%-24s tx %5.1f/min  rx %5.1f/min  timeouts %3u  poll interval %5lu ms\n", name,
+        (bt.getTxPackets() - tx) * 60000.0 / ms,
+        (bt.getRxPackets() + bt.getRxMcPackets() - rx) * 60000.0 / ms,
+        bt.getTimeouts() - to, bt.getPollInt());
+}
+
+int main()
+{
+    TCD tcd("TCD");
+
+    bt.setCallbacks(notCB, dataCB);
+    bt.begin("tcd", "vsr", BTTFN_TYPE_VSR);
+
+    tcd.dropResp = 1 << 30;
+    scenario(tcd, "TCD missing (DISCOVER)", 300000);
+    tcd.dropResp = 0;
+    scenario(tcd, "TCD appears", 30000);
+    scenario(tcd, "Connected, normal", 120000);
+    bt.setPollFast(true);
+    scenario(tcd, "Connected, fast demand", 120000);
+    bt.setPollFast(false);
+    tcd.dropResp = 1 << 30;
+    scenario(tcd, "TCD gone (known IP)", 300000);
+    tcd.dropResp = 0;
+    scenario(tcd, "TCD back", 30000);
+    tcd.nd = true;
+    scenario(tcd, "NOT_DATA starts", 10000);
+    scenario(tcd, "NOT_DATA active", 120000);
+
+    return 0;
+}
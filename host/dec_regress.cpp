@@ -0,0 +1,151 @@
+/*
+ * MP3 decode regression and benchmark
+ *
+ * Decodes the corpus with libmad and AudioGeneratorMP3, in mono
+ * (the firmware's default, MP3_MONO_DECODE) and stereo mode:
+ *
+ * 1) Mono output must be the same as the reference PCM in
+ *    ref/pcm/<name>.wav; reports frame count and largest sample
+ *    difference otherwise. Stereo output must match the frame
+ *    count and checksum (AudioOutputChecksum) in ref/pcm/stereo.sum.
+ * 2) Decode speed into a null output (frames/s, x realtime), and
+ *    the process' peak RSS.
+ *
+ *   dec_regress -w     (re)writes the references after an
+ *                      intended change of decoder output
+ */
+#include <sys/resource.h>
+#include <map>
+#include "Arduino.h"
+#include "audiohost.h"
+#include "AudioOutputChecksum.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const char *files[] = { "s44", "lr44", "s32", "s22", "vbr44", "m44", "m22", "trunc" };
+
+static const char *REFDIR = "ref/pcm/";
+
+struct Ref { uint32_t sum, frames; };
+
+static std::map<std::string, Ref> readSums()
+{
+    std::map<std::string, Ref> m;
+    char name[32];
+    Ref r;
+    FILE *f = fopen((std::string(REFDIR) + "stereo.sum").c_str(), "r");
+    if(!f) return m;
+    while(fscanf(f, "%31s %x %u", name, &r.sum, &r.frames) == 3) m[name] = r;
+    fclose(f);
+    return m;
+}
+
+// Mono reference; 16 bit, one channel
+static bool readRef(const char *name, std::vector<int16_t> &pcm, int *rate)
+{
+    MemSource src;
+    if(!src.open((REFDIR + std::string(name) + ".wav").c_str()) || src.data.size() < 44) return false;
+    memcpy(rate, &src.data[24], 4);
+    pcm.resize((src.data.size() - 44) / 2);
+    memcpy(pcm.data(), &src.data[44], pcm.size() * 2);
+    return true;
+}
+
+static double fps(MemSource &src, bool mono, double *realtime)
+{
+    AudioGeneratorMP3 mp3;
+    AudioOutputChecksum sum;
+    unsigned long t0 = micros(), t;
+    uint64_t frames = 0;
+
+    mp3.SetMonoDecode(mono);
+    do {
+        sum.reset();
+        src.rewind();
+        decodeAll(mp3, &src, &sum);
+        frames += sum.getFrames();
+    } while((t = micros() - t0) < 200000);
+
+    *realtime = (double)frames / sum.getRate() / (t / 1e6);
+    return (double)frames / t * 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    bool write = (argc > 1 && !strcmp(argv[1], "-w"));
+    std::map<std::string, Ref> sums = readSums();
+    FILE *sf = write ? fopen((std::string(REFDIR) + "stereo.sum").c_str(), "w") : NULL;
+    int fails = 0;
+
+    if(write && !sf) {
+        printf("FAIL: Cannot write %sstereo.sum\n", REFDIR);
+        return 1;
+    }
+
+    printf("                       mono PCM    stereo checksum    Mframes/s (x realtime)\n");
+    for(const char *name : files) {
+        MemSource src;
+        if(!src.open(corpusPath(name).c_str())) {
+            printf("FAIL: %s missing\n", name);
+            fails++;
+            continue;
+        }
+
+        // Mono against the reference PCM
+        AudioGeneratorMP3 mp3;
+        PCMSink mo;
+        mp3.SetMonoDecode(true);
+        decodeAll(mp3, &src, &mo);
+        std::vector<int16_t> pcm, ref;
+        for(size_t i = 0; i < mo.frames(); i++) pcm.push_back(mo.pcm[2*i]);
+
+        int rate = 0, maxDiff = 0;
+        if(write) {
+            writeWAV((REFDIR + std::string(name) + ".wav").c_str(), pcm, 1, mo.getRate());
+        } else if(!readRef(name, ref, &rate)) {
+            printf("FAIL: %s: No reference PCM\n", name);
+            fails++;
+        } else {
+            for(size_t i = 0; i < pcm.size() && i < ref.size(); i++) {
+                int d = abs(pcm[i] - ref[i]);
+                if(d > maxDiff) maxDiff = d;
+            }
+            if(pcm.size() != ref.size() || rate != mo.getRate() || maxDiff) {
+                printf("FAIL: %s mono: %zu frames @ %dHz, reference %zu @ %dHz, max difference %d\n",
+                    name, pcm.size(), mo.getRate(), ref.size(), rate, maxDiff);
+                fails++;
+            }
+        }
+
+        // Stereo against the reference checksum
+        AudioOutputChecksum sum;
+        src.rewind();
+        mp3.SetMonoDecode(false);
+        decodeAll(mp3, &src, &sum);
+        bool sumOK = true;
+        if(write) {
+            fprintf(sf, "%s %08x %u\n", name, sum.getSum(), sum.getFrames());
+        } else if(!sums.count(name) || sums[name].sum != sum.getSum() || sums[name].frames != sum.getFrames()) {
+            printf("FAIL: %s stereo: %u frames, sum %08x; reference %u, %08x\n", name, sum.getFrames(),
+                sum.getSum(), sums.count(name) ? sums[name].frames : 0, sums.count(name) ? sums[name].sum : 0);
+            sumOK = false;
+            fails++;
+        }
+
+        double rtm, rts;
+        double fm = fps(src, true, &rtm), fs = fps(src, false, &rts);
+        printf("%-6s %6zu @ %5d  %-10s  %08x %-8s  %5.2f (%3.0f) %5.2f (%3.0f)\n", name, pcm.size(), mo.getRate(),
+            write ? "written" : (maxDiff || pcm.size() != ref.size()) ? "DRIFT" : "same",
+            sum.getSum(), write ? "written" : sumOK ? "same" : "DRIFT",
+            fm / 1e6, rtm, fs / 1e6, rts);
+    }
+    if(sf) fclose(sf);
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("Peak RSS %ld KB\n", ru.ru_maxrss);
+
+    printf("%s\n", fails ? "dec_regress: FAILED" : "dec_regress: OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Music folder index (VSR_IDX.BIN) vs. probing
+ *
+ * Uses the folder code from vsr_audio.cpp (folder.inc) on three
+ * music folders of 100, 500 and 999 files, and seven missing
+ * ones, as on boot: mp_checkForFolder() for all ten, then the
+ * file count of the current folder, as mp_init() finds it.
+ * The FS stand-in adds up the time of an SD card with a FAT:
+ * A path lookup costs LOOKUP_US plus ENTRY_US per directory
+ * entry scanned (all of them if the name is not there), a read
+ * READ_US. Compared are the code as it was before the index
+ * (ref/folder_old.inc), the first boot (index written), and
+ * later boots (index read).
+ * The index must give the same results, hold each file's size
+ * and duration, and be void once a file is added or the last
+ * one changes.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "Arduino.h"
+#include "FS.h"
+#include "src/SD/SD.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const uint32_t LOOKUP_US = 1000;
+static const uint32_t ENTRY_US  = 20;
+static const uint32_t READ_US   = 500;
+
+static bool    haveSD = true;
+static uint8_t musFolderNum = 0;
+static const char *tcdrdone = "/TCD_DONE.TXT";
+static const char *mpidxfn  = "/VSR_IDX.BIN";
+static const char *mprenfn  = "/VSR_REN.TXT";
+
+// No rename journal here (see ren_bench)
+static bool mpren_replay(int, bool) { return false; }
+
+static void mp_buildFileName(char *fnbuf, int num)
+{
+    sprintf(fnbuf, "/music%1d/%03d.mp3", musFolderNum % 10, num % 1000);
+}
+
+#include "folder.inc"
+#include "ref/folder_old.inc"
+
+static const int counts[10] = { 100, 500, 999 };
+
+static std::string root;
+
+// As mp_init(): Renamer's DONE check, then index or probe
+static int new_maxNum()
+{
+    char fnbuf[32];
+
+    sprintf(fnbuf, "/music%1d", musFolderNum);
+    strcat(fnbuf, tcdrdone);
+    SD.exists(fnbuf);
+
+    int maxNum = mp_readIndex(musFolderNum);
+    if(maxNum < -1) {
+        maxNum = mp_writeIndex(musFolderNum);
+    }
+    return maxNum;
+}
+
+struct Cost { uint32_t lookups, reads; double simMs; };
+
+// Boot with current folder cur; res: mfstatus, then maxNum
+template<class C, class M> static Cost boot(C check, M maxNum, int cur, int *res)
+{
+    fs::fsStats.lookups = fs::fsStats.reads = 0;
+    fs::fsStats.simUs = 0;
+    for(int i = 0; i < 10; i++) res[i] = check(i);
+    musFolderNum = cur;
+    res[10] = maxNum();
+    return { fs::fsStats.lookups, fs::fsStats.reads, fs::fsStats.simUs / 1000.0 };
+}
+
+static void print(const char *what, const Cost &c)
+{
+    printf("%-24s %7u %7u %9.1f\n", what, c.lookups, c.reads, c.simMs);
+}
+
+static bool addFile(int folder, int num, const char *src)
+{
+    char fn[64];
+    sprintf(fn, "/music%1d/%03d.mp3", folder, num);
+    return !link(src, (root + fn).c_str());
+}
+
+int main()
+{
+    char dir[] = "/tmp/folder_benchXXXXXX";
+    std::string mp3 = "mp3/s44.mp3", mp3b = "mp3/m44.mp3";
+    char fn[64];
+    int a[11], b[11], fails = 0;
+    struct stat st;
+
+    if(!mkdtemp(dir) || stat(mp3.c_str(), &st)) {
+        printf("FAIL: No temp dir, or %s missing\n", mp3.c_str());
+        return 1;
+    }
+    root = dir;
+    SD.setRoot(dir);
+    mp3 = std::string(getcwd(fn, sizeof(fn))) + "/" + mp3;
+    mp3b = std::string(fn) + "/" + mp3b;
+
+    for(int f = 0; f < 10; f++) {
+        if(!counts[f]) continue;
+        sprintf(fn, "/music%1d", f);
+        SD.mkdir(fn);
+        strcat(fn, tcdrdone);
+        SD.open(fn, FILE_WRITE).close();
+        for(int i = 0; i < counts[f]; i++) addFile(f, i, mp3.c_str());
+    }
+
+    File t = SD.open("/music0/000.mp3", FILE_READ);
+    uint32_t dur = mp_duration(t);
+    t.close();
+
+    fs::fsStats.lookupUs = LOOKUP_US;
+    fs::fsStats.entryUs = ENTRY_US;
+    fs::fsStats.readUs = READ_US;
+
+    printf("Boot, current folder (files)  lookups   reads   card ms\n");
+    for(int cur = 0; cur < 3; cur++) {
+        char what[32];
+        for(int f = 0; f < 10; f++) {
+            sprintf(fn, "/music%1d", f);
+            strcat(fn, mpidxfn);
+            SD.remove(fn);
+        }
+        Cost o = boot(old_checkForFolder, old_maxNum, cur, a);
+        Cost w = boot(mp_checkForFolder, new_maxNum, cur, b);
+        if(memcmp(a, b, sizeof(a))) {
+            printf("FAIL: music%d: Results differ on first boot\n", cur);
+            fails++;
+        }
+        Cost r = boot(mp_checkForFolder, new_maxNum, cur, b);
+        if(memcmp(a, b, sizeof(a))) {
+            printf("FAIL: music%d: Results differ with index\n", cur);
+            fails++;
+        }
+        sprintf(what, "music%d (%d) before", cur, counts[cur]);
+        print(what, o);
+        print("  first (index written)", w);
+        print("  with index", r);
+        if(r.simMs >= o.simMs) {
+            printf("FAIL: music%d: Index not faster\n", cur);
+            fails++;
+        }
+    }
+
+    // Index contents
+    musFolderNum = 2;
+    for(int i = 0; i < counts[2]; i++) {
+        sprintf(fn, "/music2/%03d.mp3", i);
+        uint32_t ms = mp_trackDuration(i);
+        if(ms != dur || !dur) {
+            printf("FAIL: Duration of %s is %u, should be %u\n", fn, ms, dur);
+            fails++;
+            break;
+        }
+    }
+
+    // Voided by a new file, or a changed last file
+    musFolderNum = 0;
+    addFile(0, 100, mp3.c_str());
+    int n1 = mp_readIndex(0);
+    int n2 = new_maxNum();
+    SD.remove("/music0/100.mp3");
+    addFile(0, 100, mp3b.c_str());
+    int n3 = mp_readIndex(0);
+    int n4 = new_maxNum();
+    if(n1 != -2 || n2 != 100 || n3 != -2 || n4 != 100) {
+        printf("FAIL: Index not voided: added %d/%d, changed %d/%d\n", n1, n2, n3, n4);
+        fails++;
+    }
+
+    std::string rm = std::string("rm -rf ") + dir;
+    if(system(rm.c_str())) { }
+
+    printf("%s\n", fails ? "folder_bench: FAILED" : "folder_bench: OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Track gains (VSR_GAIN.BIN) for a whole SD card, offline
+ *
+ *   gain_scan <card>    writes <card>/musicN/VSR_GAIN.BIN for every
+ *                       music folder the renamer has processed
+ *   gain_scan -t        test on a card made from the corpus
+ *
+ * Each track is decoded with AudioGeneratorMP3 into the mixer's
+ * stream voice with the level meter on, as the firmware does
+ * while playing, and the firmware's mp_gainFromMeter() (gain.inc)
+ * makes the gain from it. Unlike on the device, every track is
+ * measured start to end. Tracks that fail to decode get 0 (the
+ * device measures them when played). Folders without DONE file
+ * are left alone, as their files are not numbered yet.
+ * Test: Each track played at its gain through AudioOutputI2S
+ * must come out at the target RMS (within 1dB), or be limited
+ * by its peak or the maximum gain; saturation must not wrap.
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "Arduino.h"
+#include "driver/i2s.h"
+#include "audiohost.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+#include "src/ESP8266Audio/AudioOutputI2S.h"
+#include "AudioOutputMixer.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+#include "gain.inc"
+
+static const char *tcdrdone = "/TCD_DONE.TXT";
+static const char *mpgainfn = "/VSR_GAIN.BIN";
+
+static bool exists(const std::string &fn)
+{
+    struct stat st;
+    return !stat(fn.c_str(), &st);
+}
+
+static std::string trackName(const std::string &folder, int num)
+{
+    char fn[16];
+    sprintf(fn, "/%03d.mp3", num);
+    return folder + fn;
+}
+
+// Decode fn into dst through the mixer; meter result in rms/peak
+static bool play(const std::string &fn, AudioOutput *dst, float *rms, int32_t *peak)
+{
+    MemSource src;
+    AudioGeneratorMP3 mp3;
+    AudioOutputMixer mixer(dst, 2048);
+
+    if(!src.open(fn.c_str())) return false;
+    mixer.meterStart();
+    decodeAll(mp3, &src, mixer.getStreamInput());
+    while(mixer.pump()) { }
+    mixer.meterStop();
+    *rms = mixer.meterRMS();
+    *peak = mixer.meterPeak();
+
+    return (mixer.meterFrames() > 0 && *rms > 0.0f);
+}
+
+// Gains for all tracks in folder; empty if not processed
+static std::vector<uint8_t> scanFolder(const std::string &folder)
+{
+    std::vector<uint8_t> gains;
+
+    if(!exists(folder + tcdrdone)) return gains;
+
+    for(int num = 0; num < 1000 && exists(trackName(folder, num)); num++) {
+        PCMSink sink;
+        float rms;
+        int32_t peak;
+        sink.keep = false;
+        gains.push_back(play(trackName(folder, num), &sink, &rms, &peak) ? mp_gainFromMeter(rms, peak) : 0);
+    }
+    return gains;
+}
+
+static int scanCard(const std::string &card, bool quiet)
+{
+    int folders = 0;
+
+    for(int f = 0; f < 10; f++) {
+        std::string folder = card + "/music" + std::to_string(f);
+        std::vector<uint8_t> gains = scanFolder(folder);
+        if(gains.empty()) continue;
+        FILE *fp = fopen((folder + mpgainfn).c_str(), "wb");
+        if(!fp || fwrite(gains.data(), 1, gains.size(), fp) != gains.size() || fclose(fp)) {
+            printf("music%d: Failed to write %s\n", f, mpgainfn + 1);
+            return -1;
+        }
+        if(!quiet) {
+            printf("music%d: %zu tracks;", f, gains.size());
+            for(uint8_t g : gains) printf(" %d", g);
+            printf(" (n/128)\n");
+        }
+        folders++;
+    }
+    return folders;
+}
+
+static int test()
+{
+    static const char *corpus[] = { "s44", "m44", "lr44", "s32", "vbr44", "xing44", "cbr32", "m22", "s22" };
+    const int n = sizeof(corpus) / sizeof(corpus[0]);
+    char dir[] = "/tmp/gain_scanXXXXXX";
+    char cwd[256];
+    int fails = 0;
+
+    if(!mkdtemp(dir) || !getcwd(cwd, sizeof(cwd))) {
+        printf("FAIL: No temp dir\n");
+        return 1;
+    }
+    std::string card = dir;
+    mkdir((card + "/music0").c_str(), 0755);
+    mkdir((card + "/music1").c_str(), 0755);
+    fclose(fopen((card + "/music0" + tcdrdone).c_str(), "wb"));
+    for(int i = 0; i < n; i++) {
+        std::string src = std::string(cwd) + "/" + corpusPath(corpus[i]);
+        if(symlink(src.c_str(), trackName(card + "/music0", i).c_str()) ||
+           symlink(src.c_str(), trackName(card + "/music1", i).c_str())) {
+            printf("FAIL: Cannot link %s\n", src.c_str());
+            return 1;
+        }
+    }
+
+    if(scanCard(card, true) != 1 || exists(card + "/music1" + mpgainfn)) {
+        printf("FAIL: Unprocessed folder scanned, or processed one not\n");
+        fails++;
+    }
+
+    std::vector<uint8_t> gains(n + 1);
+    FILE *fp = fopen((card + "/music0" + mpgainfn).c_str(), "rb");
+    if(!fp || fread(gains.data(), 1, n + 1, fp) != (size_t)n) {
+        printf("FAIL: %s missing or wrong size\n", mpgainfn + 1);
+        return 1;
+    }
+    fclose(fp);
+
+    printf("track      RMS   peak  gain      out RMS  out peak\n");
+    for(int i = 0; i < n; i++) {
+        AudioOutputI2S out;
+        float rms, orms;
+        int32_t peak;
+        double sq = 0;
+        int32_t opeak = 0;
+        bool wrapped = false;
+
+        // At full volume, the gain is the track's volume factor
+        out.SetGainQ14((int32_t)gains[i] << 7);
+        i2sHost.clear();
+        i2sHost.keep = true;
+        if(!gains[i] || !play(trackName(card + "/music0", i), &out, &rms, &peak)) {
+            printf("FAIL: %s: Not measured\n", corpus[i]);
+            fails++;
+            continue;
+        }
+
+        // Mono: L and R are the same; full scale on both sides
+        // of an input sign change is a wrap
+        for(size_t k = 0; k < i2sHost.frames.size(); k++) {
+            int16_t s = (int16_t)(i2sHost.frames[k] & 0xffff);
+            sq += (double)s * s;
+            if(abs(s) > opeak) opeak = abs(s);
+        }
+        orms = sqrt(sq / i2sHost.frames.size());
+        for(size_t k = 1; k < i2sHost.frames.size(); k++) {
+            int16_t a = (int16_t)(i2sHost.frames[k - 1] & 0xffff), b = (int16_t)(i2sHost.frames[k] & 0xffff);
+            if((a > 30000 && b < -30000) || (a < -30000 && b > 30000)) wrapped = true;
+        }
+
+        double err = 20.0 * log10(orms / MP_GAIN_TARGET);
+        bool limited = (gains[i] == 255 || (float)peak * gains[i] / 128.0f > 32767.0f * 0.98f);
+        printf("%-7s %6.0f %6d %5d %12.0f %9d %s\n", corpus[i], rms, peak, gains[i], orms, opeak,
+            limited ? "(limited)" : "");
+        if((!limited && fabs(err) > 1.0) || (limited && err > 1.0) || wrapped) {
+            printf("FAIL: %s: Output %.1fdB off target%s\n", corpus[i], err, wrapped ? ", wrapped" : "");
+            fails++;
+        }
+    }
+
+    std::string rm = std::string("rm -rf ") + dir;
+    if(system(rm.c_str())) { }
+
+    printf("%s\n", fails ? "gain_scan: FAILED" : "gain_scan: OK");
+    return fails ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc == 2 && !strcmp(argv[1], "-t")) {
+        return test();
+    }
+    if(argc != 2) {
+        printf("Usage: %s <SD card root>\n       %s -t\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    int folders = scanCard(argv[1], false);
+    if(!folders) printf("No processed music folders found\n");
+    return (folders > 0) ? 0 : 1;
+}
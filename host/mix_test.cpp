@@ -0,0 +1,282 @@
+/*
+ * AudioOutputMixer: Bit-exactness, ducking and cost
+ *
+ * 1) A stream plus random overlays (start, stop, gain changes,
+ *    loops, voice stealing) through the mixer, against a plain
+ *    reference of the same arithmetic: Downmix, Q15 gains,
+ *    duck ramp per block, saturation. Stereo stream at the
+ *    overlays' rate and mono stream at half their rate.
+ * 2) Ducking: A click (no duck) leaves the stream untouched, a
+ *    ducking voice ramps it down and back up.
+ * 3) Cost per mixed frame, stream plus three overlays.
+ */
+#include <random>
+#include <vector>
+#include "Arduino.h"
+#include "audiohost.h"
+#include "AudioOutputMixer.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+// Keeps the size of each block the mixer hands over
+class BlockSink : public PCMSink
+{
+  public:
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override
+    {
+        count = PCMSink::ConsumeSamples(samples, count);
+        if(count) blocks.push_back(count);
+        return count;
+    }
+    std::vector<uint16_t> blocks;
+};
+
+// Reference
+struct RefVoice {
+    const int16_t *pcm;
+    uint32_t frames, pos, step;
+    int32_t gain;
+    bool loop, duck, active;
+};
+
+struct Event {
+    size_t block;               // Before this block
+    int    vi;
+    int    what;                // 0 start, 1 stop, 2 gain
+    RefVoice v;
+};
+
+static int32_t sat(int64_t s)
+{
+    return s > 32767 ? 32767 : (s < -32768 ? -32768 : (int32_t)s);
+}
+
+static std::vector<int16_t> reference(const std::vector<int16_t> &stream, const std::vector<uint16_t> &blocks,
+                                      const std::vector<Event> &ev, int32_t duckGain)
+{
+    std::vector<int16_t> out;
+    RefVoice v[MIX_VOICES] = {};
+    int32_t g = MIX_UNITY;
+    size_t sp = 0, ei = 0;
+    const int32_t rampStep = MIX_UNITY / 16;
+
+    for(size_t b = 0; b < blocks.size(); b++) {
+        for( ; ei < ev.size() && ev[ei].block == b; ei++) {
+            const Event &e = ev[ei];
+            if(e.what == 0)      v[e.vi] = e.v;
+            else if(e.what == 1) v[e.vi].active = false;
+            else                 v[e.vi].gain = e.v.gain;
+        }
+        bool duck = false;
+        for(int i = 1; i < MIX_VOICES; i++) duck |= (v[i].active && v[i].duck);
+        int32_t target = duck ? duckGain : MIX_UNITY;
+        if(g < target)      g = std::min(g + rampStep, target);
+        else if(g > target) g = std::max(g - rampStep, target);
+
+        std::vector<int64_t> acc(blocks[b]);
+        for(int i = 0; i < blocks[b]; i++) {
+            acc[i] = ((int64_t)stream[sp++] * g) >> 15;
+        }
+        for(int i = 1; i < MIX_VOICES; i++) {
+            RefVoice &r = v[i];
+            for(int k = 0; r.active && k < blocks[b]; k++) {
+                acc[k] += ((int64_t)r.pcm[r.pos] * r.gain) >> 15;
+                r.pos += r.step;
+                if(r.pos >= r.frames) {
+                    if(r.loop) r.pos = 0; else r.active = false;
+                }
+            }
+        }
+        for(int i = 0; i < blocks[b]; i++) out.push_back(sat(acc[i]));
+    }
+
+    return out;
+}
+
+static int exactTest(int chnls, int streamRate, uint32_t seed)
+{
+    const int TOTAL = 400000;
+    BlockSink sink;
+    AudioOutputMixer mixer(&sink, 2048);
+    AudioOutput *in = mixer.getStreamInput();
+    std::mt19937 rng(seed);
+    std::vector<std::vector<int16_t>> sounds;
+    std::vector<int16_t> stream, buf(2 * 700);
+    std::vector<Event> ev;
+    int fails = 0;
+
+    // Loud enough that sums clip now and then
+    for(int i = 0; i < 8; i++) {
+        std::vector<int16_t> s(1 + rng() % 3000);
+        for(auto &x : s) x = (int16_t)(rng() % 40000 - 20000);
+        sounds.push_back(s);
+    }
+
+    in->SetRate(streamRate);
+    in->SetChannels(chnls);
+    in->begin();
+
+    int written = 0;
+    while(written < TOTAL) {
+        switch(rng() % 12) {
+        case 0: {
+            Event e = { sink.blocks.size(), 0, 0, {} };
+            auto &s = sounds[rng() % sounds.size()];
+            e.v = { s.data(), (uint32_t)s.size(), 0, (uint32_t)(streamRate == 44100 ? 1 : 2),
+                    (int32_t)(rng() % (MIX_UNITY + 1)), !(rng() % 4), !!(rng() & 1), true };
+            e.vi = mixer.playPCM(e.v.pcm, e.v.frames, 44100, e.v.loop, e.v.gain, 0, e.v.duck);
+            if(e.vi < 1) {
+                printf("FAIL: playPCM() refused a voice\n");
+                return 1;
+            }
+            ev.push_back(e);
+            break;
+        }
+        case 1: {
+            Event e = { sink.blocks.size(), 1 + (int)(rng() % (MIX_VOICES - 1)), 1, {} };
+            mixer.stopVoice(e.vi);
+            ev.push_back(e);
+            break;
+        }
+        case 2: {
+            Event e = { sink.blocks.size(), 1 + (int)(rng() % (MIX_VOICES - 1)), 2, {} };
+            e.v.gain = rng() % (MIX_UNITY + 1);
+            mixer.setVoiceGain(e.vi, e.v.gain);
+            ev.push_back(e);
+            break;
+        }
+        }
+
+        int n = std::min(1 + (int)(rng() % 700), TOTAL - written);
+        for(int i = 0; i < n; i++) {
+            buf[2*i] = (int16_t)(rng() & 0xffff);
+            buf[2*i+1] = (int16_t)(rng() & 0xffff);
+            stream.push_back(chnls == 1 ? buf[2*i] : ((int32_t)buf[2*i] + buf[2*i+1]) >> 1);
+        }
+        for(int done = 0; done < n; ) {
+            done += in->ConsumeSamples(&buf[2*done], n - done);
+        }
+        if(!(rng() % 3)) in->loop();
+        written += n;
+    }
+    in->loop();
+
+    std::vector<int16_t> ref = reference(stream, sink.blocks, ev, MIX_UNITY / 2);
+    size_t frames = sink.frames(), bad = 0, first = 0;
+    for(size_t i = 0; i < frames && i < ref.size(); i++) {
+        if(sink.pcm[2*i] != ref[i] && !bad++) first = i;
+    }
+    if(bad || frames != ref.size() || frames != (size_t)TOTAL) {
+        printf("FAIL: %s stream at %d Hz: %zu of %zu frames differ (first %zu), %zu expected\n",
+            chnls == 1 ? "Mono" : "Stereo", streamRate, bad, frames, first, ref.size());
+        fails++;
+    }
+
+    printf("%-6s stream, %5d Hz, overlays 44100 Hz: %d frames, %zu voice events, %s\n",
+        chnls == 1 ? "Mono" : "Stereo", streamRate, TOTAL, ev.size(), fails ? "FAILED" : "bit-exact");
+
+    in->stop();
+    return fails;
+}
+
+// Stream of constant 10000; returns gain applied per block
+static std::vector<int32_t> duckRun(bool duck, int *fails)
+{
+    BlockSink sink;
+    AudioOutputMixer mixer(&sink, 256);
+    AudioOutput *in = mixer.getStreamInput();
+    std::vector<int16_t> st(2 * MIX_BLOCK, 10000);
+    static const int16_t silent[MIX_BLOCK * 20] = { 0 };
+    std::vector<int32_t> g;
+
+    in->SetRate(44100);
+    in->begin();
+    for(int b = 0; b < 60; b++) {
+        if(b == 2) mixer.playPCM(silent, MIX_BLOCK * 20, 44100, false, MIX_UNITY, 0, duck);
+        if(in->ConsumeSamples(st.data(), MIX_BLOCK) != MIX_BLOCK) (*fails)++;
+        in->loop();
+        g.push_back(sink.pcm.back() * MIX_UNITY / 10000);
+    }
+    in->stop();
+
+    return g;
+}
+
+static int duckTest()
+{
+    int fails = 0;
+    std::vector<int32_t> click = duckRun(false, &fails);
+    std::vector<int32_t> key = duckRun(true, &fails);
+
+    for(int32_t g : click) {
+        if(g != MIX_UNITY) {
+            printf("FAIL: Click changed stream gain to %d\n", g);
+            fails++;
+            break;
+        }
+    }
+
+    int down = 0, up = 0;
+    int32_t prev = MIX_UNITY;
+    for(size_t b = 0; b < key.size(); b++) {
+        int32_t step = key[b] - prev;
+        if(step > MIX_UNITY / 16 + 4 || step < -MIX_UNITY / 16 - 4) {
+            printf("FAIL: Stream gain jumps by %d at block %zu\n", step, b);
+            fails++;
+        }
+        if(key[b] <= MIX_UNITY / 2 + 4 && !down) down = b;
+        if(down && !up && b > 22 && key[b] >= MIX_UNITY - 4) up = b;
+        prev = key[b];
+    }
+    if(!down || !up) {
+        printf("FAIL: Ducking voice: Stream not ducked and restored\n");
+        fails++;
+    }
+
+    printf("Ducking: Click leaves stream at unity; key sound ducks it in %d blocks, restored after %d\n",
+        down - 2, up - 22);
+    return fails;
+}
+
+static void cost()
+{
+    BlockSink sink;
+    AudioOutputMixer mixer(&sink, 2048);
+    AudioOutput *in = mixer.getStreamInput();
+    std::vector<int16_t> st(2 * 1152), ov(44100);
+    const uint32_t N = 20000000;
+
+    for(auto &x : st) x = (int16_t)(rand() & 0xffff);
+    for(auto &x : ov) x = (int16_t)(rand() & 0xffff);
+
+    sink.keep = false;
+    in->SetRate(44100);
+    in->begin();
+    for(int i = 0; i < 3; i++) mixer.playPCM(ov.data(), ov.size(), 44100, true, MIX_UNITY / 3);
+
+    unsigned long t0 = micros();
+    for(uint32_t n = 0; n < N; n += 1152) {
+        for(int done = 0; done < 1152; ) {
+            done += in->ConsumeSamples(&st[2*done], 1152 - done);
+        }
+    }
+    in->loop();
+    unsigned long t = micros() - t0;
+    in->stop();
+
+    printf("Stream + 3 overlays, ducked: %.1f ns per mixed frame on host (%.1f%% of one core at 44.1kHz)\n",
+        t * 1000.0 / N, t / 1e6 * 44100 / N * 100);
+}
+
+int main()
+{
+    int fails = 0;
+
+    fails += exactTest(2, 44100, 1);
+    fails += exactTest(1, 22050, 2);
+    fails += duckTest();
+    cost();
+
+    printf("%s\n", fails ? "mix_test: FAILED" : "mix_test: OK");
+    return fails ? 1 : 0;
+}
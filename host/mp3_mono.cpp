@@ -0,0 +1,88 @@
+/*
+ * MP3 mono decode vs. stereo decode
+ *
+ * Decodes the corpus with AudioGeneratorMP3 in stereo and in
+ * mono mode (MAD_OPTION_SINGLECHANNEL, downmix inside libmad)
+ * and reports frames/s for both, and the error of the mono
+ * output against a downmix of the stereo output.
+ */
+#include <math.h>
+#include "Arduino.h"
+#include "audiohost.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const char *files[] = { "s44", "lr44", "s32", "s22", "vbr44", "m44" };
+
+static double fps(MemSource &src, bool mono, PCMSink &sink)
+{
+    AudioGeneratorMP3 mp3;
+    unsigned long t0 = micros(), t;
+    uint64_t frames = 0;
+
+    mp3.SetMonoDecode(mono);
+    sink.keep = false;
+    do {
+        sink.clear();
+        src.rewind();
+        decodeAll(mp3, &src, &sink);
+        frames += sink.frames();
+    } while((t = micros() - t0) < 300000);
+    sink.keep = true;
+
+    return (double)frames / t * 1e6;
+}
+
+int main()
+{
+    int fails = 0;
+
+    printf("Mframes/s  stereo    mono  speedup  max err  SNR vs downmix\n");
+    for(const char *name : files) {
+        MemSource src;
+        PCMSink st, mo;
+        if(!src.open(corpusPath(name).c_str())) {
+            printf("FAIL: %s missing\n", name);
+            fails++;
+            continue;
+        }
+
+        AudioGeneratorMP3 a, b;
+        a.SetMonoDecode(false);     // Default with MP3_MONO_DECODE is mono
+        decodeAll(a, &src, &st);
+        src.rewind();
+        b.SetMonoDecode(true);
+        decodeAll(b, &src, &mo);
+
+        if(st.frames() != mo.frames() || !st.frames()) {
+            printf("FAIL: %s: %zu stereo vs %zu mono frames\n", name, st.frames(), mo.frames());
+            fails++;
+            continue;
+        }
+
+        int maxErr = 0;
+        double sig = 0, err = 0;
+        for(size_t i = 0; i < st.frames(); i++) {
+            int dm = (st.pcm[2*i] + st.pcm[2*i+1]) / 2;
+            int d = abs(mo.pcm[2*i] - dm);
+            if(mo.pcm[2*i] != mo.pcm[2*i+1]) d = 99999;
+            if(d > maxErr) maxErr = d;
+            sig += (double)dm * dm;
+            err += (double)d * d;
+        }
+        // Downmix before synthesis differs by rounding, and where
+        // the channels' block types differ (overlap is mixed then)
+        if(err && 10 * log10(sig / err) < 40) {
+            printf("FAIL: %s: Mono too far from downmix\n", name);
+            fails++;
+        }
+
+        double s = fps(src, false, st), m = fps(src, true, mo);
+        printf("%-8s %8.1f %7.1f    x%.2f  %7d  %s\n", name, s / 1e6, m / 1e6, m / s, maxErr,
+            err ? (std::to_string((int)(10 * log10(sig / err))) + " dB").c_str() : "exact");
+    }
+
+    printf("%s\n", fails ? "mp3_mono: FAILED" : "mp3_mono: OK");
+    return fails ? 1 : 0;
+}
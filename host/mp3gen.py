@@ -0,0 +1,287 @@
+#!/usr/bin/env python3
+#
+# Synthetic MPEG audio Layer III files for the host tests
+#
+# No encoder needed: Spectral lines are set directly (values
+# +/-1, Huffman table 1 and count1 table B, no scalefactors),
+# loudness via global_gain. That gives tones and chords that
+# move from frame to frame, in stereo, M/S and intensity
+# stereo, with long and short blocks; enough to exercise the
+# whole decoder. Also writes Xing/VBRI headers, ID3v2 tags
+# and CRC-protected frames.
+#
+#   mp3gen.py <outdir>      writes the corpus (see CORPUS)
+#
+# Output is deterministic; the corpus in mp3/ is checked in.
+
+import os
+import random
+import struct
+import sys
+
+BITRATES = {
+    1: [0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320],
+    2: [0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160],
+}
+RATES = {
+    1: [44100, 48000, 32000],
+    2: [22050, 24000, 16000],
+}
+
+class Bits:
+    def __init__(self):
+        self.b = []
+
+    def put(self, v, n):
+        for i in range(n - 1, -1, -1):
+            self.b.append((v >> i) & 1)
+
+    def __len__(self):
+        return len(self.b)
+
+    def bytes(self):
+        b = self.b + [0] * (-len(self.b) % 8)
+        return bytes(int(''.join(map(str, b[i:i + 8])), 2) for i in range(0, len(b), 8))
+
+def crc16(data, crc=0xffff):
+    for c in data:
+        for i in range(7, -1, -1):
+            bit = ((crc >> 15) ^ (c >> i)) & 1
+            crc = ((crc << 1) & 0xffff) ^ (0x8005 if bit else 0)
+    return crc
+
+# Huffman table 1 (x, y in 0..1) and count1 table B
+HT1 = {(0, 0): (1, 1), (0, 1): (1, 3), (1, 0): (1, 2), (1, 1): (0, 3)}
+
+def granule_data(lines):
+    """Big values (table 1) up to the last line below 288,
+    count1 quadruples (table B) above. lines: {index: +/-1}"""
+    b = Bits()
+    bigl = [k for k in lines if k < 288]
+    bv = (max(bigl) // 2 + 1) if bigl else 0
+    for i in range(bv):
+        x, y = lines.get(2 * i, 0), lines.get(2 * i + 1, 0)
+        code, n = HT1[(abs(x), abs(y))]
+        b.put(code, n)
+        for v in (x, y):
+            if v:
+                b.put(1 if v < 0 else 0, 1)
+    top = max(lines) if lines else -1
+    i = 2 * bv
+    while i <= top and i + 4 <= 576:
+        q = [lines.get(i + j, 0) for j in range(4)]
+        b.put(15 - sum(abs(v) << (3 - j) for j, v in enumerate(q)), 4)
+        for v in q:
+            if v:
+                b.put(1 if v < 0 else 0, 1)
+        i += 4
+    return b, bv
+
+class Gen:
+    def __init__(self, seed, version, rate, mono, crc=False):
+        self.rnd = random.Random(seed)
+        self.version = version              # 1: MPEG1, 2: MPEG2 (LSF)
+        self.ri = RATES[version].index(rate)
+        self.rate = rate
+        self.mono = mono
+        self.crc = crc
+        self.ngr = 2 if version == 1 else 1
+        self.slot = 0.0
+        self.notes = [self.rnd.randrange(4, 60) for _ in range(4)]
+
+    def framelen(self, bri, pad):
+        k = 144000 if self.version == 1 else 72000
+        return k * BITRATES[self.version][bri] // self.rate + pad
+
+    def silen(self):
+        if self.version == 1:
+            return 17 if self.mono else 32
+        return 9 if self.mono else 17
+
+    def header(self, bri, pad, mode, modeext):
+        h = Bits()
+        h.put(0x7ff, 11)
+        h.put(3 if self.version == 1 else 2, 2)
+        h.put(1, 2)                         # Layer III
+        h.put(0 if self.crc else 1, 1)
+        h.put(bri, 4)
+        h.put(self.ri, 2)
+        h.put(pad, 1)
+        h.put(0, 1)
+        h.put(mode, 2)
+        h.put(modeext, 2)
+        h.put(0, 1)
+        h.put(1, 1)
+        h.put(0, 2)
+        return h.bytes()
+
+    def padding(self, bri):
+        # Like encoders: Pad when the fractional slots add up
+        k = 144000 if self.version == 1 else 72000
+        exact = k * BITRATES[self.version][bri] / self.rate
+        self.slot += exact - int(exact)
+        if self.slot >= 1.0:
+            self.slot -= 1.0
+            return 1
+        return 0
+
+    def content(self, ch, density):
+        # A slowly moving chord per channel plus some sparse
+        # high partials (count1 region)
+        lines = {}
+        for n in self.notes[ch * 2:ch * 2 + 2] if not self.mono else self.notes[:3]:
+            lines[n] = self.rnd.choice((1, -1))
+        for _ in range(density):
+            lines[self.rnd.randrange(60, 400)] = self.rnd.choice((1, -1))
+        return lines
+
+    def frame(self, bri=None, density=2, stereo=None, blocks=True):
+        """One frame; bri None picks the smallest bitrate that fits (VBR).
+        stereo: 'lr', mode extension (1: I/S, 2: M/S, 3: both) or 'mix'"""
+        rnd = self.rnd
+        if rnd.random() < 0.3:
+            i = rnd.randrange(len(self.notes))
+            self.notes[i] = max(2, min(80, self.notes[i] + rnd.choice((-3, -2, -1, 1, 2, 3))))
+
+        nch = 1 if self.mono else 2
+        if stereo == 'mix':
+            stereo = rnd.choice(('lr', 1, 2, 3))
+        if self.mono:
+            mode, modeext = 3, 0
+        else:
+            mode, modeext = (0, 0) if stereo == 'lr' else (1, stereo or 2)
+        if self.version == 2 and modeext & 1:
+            modeext = 2                     # No LSF intensity stereo
+
+        grs = []
+        for gr in range(self.ngr):
+            short = blocks and rnd.random() < 0.15
+            row = []
+            for ch in range(nch):
+                data, bv = granule_data(self.content(ch, density))
+                gg = rnd.randrange(185, 200) - density // 3     # Don't clip
+                row.append((data, bv, gg, short))
+            grs.append(row)
+        mdbits = sum(len(g[0]) for row in grs for g in row)
+
+        si = Bits()
+        if self.version == 1:
+            si.put(0, 9)
+            si.put(0, 5 if self.mono else 3)
+            si.put(0, 4 * nch)              # scfsi
+        else:
+            si.put(0, 8)
+            si.put(0, 1 if self.mono else 2)
+        for row in grs:
+            for data, bv, gg, short in row:
+                si.put(len(data), 12)       # part2_3_length (no part2)
+                si.put(bv, 9)
+                si.put(gg, 8)
+                si.put(0, 4 if self.version == 1 else 9)
+                if short:
+                    si.put(1, 1)            # window_switching_flag
+                    si.put(2, 2)            # block_type: Short
+                    si.put(0, 1)
+                    si.put(1, 5); si.put(1, 5)
+                    si.put(0, 9)            # subblock_gain
+                else:
+                    si.put(0, 1)
+                    si.put(1, 5); si.put(1, 5); si.put(1, 5)
+                    si.put(7, 4); si.put(7, 3)
+                if self.version == 1:
+                    si.put(0, 1)            # preflag
+                si.put(0, 1)                # scalefac_scale
+                si.put(1, 1)                # count1table_select: B
+        assert len(si) == self.silen() * 8
+
+        need = 4 + (2 if self.crc else 0) + self.silen() + (mdbits + 7) // 8
+        if bri is None:
+            bri = next(i for i in range(1, 15) if self.framelen(i, 0) >= need)
+        pad = self.padding(bri)
+        flen = self.framelen(bri, pad)
+        assert flen >= need, "frame too small for content"
+
+        hdr = self.header(bri, pad, mode, modeext)
+        sib = si.bytes()
+        md = Bits()
+        for row in grs:
+            for g in row:
+                md.b += g[0].b
+        out = hdr
+        if self.crc:
+            out += struct.pack('>H', crc16(hdr[2:] + sib))
+        out += sib + md.bytes()
+        return out + bytes(flen - len(out))
+
+    def tagframe(self, bri, kind, frames, nbytes, offsets):
+        """Silent first frame carrying a Xing or VBRI header. nbytes
+        and offsets (of the audio frames) count from its start."""
+        flen = self.framelen(bri, 0)
+        mode = 3 if self.mono else 1
+        out = bytearray(self.header(bri, 0, mode, 0))
+        if self.crc:
+            out += b'\0\0'
+        if kind == 'xing':
+            out += bytes(self.silen())
+            toc = []
+            for i in range(100):
+                p = offsets[min(len(offsets) - 1, i * len(offsets) // 100)]
+                toc.append(min(255, p * 256 // nbytes))
+            out += b'Xing' + struct.pack('>III', 7, frames, nbytes) + bytes(toc)
+        else:
+            # VBRI always sits 32 bytes after the header
+            out += bytes(32)
+            per = 4
+            ents = [offsets[i + per] - offsets[i] if i + per < len(offsets) else nbytes - offsets[i]
+                    for i in range(0, len(offsets), per)]
+            out += b'VBRI' + struct.pack('>HHHIIHHHH', 1, 0, 75, nbytes, frames, len(ents), 1, 2, per)
+            out += b''.join(struct.pack('>H', e) for e in ents)
+        assert len(out) <= flen
+        return bytes(out) + bytes(flen - len(out))
+
+def id3v2(title):
+    body = b'TIT2' + struct.pack('>I', len(title) + 1) + b'\0\0' + b'\0' + title.encode()
+    body += bytes(256)                      # Padding
+    n = len(body)
+    size = bytes(((n >> s) & 0x7f) for s in (21, 14, 7, 0))
+    return b'ID3\x03\x00\x00' + size + body
+
+def stream(g, n, bri=None, **kw):
+    return [g.frame(bri, **kw) for _ in range(n)]
+
+def vbr(g, n, tag):
+    # Density varies over time, so does bitrate
+    frames = [g.frame(None, density=int(40 * abs((i % 50) - 25) / 25)) for i in range(n)]
+    bri = 9 if g.version == 1 else 8
+    offsets, p = [], g.framelen(bri, 0)
+    for f in frames:
+        offsets.append(p)
+        p += len(f)
+    return [g.tagframe(bri, tag, n, p, offsets)] + frames
+
+CORPUS = {
+    # Gen(seed, MPEG version, rate, mono, crc), frames, bitrate index
+    's44':   lambda: stream(Gen(1, 1, 44100, False), 16, 9, stereo='mix'),
+    'lr44':  lambda: stream(Gen(2, 1, 44100, False), 16, 9, stereo='lr'),
+    'm44':   lambda: id3v2('Mono 44.1k') + b''.join(stream(Gen(3, 1, 44100, True), 16, 5)),
+    's32':   lambda: stream(Gen(4, 1, 32000, False, crc=True), 16, 8),
+    's22':   lambda: stream(Gen(5, 2, 22050, False), 16, 8),
+    'm22':   lambda: stream(Gen(6, 2, 22050, True, crc=True), 16, 6),
+    'vbr44': lambda: id3v2('VBR 44.1k') + b''.join(vbr(Gen(7, 1, 44100, False), 24, 'xing')),
+    'trunc': lambda: b''.join(stream(Gen(1, 1, 44100, False), 16, 9, stereo='mix'))[:417 * 12 + 200],
+    # Longer, for seeking (seek_test)
+    'xing44': lambda: id3v2('Xing 44.1k') + b''.join(vbr(Gen(8, 1, 44100, False), 300, 'xing')),
+    'xcrc44': lambda: b''.join(vbr(Gen(9, 1, 44100, False, crc=True), 300, 'xing')),
+    'vbri44': lambda: b''.join(vbr(Gen(10, 1, 44100, False), 300, 'vbri')),
+    'cbr32':  lambda: id3v2('CBR 32k') + b''.join(stream(Gen(11, 1, 32000, False, crc=True), 300, 5)),
+}
+
+def build(name):
+    d = CORPUS[name]()
+    return d if isinstance(d, (bytes, bytearray)) else b''.join(d)
+
+if __name__ == '__main__':
+    outdir = sys.argv[1] if len(sys.argv) > 1 else '.'
+    for name in CORPUS:
+        with open(os.path.join(outdir, name + '.mp3'), 'wb') as f:
+            f.write(build(name))
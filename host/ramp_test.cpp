@@ -0,0 +1,166 @@
+/*
+ * AudioOutputI2S: Gain ramp smoothness and per-block cost
+ *
+ * Feeds constant full-scale-half samples (16384, so each output
+ * sample is the gain in Q14) through ConsumeSamples() into the
+ * stand-in driver, and changes the gain:
+ * 1) The gain must move towards the target in steps of at most
+ *    1/16 of the remaining distance, one step per 64-frame DMA
+ *    block and none inside a block, and settle in time.
+ * 2) While the DMA is full (driver takes nothing), any number
+ *    of calls must not move it.
+ * 3) Largest jump between samples on a volume change, instant
+ *    (as before) vs ramped.
+ * 4) Cost of a block with the gain steady and while ramping.
+ */
+#include <vector>
+#include <stdlib.h>
+#include "Arduino.h"
+#include "driver/i2s.h"
+#include "src/ESP8266Audio/AudioOutputI2S.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const int BLOCK   = 64;      // AudioOutputI2S::i2sBlockLen
+static const int GRANULE = 576;
+static const int MAXBLKS = 140;     // Must settle within (200ms)
+
+static std::vector<int16_t> dc(int frames)
+{
+    return std::vector<int16_t>(frames * 2, 16384);
+}
+
+static int16_t left(uint32_t f)
+{
+    return (int16_t)(f & 0xffff);
+}
+
+// Feed until the gain reaches "to"; checks steps, returns blocks
+// (-1 if a step is wrong)
+static int ramp(AudioOutputI2S &o, int32_t from, int32_t to, int *maxStep)
+{
+    std::vector<int16_t> pcm = dc(GRANULE);
+    int32_t g = from;
+    int blocks = 0;
+
+    o.SetGainQ14(to);
+    *maxStep = 0;
+    while(g != to && blocks < 10 * MAXBLKS) {
+        i2sHost.clear();
+        o.ConsumeSamples(pcm.data(), GRANULE);
+        for(size_t i = 0; i < i2sHost.frames.size(); i++) {
+            int32_t s = left(i2sHost.frames[i]);
+            if(i % BLOCK) {
+                if(s != g) return -1;
+                continue;
+            }
+            int32_t d = abs(s - g), rem = abs(to - g);
+            if(d > (rem + 15) / 16 || (to - s) * (to - g) < 0) return -1;
+            if(d > *maxStep) *maxStep = d;
+            g = s;
+            if(s != to) blocks++;
+        }
+    }
+    return blocks;
+}
+
+static double blockNs(AudioOutputI2S &o, bool ramping)
+{
+    std::vector<int16_t> pcm = dc(GRANULE);
+    long n = 0;
+    unsigned long t0 = micros(), t;
+
+    do {
+        // Target flips every granule, so the gain never settles
+        o.SetGainQ14(ramping ? ((n & 1) ? 1 << 14 : 0) : 1 << 13);
+        o.ConsumeSamples(pcm.data(), GRANULE);
+        n++;
+    } while((t = micros() - t0) < 500000);
+
+    return t * 1000.0 / (n * GRANULE / BLOCK);
+}
+
+int main()
+{
+    int fails = 0, step;
+
+    AudioOutputI2S o;
+    o.SetChannels(2);
+    o.SetGainQ14(1 << 14);
+    o.begin();
+    i2sHost.keep = true;
+
+    // 1) Down to 0, up to 1.0, and a small change
+    static const struct { int32_t from, to; } steps[] = { { 1 << 14, 0 }, { 0, 1 << 14 }, { 1 << 14, 13107 } };
+    for(auto &s : steps) {
+        int b = ramp(o, s.from, s.to, &step);
+        printf("Ramp %5d -> %5d: %3d blocks (%3.0fms at 44.1kHz), largest step %4d\n", s.from, s.to, b,
+            b * BLOCK / 44.1, step);
+        if(b < 0 || b > MAXBLKS) {
+            printf("FAIL: Ramp %d -> %d: %s\n", s.from, s.to, (b < 0) ? "Step too large or inside block" : "Too slow");
+            fails++;
+        }
+    }
+
+    // 2) DMA full: Retries must not advance the ramp
+    {
+        std::vector<int16_t> pcm = dc(GRANULE);
+        o.SetGainQ14(0);
+        i2sHost.room = 0;
+        for(int i = 0; i < 1000; i++) o.ConsumeSamples(pcm.data(), GRANULE);
+        i2sHost.room = -1;
+        i2sHost.clear();
+        o.ConsumeSamples(pcm.data(), BLOCK);
+        int32_t g = left(i2sHost.frames[0]);
+        if(g != 13107) {
+            printf("FAIL: Gain moved to %d while the DMA was full\n", g);
+            fails++;
+        }
+        ramp(o, 13107, 0, &step);
+    }
+
+    // 3) Zipper: Largest jump between samples, 0.8 -> 0.3
+    {
+        std::vector<int16_t> pcm = dc(GRANULE);
+        int32_t inst, rmp = 0;
+
+        o.SetGainQ14(13107);
+        o.ConsumeSample(16384, 16384);
+        o.SetGainQ14(4915);
+        // Single-sample path applies the gain right away, as
+        // all paths did before
+        i2sHost.clear();
+        o.ConsumeSample(16384, 16384);
+        inst = 13107 - left(i2sHost.frames[0]);
+
+        o.SetGainQ14(13107);
+        o.ConsumeSample(16384, 16384);
+        o.SetGainQ14(4915);
+        int32_t prev = 13107;
+        for(int i = 0; i < 10; i++) {
+            i2sHost.clear();
+            o.ConsumeSamples(pcm.data(), GRANULE);
+            for(uint32_t f : i2sHost.frames) {
+                if(abs(left(f) - prev) > rmp) rmp = abs(left(f) - prev);
+                prev = left(f);
+            }
+        }
+        printf("Largest jump 0.8 -> 0.3: instant %d (%.1f%%), ramped %d (%.1f%%)\n", inst, inst * 100.0 / 16384,
+            rmp, rmp * 100.0 / 16384);
+        if(rmp > inst / 16 + 1) {
+            printf("FAIL: Ramped jump too large\n");
+            fails++;
+        }
+    }
+
+    // 4) Cost per block, DMA takes everything and discards it
+    {
+        i2sHost.keep = false;
+        double st = blockNs(o, false);
+        double rp = blockNs(o, true);
+        printf("Per 64-frame block: steady %.0fns, ramping %.0fns (%+.1f%%)\n", st, rp, (rp - st) * 100.0 / st);
+    }
+
+    printf("%s\n", fails ? "ramp_test: FAILED" : "ramp_test: OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,235 @@
+/*
+ * Music renamer with 1000 long file names
+ *
+ * Uses the renamer from vsr_audio.cpp (ren.inc) on a folder of
+ * 1000 mp3 files with names of 40 to 160 characters, many of
+ * them sharing a long prefix (artist - album - ...). Each file
+ * holds its own name, so the result can be checked.
+ * 1) Sort: The merge sort against the insertion sort it
+ *    replaced (ref/ren_old.inc); same order, time per sort.
+ * 2) Rename: Whole mp_renameFilesInDir(), host time and the
+ *    time of an SD card with a FAT as added up by the FS stand-
+ *    in (see folder_bench). Every file must end up as ddd.mp3,
+ *    in sorted order per round (names that do not fit into the
+ *    sort buffer go into a next round).
+ * 3) Power loss while writing the journal and while renaming:
+ *    mp_checkForFolder() on the next boot, then the renamer,
+ *    must give the same result as 2).
+ */
+#include <stdlib.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+#include "Arduino.h"
+#include "FS.h"
+#include "src/SD/SD.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const uint32_t LOOKUP_US = 1000;
+static const uint32_t ENTRY_US  = 20;
+static const uint32_t READ_US   = 500;
+
+static struct { uint32_t getMaxAllocHeap() { return 110000; } } ESP;
+
+static bool    haveSD = true;
+static uint8_t musFolderNum = 0;
+static int     mfstatus[10];
+static unsigned long renNow1, renNow2;
+static const char *tcdrdone = "/TCD_DONE.TXT";
+static const char *mpgainfn = "/VSR_GAIN.BIN";
+static const char *mpidxfn  = "/VSR_IDX.BIN";
+static const char *mprenfn  = "/VSR_REN.TXT";
+
+static int shown = 0;
+static void wifi_loop() { }
+static void showNumber(int) { shown++; }
+
+static void mp_buildFileName(char *fnbuf, int num)
+{
+    sprintf(fnbuf, "/music%1d/%03d.mp3", musFolderNum % 10, num % 1000);
+}
+
+#include "ren.inc"
+#include "ref/ren_old.inc"
+
+static const int NFILES = 1000;
+
+static std::string root;
+
+static std::vector<std::string> makeNames()
+{
+    static const char *words[] = { "Back", "to", "the", "Future", "Overture", "Doc", "Marty", "Clock",
+        "Tower", "Remastered", "Live", "Version", "Theme", "Suite", "Part", "Hill", "Valley", "Power", "of",
+        "Love", "Johnny", "B.", "Goode", "Earth", "Angel", "Night", "Train", "Main", "Title" };
+    std::vector<std::string> n;
+    uint32_t r = 12345;
+    auto rnd = [&r](int m) { r = r * 1103515245 + 12345; return (int)((r >> 16) % m); };
+
+    while((int)n.size() < NFILES) {
+        char buf[256];
+        std::string s;
+        // Half of them share an artist/album prefix
+        if(rnd(2)) {
+            sprintf(buf, "Original Motion Picture Soundtrack Artist %d - The Album %d - ", rnd(4), rnd(3));
+            s = buf;
+        }
+        int len = 40 + rnd(120);
+        while((int)s.size() < len) {
+            s += words[rnd(sizeof(words) / sizeof(words[0]))];
+            s += rnd(3) ? " " : " - ";
+        }
+        sprintf(buf, "%s%03d.%s", s.c_str(), (int)n.size(), rnd(4) ? "mp3" : "MP3");
+        n.push_back(buf);
+    }
+    return n;
+}
+
+static void makeFolder(const std::vector<std::string> &names)
+{
+    if(system(("rm -rf " + root + "/music0").c_str())) { }
+    SD.mkdir("/music0");
+    for(auto &n : names) {
+        FILE *f = fopen((root + "/music0/" + n).c_str(), "wb");
+        fputs(n.c_str(), f);
+        fclose(f);
+    }
+}
+
+// Name each ddd.mp3 came from; empty if any is missing
+static std::vector<std::string> result()
+{
+    std::vector<std::string> r;
+    for(int i = 0; i < NFILES; i++) {
+        char fn[64], buf[256];
+        sprintf(fn, "%s/music0/%03d.mp3", root.c_str(), i);
+        FILE *f = fopen(fn, "rb");
+        if(!f) return std::vector<std::string>();
+        size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+        buf[n] = 0;
+        fclose(f);
+        r.push_back(buf);
+    }
+    return r;
+}
+
+static bool exists(const char *fn)
+{
+    return !access((root + "/music0" + fn).c_str(), F_OK);
+}
+
+template<class F> static double sortUs(F sort, std::vector<char *> p)
+{
+    std::vector<char *> a;
+    std::vector<char *> t(p.size());
+    unsigned long t0 = micros(), t1;
+    int n = 0;
+
+    do {
+        a = p;
+        sort(a.data(), t.data(), a.size());
+        n++;
+    } while((t1 = micros() - t0) < 200000);
+
+    return (double)t1 / n;
+}
+
+int main()
+{
+    char dir[] = "/tmp/ren_benchXXXXXX";
+    int fails = 0;
+
+    if(!mkdtemp(dir)) {
+        printf("FAIL: No temp dir\n");
+        return 1;
+    }
+    root = dir;
+    SD.setRoot(dir);
+
+    // 1) Sort
+    std::vector<std::string> names = makeNames();
+    size_t total = 0;
+    std::vector<char *> p;
+    for(auto &n : names) {
+        p.push_back((char *)n.c_str());
+        total += n.size() + 1;
+    }
+    std::vector<char *> a = p, b = p, t(p.size());
+    old_insertionSort(a.data(), a.size());
+    mpren_mergeSort(b.data(), t.data(), b.size());
+    if(a != b) {
+        printf("FAIL: Sort order differs from the old sort\n");
+        fails++;
+    }
+    double to = sortUs([](char **x, char **, int n) { old_insertionSort(x, n); }, p);
+    double tn = sortUs([](char **x, char **y, int n) { mpren_mergeSort(x, y, n); }, p);
+    printf("%d names, %zu bytes; sort: insertion %.0fus, merge %.0fus (x%.1f)\n", NFILES, total, to, tn, to / tn);
+
+    // 2) Rename
+    makeFolder(names);
+    fs::fsStats.lookupUs = LOOKUP_US;
+    fs::fsStats.entryUs = ENTRY_US;
+    fs::fsStats.readUs = READ_US;
+    fs::fsStats.lookups = fs::fsStats.renames = fs::fsStats.writes = 0;
+    fs::fsStats.simUs = 0;
+    unsigned long t0 = micros();
+    mp_renameFilesInDir(false);
+    unsigned long host = micros() - t0;
+    printf("Rename: host %.1fms; card %.1fs (%u lookups, %u renames, %u writes)\n", host / 1000.0,
+        fs::fsStats.simUs / 1e6, fs::fsStats.lookups, fs::fsStats.renames, fs::fsStats.writes);
+
+    std::vector<std::string> ref = result();
+    std::map<std::string, int> seen;
+    int rounds = 1, unsorted = 0;
+    for(size_t i = 1; i < ref.size(); i++) {
+        // A new round starts over in the alphabet
+        if(mpren_strGT(ref[i-1].c_str(), ref[i].c_str())) {
+            if(++rounds > 2) unsorted++;
+        }
+    }
+    for(auto &n : ref) seen[n]++;
+    if(ref.size() != (size_t)NFILES || seen.size() != (size_t)NFILES || unsorted ||
+       !exists(tcdrdone) || exists(mprenfn)) {
+        printf("FAIL: Rename: %zu of %d files, %zu distinct, %d out of order, DONE %d, journal %d\n",
+            ref.size(), NFILES, seen.size(), unsorted, exists(tcdrdone), exists(mprenfn));
+        fails++;
+    }
+    printf("        %d rounds (sort buffer), files in order per round\n", rounds);
+
+    fs::fsStats.lookupUs = fs::fsStats.entryUs = fs::fsStats.readUs = 0;
+
+    // 3) Power loss
+    static const struct { const char *what; uint32_t rename, write; } cuts[] = {
+        { "writing journal", 0, 300 }, { "renaming", 400, 0 }, { "second round", 700, 0 }
+    };
+    for(auto &c : cuts) {
+        makeFolder(names);
+        fs::fsStats.cutRename = c.rename;
+        fs::fsStats.cutWrite = c.write;
+        bool cut = false;
+        try {
+            mp_renameFilesInDir(false);
+        } catch(fs::PowerCut &) {
+            cut = true;
+        }
+        fs::fsStats.cutRename = fs::fsStats.cutWrite = 0;
+
+        // Next boot
+        int st = mp_checkForFolder(0);
+        bool jnl = exists(mprenfn);
+        mp_renameFilesInDir(false);
+        std::vector<std::string> res = result();
+        bool same = (res == ref);
+        if(!cut || st != -1 || jnl || !same || !exists(tcdrdone)) {
+            printf("FAIL: Power loss %s: cut %d, status %d, journal left %d, same result %d\n",
+                c.what, cut, st, jnl, same);
+            fails++;
+        }
+        printf("Power loss %-16s resumed, %s\n", c.what, same ? "same result" : "DIFFERENT result");
+    }
+
+    if(system(("rm -rf " + root).c_str())) { }
+
+    printf("%s\n", fails ? "ren_bench: FAILED" : "ren_bench: OK");
+    return fails ? 1 : 0;
+}
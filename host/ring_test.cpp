@@ -0,0 +1,242 @@
+/*
+ * AudioOutputRing: Ordering and sizing
+ *
+ * 1) Decoder and feeder on two std::threads, the decoder writing
+ *    a running frame counter in random-sized pieces, changing
+ *    the rate and discarding at random points; the feeder
+ *    draining into the I2S stand-in with random DMA room.
+ *    Checks that frames arrive in order, gaps only where a
+ *    discard happened, and each rate change takes effect at
+ *    exactly the frame it was requested at.
+ * 2) Mono and full-ring behavior.
+ * 3) Sizing: A decoder producing 1152-frame MP3 frames with
+ *    random stalls (SD, WiFi) against a 44.1kHz DMA, on a
+ *    simulated 1ms clock; underruns per minute per ring size.
+ */
+#include <thread>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include "Arduino.h"
+#include "driver/i2s.h"
+#include "AudioOutputRing.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const uint32_t TOTAL = 4000000;
+
+static int orderTest(uint32_t ringFrames)
+{
+    AudioOutputRing ring(ringFrames);
+    AudioOutputI2S out;
+    std::vector<uint32_t> discards;
+    std::vector<std::pair<uint32_t, int>> rates = { { 0, 44100 } };
+    volatile bool done = false;
+    int fails = 0;
+
+    out.begin();
+    ring.begin();
+    i2sHost.clear();
+    i2sHost.rates.push_back({ 0, i2sHost.rate });
+    i2sHost.keep = true;
+
+    std::thread feeder([&] {
+        std::mt19937 rng(2);
+        while(1) {
+            bool last = done;
+            i2sHost.room = rng() % 700;
+            if(!ring.drain(&out)) {
+                if(last && !ring.available()) break;
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    std::mt19937 rng(1);
+    std::vector<int16_t> buf(2 * 1500);
+    uint32_t seq = 0;
+    while(seq < TOTAL) {
+        switch(rng() % 200) {
+        case 0:
+            discards.push_back(seq);
+            ring.discard();
+            break;
+        case 1:
+            rates.push_back({ seq, rates.back().second == 44100 ? 22050 : 44100 });
+            ring.SetRate(rates.back().second);
+            break;
+        }
+        if(rng() & 1) {
+            uint32_t n = 1 + rng() % 1500;
+            if(n > TOTAL - seq) n = TOTAL - seq;
+            for(uint32_t i = 0; i < n; i++) {
+                buf[2*i] = (int16_t)(seq + i);
+                buf[2*i+1] = (int16_t)((seq + i) >> 16);
+            }
+            uint32_t w = 0;
+            while((w += ring.ConsumeSamples(&buf[2*w], n - w)) < n) {
+                std::this_thread::yield();
+            }
+            seq += n;
+        } else {
+            while(!ring.ConsumeSample((int16_t)seq, (int16_t)(seq >> 16))) {
+                std::this_thread::yield();
+            }
+            seq++;
+        }
+    }
+    done = true;
+    feeder.join();
+
+    // Order: +1, or a jump to a discard position
+    const std::vector<uint32_t> &f = i2sHost.frames;
+    uint32_t lost = 0;
+    for(size_t i = 0; i < f.size(); i++) {
+        uint32_t prev = i ? f[i-1] + 1 : 0;
+        if(f[i] == prev) continue;
+        if(f[i] > prev && std::binary_search(discards.begin(), discards.end(), f[i])) {
+            lost += f[i] - prev;
+            continue;
+        }
+        printf("FAIL: Ring %u: Frame %zu is %u, expected %u\n", ringFrames, i, f[i], prev);
+        fails++;
+        break;
+    }
+    if(f.empty() || f.back() != TOTAL - 1) {
+        printf("FAIL: Ring %u: Stream does not end with last frame\n", ringFrames);
+        fails++;
+    }
+
+    // Rate at each frame as requested by decoder. Changes
+    // inside discarded stretches may be applied late.
+    size_t ri = 0, pi = 0;
+    int bad = 0;
+    for(size_t i = 0; i < f.size() && !fails; i++) {
+        while(ri + 1 < i2sHost.rates.size() && i2sHost.rates[ri + 1].first <= i) ri++;
+        while(pi + 1 < rates.size() && rates[pi + 1].first <= f[i]) pi++;
+        bool skipped = i && f[i] != f[i-1] + 1;
+        if(i2sHost.rates[ri].second != rates[pi].second && !skipped) bad++;
+    }
+    if(bad) {
+        printf("FAIL: Ring %u: %d frames played at wrong rate\n", ringFrames, bad);
+        fails++;
+    }
+
+    printf("Ring %5u: %u frames, %zu discards (%u frames dropped), %zu rate changes, %s\n",
+        ringFrames, TOTAL, discards.size(), lost, rates.size() - 1, fails ? "FAILED" : "in order");
+
+    return fails;
+}
+
+static int monoFullTest()
+{
+    AudioOutputRing ring(64);
+    AudioOutputI2S out;
+    int16_t s[2 * 80];
+    int fails = 0;
+
+    out.begin();
+    i2sHost.clear();
+    i2sHost.room = -1;
+
+    for(int i = 0; i < 80; i++) { s[2*i] = i; s[2*i+1] = -i; }
+
+    ring.SetChannels(1);
+    ring.ConsumeSample(7, 9);
+    if(ring.ConsumeSamples(s, 80) != 63) {
+        printf("FAIL: Full ring took more than its size\n");
+        fails++;
+    }
+    if(ring.ConsumeSample(1, 1)) {
+        printf("FAIL: Full ring took a sample\n");
+        fails++;
+    }
+    ring.drain(&out);
+    for(size_t i = 0; i < i2sHost.frames.size(); i++) {
+        uint32_t v = i2sHost.frames[i];
+        if((v & 0xffff) != (v >> 16) || (int16_t)v != (i ? (int16_t)(i - 1) : 7)) {
+            printf("FAIL: Mono frame %zu is %08x\n", i, v);
+            fails++;
+            break;
+        }
+    }
+    if(i2sHost.frames.size() != 64) {
+        printf("FAIL: Drained %zu frames, expected 64\n", i2sHost.frames.size());
+        fails++;
+    }
+
+    return fails;
+}
+
+// Underruns per minute: DMA 8 x 64 frames, decoder needs
+// decMs per MP3 frame plus a stall of up to maxStall ms
+// every ~second.
+static double sizing(uint32_t ringFrames, int decMs, int maxStall)
+{
+    const int DMA = 8 * 64, MINUTES = 10;
+    AudioOutputRing ring(ringFrames);
+    AudioOutputI2S out;
+    std::mt19937 rng(3);
+    std::vector<int16_t> pcm(2 * 1152);
+    uint32_t pending = 0, underruns = 0;
+    int busy = 0;
+    double dmaQ = 0;
+    bool started = false;
+
+    out.begin();
+    i2sHost.keep = false;
+
+    for(int ms = 0; ms < MINUTES * 60000; ms++) {
+        // Decoder task
+        if(busy) {
+            busy--;
+        } else {
+            if(pending) {
+                pending -= ring.ConsumeSamples(&pcm[2 * (1152 - pending)], pending);
+            }
+            if(!pending) {
+                pending = 1152;
+                busy = decMs;
+                if(!(rng() % 1000)) busy += rng() % (maxStall + 1);
+            }
+        }
+        // Feeder task
+        i2sHost.room = DMA - (long)dmaQ;
+        ring.drain(&out);
+        dmaQ = DMA - i2sHost.room;
+        // DMA
+        if(dmaQ >= DMA) started = true;
+        if(started) {
+            if(dmaQ < 44.1) {
+                underruns++;
+                dmaQ = 0;
+            } else {
+                dmaQ -= 44.1;
+            }
+        }
+    }
+
+    return (double)underruns / MINUTES;
+}
+
+int main()
+{
+    int fails = 0;
+
+    fails += orderTest(256);
+    fails += orderTest(2048);
+    fails += monoFullTest();
+
+    printf("\nUnderruns/min, 1152 frames/6ms decode, stall every ~1s (AT_RING_FRAMES 2048):\n");
+    printf("Ring frames   max stall 20ms   40ms   60ms   100ms\n");
+    for(uint32_t rf = 512; rf <= 8192; rf <<= 1) {
+        printf("%5u (%3ums)", rf, rf * 1000 / 44100);
+        for(int st : { 20, 40, 60, 100 }) {
+            printf("  %6.1f", sizing(rf, 6, st));
+        }
+        printf("\n");
+    }
+
+    printf("%s\n", fails ? "ring_test: FAILED" : "ring_test: OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Sound effect cache: LRU/budget, and trigger latency
+ *
+ * 1) AudioSoundCache against a reference model: Random adds
+ *    and lookups; checks budget, LRU eviction order, entry
+ *    limit and failed entries.
+ * 2) Trigger-to-first-sample latency of a short sound: Open,
+ *    ID3 skip and MP3 decoder start on a simulated SD card,
+ *    vs. lookup and AudioGeneratorPCM start from the cache.
+ */
+#include <map>
+#include <random>
+#include "Arduino.h"
+#include "FS.h"
+#include "audiohost.h"
+#include "AudioSoundCache.h"
+#include "AudioGeneratorPCM.h"
+#include "AudioFileSourceLoop.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+// Reference: Same policy, written plainly
+struct Model {
+    struct E { uint32_t size; uint32_t use; bool data; };
+    std::map<std::string, E> m;
+    uint32_t budget, used = 0, cnt = 0;
+    size_t maxEntries;
+
+    Model(uint32_t b, size_t n) : budget(b), maxEntries(n) {}
+
+    const char *lru(bool withData)
+    {
+        const char *r = NULL;
+        uint32_t best = 0;
+        for(auto &kv : m) {
+            if(withData && !kv.second.data) continue;
+            if(!r || (int32_t)(kv.second.use - best) < 0) { r = kv.first.c_str(); best = kv.second.use; }
+        }
+        return r;
+    }
+    void evict(const std::string &n)
+    {
+        if(m[n].data) used -= m[n].size;
+        m.erase(n);
+    }
+    void slot(const std::string &n, uint32_t size, bool data)
+    {
+        if(m.size() >= maxEntries) evict(lru(false));
+        m[n] = { size, ++cnt, data };
+        if(data) used += size;
+    }
+    bool find(const std::string &n)
+    {
+        auto it = m.find(n);
+        if(it == m.end()) return false;
+        it->second.use = ++cnt;
+        return true;
+    }
+    void add(const std::string &n, uint32_t size)
+    {
+        if(size > budget) { slot(n, 0, false); return; }
+        while(used + size > budget) {
+            const char *l = lru(true);
+            if(!l) break;
+            evict(l);
+        }
+        slot(n, size, true);
+    }
+};
+
+static int lruTest()
+{
+    const uint32_t BUDGET = 20000;
+    const int ENTRIES = 8;
+    AudioSoundCache sc(BUDGET, ENTRIES);
+    Model ref(BUDGET, ENTRIES);
+    std::mt19937 rng(1);
+    int fails = 0, evictions = 0;
+
+    for(int i = 0; i < 200000 && !fails; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/snd%u.mp3", (unsigned)(rng() % 14));
+
+        if(rng() % 3) {
+            const SndCacheEntry *e = sc.find(name);
+            bool r = ref.find(name);
+            if(!!e != r || (e && !!e->pcm != ref.m[name].data)) {
+                printf("FAIL: find(%s) differs from model at step %d\n", name, i);
+                fails++;
+            }
+            if(e && e->pcm && e->pcm[e->frames - 1] != (int16_t)e->frames) {
+                printf("FAIL: %s: Data of wrong entry\n", name);
+                fails++;
+            }
+        } else if(!sc.find(name)) {
+            ref.find(name);
+            // Mostly sizes that fit a few times; sometimes too big
+            uint32_t frames = (rng() % 20) ? 200 + rng() % 4000 : BUDGET;
+            int16_t *pcm = (int16_t *)malloc(frames * sizeof(int16_t));
+            pcm[frames - 1] = (int16_t)frames;
+            size_t before = ref.m.size();
+            sc.add(name, pcm, frames, 44100);
+            ref.add(name, frames * sizeof(int16_t));
+            if(ref.m.size() <= before) evictions++;
+        } else {
+            ref.find(name);
+        }
+
+        if(sc.getUsed() != ref.used || sc.getUsed() > BUDGET) {
+            printf("FAIL: Used %u, model %u, budget %u at step %d\n", sc.getUsed(), ref.used, BUDGET, i);
+            fails++;
+        }
+    }
+
+    sc.clear();
+    if(sc.getUsed()) {
+        printf("FAIL: %u bytes used after clear()\n", sc.getUsed());
+        fails++;
+    }
+
+    printf("LRU/budget: 200000 random lookups/adds, %d with eviction, %s\n", evictions, fails ? "FAILED" : "same as model");
+    return fails;
+}
+
+// Returns us from trigger to first frame at output
+static double viaFile(const char *fn)
+{
+    AudioFileSourceSDLoop src;
+    AudioGeneratorMP3 mp3;
+    PCMSink sink;
+    uint8_t h[10];
+
+    sink.room = 64;
+
+    unsigned long t0 = micros();
+    src.open(fn);
+    // Like skipID3()
+    if(src.read(h, 10) == 10 && !memcmp(h, "ID3", 3)) {
+        src.seek(10 + ((h[6] << 21) | (h[7] << 14) | (h[8] << 7) | h[9]), SEEK_SET);
+    } else {
+        src.seek(0, SEEK_SET);
+    }
+    mp3.begin(&src, &sink);
+    while(!sink.frames() && mp3.loop()) { }
+    unsigned long t = micros() - t0;
+    mp3.stop();
+
+    return t;
+}
+
+static double viaCache(AudioSoundCache &sc, const char *fn)
+{
+    AudioGeneratorPCM pcm;
+    PCMSink sink;
+    const int N = 10000;
+
+    unsigned long t0 = micros();
+    for(int i = 0; i < N; i++) {
+        const SndCacheEntry *e = sc.find(fn);
+        sink.clear();
+        sink.room = 64;
+        pcm.begin(e->pcm, e->frames, e->rate, &sink);
+        while(!sink.frames() && pcm.loop()) { }
+        pcm.stop();
+    }
+
+    return (double)(micros() - t0) / N;
+}
+
+int main()
+{
+    int fails = 0;
+    const char *fn = "/mp3/m44.mp3";
+
+    fails += lruTest();
+
+    // Decode into cache like sc_fill()
+    AudioSoundCache sc(64 * 1024, 16);
+    {
+        AudioFileSourceSDLoop src;
+        AudioGeneratorMP3 mp3;
+        AudioOutputCapture cap;
+        int16_t *buf = (int16_t *)malloc(32768 * sizeof(int16_t));
+        src.open(fn);
+        cap.beginCapture(buf, 32768);
+        decodeAll(mp3, &src, &cap);
+        if(!cap.getFrames() || !sc.add(fn, buf, cap.getFrames(), cap.getRate())) {
+            printf("FAIL: Could not cache %s\n", fn);
+            return 1;
+        }
+    }
+
+    printf("\nTrigger to first sample, %s (ID3, MP3):\n", fn);
+    printf("From cache:                       %8.2f us\n", viaCache(sc, fn));
+    printf("From file, in host page cache:    %8.0f us\n", viaFile(fn));
+    // SD model: 3ms open (FAT lookup), 1.5ms per read call
+    fs::fsStats.openDelayUs = 3000;
+    fs::fsStats.readDelayUs = 1500;
+    printf("From file, simulated SD card:     %8.0f us\n", viaFile(fn));
+
+    printf("%s\n", fails ? "sc_test: FAILED" : "sc_test: OK");
+    return fails ? 1 : 0;
+}
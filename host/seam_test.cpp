@@ -0,0 +1,195 @@
+/*
+ * Appended file seam (ttstart.mp3 -> humm.wav)
+ *
+ * An MP3 followed by a looping WAV through the mixer, the way
+ * gen_start()/gen_prime()/gen_loop() do it, into an output that
+ * takes a DMA-sized piece per loop. The output must be the
+ * MP3's frames followed directly by the WAV's: No frame lost,
+ * none inserted, no zero at the seam. With a crossfade, the
+ * WAV's first frames must blend into the MP3's last ones.
+ * For comparison, the old stop-and-restart path; and the time
+ * the output waits at the seam on a simulated SD card.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include "Arduino.h"
+#include "FS.h"
+#include "LittleFS.h"
+#include "audiohost.h"
+#include "AudioOutputMixer.h"
+#include "AudioFileSourceLoop.h"
+#include "AudioGeneratorWAVLoop.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const char *MP3FN = "/mp3/s44.mp3";
+static const char *WAVFN = "/hum.wav";
+static std::vector<int16_t> hum;
+
+// Time of each ConsumeSamples(), and output restarts
+class TimedSink : public PCMSink
+{
+  public:
+    virtual bool begin() override         { begins++; return true; }
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override
+    {
+        size_t at = frames();
+        count = PCMSink::ConsumeSamples(samples, count);
+        if(count) calls.push_back({ at, micros() });
+        return count;
+    }
+    // Time between the calls delivering frames n-1 and n
+    unsigned long gapAt(size_t n)
+    {
+        for(size_t i = 1; i < calls.size(); i++) {
+            if(calls[i].first >= n) return calls[i].second - calls[i-1].second;
+        }
+        return 0;
+    }
+    std::vector<std::pair<size_t, unsigned long>> calls;
+    int begins = 0;
+};
+
+// mode 0: MP3 only, 1: primed and handed off, 2: stop and restart.
+// room: Frames the output takes per loop; must be limited once
+// the looping WAV plays, or its loop() never returns.
+static void run(int mode, uint32_t xfade, int room, size_t until, TimedSink &sink, size_t *mp3End)
+{
+    AudioFileSourceSDLoop s0;
+    AudioFileSourceFSLoop s1;
+    AudioGeneratorMP3 mp3;
+    AudioGeneratorWAVLoop wav;
+    AudioOutputMixer mixer(&sink, 256);
+
+    mixer.setCrossfade(xfade);
+
+    s0.open(MP3FN);
+    mp3.begin(&s0, mixer.getStreamInput());
+
+    if(mode == 1) {
+        s1.open(WAVFN);
+        s1.setPlayLoop(true);
+        wav.begin(&s1, mixer.getNextInput());
+        s1.setStartPos(wav.startPos);
+    }
+
+    do {
+        if(room >= 0) sink.room = room;
+    } while(mp3.loop());
+
+    *mp3End = sink.frames();
+    if(mode == 1) {
+        mixer.handoff();
+        mp3.stop();
+    } else {
+        mp3.stop();
+        *mp3End = sink.frames();
+        if(!mode) return;
+        s1.open(WAVFN);
+        s1.setPlayLoop(true);
+        wav.begin(&s1, mixer.getStreamInput());
+        s1.setStartPos(wav.startPos);
+    }
+
+    while(sink.frames() < until) {
+        if(room >= 0) sink.room = room;
+        wav.loop();
+    }
+    wav.stop();
+}
+
+static int16_t out(TimedSink &s, size_t i) { return s.pcm[2*i]; }
+
+// Frames from "at" on must be the WAV, looped; returns mismatches
+static size_t checkWAV(TimedSink &s, size_t at, size_t from = 0)
+{
+    size_t bad = 0;
+    for(size_t i = at + from; i < s.frames(); i++) {
+        if(out(s, i) != hum[(i - at) % hum.size()]) bad++;
+    }
+    return bad;
+}
+
+int main()
+{
+    int fails = 0;
+    char tmpl[] = "/tmp/seamXXXXXX";
+    const char *dir = mkdtemp(tmpl);
+
+    // Half a second of 110Hz hum, never zero
+    for(int i = 0; i < 22050; i++) {
+        hum.push_back((int16_t)(4000 + 3000 * sin(2 * M_PI * 110 * i / 44100)));
+    }
+    LittleFS.setRoot(dir);
+    if(!dir || !writeWAV((std::string(dir) + WAVFN).c_str(), hum, 1, 44100)) {
+        printf("FAIL: Cannot write WAV\n");
+        return 1;
+    }
+
+    // Reference: The MP3 by itself
+    TimedSink ref;
+    size_t lenA;
+    run(0, 0, -1, 0, ref, &lenA);
+    const size_t until = lenA + 3 * hum.size();
+
+    // Gapless: MP3 frames, then WAV frames
+    {
+        TimedSink s;
+        size_t end;
+        run(1, 0, 256, until, s, &end);
+        size_t badA = 0, zeros = 0;
+        for(size_t i = 0; i < lenA; i++) badA += (out(s, i) != out(ref, i));
+        for(size_t i = lenA - 64; i < lenA + 64; i++) zeros += !out(s, i);
+        size_t badB = checkWAV(s, lenA);
+        if(badA || badB || zeros || s.begins != 1) {
+            printf("FAIL: Gapless: %zu MP3 and %zu WAV frames differ, %zu zeros at seam, %d output starts\n",
+                badA, badB, zeros, s.begins);
+            fails++;
+        }
+        printf("Primed, no crossfade:  %zu MP3 frames, then WAV from frame %zu on, %zu zeros around seam, %s\n",
+            lenA, lenA, zeros, (badA || badB) ? "FAILED" : "sample-accurate");
+    }
+
+    // Crossfade: The WAV's first x frames blend into the MP3's
+    // last x frames, which were still unplayed in the FIFO
+    {
+        const uint32_t XF = 64;
+        TimedSink s;
+        size_t end, bad = 0;
+        run(1, XF, 256, until, s, &end);
+        size_t at = lenA - XF;
+        for(size_t k = 0; k < XF; k++) {
+            int32_t o = out(ref, at + k), w = hum[k];
+            bad += (out(s, at + k) != (int16_t)(o + ((w - o) * (int32_t)k) / (int32_t)XF));
+        }
+        for(size_t i = 0; i < at; i++) bad += (out(s, i) != out(ref, i));
+        bad += checkWAV(s, at, XF);
+        if(bad) {
+            printf("FAIL: Crossfade: %zu frames differ\n", bad);
+            fails++;
+        }
+        printf("Primed, %u crossfade: WAV blends in from frame %zu, %s\n", XF, at, bad ? "FAILED" : "exact");
+    }
+
+    // Old path: Stop, open, parse, restart output
+    {
+        TimedSink s;
+        size_t end;
+        run(2, 0, 256, until, s, &end);
+        printf("Stop and restart:      %zu MP3 frames dropped at stop, %d output starts\n", lenA - end, s.begins);
+    }
+
+    // Output stall at seam, simulated SD card (3ms open, 1.5ms per read)
+    fs::fsStats.openDelayUs = 3000;
+    fs::fsStats.readDelayUs = 1500;
+    for(int mode = 1; mode <= 2; mode++) {
+        TimedSink s;
+        size_t end;
+        run(mode, 0, 4096, until, s, &end);
+        printf("Output waits at seam, %s: %6lu us\n", mode == 1 ? "primed          " : "stop and restart", s.gapAt(end));
+    }
+
+    printf("%s\n", fails ? "seam_test: FAILED" : "seam_test: OK");
+    return fails ? 1 : 0;
+}
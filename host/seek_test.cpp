@@ -0,0 +1,207 @@
+/*
+ * MP3 seek: mp_timeToPos() and the per-track seek index
+ *
+ * Uses the seek code from vsr_audio.cpp (seek.inc) on the long
+ * corpus files: Xing (with ID3v2, and with CRC), VBRI, and CBR
+ * (with ID3v2 and CRC). The truth is a walk over all frame
+ * headers. For times every 100ms, the frame the decoder syncs
+ * to from the returned position must be at most a few frames
+ * off the one asked for: First by the file's tag or frame
+ * length, then by the seek index. Between index entries, VBR
+ * frame sizes vary, so a frame or two off is expected there;
+ * at the entries, the decoder must sync to the exact frame.
+ * The index is built the way the firmware does it, by playing
+ * the file through AudioGeneratorMP3, once in one go and once
+ * stopped and resumed; both must hold the exact positions. A
+ * changed file size must void it.
+ * mp_duration() (for the folder index) must be within a frame
+ * of the walk's length.
+ */
+#include <stdlib.h>
+#include <math.h>
+#include "Arduino.h"
+#include "FS.h"
+#include "src/SD/SD.h"
+#include "audiohost.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+#include "seek.inc"
+
+struct SeekFile { const char *name; int maxEst; };
+
+// Largest error allowed without index, in frames
+static const SeekFile files[] = { { "xing44", 4 }, { "xcrc44", 4 }, { "vbri44", 2 }, { "cbr32", 1 } };
+
+static const int MAXIDX = 2;    // With index, between entries
+
+// Offsets of all frames after the ID3v2 tag
+static std::vector<uint32_t> walk(const std::vector<uint8_t> &d, int *rate, int *spf)
+{
+    static const int br1[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+    static const int br2[] = { 0,  8, 16, 24, 32, 40, 48, 56,  64,  80,  96, 112, 128, 144, 160 };
+    static const int sr[] = { 44100, 48000, 32000 };
+    std::vector<uint32_t> offs;
+    uint32_t p = mp_id3Size(d.data());
+
+    while(p + 4 <= d.size()) {
+        uint32_t h = mp_be32(&d[p]);
+        if((h & 0xffe00000) != 0xffe00000) break;
+        int ver = (h >> 19) & 3;
+        *rate = sr[(h >> 10) & 3] >> ((ver == 3) ? 0 : ((ver == 2) ? 1 : 2));
+        *spf = (ver == 3) ? 1152 : 576;
+        int br = (ver == 3 ? br1 : br2)[(h >> 12) & 15];
+        offs.push_back(p);
+        p += (ver == 3 ? 144000 : 72000) * br / *rate + ((h >> 9) & 1);
+    }
+    return offs;
+}
+
+// Frame the decoder syncs to from pos
+static int landing(const std::vector<uint32_t> &offs, uint32_t pos)
+{
+    return std::lower_bound(offs.begin(), offs.end(), pos) - offs.begin();
+}
+
+// Max error in frames over times every 100ms; -1 if a time
+// inside the track fails
+static int maxError(const char *fn, const std::vector<uint32_t> &offs, int rate, int spf)
+{
+    int maxErr = 0;
+
+    for(uint32_t ms = 0; ; ms += 100) {
+        uint32_t n = (uint64_t)ms * rate / (spf * 1000), pos;
+        if(n >= offs.size()) break;
+        if(!mp_timeToPos(fn, ms, pos)) return -1;
+        int e = abs(landing(offs, pos) - (int)n);
+        if(e > maxErr) maxErr = e;
+    }
+    return maxErr;
+}
+
+// Play src from pos through the generator, recording into idx;
+// stop after "frames" frames (0 = to the end). Returns entries.
+static int play(MemSource &src, uint32_t *idx, int count, uint32_t num, uint32_t pos, uint32_t frames,
+                uint32_t *stopNum, uint32_t *stopPos)
+{
+    AudioGeneratorMP3 mp3;
+    PCMSink sink;
+
+    sink.keep = false;
+    src.seek(pos, SEEK_SET);
+    if(!mp3.begin(&src, &sink)) return 0;
+    mp3.SetFrameIndex(idx, MP_SEEK_MAX, MP_SEEK_STEP, count, num);
+    while(mp3.isRunning() && mp3.loop()) {
+        if(frames && mp3.GetFrameNum() >= num + frames) break;
+    }
+    *stopNum = mp3.GetFrameNum();
+    *stopPos = mp3.GetFramePos();
+    count = mp3.GetFrameIndexCount();
+    mp3.stop();
+
+    return count;
+}
+
+static int checkIndex(const uint32_t *idx, int count, const std::vector<uint32_t> &offs)
+{
+    int bad = (count != (int)((offs.size() + MP_SEEK_STEP - 1) / MP_SEEK_STEP));
+    for(int k = 0; k < count; k++) {
+        bad += (idx[k] != offs[k * MP_SEEK_STEP]);
+    }
+    return bad;
+}
+
+int main()
+{
+    char dir[] = "/tmp/seek_testXXXXXX";
+    uint32_t idx[MP_SEEK_MAX], idx2[MP_SEEK_MAX], sn, sp;
+    int fails = 0;
+
+    if(!mkdtemp(dir)) {
+        printf("FAIL: No temp dir\n");
+        return 1;
+    }
+    SD.setRoot(dir);
+
+    printf("                                estimate          index\n");
+    printf("file    frames     ms         frames  ms      frames  ms\n");
+    for(const SeekFile &sf : files) {
+        MemSource src;
+        std::string fn = std::string("/") + sf.name + ".mp3";
+        if(!src.open(corpusPath(sf.name).c_str())) {
+            printf("FAIL: %s missing\n", sf.name);
+            fails++;
+            continue;
+        }
+        FILE *f = fopen((dir + fn).c_str(), "wb");
+        fwrite(src.data.data(), 1, src.data.size(), f);
+        fclose(f);
+
+        int rate = 0, spf = 0;
+        std::vector<uint32_t> offs = walk(src.data, &rate, &spf);
+        double msf = spf * 1000.0 / rate;
+
+        File df = SD.open(fn.c_str(), FILE_READ);
+        uint32_t dur = mp_duration(df);
+        df.close();
+        if(fabs(dur - offs.size() * msf) > msf + 1) {
+            printf("FAIL: %s: Duration %ums, frames give %.0fms\n", sf.name, dur, offs.size() * msf);
+            fails++;
+        }
+
+        // From tag or frame length
+        int est = maxError(fn.c_str(), offs, rate, spf);
+        if(est < 0 || est > sf.maxEst) {
+            printf("FAIL: %s: Estimate off by %d frames (%d allowed)\n", sf.name, est, sf.maxEst);
+            fails++;
+        }
+
+        // Index, in one go
+        int count = play(src, idx, 0, 0, 0, 0, &sn, &sp);
+        if(checkIndex(idx, count, offs)) {
+            printf("FAIL: %s: Index (%d entries) differs from frame walk\n", sf.name, count);
+            fails++;
+        }
+
+        // Stopped and resumed at the stop frame
+        int c2 = play(src, idx2, 0, 0, 0, 100, &sn, &sp);
+        c2 = play(src, idx2, c2, sn, sp, 0, &sn, &sp);
+        if(c2 != count || memcmp(idx, idx2, count * sizeof(uint32_t))) {
+            printf("FAIL: %s: Resumed index (%d entries) differs\n", sf.name, c2);
+            fails++;
+        }
+
+        // Saved; voided by another size
+        mp_seekSave(fn.c_str(), src.data.size(), idx, count);
+        if(mp_seekLoad(fn.c_str(), src.data.size(), idx2, MP_SEEK_MAX) != count ||
+           mp_seekLoad(fn.c_str(), src.data.size() + 1, idx2, MP_SEEK_MAX) ||
+           mp_seekLookup(fn.c_str(), src.data.size() + 1, MP_SEEK_STEP, sp)) {
+            printf("FAIL: %s: Index not loaded, or not voided by size\n", sf.name);
+            fails++;
+        }
+
+        int ind = maxError(fn.c_str(), offs, rate, spf);
+        if(ind < 0 || ind > MAXIDX) {
+            printf("FAIL: %s: With index off by %d frames (%d allowed)\n", sf.name, ind, MAXIDX);
+            fails++;
+        }
+
+        for(uint32_t n = 0; n < offs.size(); n += MP_SEEK_STEP) {
+            uint32_t ms = ((uint64_t)n * spf * 1000 + rate - 1) / rate, pos;
+            if(!mp_timeToPos(fn.c_str(), ms, pos) || landing(offs, pos) != (int)n) {
+                printf("FAIL: %s: Index entry for frame %u not exact\n", sf.name, n);
+                fails++;
+                break;
+            }
+        }
+
+        printf("%-7s %6zu %6u        %6d %4.0f    %6d %4.0f\n", sf.name, offs.size(), dur, est, est * msf, ind, ind * msf);
+    }
+
+    std::string rm = std::string("rm -rf ") + dir;
+    if(system(rm.c_str())) { }
+
+    printf("%s\n", fails ? "seek_test: FAILED" : "seek_test: OK");
+    return fails ? 1 : 0;
+}
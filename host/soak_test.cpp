@@ -0,0 +1,260 @@
+/*
+ * Decoder arena: Heap soak
+ *
+ * Thousands of MP3 and WAV plays, with the buffers either from
+ * one arena allocated at setup (as audio_setup() does) or from
+ * the heap per play (as before), on a simulated 160KB first-fit
+ * heap shared with other code: Long- and short-lived blocks of
+ * JSON-ish sizes, also while a sound plays, and a 32KB block
+ * (the renamer's) every 100 plays. Counts the audio code's heap
+ * calls per play (must be none with the arena), and tracks the
+ * largest free block against the total free: With buffers per
+ * play, other code's blocks land between them and split the
+ * heap once they are freed.
+ */
+#include <unistd.h>
+#include <random>
+#include "Arduino.h"
+#include "FS.h"
+#include "audiohost.h"
+#include "AudioFileSourceLoop.h"
+#include "AudioGeneratorWAVLoop.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+// Simulated heap: Blocks with a header, first fit, coalescing
+// on free. Only used while "simHeap" is set.
+extern "C" void *__libc_malloc(size_t);
+extern "C" void  __libc_free(void *);
+extern "C" void *__libc_realloc(void *, size_t);
+
+static const size_t HEAP = 160 * 1024;
+static uint8_t  heap[HEAP] __attribute__((aligned(16)));
+static bool     simHeap = false;
+static uint32_t heapCalls = 0;
+static int      inFS = 0;        // Not counted
+
+struct Hdr { uint32_t size; uint32_t used; uint64_t pad; };   // 16 bytes
+
+static Hdr *hdr(size_t off)   { return (Hdr *)(heap + off); }
+static bool inHeap(void *p)   { return p >= (void *)heap && p < (void *)(heap + HEAP); }
+
+static void heapInit()
+{
+    hdr(0)->size = HEAP;
+    hdr(0)->used = 0;
+}
+
+static void *hMalloc(size_t n)
+{
+    n = (n + sizeof(Hdr) + 15) & ~(size_t)15;
+    if(!inFS) heapCalls++;
+    for(size_t off = 0; off < HEAP; off += hdr(off)->size) {
+        Hdr *h = hdr(off);
+        if(h->used || h->size < n) continue;
+        if(h->size - n >= 32) {
+            hdr(off + n)->size = h->size - n;
+            hdr(off + n)->used = 0;
+            h->size = n;
+        }
+        h->used = 1;
+        return h + 1;
+    }
+    return NULL;
+}
+
+static void hFree(void *p)
+{
+    if(!inFS) heapCalls++;
+    ((Hdr *)p - 1)->used = 0;
+    // Coalesce all neighbours
+    for(size_t off = 0; off < HEAP; off += hdr(off)->size) {
+        while(!hdr(off)->used && off + hdr(off)->size < HEAP && !hdr(off + hdr(off)->size)->used) {
+            hdr(off)->size += hdr(off + hdr(off)->size)->size;
+        }
+    }
+}
+
+static size_t largestFree(size_t *total = NULL)
+{
+    size_t m = 0, t = 0;
+    for(size_t off = 0; off < HEAP; off += hdr(off)->size) {
+        if(hdr(off)->used) continue;
+        size_t n = hdr(off)->size - sizeof(Hdr);
+        if(n > m) m = n;
+        t += n;
+    }
+    if(total) *total = t;
+    return m;
+}
+
+extern "C" void *malloc(size_t n)
+{
+    return simHeap ? hMalloc(n) : __libc_malloc(n);
+}
+
+extern "C" void free(void *p)
+{
+    if(!p) return;
+    if(inHeap(p)) hFree(p); else __libc_free(p);
+}
+
+extern "C" void *calloc(size_t n, size_t s)
+{
+    void *p = malloc(n * s);
+    if(p) memset(p, 0, n * s);
+    return p;
+}
+
+extern "C" void *realloc(void *p, size_t n)
+{
+    if(!p) return malloc(n);
+    if(!inHeap(p)) return __libc_realloc(p, n);
+    void *q = malloc(n);
+    if(q) {
+        size_t old = ((Hdr *)p - 1)->size - sizeof(Hdr);
+        memcpy(q, p, old < n ? old : n);
+        free(p);
+    }
+    return q;
+}
+
+// No bookkeeping, so the sink does not use the heap itself
+class NullSink : public PCMSink
+{
+  public:
+    NullSink() { keep = false; }
+    virtual bool SetRate(int hz) override { hertz = hz; return true; }
+};
+
+// File handles allocate (also on the ESP32: Handle, FILE and its
+// buffer on the first read); keep that out of the count
+class SoakSource : public AudioFileSourceSDLoop
+{
+  public:
+    virtual bool open(const char *fn) override
+    {
+        uint8_t b;
+        inFS++;
+        bool ok = AudioFileSourceSDLoop::open(fn) && read(&b, 1) && seek(0, SEEK_SET);
+        inFS--;
+        return ok;
+    }
+    virtual bool close() override
+    {
+        inFS++;
+        AudioFileSourceSDLoop::close();
+        inFS--;
+        return true;
+    }
+};
+
+struct Result {
+    double   callsPerPlay;
+    size_t   minLargest, endLargest, endFree;
+    int      bigFails, playFails;
+};
+
+static Result soak(bool arena, int plays)
+{
+    Result r = { 0, HEAP, 0, 0, 0, 0 };
+    std::mt19937 rng(1);
+    void *blk[32] = { NULL };
+    uint32_t audioCalls = 0;
+
+    heapInit();
+    simHeap = true;
+
+    // Setup, like audio_setup()
+    const int MP3SZ = AudioGeneratorMP3::preAllocSize(), WAVSZ = 1024, SRCSZ = 2 * AFSL_CHUNK;
+    uint8_t *a = arena ? (uint8_t *)malloc(MP3SZ + WAVSZ + SRCSZ) : NULL;
+    AudioGeneratorMP3 *mp3 = a ? new AudioGeneratorMP3(a, MP3SZ) : new AudioGeneratorMP3();
+    AudioGeneratorWAVLoop *wav = new AudioGeneratorWAVLoop();
+    SoakSource *src = new SoakSource();
+    NullSink *sink = new NullSink();
+    if(a) {
+        wav->SetBuffer(a + MP3SZ, WAVSZ);
+        src->setBuffer(a + MP3SZ + WAVSZ);
+    }
+
+    // Other code (web server, JSON, WiFi): Some blocks come,
+    // some go, also while a sound plays
+    auto other = [&] {
+        int s = rng() % 32;
+        if(blk[s]) {
+            free(blk[s]);
+            blk[s] = NULL;
+        } else {
+            blk[s] = malloc(64 + rng() % ((rng() % 8) ? 1500 : 6000));
+        }
+    };
+
+    for(int i = 0; i < plays; i++) {
+        if(!(i % 100)) {
+            void *big = malloc(32 * 1024);
+            if(big) free(big); else r.bigFails++;
+        }
+
+        // Play
+        bool isWAV = i & 1;
+        AudioGenerator *gen = isWAV ? (AudioGenerator *)wav : (AudioGenerator *)mp3;
+        uint32_t c0 = heapCalls, oc = 0;
+        if(src->open(isWAV ? "/soak.wav" : "/mp3/m44.mp3") && gen->begin(src, sink)) {
+            while(gen->isRunning()) {
+                if(!(rng() % 4)) {
+                    uint32_t c = heapCalls;
+                    other();
+                    oc += heapCalls - c;
+                }
+                if(!gen->loop()) break;
+            }
+            gen->stop();
+        } else {
+            r.playFails++;
+        }
+        src->close();
+        audioCalls += heapCalls - c0 - oc;
+
+        size_t l = largestFree();
+        if(l < r.minLargest) r.minLargest = l;
+    }
+
+    r.endLargest = largestFree(&r.endFree);
+    r.callsPerPlay = (double)audioCalls / plays;
+
+    simHeap = false;
+    return r;
+}
+
+int main()
+{
+    int fails = 0;
+    const int PLAYS = 4000;
+    char tmpl[] = "/tmp/soakXXXXXX";
+
+    // Short WAV next to the MP3 corpus
+    if(!mkdtemp(tmpl)) return 1;
+    std::vector<int16_t> pcm(4410 * 2, 1000);
+    writeWAV((std::string(tmpl) + "/soak.wav").c_str(), pcm, 2, 44100);
+    symlink((std::string(getcwd(NULL, 0)) + "/mp3").c_str(), (std::string(tmpl) + "/mp3").c_str());
+    SD.setRoot(tmpl);
+
+    printf("%d plays (MP3/WAV), 160KB heap    heap calls/play  largest free: min    end  (free)  32KB fails\n", PLAYS);
+    for(int arena = 0; arena <= 1; arena++) {
+        Result r = soak(arena, PLAYS);
+        printf("%-36s %8.1f %19zu %6zu  (%6zu) %6d\n", arena ? "Arena from setup" : "Heap per play (before)",
+            r.callsPerPlay, r.minLargest, r.endLargest, r.endFree, r.bigFails);
+        if(r.playFails) {
+            printf("FAIL: %d plays failed\n", r.playFails);
+            fails++;
+        }
+        if(arena && r.callsPerPlay) {
+            printf("FAIL: Plays use the heap with the arena\n");
+            fails++;
+        }
+    }
+
+    printf("%s\n", fails ? "soak_test: FAILED" : "soak_test: OK");
+    return fails ? 1 : 0;
+}
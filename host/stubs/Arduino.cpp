@@ -0,0 +1,57 @@
+/*
+ * Minimal Arduino core stand-in for host builds
+ * millis() is up to each program (real or simulated time);
+ * micros() is always real time.
+ */
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include "Arduino.h"
+
+HardwareSerial Serial;
+
+void HardwareSerial::printf(const char *fmt, ...)
+{
+    va_list a;
+    va_start(a, fmt);
+    vprintf(fmt, a);
+    va_end(a);
+}
+
+void HardwareSerial::println(const char *s)
+{
+    puts(s);
+}
+
+uint32_t esp_random()
+{
+    return (uint32_t)rand();
+}
+
+unsigned long micros()
+{
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (unsigned long)(t.tv_sec * 1000000ull + t.tv_nsec / 1000);
+}
+
+void delay(unsigned long ms)
+{
+    usleep(ms * 1000);
+}
+
+void yield()
+{
+    sched_yield();
+}
+
+void vTaskDelay(uint32_t ticks)
+{
+    usleep(ticks * 1000);
+}
+
+void esp_chip_info(esp_chip_info_t *info)
+{
+    info->revision = 3;
+}
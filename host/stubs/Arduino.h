@@ -0,0 +1,46 @@
+/*
+ * Minimal Arduino core stand-in for host builds
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#define ESP32 1
+
+#define PSTR(s) (s)
+#define IRAM_ATTR
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void yield();
+uint32_t esp_random();
+
+// IDF and FreeRTOS bits used by the audio code
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_IDF_VERSION_VAL(a, b, c) (((a) << 16) | ((b) << 8) | (c))
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(4, 4, 0)
+#define CONFIG_IDF_TARGET_ESP32 1
+#define ESP_INTR_FLAG_LEVEL1 (1 << 1)
+struct esp_chip_info_t { int revision; };
+void esp_chip_info(esp_chip_info_t *info);
+
+typedef void *QueueHandle_t;
+#define pdTRUE 1
+#define portMAX_DELAY 0xffffffff
+int  xQueueReset(QueueHandle_t q);
+int  xQueueReceive(QueueHandle_t q, void *item, uint32_t ticks);
+void vTaskDelay(uint32_t ticks);
+
+struct HardwareSerial {
+    void printf(const char *fmt, ...);
+    void println(const char *s);
+    void flush() {}
+};
+extern HardwareSerial Serial;
@@ -0,0 +1,65 @@
+/*
+ * AsyncUDP stand-in for host builds: One receiver thread per
+ * socket plays the network task. Like tcdsim.h, the client
+ * binds to 127.0.0.1, and multicast goes to the TCD (127.0.0.2).
+ */
+#pragma once
+#include <thread>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include "IPAddress.h"
+
+class AsyncUDPPacket {
+  public:
+    uint8_t *data()        { return d; }
+    size_t length()        { return l; }
+    IPAddress remoteIP()   { return ip; }
+    uint16_t remotePort()  { return p; }
+    uint8_t   *d;
+    size_t    l;
+    IPAddress ip;
+    uint16_t  p;
+};
+
+typedef void (*AuPacketHandlerFunctionWithArg)(void *arg, AsyncUDPPacket& packet);
+
+class AsyncUDP {
+  public:
+    void onPacket(AuPacketHandlerFunctionWithArg c, void *a) { cb = c; arg = a; }
+    bool listen(uint16_t port) {
+        sockaddr_in a = {};
+        int one = 1;
+        s = socket(AF_INET, SOCK_DGRAM, 0);
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        a.sin_family = AF_INET; a.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+        if(bind(s, (sockaddr *)&a, sizeof(a))) return false;
+        std::thread([this] {
+            uint8_t b[64];
+            for(;;) {
+                sockaddr_in a; socklen_t al = sizeof(a);
+                int n = recvfrom(s, b, sizeof(b), 0, (sockaddr *)&a, &al);
+                if(n <= 0) continue;
+                uint32_t x = ntohl(a.sin_addr.s_addr);
+                AsyncUDPPacket p;
+                p.d = b; p.l = n; p.ip = IPAddress(x >> 24, x >> 16, x >> 8, x); p.p = ntohs(a.sin_port);
+                cb(arg, p);
+            }
+        }).detach();
+        return true;
+    }
+    bool listenMulticast(IPAddress, uint16_t port) { return listen(port); }
+    size_t writeTo(const uint8_t *d, size_t l, IPAddress ip, uint16_t port) {
+        sockaddr_in a = {};
+        a.sin_family = AF_INET; a.sin_port = htons(port);
+        inet_pton(AF_INET, ip[0] == 224 ? "127.0.0.2" : ip.toString(), &a.sin_addr);
+        return sendto(s, d, l, 0, (sockaddr *)&a, sizeof(a));
+    }
+    void close() {}
+  private:
+    int s = -1;
+    AuPacketHandlerFunctionWithArg cb = NULL;
+    void *arg = NULL;
+};
@@ -0,0 +1,258 @@
+/*
+ * FS stand-in for host builds, on top of stdio and dirent
+ */
+#include <stdarg.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "FS.h"
+#include "LittleFS.h"
+#include "SPI.h"
+#include "src/SD/SD.h"
+
+using namespace fs;
+
+FSStats fs::fsStats;
+
+fs::SDFS::SDFS(FSImplPtr impl) : FS(impl) {}
+fs::SDFS SD(NULL);
+fs::LittleFSFS LittleFS;
+SPIClass SPI;
+
+class fs::FileImpl {
+  public:
+    ~FileImpl()  { close(); }
+    void close() {
+        if(f) fclose(f);
+        if(d) closedir(d);
+        f = NULL;
+        d = NULL;
+    }
+    FILE        *f = NULL;
+    DIR         *d = NULL;
+    std::string hpath;      // Host path
+    std::string vpath;      // Our path
+    std::string mode;
+};
+
+static std::string baseName(const std::string &p)
+{
+    size_t i = p.rfind('/');
+    return (i == std::string::npos) ? p : p.substr(i + 1);
+}
+
+std::string FS::hostPath(const char *path)
+{
+    return root + ((*path == '/') ? "" : "/") + path;
+}
+
+// FAT lookup: Directory entries are scanned in order
+static void simLookup(const std::string &hp)
+{
+    fsStats.lookups++;
+    if(!fsStats.lookupUs && !fsStats.entryUs) return;
+
+    size_t i = hp.rfind('/');
+    std::string dir = (i == std::string::npos) ? "." : hp.substr(0, i), name = baseName(hp);
+    uint32_t n = 0;
+    DIR *d = opendir(dir.c_str());
+    struct dirent *de;
+    while(d && (de = readdir(d))) {
+        if(!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+        n++;
+        if(name == de->d_name) break;
+    }
+    if(d) closedir(d);
+    fsStats.simUs += fsStats.lookupUs + (uint64_t)n * fsStats.entryUs;
+}
+
+File FS::open(const char *path, const char *mode, const bool create)
+{
+    struct stat st;
+    std::string hp = hostPath(path);
+    FileImplPtr p = std::make_shared<FileImpl>();
+
+    (void)create;
+    simLookup(hp);
+    p->hpath = hp;
+    p->vpath = path;
+    p->mode = mode;
+
+    if(!stat(hp.c_str(), &st) && S_ISDIR(st.st_mode)) {
+        if(!(p->d = opendir(hp.c_str()))) return File();
+    } else if(!(p->f = fopen(hp.c_str(), (*mode == 'r') ? "rb" : ((*mode == 'a') ? "ab" : "wb")))) {
+        return File();
+    }
+    fsStats.opens++;
+    if(fsStats.openDelayUs) usleep(fsStats.openDelayUs);
+    return File(p);
+}
+
+bool FS::exists(const char *path)
+{
+    struct stat st;
+    simLookup(hostPath(path));
+    return !stat(hostPath(path).c_str(), &st);
+}
+
+bool FS::remove(const char *path)
+{
+    return !unlink(hostPath(path).c_str());
+}
+
+static void simCut(uint32_t &n)
+{
+    if(n && !--n) throw PowerCut();
+}
+
+bool FS::rename(const char *from, const char *to)
+{
+    fsStats.renames++;
+    simCut(fsStats.cutRename);
+    simLookup(hostPath(from));
+    simLookup(hostPath(to));
+    return !::rename(hostPath(from).c_str(), hostPath(to).c_str());
+}
+
+bool FS::mkdir(const char *path)
+{
+    return !::mkdir(hostPath(path).c_str(), 0755);
+}
+
+bool FS::rmdir(const char *path)
+{
+    return !::rmdir(hostPath(path).c_str());
+}
+
+size_t File::write(const uint8_t *buf, size_t size)
+{
+    if(!impl || !impl->f) return 0;
+    fsStats.writes++;
+    simCut(fsStats.cutWrite);
+    return fwrite(buf, 1, size, impl->f);
+}
+
+size_t File::read(uint8_t *buf, size_t size)
+{
+    if(!impl || !impl->f) return 0;
+    fsStats.reads++;
+    fsStats.simUs += fsStats.readUs;
+    if(fsStats.readDelayUs) usleep(fsStats.readDelayUs);
+    size = fread(buf, 1, size, impl->f);
+    fsStats.readBytes += size;
+    return size;
+}
+
+int File::read()
+{
+    uint8_t c;
+    return (read(&c, 1) == 1) ? c : -1;
+}
+
+int File::available()
+{
+    return impl && impl->f ? (int)(size() - position()) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode)
+{
+    if(!impl || !impl->f) return false;
+    fsStats.seeks++;
+    return !fseek(impl->f, pos, (mode == SeekSet) ? SEEK_SET : ((mode == SeekCur) ? SEEK_CUR : SEEK_END));
+}
+
+size_t File::position() const
+{
+    return (impl && impl->f) ? ftell(impl->f) : 0;
+}
+
+size_t File::size() const
+{
+    struct stat st;
+    if(!impl || !impl->f) return 0;
+    fflush(impl->f);
+    return fstat(fileno(impl->f), &st) ? 0 : st.st_size;
+}
+
+void File::close()
+{
+    if(impl) impl->close();
+    impl.reset();
+}
+
+File::operator bool() const
+{
+    return impl && (impl->f || impl->d);
+}
+
+const char *File::path() const
+{
+    return impl ? impl->vpath.c_str() : NULL;
+}
+
+const char *File::name() const
+{
+    static std::string n;
+    if(!impl) return NULL;
+    n = baseName(impl->vpath);
+    return n.c_str();
+}
+
+time_t File::getLastWrite()
+{
+    struct stat st;
+    if(!impl || stat(impl->hpath.c_str(), &st)) return 0;
+    return st.st_mtime;
+}
+
+bool File::isDirectory()
+{
+    return impl && impl->d;
+}
+
+File File::openNextFile(const char *mode)
+{
+    struct dirent *e;
+
+    if(!impl || !impl->d) return File();
+
+    while((e = readdir(impl->d))) {
+        if(strcmp(e->d_name, ".") && strcmp(e->d_name, "..")) break;
+    }
+    if(!e) return File();
+    fsStats.simUs += fsStats.entryUs;
+
+    std::string vp = impl->vpath + ((impl->vpath.back() == '/') ? "" : "/") + e->d_name;
+    FileImplPtr p = std::make_shared<FileImpl>();
+    struct stat st;
+    p->hpath = impl->hpath + "/" + e->d_name;
+    p->vpath = vp;
+    p->mode = mode;
+    if(!stat(p->hpath.c_str(), &st) && S_ISDIR(st.st_mode)) {
+        if(!(p->d = opendir(p->hpath.c_str()))) return File();
+    } else if(!(p->f = fopen(p->hpath.c_str(), "rb"))) {
+        return File();
+    }
+    fsStats.opens++;
+    return File(p);
+}
+
+void File::rewindDirectory()
+{
+    if(impl && impl->d) rewinddir(impl->d);
+}
+
+size_t File::print(const char *s)
+{
+    return write((const uint8_t *)s, strlen(s));
+}
+
+size_t File::printf(const char *fmt, ...)
+{
+    char buf[512];
+    va_list a;
+    va_start(a, fmt);
+    int n = vsnprintf(buf, sizeof(buf), fmt, a);
+    va_end(a);
+    return write((const uint8_t *)buf, (n < (int)sizeof(buf)) ? n : sizeof(buf) - 1);
+}
@@ -0,0 +1,98 @@
+/*
+ * FS stand-in for host builds
+ *
+ * Files live in a host directory (setRoot(), default "."),
+ * "/a/b" is <root>/a/b. Reads can be slowed down to play a
+ * slow card, or the time of a card with a FAT be added up;
+ * all calls are counted in fsStats.
+ */
+#pragma once
+#include <memory>
+#include <string>
+#include <time.h>
+#include "Arduino.h"
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FSStats {
+    uint32_t opens, reads, seeks, writes;
+    uint64_t readBytes;
+    uint32_t readDelayUs;   // Per read() call
+    uint32_t openDelayUs;   // Per open()
+    // Simulated (not slept) card time, added up in simUs: Per
+    // path lookup (open(), exists()) plus per directory entry
+    // scanned to find the name (all if not found), per read()
+    uint32_t lookups;
+    uint32_t lookupUs, entryUs, readUs;
+    uint64_t simUs;
+    // Power loss: The n'th rename() or write() from now throws
+    // PowerCut (0 = never)
+    uint32_t renames;
+    uint32_t cutRename, cutWrite;
+};
+struct PowerCut {};
+extern FSStats fsStats;
+
+class FileImpl;
+typedef std::shared_ptr<FileImpl> FileImplPtr;
+class FSImpl;
+typedef std::shared_ptr<FSImpl> FSImplPtr;
+
+class File {
+  public:
+    File(FileImplPtr p = FileImplPtr()) : impl(p) {}
+
+    size_t write(uint8_t c)                     { return write(&c, 1); }
+    size_t write(const uint8_t *buf, size_t size);
+    size_t read(uint8_t *buf, size_t size);
+    int    read();
+    int    available();
+    void   flush()                              {}
+    bool   seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    void   close();
+    operator bool() const;
+    const char *path() const;
+    const char *name() const;
+    time_t getLastWrite();
+
+    bool   isDirectory();
+    File   openNextFile(const char *mode = FILE_READ);
+    void   rewindDirectory();
+
+    size_t print(const char *s);
+    size_t printf(const char *fmt, ...);
+
+  private:
+    FileImplPtr impl;
+};
+
+class FS {
+  public:
+    FS(FSImplPtr p = FSImplPtr()) { (void)p; }
+
+    void setRoot(const char *dir)               { root = dir; }
+    std::string hostPath(const char *path);
+
+    File open(const char *path, const char *mode = FILE_READ, const bool create = false);
+    bool exists(const char *path);
+    bool remove(const char *path);
+    bool rename(const char *from, const char *to);
+    bool mkdir(const char *path);
+    bool rmdir(const char *path);
+
+  protected:
+    std::string root = ".";
+};
+
+}
+
+using fs::FS;
+using fs::File;
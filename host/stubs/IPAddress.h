@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+class IPAddress {
+  public:
+    uint8_t b[4] = {0,0,0,0};
+    IPAddress() {}
+    IPAddress(uint32_t x) { memcpy(b,&x,4); }
+    operator uint32_t() const { uint32_t x; memcpy(&x,b,4); return x; }
+    IPAddress(uint8_t a, uint8_t c, uint8_t d, uint8_t e) { b[0]=a;b[1]=c;b[2]=d;b[3]=e; }
+    bool fromString(const char *s) { unsigned x[4]; char t; if(sscanf(s,"%u.%u.%u.%u%c",&x[0],&x[1],&x[2],&x[3],&t)!=4) return false; for(int i=0;i<4;i++){ if(x[i]>255) return false; b[i]=x[i]; } return true; }
+    uint8_t operator[](int i) const { return b[i]; }
+    bool operator==(const IPAddress &o) const { return !memcmp(b,o.b,4); }
+    bool operator!=(const IPAddress &o) const { return memcmp(b,o.b,4); }
+    const char *toString() const { static char x[16]; sprintf(x,"%d.%d.%d.%d",b[0],b[1],b[2],b[3]); return x; }
+};
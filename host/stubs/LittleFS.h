@@ -0,0 +1,14 @@
+/*
+ * LittleFS stand-in for host builds
+ */
+#pragma once
+#include "FS.h"
+
+namespace fs {
+class LittleFSFS : public FS {
+  public:
+    bool begin(bool formatOnFail = false) { (void)formatOnFail; return true; }
+};
+}
+
+extern fs::LittleFSFS LittleFS;
@@ -0,0 +1,52 @@
+/*
+ * I2S driver stand-in for host builds
+ *
+ * The "DMA" is i2sHost: i2s_write() takes up to "room" frames
+ * (no limit if negative) and appends them to "frames" if "keep"
+ * is set. Tests play the DMA side by setting room and clearing
+ * frames, and queue underrun events by counting up "events".
+ */
+#pragma once
+#include <utility>
+#include <vector>
+#include "Arduino.h"
+
+typedef int i2s_port_t;
+typedef int i2s_mode_t;
+typedef int i2s_comm_format_t;
+enum {
+    I2S_MODE_MASTER = 1, I2S_MODE_TX = 4, I2S_MODE_DAC_BUILT_IN = 16, I2S_MODE_PDM = 64,
+    I2S_COMM_FORMAT_STAND_I2S = 1, I2S_COMM_FORMAT_STAND_MSB = 2,
+    I2S_BITS_PER_SAMPLE_16BIT = 16, I2S_CHANNEL_FMT_RIGHT_LEFT = 0,
+    I2S_PIN_NO_CHANGE = -1, I2S_DAC_CHANNEL_BOTH_EN = 3
+};
+typedef struct {
+    int  mode, sample_rate, bits_per_sample, channel_format, communication_format;
+    int  intr_alloc_flags, dma_buf_count, dma_buf_len, use_apll;
+    bool tx_desc_auto_clear;
+    int  fixed_mclk;
+} i2s_config_t;
+typedef struct { int bck_io_num, ws_io_num, data_out_num, data_in_num; } i2s_pin_config_t;
+typedef enum { I2S_EVENT_DMA_ERROR, I2S_EVENT_TX_DONE, I2S_EVENT_RX_DONE, I2S_EVENT_TX_Q_OVF, I2S_EVENT_RX_Q_OVF } i2s_event_type_t;
+typedef struct { i2s_event_type_t type; size_t size; } i2s_event_t;
+
+struct I2SHost {
+    std::vector<uint32_t> frames;
+    long     room = -1;
+    bool     keep = true;
+    bool     installed = false;
+    int      rate = 0;
+    uint32_t writes = 0;
+    uint32_t events = 0;        // Pending TX_Q_OVF
+    std::vector<std::pair<size_t, int>> rates;  // frames.size() at each rate change
+    void clear() { frames.clear(); rates.clear(); writes = 0; }
+};
+extern I2SHost i2sHost;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *cfg, int qsize, void *queue);
+esp_err_t i2s_driver_uninstall(i2s_port_t port);
+esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t *pins);
+esp_err_t i2s_set_dac_mode(int mode);
+esp_err_t i2s_zero_dma_buffer(i2s_port_t port);
+esp_err_t i2s_write(i2s_port_t port, const void *src, size_t size, size_t *written, uint32_t ticks);
+esp_err_t i2s_set_sample_rates(i2s_port_t port, uint32_t rate);
@@ -0,0 +1,62 @@
+/*
+ * I2S driver stand-in for host builds
+ */
+#include "driver/i2s.h"
+
+I2SHost i2sHost;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t *cfg, int qsize, void *queue)
+{
+    (void)port;
+    i2sHost.installed = true;
+    i2sHost.rate = cfg->sample_rate;
+    i2sHost.events = 0;
+    if(qsize && queue) *(QueueHandle_t *)queue = &i2sHost;
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t)
+{
+    i2sHost.installed = false;
+    return ESP_OK;
+}
+
+esp_err_t i2s_set_pin(i2s_port_t, const i2s_pin_config_t *)  { return ESP_OK; }
+esp_err_t i2s_set_dac_mode(int)                             { return ESP_OK; }
+esp_err_t i2s_zero_dma_buffer(i2s_port_t)                   { return ESP_OK; }
+
+esp_err_t i2s_set_sample_rates(i2s_port_t, uint32_t rate)
+{
+    i2sHost.rate = rate;
+    i2sHost.rates.push_back({ i2sHost.frames.size(), (int)rate });
+    return ESP_OK;
+}
+
+esp_err_t i2s_write(i2s_port_t, const void *src, size_t size, size_t *written, uint32_t)
+{
+    size_t n = size / sizeof(uint32_t);
+    const uint32_t *s = (const uint32_t *)src;
+
+    if(i2sHost.room >= 0 && n > (size_t)i2sHost.room) n = i2sHost.room;
+    if(i2sHost.room >= 0) i2sHost.room -= n;
+    if(i2sHost.keep) i2sHost.frames.insert(i2sHost.frames.end(), s, s + n);
+    i2sHost.writes++;
+    *written = n * sizeof(uint32_t);
+    return ESP_OK;
+}
+
+// The only queue in host builds is the I2S event queue
+int xQueueReset(QueueHandle_t)
+{
+    i2sHost.events = 0;
+    return pdTRUE;
+}
+
+int xQueueReceive(QueueHandle_t, void *item, uint32_t)
+{
+    if(!i2sHost.events) return 0;
+    i2sHost.events--;
+    ((i2s_event_t *)item)->type = I2S_EVENT_TX_Q_OVF;
+    ((i2s_event_t *)item)->size = 0;
+    return pdTRUE;
+}
@@ -0,0 +1,6 @@
+/*
+ * Forced include for the polled builds: Sketch configuration,
+ * but BTTFN through WiFiUDP polled from the main loop
+ */
+#include "vsr_global.h"
+#undef VSR_BTTFN_ASYNC
@@ -0,0 +1,109 @@
+/*
+ * MP3 synthesis at full vs. half sample rate
+ *
+ * Decodes each corpus file into frames once (libmad, stereo and
+ * mono as with MAD_OPTION_SINGLECHANNEL), then times only the
+ * synthesis of those frames, the way AudioGeneratorMP3 does it
+ * (mad_synth_frame_interleaved(), one granule at a time), with
+ * and without MAD_OPTION_HALFSAMPLERATE. Reports us per frame
+ * for decoding and both syntheses; half rate must put out half
+ * the samples and cost clearly less.
+ */
+#include <vector>
+#include "Arduino.h"
+#include "audiohost.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static const char *files[] = { "s44", "lr44", "s32", "s22", "m44" };
+
+static std::vector<mad_frame> decodeFrames(const std::vector<uint8_t> &mp3, int options, double *decUs)
+{
+    std::vector<uint8_t> buf(mp3);
+    std::vector<mad_frame> frames;
+    static mad_stream stream;
+    static mad_frame frame;
+    unsigned long t0 = micros(), t;
+    uint64_t n = 0;
+
+    buf.resize(buf.size() + MAD_BUFFER_GUARD);
+    do {
+        bool first = frames.empty();
+        mad_stream_init(&stream);
+        mad_frame_init(&frame);
+        mad_stream_options(&stream, options);
+        mad_stream_buffer(&stream, buf.data(), buf.size());
+        for(;;) {
+            if(mad_frame_decode(&frame, &stream)) {
+                if(MAD_RECOVERABLE(stream.error)) continue;
+                break;
+            }
+            if(first) frames.push_back(frame);
+            n++;
+        }
+    } while(n && (t = micros() - t0) < 200000);
+    *decUs = n ? (double)t / n : 0;
+
+    return frames;
+}
+
+// us per frame; *samples: Samples per channel, first pass
+static double synthUs(std::vector<mad_frame> &frames, bool half, size_t *samples)
+{
+    static mad_synth synth;
+    int16_t out[2 * 32 * 8];
+    unsigned long t0 = micros(), t;
+    uint64_t n = 0;
+
+    *samples = 0;
+    for(auto &f : frames) {
+        if(half) f.options |= MAD_OPTION_HALFSAMPLERATE;
+        else     f.options &= ~MAD_OPTION_HALFSAMPLERATE;
+    }
+    mad_synth_init(&synth);
+    do {
+        for(auto &f : frames) {
+            unsigned int ns = MAD_NSBSAMPLES(&f.header);
+            for(unsigned int s = 0; s < ns; s += 8) {
+                int len = mad_synth_frame_interleaved(&synth, &f, s, s + 8, out);
+                if(!n) *samples += len;
+            }
+        }
+        n += frames.size();
+    } while((t = micros() - t0) < 200000);
+
+    return (double)t / n;
+}
+
+int main()
+{
+    int fails = 0;
+
+    printf("us/frame          decode   synth full   synth half  (x)   decode+synth saved\n");
+    for(const char *name : files) {
+        MemSource src;
+        if(!src.open(corpusPath(name).c_str())) {
+            printf("FAIL: %s missing\n", name);
+            fails++;
+            continue;
+        }
+        for(int mono = 0; mono <= 1; mono++) {
+            double dec;
+            std::vector<mad_frame> frames = decodeFrames(src.data, mono ? MAD_OPTION_SINGLECHANNEL : 0, &dec);
+            size_t nf, nh;
+            double full = synthUs(frames, false, &nf);
+            double half = synthUs(frames, true, &nh);
+            if(frames.empty() || nh * 2 != nf || half > 0.9 * full) {
+                printf("FAIL: %s: %zu frames, %zu/%zu samples full/half, %.1f/%.1f us\n",
+                    name, frames.size(), nf, nh, full, half);
+                fails++;
+            }
+            printf("%-5s %-6s %9.1f %12.1f %12.1f  (%.2f)  %5.0f%%\n", name, mono ? "mono" : "stereo",
+                dec, full, half, half / full, 100 * (full - half) / (dec + full));
+        }
+    }
+
+    printf("%s\n", fails ? "synth_bench: FAILED" : "synth_bench: OK");
+    return fails ? 1 : 0;
+}
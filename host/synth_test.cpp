@@ -0,0 +1,146 @@
+/*
+ * mad_synth_frame_interleaved() vs. the synth it replaced
+ *
+ * Decodes each corpus file into frames (stereo, and mono as with
+ * MAD_OPTION_SINGLECHANNEL), then synthesizes them at full and
+ * half rate twice: As AudioGeneratorMP3 did before (per ns with
+ * mad_synth_frame_onens() from synth.c as it was, ref/, then
+ * copied from synth->pcm into an interleaved buffer), and as it
+ * does now (one granule at a time straight into the buffer).
+ * Output must be bit-exact; then frames/s for both.
+ */
+#include <vector>
+#include "Arduino.h"
+#include "audiohost.h"
+#include "src/ESP8266Audio/AudioGeneratorMP3.h"
+
+extern "C" {
+void old_mad_synth_init(struct mad_synth *);
+enum mad_flow old_mad_synth_frame_onens(struct mad_synth *, struct mad_frame const *, unsigned int);
+}
+
+unsigned long millis() { return micros() / 1000; }
+
+static const char *files[] = { "s44", "lr44", "s32", "s22", "vbr44", "m44", "m22" };
+
+static const int GRANULE = 18;
+
+static std::vector<mad_frame> decodeFrames(std::vector<uint8_t> buf, int options)
+{
+    std::vector<mad_frame> frames;
+    static mad_stream stream;
+    static mad_frame frame;
+
+    buf.resize(buf.size() + MAD_BUFFER_GUARD);
+    mad_stream_init(&stream);
+    mad_frame_init(&frame);
+    mad_stream_options(&stream, options);
+    mad_stream_buffer(&stream, buf.data(), buf.size());
+    for(;;) {
+        if(mad_frame_decode(&frame, &stream)) {
+            if(MAD_RECOVERABLE(stream.error)) continue;
+            break;
+        }
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// Old: One ns per call, copy from synth->pcm
+static void synthOld(const std::vector<mad_frame> &frames, std::vector<int16_t> *out)
+{
+    static mad_synth synth;
+    int16_t buf[2 * 32];
+
+    old_mad_synth_init(&synth);
+    for(auto &f : frames) {
+        unsigned int ns = MAD_NSBSAMPLES(&f.header);
+        for(unsigned int s = 0; s < ns; s++) {
+            old_mad_synth_frame_onens(&synth, &f, s);
+            const int16_t *l = synth.pcm.samples[0];
+            const int16_t *r = synth.pcm.samples[1];
+            int16_t *d = buf;
+            for(int i = 0; i < synth.pcm.length; i++) {
+                *d++ = *l++;
+                *d++ = *r++;
+            }
+            if(out) out->insert(out->end(), buf, buf + 2 * synth.pcm.length);
+        }
+    }
+}
+
+// New: One granule per call, straight into the buffer
+static void synthNew(const std::vector<mad_frame> &frames, std::vector<int16_t> *out)
+{
+    static mad_synth synth;
+    int16_t buf[2 * GRANULE * 32];
+
+    mad_synth_init(&synth);
+    for(auto &f : frames) {
+        unsigned int ns = MAD_NSBSAMPLES(&f.header);
+        for(unsigned int s = 0; s < ns; s += GRANULE) {
+            int len = mad_synth_frame_interleaved(&synth, &f, s, s + GRANULE, buf);
+            if(out) out->insert(out->end(), buf, buf + 2 * len);
+        }
+    }
+}
+
+template<class F> static double fps(F synth, const std::vector<mad_frame> &frames, size_t len)
+{
+    unsigned long t0 = micros(), t;
+    int reps = 0;
+
+    do {
+        synth(frames, NULL);
+        reps++;
+    } while((t = micros() - t0) < 200000);
+
+    return (double)reps * len / t * 1e6;
+}
+
+int main()
+{
+    int fails = 0;
+
+    printf("Mframes/s                  old     new\n");
+    for(const char *name : files) {
+        MemSource src;
+        if(!src.open(corpusPath(name).c_str())) {
+            printf("FAIL: %s missing\n", name);
+            fails++;
+            continue;
+        }
+        for(int mono = 0; mono <= 1; mono++) {
+            std::vector<mad_frame> frames = decodeFrames(src.data, mono ? MAD_OPTION_SINGLECHANNEL : 0);
+            for(int half = 0; half <= 1; half++) {
+                for(auto &f : frames) {
+                    if(half) f.options |= MAD_OPTION_HALFSAMPLERATE;
+                    else     f.options &= ~MAD_OPTION_HALFSAMPLERATE;
+                }
+                std::vector<int16_t> a, b;
+                synthOld(frames, &a);
+                synthNew(frames, &b);
+
+                // One channel (mono file or downmix): Only L is written
+                bool two = !frames.empty() && !mono && MAD_NCHANNELS(&frames[0].header) == 2;
+                size_t bad = (a.size() != b.size()) || a.empty();
+                for(size_t i = 0; !bad && i < a.size(); i += 2) {
+                    bad += (a[i] != b[i]) || (two && a[i+1] != b[i+1]);
+                }
+                if(bad) {
+                    printf("FAIL: %s %s %s: %zu vs %zu samples, or output differs\n", name,
+                        mono ? "mono" : "stereo", half ? "half" : "full", a.size(), b.size());
+                    fails++;
+                }
+
+                size_t len = a.size() / 2;
+                double fo = fps(synthOld, frames, len), fn = fps(synthNew, frames, len);
+                printf("%-5s %-6s %-4s %s %7.2f %7.2f  (x%.2f)\n", name, mono ? "mono" : "stereo",
+                    half ? "half" : "full", bad ? "differs  " : "bit-exact", fo / 1e6, fn / 1e6, fn / fo);
+            }
+        }
+    }
+
+    printf("%s\n", fails ? "synth_test: FAILED" : "synth_test: OK");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Loopback network and simulated TCD for host builds
+ *
+ * The client (VSR) lives on 127.0.0.1, the TCD on 127.0.0.2;
+ * multicast destinations are mapped to the respective peer.
+ * Requires a loopback interface answering all of 127/8 (Linux).
+ */
+#pragma once
+
+#include <initializer_list>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "Udp.h"
+#include "bttfn.h"
+
+static int mksock(const char *ip, int port)
+{
+    int s = socket(AF_INET, SOCK_DGRAM, 0), one = 1;
+    sockaddr_in a = {};
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    inet_pton(AF_INET, ip, &a.sin_addr);
+    if(bind(s, (sockaddr *)&a, sizeof(a))) { perror("bind"); exit(1); }
+    fcntl(s, F_SETFL, O_NONBLOCK);
+    return s;
+}
+
+static void tcd_csum(uint8_t *b)
+{
+    uint8_t a = 0;
+    for(int i = 4; i < 47; i++) a += b[i] ^ 0x55;
+    b[47] = a;
+}
+
+// WiFiUDP stand-in on a non-blocking socket
+class SockUDP : public UDP {
+  public:
+    SockUDP(const char *me, const char *peer) : me(me), peer(peer) {}
+    uint8_t begin(uint16_t p) { s = mksock(me, p); return 1; }
+    uint8_t beginMulticast(IPAddress, uint16_t p) { return begin(p); }
+    void stop() {}
+    int beginPacket(IPAddress ip, uint16_t port) {
+        dst = {}; dst.sin_family = AF_INET; dst.sin_port = htons(port);
+        inet_pton(AF_INET, ip[0] == 224 ? peer : ip.toString(), &dst.sin_addr);
+        txl = 0;
+        return 1;
+    }
+    int beginPacket(const char *, uint16_t) { return 0; }
+    size_t write(const uint8_t *b, size_t l) { memcpy(tx + txl, b, l); txl += l; return l; }
+    size_t write(uint8_t) { return 0; }
+    int endPacket() { return sendto(s, tx, txl, 0, (sockaddr *)&dst, sizeof(dst)) == txl; }
+    int parsePacket() {
+        sockaddr_in a; socklen_t al = sizeof(a);
+        rxl = recvfrom(s, rx, sizeof(rx), 0, (sockaddr *)&a, &al);
+        if(rxl <= 0) return rxl = 0;
+        uint32_t x = ntohl(a.sin_addr.s_addr);
+        rip = IPAddress(x >> 24, x >> 16, x >> 8, x);
+        return rxl;
+    }
+    int available() { return rxl; }
+    int read(unsigned char *b, size_t l) { memcpy(b, rx, l < (size_t)rxl ? l : rxl); return rxl; }
+    int read(char *b, size_t l) { return read((unsigned char *)b, l); }
+    int read() { return -1; }
+    int peek() { return -1; }
+    void flush() {}
+    IPAddress remoteIP() { return rip; }
+    uint16_t remotePort() { return 0; }
+  private:
+    const char *me, *peer;
+    int s = -1;
+    uint8_t rx[64], tx[64];
+    int rxl = 0, txl = 0;
+    IPAddress rip;
+    sockaddr_in dst;
+};
+
+// Simulated TCD, driven from the test's loop through poll()
+struct TCD {
+    int s, sd;
+    uint32_t hash = 0;
+    uint32_t notSeq = 1;
+    int      dropResp = 0;      // Drop this many requests
+    int      served = 0;        // Requests answered
+    bool     nd = false;        // Push NOT_DATA every second
+    uint32_t ndSeq = 1, session = 0x1234;
+    unsigned long lastND = 0;
+
+    TCD(const char *name) {
+        s = mksock("127.0.0.2", 1338);
+        sd = mksock("127.0.0.2", 1339);
+        for(const unsigned char *p = (const unsigned char *)name; *p; p++) hash = 37 * hash + tolower(*p);
+    }
+    void to(uint8_t *b, int port) {
+        sockaddr_in a = {};
+        a.sin_family = AF_INET; a.sin_port = htons(port);
+        inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+        sendto(s, b, 48, 0, (sockaddr *)&a, sizeof(a));
+    }
+    void poll() {
+        uint8_t b[64]; sockaddr_in a; socklen_t al = sizeof(a);
+        for(int sk : { s, sd }) {
+            while(recvfrom(sk, b, 64, 0, (sockaddr *)&a, &al) == 48) {
+                // DISCOVER: Only answer if our hostname is asked for
+                if((b[5] & 0x80) && sk == sd && GET32(b, 31) != hash) continue;
+                if(b[25] == BTTFN_REMCMD_KEEPALIVE) continue;
+                if(dropResp > 0) { dropResp--; continue; }
+                served++;
+                b[4] = BTTFN_VERSION | 0x80;
+                b[31] = (b[5] & 0x40) ? (0x01 | 0x10) : 0;   // Caps: Speed by mc, NOT_DATA
+                b[18] = 55; b[19] = 0; b[20] = 0x00; b[21] = 0x80; b[26] = 0;
+                tcd_csum(b);
+                to(b, ntohs(a.sin_port));
+            }
+        }
+        if(nd && millis() - lastND > 1000) {
+            uint8_t n[48] = { 'B', 'T', 'T', 'F' };
+            lastND = millis();
+            n[4] = BTTFN_VERSION | 0x40; n[5] = BTTFN_NOT_DATA | 0x12;
+            SET32(n, 6, ndSeq); ndSeq++;
+            SET32(n, 27, session);
+            n[18] = 60;
+            tcd_csum(n);
+            to(n, 1338);
+        }
+    }
+    void notify(uint8_t type, int mcast, uint16_t a1 = 0, uint16_t a2 = 0) {
+        uint8_t n[48] = { 'B', 'T', 'T', 'F' };
+        n[4] = BTTFN_VERSION | 0x40; n[5] = type;
+        n[6] = a1; n[7] = a1 >> 8; n[8] = a2; n[9] = a2 >> 8;
+        SET32(n, 12, notSeq); notSeq++;
+        tcd_csum(n);
+        to(n, mcast ? 1340 : 1338);
+    }
+};
@@ -0,0 +1,80 @@
+/*
+ * AudioGeneratorWAVLoop: Block path vs. old per-sample path
+ *
+ * Plays 8 and 16 bit, mono and stereo WAV data from memory
+ * through the current generator and the one from before the
+ * block path (ref/), into an output taking a DMA-sized piece
+ * per loop. Output must be the same; then frames/s for each.
+ */
+#include <vector>
+#include <algorithm>
+#include "Arduino.h"
+#include "audiohost.h"
+#include "AudioGeneratorWAVLoop.h"
+#include "ref/AudioGeneratorWAVOld.h"
+
+unsigned long millis() { return micros() / 1000; }
+
+static std::vector<uint8_t> mkWAV(int chnls, int bits, int frames)
+{
+    std::vector<int16_t> pcm(frames * chnls);
+    for(auto &s : pcm) s = (int16_t)(rand() & 0xffff);
+    writeWAV("/tmp/wav_bench.wav", pcm, chnls, 44100, bits);
+    MemSource m;
+    m.open("/tmp/wav_bench.wav");
+    remove("/tmp/wav_bench.wav");
+    return m.data;
+}
+
+static const int FRAMES = 100003;
+
+template<class Gen> static double play(const std::vector<uint8_t> &wav, PCMSink &sink)
+{
+    Gen gen;
+    MemSource src(wav);
+    int reps = 0;
+    unsigned long t0 = micros(), t;
+
+    // Once for the output, then repeat for timing
+    do {
+        src.rewind();
+        if(!gen.begin(&src, &sink)) return 0;
+        do {
+            sink.room = 512;
+        } while(gen.loop());
+        gen.stop();
+        sink.keep = false;
+        reps++;
+    } while((t = micros() - t0) < 300000);
+
+    return (double)reps * FRAMES / (t / 1e6);
+}
+
+int main()
+{
+    int fails = 0;
+
+    srand(1);
+
+    printf("              old       new   Mframes/s\n");
+    for(int bits = 8; bits <= 16; bits += 8) {
+        for(int ch = 1; ch <= 2; ch++) {
+            std::vector<uint8_t> wav = mkWAV(ch, bits, FRAMES);
+            PCMSink a, b;
+            double fo = play<AudioGeneratorWAVOld>(wav, a);
+            double fn = play<AudioGeneratorWAVLoop>(wav, b);
+            // First pass is kept. The old path puts out its
+            // stored sample, still zero, before the first frame
+            if(b.pcm.size() != 2 * FRAMES || a.pcm.size() != b.pcm.size() + 2 || a.pcm[0] || a.pcm[1] ||
+               !std::equal(b.pcm.begin(), b.pcm.end(), a.pcm.begin() + 2)) {
+                printf("FAIL: %d bit, %d channel(s): Output differs\n", bits, ch);
+                fails++;
+            }
+            printf("%2d bit %-6s %6.1f    %6.1f   (x%.1f)\n", bits, ch == 1 ? "mono" : "stereo",
+                fo / 1e6, fn / 1e6, fn / fo);
+        }
+    }
+
+    printf("%s\n", fails ? "wav_bench: FAILED" : "wav_bench: OK");
+    return fails ? 1 : 0;
+}
@@ -2,6 +2,7 @@
  * AudioFileSourceLoop
  * Read SD/SPIFFS/LittleFS file to be used by AudioGenerator
  * Reads file in a loop (for looped playback)
+ * Reads ahead in chunks aligned to file offsets
  * 
  * Thomas Winischhofer (A10001986), 2023
  *
@@ -14,20 +15,202 @@
 
 AudioFileSourceLoop::~AudioFileSourceLoop()
 {
+    close();
+}
+
+bool AudioFileSourceLoop::close()
+{
+    lock();
     if(f) f.close();
+    if(cbuf[0]) {
+        if(cbuf[0] != extBuf) free(cbuf[0]);
+        cbuf[0] = cbuf[1] = NULL;
+    }
+    unlock();
+    return true;
 }
 
-uint32_t AudioFileSourceLoop::read(void *data, uint32_t len)
+/*
+ * Read-ahead buffering
+ * 
+ * Reads from the file are done in whole chunks, at offsets
+ * that are multiples of the chunk size, so FAT can transfer
+ * entire sectors directly. We keep two chunks: the one being
+ * read from, and the next one, which loop() fetches ahead of
+ * time while the generator is idle. At EOF in loop mode, the
+ * "next" chunk is the one holding startPos, so restarting the
+ * loop is just a switch of chunks. Files that fit into two 
+ * chunks are therefore read only once.
+ *
+ * With VSR_AUDIO_TASK, loop() only notes which chunk is
+ * wanted, and the feed task fetches it in refill() right
+ * after topping up the DMA buffers, so the decoder task
+ * does not wait for the card. Whoever touches the file or
+ * switches chunks holds "busy"; refill() never waits for it.
+ */
+bool AudioFileSourceLoop::initBuf()
+{
+    lock();
+
+    rdPos = 0;
+    #ifdef VSR_AUDIO_TASK
+    want = 0xffffffff;
+    #endif
+    ctag[0] = ctag[1] = 0xffffffff;
+    clen[0] = clen[1] = 0;
+    cur = 0;
+
+    if(!f) {
+        unlock();
+        return false;
+    }
+
+    fsize = f.size();
+
+    if(!cbuf[0]) {
+        if((cbuf[0] = extBuf ? extBuf : (uint8_t *)malloc(2 * AFSL_CHUNK))) {
+            cbuf[1] = cbuf[0] + AFSL_CHUNK;
+        }
+    }
+
+    unlock();
+    return true;
+}
+
+#ifdef VSR_AUDIO_TASK
+void AudioFileSourceLoop::lock()
+{
+    while(__atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE)) {
+        vTaskDelay(1);
+    }
+}
+
+bool AudioFileSourceLoop::refill()
+{
+    uint32_t w = want;
+
+    if(w == 0xffffffff || __atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE))
+        return false;
+
+    if(cbuf[0] && f) getChunk(w);
+    __atomic_compare_exchange_n(&want, &w, 0xffffffff, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+    unlock();
+    return true;
+}
+#endif
+
+AudioTiming AudioFileSourceLoop::readStats;
+
+int AudioFileSourceLoop::getChunk(uint32_t pos)
 {
+    uint32_t base = pos & ~(AFSL_CHUNK - 1);
+    int i;
+
+    if(ctag[cur] == base)       return cur;
+    if(ctag[cur ^ 1] == base)   return cur ^ 1;
+
+    // Never overwrite the chunk we're reading from
+    i = cur ^ 1;
+
+    unsigned long now = micros();
+    if(!f.seek(base)) return -1;
+    clen[i] = f.read(cbuf[i], (fsize - base < AFSL_CHUNK) ? fsize - base : AFSL_CHUNK);
+    ctag[i] = base;
+    readStats.add(micros() - now);
+
+    return i;
+}
+
+uint32_t AudioFileSourceLoop::readDirect(void *data, uint32_t len)
+{
+    unsigned long now = micros();
     uint32_t glen = f.read(reinterpret_cast<uint8_t*>(data), len);
-    if(!doPlayLoop || glen == len) return glen;
-    seek(startPos, SEEK_SET);
-    return glen + f.read(reinterpret_cast<uint8_t*>(data) + glen, len - glen);
+    if(doPlayLoop && glen < len) {
+        f.seek(startPos);
+        glen += f.read(reinterpret_cast<uint8_t*>(data) + glen, len - glen);
+    }
+    readStats.add(micros() - now);
+    return glen;
+}
+
+uint32_t AudioFileSourceLoop::read(void *data, uint32_t len)
+{
+    uint8_t *d = reinterpret_cast<uint8_t*>(data);
+    uint32_t done = 0;
+
+    if(!cbuf[0]) return readDirect(data, len);
+
+    while(done < len) {
+        if(rdPos >= fsize) {
+            if(!doPlayLoop || (uint32_t)startPos >= fsize) break;
+            rdPos = startPos;
+        }
+
+        // refill() only ever fills the other chunk, so
+        // only switching chunks needs the lock
+        int i = cur;
+        if(ctag[i] != (rdPos & ~(AFSL_CHUNK - 1))) {
+            lock();
+            if((i = getChunk(rdPos)) >= 0) cur = i;
+            unlock();
+            if(i < 0) break;
+        }
+
+        uint32_t off = rdPos - ctag[i];
+        if(off >= clen[i]) break;     // Short read from file
+        uint32_t n = clen[i] - off;
+        if(n > len - done) n = len - done;
+
+        memcpy(d + done, cbuf[i] + off, n);
+        done += n;
+        rdPos += n;
+    }
+
+    return done;
+}
+
+bool AudioFileSourceLoop::loop()
+{
+    uint32_t next;
+
+    if(!cbuf[0] || ctag[cur] == 0xffffffff) return true;
+
+    next = ctag[cur] + AFSL_CHUNK;
+    if(next >= fsize) {
+        if(!doPlayLoop || (uint32_t)startPos >= fsize) return true;
+        next = startPos;
+    }
+
+    #ifdef VSR_AUDIO_TASK
+    if(ctag[cur ^ 1] != (next & ~(AFSL_CHUNK - 1))) want = next;
+    #else
+    getChunk(next);
+    #endif
+
+    return true;
+}
+
+uint32_t AudioFileSourceLoop::getPos()
+{
+    if(!f) return 0;
+    return cbuf[0] ? rdPos : f.position();
 }
 
 bool AudioFileSourceLoop::seek(int32_t pos, int dir)
 {
     if(!f) return false;
+
+    if(cbuf[0]) {
+        // Logical position only; data is fetched on read
+        if(dir == SEEK_CUR)      pos += rdPos;
+        else if(dir == SEEK_END) pos += fsize;
+        else if(dir != SEEK_SET) return false;
+        if(pos < 0 || (uint32_t)pos > fsize) return false;
+        rdPos = pos;
+        return true;
+    }
+
     if(dir == SEEK_SET)      return f.seek(pos);
     else if(dir == SEEK_CUR) return f.seek(f.position() + pos);
     else if(dir == SEEK_END) return f.seek(f.size() + pos);
@@ -49,8 +232,9 @@ AudioFileSourceSDLoop::AudioFileSourceSDLoop(const char *filename)
 
 bool AudioFileSourceSDLoop::open(const char *filename)
 {
+    close();
     f = SD.open(filename, FILE_READ);
-    return f;
+    return initBuf();
 }
 
 // FlashFS -------------------------------------------
@@ -68,6 +252,7 @@ AudioFileSourceFSLoop::AudioFileSourceFSLoop(const char *filename)
 
 bool AudioFileSourceFSLoop::open(const char *filename)
 {
+    close();
     f = LittleFS.open(filename, FILE_READ);
-    return f;
+    return initBuf();
 }
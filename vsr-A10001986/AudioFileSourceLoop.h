@@ -2,6 +2,7 @@
  * AudioFileSourceLoop
  * Read SD/SPIFFS/LittleFS file to be used by AudioGenerator
  * Reads file in a loop (for looped playback)
+ * Reads ahead in chunks aligned to file offsets
  * 
  * Thomas Winischhofer (A10001986), 2023
  *
@@ -16,6 +17,12 @@
 #include "src/SD/SD.h"
 #include <LittleFS.h>
 
+// Read-ahead: Two chunks; size must be a power of 2 and 
+// a multiple of the SD sector size (512)
+#ifndef AFSL_CHUNK
+#define AFSL_CHUNK 4096
+#endif
+
 class AudioFileSourceLoop : public AudioFileSource
 {
   public:
@@ -25,17 +32,56 @@ class AudioFileSourceLoop : public AudioFileSource
     virtual bool open(const char *filename) = 0;
     uint32_t read(void *data, uint32_t len) override;
     bool seek(int32_t pos, int dir) override;
-    bool close() override                 { f.close(); return true; }
+    bool close() override;
     bool isOpen() override                { return f ? true : false; }
     uint32_t getSize() override           { return f ? f.size() : 0; }
-    uint32_t getPos() override            { return f ? f.position() : 0; }
+    uint32_t getPos() override;
+    bool loop() override;
     void setStartPos(int32_t newStartPos) { startPos = newStartPos; }
     void setPlayLoop(bool playLoop)       { doPlayLoop = playLoop; }
+    // Use caller's buffer (2 * AFSL_CHUNK) instead of heap
+    void setBuffer(uint8_t *buf)          { extBuf = buf; }
+    #ifdef VSR_AUDIO_TASK
+    // Read-ahead on behalf of the reading task
+    bool refill();
+    #endif
+
+    // Time spent in file reads, all instances
+    static AudioTiming readStats;
 
   protected:
+    bool    initBuf();
+
     File    f;
     int32_t startPos = 0;
     bool    doPlayLoop = false;
+
+  private:
+    uint32_t readDirect(void *data, uint32_t len);
+    int     getChunk(uint32_t pos);
+    #ifdef VSR_AUDIO_TASK
+    void    lock();
+    void    unlock()                      { __atomic_store_n(&busy, 0, __ATOMIC_RELEASE); }
+    #else
+    void    lock()                        {}
+    void    unlock()                      {}
+    #endif
+
+    // Chunks are cached by file offset; if allocation 
+    // fails, we read directly from file.
+    uint8_t  *cbuf[2] = { NULL, NULL };
+    uint8_t  *extBuf = NULL;
+    uint32_t ctag[2];
+    uint32_t clen[2];
+    int      cur = 0;
+    uint32_t rdPos = 0;
+    uint32_t fsize = 0;
+
+    #ifdef VSR_AUDIO_TASK
+    // Chunk loop() asks refill() for, and file/chunk owner
+    volatile uint32_t want = 0xffffffff;
+    volatile uint8_t  busy = 0;
+    #endif
 };
 
 class AudioFileSourceSDLoop : public AudioFileSourceLoop
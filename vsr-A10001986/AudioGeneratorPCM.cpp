@@ -0,0 +1,66 @@
+/*
+ * AudioGeneratorPCM
+ * Plays mono 16 bit PCM from RAM
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#include "AudioGeneratorPCM.h"
+
+bool AudioGeneratorPCM::begin(const int16_t *pcm, uint32_t frames, int rate, AudioOutput *output)
+{
+    if(!pcm || !frames || !output) return false;
+
+    this->pcm = pcm;
+    this->frames = frames;
+    this->output = output;
+    pos = 0;
+    blkLen = blkPtr = 0;
+
+    output->SetRate(rate);
+    output->SetBitsPerSample(16);
+    output->SetChannels(1);
+    if(!output->begin()) return false;
+
+    running = true;
+    return true;
+}
+
+bool AudioGeneratorPCM::loop()
+{
+    if(!running) goto done;
+
+    while(1) {
+        if(blkPtr < blkLen) {
+            blkPtr += output->ConsumeSamples(blk + (blkPtr << 1), blkLen - blkPtr);
+            if(blkPtr < blkLen) goto done;   // Output full, try later
+        }
+
+        if(pos >= frames) {
+            // Like the other generators, stay "running"
+            // until caller stop()s us
+            output->loop();
+            return false;
+        }
+
+        blkLen = frames - pos;
+        if(blkLen > 32) blkLen = 32;
+        for(int i = 0; i < blkLen; i++) {
+            blk[i << 1] = pcm[pos++];
+        }
+        blkPtr = 0;
+    }
+
+done:
+    output->loop();
+    return running;
+}
+
+bool AudioGeneratorPCM::stop()
+{
+    if(!running) return true;
+    running = false;
+    output->stop();
+    return true;
+}
@@ -0,0 +1,36 @@
+/*
+ * AudioGeneratorPCM
+ * Plays mono 16 bit PCM from RAM
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#ifndef _AudioGeneratorPCM_H
+#define _AudioGeneratorPCM_H
+
+#include "src/ESP8266Audio/AudioGenerator.h"
+
+class AudioGeneratorPCM : public AudioGenerator
+{
+  public:
+    AudioGeneratorPCM() { running = false; }
+    virtual ~AudioGeneratorPCM() override {}
+    bool begin(const int16_t *pcm, uint32_t frames, int rate, AudioOutput *output);
+    virtual bool loop() override;
+    virtual bool stop() override;
+    virtual bool isRunning() override { return running; }
+
+  private:
+    const int16_t *pcm;
+    uint32_t frames;
+    uint32_t pos;
+
+    // Output wants interleaved frames; R slot is 
+    // ignored since we set channels to 1
+    int16_t  blk[2*32];
+    int      blkLen;
+    int      blkPtr;
+};
+
+#endif
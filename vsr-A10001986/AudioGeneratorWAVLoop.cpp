@@ -1,6 +1,7 @@
 /*
   AudioGeneratorWAVLoop
-  Audio output generator that reads 8 and 16-bit WAV files
+  Audio output generator that reads 8 and 16-bit PCM and 
+  IMA-ADPCM WAV files
   
   Copyright (C) 2017  Earle F. Philhower, III
   Adapted by Thomas Winischhofer (A10001986), 2023/2025
@@ -29,10 +30,12 @@ AudioGeneratorWAVLoop::AudioGeneratorWAVLoop()
     running = false;
     file = NULL;
     output = NULL;
-    buffSize = 128;
+    buffSize = 1024;
     buff = NULL;
+    extBuff = NULL;
     buffPtr = 0;
     buffLen = 0;
+    blkPtr = blkLen = 0;
 }
 
 AudioGeneratorWAVLoop::~AudioGeneratorWAVLoop()
@@ -56,95 +59,190 @@ bool AudioGeneratorWAVLoop::isRunning()
 
 bool AudioGeneratorWAVLoop::freeBuf()
 {
-    if(buff) free(buff);
+    if(buff && buff != extBuff) free(buff);
     buff = NULL;
     return false;
 }
 
 // Handle buffered reading, reload each time we run out of data
-bool AudioGeneratorWAVLoop::GetBufferedData16x2(int16_t& destL, int16_t& destR)
+bool AudioGeneratorWAVLoop::GetBufferedBlock()
 {
-    if(buffPtr >= buffLen) {
-        buffPtr = 0;
-        //uint32_t toRead = availBytes > buffSize ? buffSize : availBytes;
-        //buffLen = file->read( buff, toRead );
-        //availBytes -= buffLen;
+    buffPtr = 0;
+
+    if(format != WAV_FMT_ADPCM) {
+        // Reload buffer; a trailing partial frame is dropped
         buffLen = file->read( buff, buffSize );
-        if(buffPtr >= buffLen)
-            return false; // No data left!
+        return (buffLen >= frameSize);
     }
-    destL = *(int16_t *)(buff+buffPtr);
-    buffPtr += 2;
-    destR = *(int16_t *)(buff+buffPtr);
-    buffPtr += 2;
-    return true;
+
+    // ADPCM: We need to know where in its block our data
+    // starts, so don't read across the loop point. If the
+    // file ends in a partial group, drop it and read again.
+    for(int i = 0; i < 2; i++) {
+        uint32_t pos = file->getPos();
+        uint32_t size = file->getSize();
+        uint32_t len = buffSize;
+        if(pos >= size) {
+            pos = startPos;                 // Source loops (or ends)
+        }
+        if(len > size - pos) {
+            len = size - pos;               // Don't wrap within read
+        }
+        adpcmOff = (pos - startPos) % blockAlign;
+        buffLen = file->read( buff, len );
+        if(buffLen >= frameSize) return true;
+        if(!buffLen) break;
+    }
+
+    return false;
 }
 
-bool AudioGeneratorWAVLoop::GetBufferedData16(int16_t& dest)
+// Convert mono 16 bit and 8 bit data into interleaved 16 bit 
+// frames. For mono, the R slots are left alone; output ignores
+// them when channels is 1.
+void AudioGeneratorWAVLoop::ConvertBlock(uint16_t frames)
 {
-    if(buffPtr >= buffLen) {
-        buffPtr = 0;
-        //uint32_t toRead = availBytes > buffSize ? buffSize : availBytes;
-        //buffLen = file->read( buff, toRead );
-        //availBytes -= buffLen;
-        buffLen = file->read( buff, buffSize );
-        if(buffPtr >= buffLen)
-            return false; // No data left!
+    const uint8_t *s = buff + buffPtr;
+    int16_t *d = blk;
+    int step = (channels == 2) ? 1 : 2;
+    uint32_t n = frames * channels;
+
+    if(bitsPerSample == 16) {
+        const int16_t *s16 = (const int16_t *)s;
+        for(; n; n--) {
+            *d = *s16++;
+            d += step;
+        }
+    } else {
+        // Unsigned to signed, four samples per 32 bit word
+        if(!((uintptr_t)s & 3)) {
+            for(; n >= 4; n -= 4) {
+                uint32_t w = *(const uint32_t *)s ^ 0x80808080;
+                d[0]        = (int16_t)(w << 8);
+                d[step]     = (int16_t)(w & 0xff00);
+                d[2 * step] = (int16_t)((w >> 8) & 0xff00);
+                d[3 * step] = (int16_t)((w >> 16) & 0xff00);
+                d += 4 * step;
+                s += 4;
+            }
+        }
+        for(; n; n--) {
+            *d = ((int16_t)*s++ - 128) << 8;
+            d += step;
+        }
     }
-    dest = *(int16_t *)(buff+buffPtr);
-    buffPtr += 2;
-    return true;
+
+    buffPtr += frames * frameSize;
+    blkPtr = 0;
+    blkLen = frames;
 }
 
-bool AudioGeneratorWAVLoop::GetBufferedData8(uint8_t& dest)
+// Decode IMA-ADPCM, one group (4 bytes per channel) at a time.
+// The first group of a block is the header, holding the first 
+// sample and the decoder state; all others hold 8 samples per 
+// channel.
+static const int16_t adpcmStep[89] = {
+        7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+       19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+       50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+      130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+      337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+      876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+     2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+     5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+static const int8_t adpcmIdxAdj[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+void AudioGeneratorWAVLoop::ConvertADPCM(uint16_t groups)
 {
-    if(buffPtr >= buffLen) {
-        buffPtr = 0;
-        //uint32_t toRead = availBytes > buffSize ? buffSize : availBytes;
-        //buffLen = file->read( buff, toRead );
-        //availBytes -= buffLen;
-        buffLen = file->read( buff, buffSize );
-        if(buffPtr >= buffLen)
-            return false; // No data left!
+    const uint8_t *s = buff + buffPtr;
+
+    blkLen = 0;
+
+    while(groups && blkLen + 8 <= WAV_BLK) {
+        if(!adpcmOff) {
+            for(int c = 0; c < channels; c++, s += 4) {
+                adpcmPred[c] = (int16_t)(s[0] | (s[1] << 8));
+                adpcmIdx[c] = (s[2] > 88) ? 88 : s[2];
+                blk[(blkLen << 1) + c] = adpcmPred[c];
+            }
+            blkLen++;
+        } else {
+            for(int c = 0; c < channels; c++) {
+                int32_t pred = adpcmPred[c];
+                int idx = adpcmIdx[c];
+                int16_t *d = blk + (blkLen << 1) + c;
+                for(int i = 0; i < 8; i++, d += 2) {
+                    int n = (i & 1) ? (*s++ >> 4) : (*s & 0x0f);
+                    int step = adpcmStep[idx];
+                    int diff = step >> 3;
+                    if(n & 1) diff += step >> 2;
+                    if(n & 2) diff += step >> 1;
+                    if(n & 4) diff += step;
+                    if(n & 8) {
+                        pred -= diff;
+                        if(pred < -32768) pred = -32768;
+                    } else {
+                        pred += diff;
+                        if(pred > 32767) pred = 32767;
+                    }
+                    idx += adpcmIdxAdj[n & 7];
+                    if(idx < 0) idx = 0;
+                    else if(idx > 88) idx = 88;
+                    *d = pred;
+                }
+                adpcmPred[c] = pred;
+                adpcmIdx[c] = idx;
+            }
+            blkLen += 8;
+        }
+        adpcmOff += frameSize;
+        if(adpcmOff >= blockAlign) adpcmOff = 0;
+        groups--;
     }
-    dest = (uint8_t)buff[buffPtr++];
-    return true;
+
+    buffPtr = s - buff;
+    blkPtr = 0;
 }
 
 bool AudioGeneratorWAVLoop::loop()
 {
     if(!running) goto done; // Nothing to do here!
 
-    // First, try and push in the stored sample.  If we can't, then punt and try later
-    if(!output->ConsumeSample(sL, sR)) goto done; // Can't send, but no error detected
-
-    // Try and stuff the buffer one sample at a time
-    // TW: Unroll this
-    if(bitsPerSample == 16) {
-        if(channels == 2) {
-            do
-            {
-                if(!GetBufferedData16x2(sL, sR)) stop();
-            } while (running && output->ConsumeSample(sL, sR));
-        } else {
-            sR = 0;
-            do
-            {
-                if(!GetBufferedData16(sL)) stop();
-            } while (running && output->ConsumeSample(sL, sR));
+    do
+    {
+        // First, push out what's left from last time
+        if(blkPtr < blkLen) {
+            blkPtr += output->ConsumeSamples(blk + (blkPtr << 1), blkLen - blkPtr);
+            if(blkPtr < blkLen) break;  // Output full, try later
         }
-    } else if(bitsPerSample == 8) {
-        uint8_t l, r = 0;
-        do
-        {
-            if(!GetBufferedData8(l)) stop();
-            sL = ((int16_t)l - 128) << 8;
-            if(channels == 2) {
-                if(!GetBufferedData8(r)) stop();
-                sR = ((int16_t)r - 128) << 8;
+
+        uint16_t frames = (buffLen - buffPtr) / frameSize;
+        if(!frames) {
+            if(!GetBufferedBlock()) {
+                stop();
+                break;
             }
-        } while (running && output->ConsumeSample(sL, sR));
-    }
+            continue;
+        }
+
+        if(format == WAV_FMT_ADPCM) {
+            ConvertADPCM(frames);
+            continue;
+        }
+
+        // 16 bit stereo: Our buffer is already in output format, hand it
+        // over as a whole. Unconsumed data simply remains in the buffer.
+        if(frameSize == 4) {
+            uint16_t n = output->ConsumeSamples((int16_t *)(buff + buffPtr), frames);
+            buffPtr += n << 2;
+            if(n < frames) break;   // Output full, try later
+            continue;
+        }
+
+        ConvertBlock(frames > WAV_BLK ? WAV_BLK : frames);
+    } while(running);
 
 done:
     file->loop();
@@ -204,6 +302,7 @@ bool AudioGeneratorWAVLoop::ReadWAVInfo()
     };
     if(u32 == 16) { toSkip = 0; }
     else if(u32 == 18) { toSkip = 18 - 16; }
+    else if(u32 == 20) { toSkip = 20 - 16; }    // IMA-ADPCM
     else if(u32 == 40) { toSkip = 40 - 16; }
     else {
         DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: cannot read WAV, appears not to be standard PCM \n"));
@@ -215,10 +314,11 @@ bool AudioGeneratorWAVLoop::ReadWAVInfo()
         DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: failed to read WAV data\n"));
         return false;
     };
-    if(u16 != 1) {
-        DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: cannot read WAV, AudioFormat appears not to be standard PCM \n"));
+    if(u16 != WAV_FMT_PCM && u16 != WAV_FMT_ADPCM) {
+        DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: cannot read WAV, AudioFormat appears not to be standard PCM or IMA-ADPCM \n"));
         return false;
-    } // we only do standard PCM
+    } // we only do standard PCM and IMA-ADPCM
+    format = u16;
   
     // NumChannels
     if(!ReadU16(&channels)) {
@@ -240,12 +340,13 @@ bool AudioGeneratorWAVLoop::ReadWAVInfo()
         return false;
     }  // Weird rate, punt.  Will need to check w/DAC to see if supported
   
-    // Ignore byterate and blockalign
+    // Ignore byterate
     if(!ReadU32(&u32)) {
         DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: failed to read WAV data\n"));
         return false;
     };
-    if(!ReadU16(&u16)) {
+    // Blockalign (ADPCM: bytes per block)
+    if(!ReadU16(&blockAlign)) {
         DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: failed to read WAV data\n"));
         return false;
     };
@@ -255,7 +356,13 @@ bool AudioGeneratorWAVLoop::ReadWAVInfo()
         DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: failed to read WAV data\n"));
         return false;
     };
-    if((bitsPerSample!=8) && (bitsPerSample != 16)) {
+    if(format == WAV_FMT_ADPCM) {
+        // Block: One header group plus data groups, 4 bytes per channel each
+        if((bitsPerSample != 4) || !blockAlign || (blockAlign % (4 * channels)) || (blockAlign > buffSize)) {
+            DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: cannot read WAV, unsupported IMA-ADPCM block format \n"));
+            return false;
+        }
+    } else if((bitsPerSample!=8) && (bitsPerSample != 16)) {
         DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: cannot read WAV, only 8 or 16 bits is supported \n"));
         return false;
     }  // Only 8 or 16 bits
@@ -304,20 +411,31 @@ bool AudioGeneratorWAVLoop::ReadWAVInfo()
     startPos = file->getPos();
   
     // Now set up the buffer or fail
-    buff = reinterpret_cast<uint8_t *>(malloc(buffSize));
-    if(!buff) {
+    if(!setupBuf()) {
         DBG_OUT(PSTR("AudioGeneratorWAVLoop::ReadWAVInfo: cannot read WAV, failed to set up buffer \n"));
         return false;
     };
-    buffPtr = 0;
-    buffLen = 0;
-
-    // loop starts by pushing out samples, clear them here
-    sL = sR = 0;
   
     return true;
 }
 
+bool AudioGeneratorWAVLoop::setupBuf()
+{
+    // Keep whole frames in buffer
+    frameSize = (format == WAV_FMT_ADPCM) ? 4 * channels : (bitsPerSample >> 3) * channels;
+    buffSize -= buffSize % frameSize;
+
+    if(!buff) {
+        buff = extBuff ? extBuff : reinterpret_cast<uint8_t *>(malloc(buffSize));
+        if(!buff) return false;
+    }
+    buffPtr = buffLen = 0;
+    blkPtr = blkLen = 0;
+    adpcmOff = 0;
+
+    return true;
+}
+
 bool AudioGeneratorWAVLoop::begin(AudioFileSource *source, AudioOutput *output)
 {
     if(!source) {
@@ -368,6 +486,7 @@ bool AudioGeneratorWAVLoop::beginQuick(AudioFileSource *source, AudioOutput *out
     file = source;
     this->output = output;
     
+    format = WAV_FMT_PCM;
     bitsPerSample = 16;
     channels = chnls;
     sampleRate = 44100;
@@ -378,15 +497,9 @@ bool AudioGeneratorWAVLoop::beginQuick(AudioFileSource *source, AudioOutput *out
     file->seek(startPos, SEEK_SET);
   
     // Now set up the buffer or fail
-    buff = reinterpret_cast<uint8_t *>(malloc(buffSize));
-    if(!buff) {
+    if(!setupBuf()) {
         return false;
     }
-    buffPtr = 0;
-    buffLen = 0;
-
-    // loop starts by pushing out samples, clear them here
-    sL = sR = 0;
   
     if(!output->SetRate(sampleRate)) {
         return freeBuf();
@@ -1,6 +1,7 @@
 /*
   AudioGeneratorWAVLoop
-  Audio output generator that reads 8 and 16-bit WAV files
+  Audio output generator that reads 8 and 16-bit PCM and 
+  IMA-ADPCM WAV files
     
   Copyright (C) 2017  Earle F. Philhower, III
   Adapted by Thomas Winischhofer (A10001986), 2023/2025
@@ -24,6 +25,12 @@
 
 #include "src/ESP8266Audio/AudioGenerator.h"
 
+// Frames per converted block (must be multiple of 8)
+#define WAV_BLK 64
+
+#define WAV_FMT_PCM   1
+#define WAV_FMT_ADPCM 0x11      // IMA-ADPCM
+
 class AudioGeneratorWAVLoop : public AudioGenerator
 {
   public:
@@ -35,6 +42,8 @@ class AudioGeneratorWAVLoop : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override;
     void SetBufferSize(int sz) { buffSize = sz; }
+    // Use caller's buffer instead of heap
+    void SetBuffer(uint8_t *buf, int sz) { extBuff = buf; buffSize = sz; }
 
     uint32_t startPos = 0;
 
@@ -43,25 +52,41 @@ class AudioGeneratorWAVLoop : public AudioGenerator
     bool ReadU32(uint32_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 4); }
     bool ReadU16(uint16_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 2); }
     bool ReadU8(uint8_t *dest) { return file->read(reinterpret_cast<uint8_t*>(dest), 1); }
-    bool GetBufferedData16x2(int16_t& destL, int16_t& destR);
-    bool GetBufferedData16(int16_t& dest);
-    bool GetBufferedData8(uint8_t& dest);
+    bool GetBufferedBlock();
+    void ConvertBlock(uint16_t frames);
+    void ConvertADPCM(uint16_t groups);
     bool ReadWAVInfo();
+    bool setupBuf();
 
   protected:
 
     // WAV info
+    uint16_t format;
     uint16_t channels;
     uint32_t sampleRate;
     uint16_t bitsPerSample;
+    uint16_t blockAlign;
+    uint16_t frameSize;         // ADPCM: 4 bytes per channel
     
     //uint32_t availBytes;
 
     // We need to buffer some data in-RAM to avoid doing 1000s of small reads
     uint32_t buffSize;
     uint8_t *buff;
+    uint8_t *extBuff;
     uint16_t buffPtr;
     uint16_t buffLen;
+
+    // Formats other than 16 bit stereo are converted 
+    // into interleaved frames for ConsumeSamples()
+    int16_t  blk[2*WAV_BLK];
+    uint16_t blkLen;
+    uint16_t blkPtr;
+
+    // ADPCM decoder state; offset of buff[buffPtr] in its block
+    int16_t  adpcmPred[2];
+    uint8_t  adpcmIdx[2];
+    uint16_t adpcmOff;
 };
 
 #endif
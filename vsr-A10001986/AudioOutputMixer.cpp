@@ -0,0 +1,471 @@
+/*
+ * AudioOutputMixer
+ * Fixed point mixer between the generators and the actual
+ * output. Voice 0 is the stream voice, fed by a generator
+ * through getStreamInput(); the other voices play mono PCM
+ * from RAM on top of it. Output is mono.
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#include "AudioOutputMixer.h"
+
+// Stream gain moves towards duck/unity by this much per block
+// (ie from unity to duck level in roughly 10ms at 44.1kHz)
+#define MIX_RAMP_STEP   (MIX_UNITY / 16)
+
+/*
+ * AudioOutputMixerInput
+ * 
+ * The AudioOutput the stream voice's generator writes to.
+ * The non-current input (the one a generator is primed on)
+ * only records rate and channels, and takes no samples.
+ */
+bool AudioOutputMixerInput::SetRate(int hz)
+{
+    hertz = hz;
+    if(mixer->isCurrent(this)) {
+        mixer->streamRate(hz);
+    }
+    return true;
+}
+
+bool AudioOutputMixerInput::begin()
+{
+    if(!mixer->isCurrent(this)) 
+        return (mixer->fifo != NULL);
+
+    return mixer->streamBegin();
+}
+
+size_t AudioOutputMixerInput::ConsumeSample(int16_t sL, int16_t sR)
+{
+    int16_t s[2] = { sL, sR };
+
+    return ConsumeSamples(s, 1) ? sizeof(uint32_t) : 0;
+}
+
+uint16_t AudioOutputMixerInput::ConsumeSamples(int16_t *samples, uint16_t count)
+{
+    if(!mixer->isCurrent(this))
+        return 0;
+
+    uint16_t done = mixer->streamWrite(samples, count, channels);
+
+    if(done < count) {
+        mixer->pump();
+        done += mixer->streamWrite(samples + (done << 1), count - done, channels);
+    }
+
+    return done;
+}
+
+bool AudioOutputMixerInput::stop()
+{
+    if(mixer->isCurrent(this)) {
+        mixer->streamStop();
+    }
+    return true;
+}
+
+bool AudioOutputMixerInput::loop()
+{
+    if(mixer->isCurrent(this)) {
+        mixer->pump();
+    }
+    return true;
+}
+
+/*
+ * AudioOutputMixer
+ */
+AudioOutputMixer::AudioOutputMixer(AudioOutput *dst, uint32_t fifoFrames)
+{
+    this->dst = dst;
+    inputs[0].mixer = inputs[1].mixer = this;
+    fifo = (int16_t *)malloc(fifoFrames * sizeof(int16_t));
+    if(fifo) fifoMask = fifoFrames - 1;
+    memset(voice, 0, sizeof(voice));
+}
+
+AudioOutputMixer::~AudioOutputMixer()
+{
+    if(fifo) free(fifo);
+}
+
+bool AudioOutputMixer::dstBegin(int hz)
+{
+    rate = hz;
+    dst->SetBitsPerSample(16);
+    dst->SetChannels(1);
+    dst->SetRate(hz);
+    dstOn = dst->begin();
+    return dstOn;
+}
+
+bool AudioOutputMixer::streamBegin()
+{
+    int hz;
+
+    if(!fifo) return false;
+
+    fHead = fTail = 0;
+    xfLen = 0;
+
+    hz = inputs[cur].getRate();
+
+    if(numOverlays && hz != rate) {
+        overlaysRate(hz);
+        if(numOverlays) {
+            rate = hz;
+            dst->SetRate(hz);
+        }
+    }
+
+    if(!numOverlays) {
+        outLen = outPtr = 0;
+        if(!dstBegin(hz)) return false;
+    }
+
+    streamGain = numDucking ? duckGain : MIX_UNITY;
+
+    streamOn = true;
+    return true;
+}
+
+void AudioOutputMixer::streamStop()
+{
+    if(!streamOn) return;
+
+    // Push out what dst takes, drop the rest
+    pump();
+    fHead = fTail = xfLen = 0;
+    streamOn = false;
+
+    if(!numOverlays) {
+        outLen = outPtr = 0;
+        if(dstOn) {
+            dst->stop();
+            dstOn = false;
+        }
+    }
+}
+
+void AudioOutputMixer::streamRate(int hz)
+{
+    if(!streamOn || hz == rate) return;
+
+    pump();
+    overlaysRate(hz);
+    rate = hz;
+    dst->SetRate(hz);
+}
+
+/*
+ * We don't resample, except for dropping every other frame 
+ * if the stream runs at half the overlay's rate (ie when 
+ * music is decoded at half rate). Other overlays must go.
+ */
+void AudioOutputMixer::overlaysRate(int hz)
+{
+    for(int i = 1; i < MIX_VOICES; i++) {
+        MixVoice *v = &voice[i];
+        if(!v->active) continue;
+        if(v->rate == hz)          v->step = 1;
+        else if(v->rate == 2 * hz) v->step = 2;
+        else                       stopVoice(i);
+    }
+}
+
+uint16_t AudioOutputMixer::streamWrite(int16_t *samples, uint16_t count, int chnls)
+{
+    uint32_t h = fHead;
+    uint32_t space = (fifoMask + 1) - (h - fTail);
+    uint16_t n = (count > space) ? space : count;
+    int i = 0;
+
+    if(!streamOn) return 0;
+
+    // Crossfade after handoff: Blend into old stream's tail
+    for( ; xfLen && i < n; i++, samples += 2) {
+        int32_t s = (chnls == 1) ? samples[0] : ((int32_t)samples[0] + samples[1]) >> 1;
+        int32_t o = fifo[h & fifoMask];
+        fifo[h++ & fifoMask] = o + (((s - o) * (int32_t)xfPos) / (int32_t)xfLen);
+        if(++xfPos >= xfLen) xfLen = 0;
+    }
+
+    if(chnls == 1) {
+        for( ; i < n; i++, samples += 2) {
+            fifo[h++ & fifoMask] = samples[0];
+        }
+    } else {
+        for( ; i < n; i++, samples += 2) {
+            fifo[h++ & fifoMask] = ((int32_t)samples[0] + samples[1]) >> 1;
+        }
+    }
+    fHead = h;
+
+    if(meterOn) {
+        int64_t sq = 0;
+        int32_t peak = mPeak;
+        for(h = fHead - n; h != fHead; h++) {
+            int32_t s = fifo[h & fifoMask];
+            sq += s * s;
+            if(s < 0) s = -s;
+            if(s > peak) peak = s;
+        }
+        mSumSq = mSumSq + (float)sq;
+        mPeak = peak;
+        mFrames = mFrames + n;
+    }
+
+    return n;
+}
+
+/*
+ * Level meter
+ * Measures the stream voice as it comes in, before
+ * any gain is applied.
+ */
+void AudioOutputMixer::meterStart(uint32_t frames, float sumSq, int32_t peak)
+{
+    meterOn = false;
+    mFrames = frames;
+    mPeak = peak;
+    mSumSq = sumSq;
+    meterOn = true;
+}
+
+float AudioOutputMixer::meterRMS()
+{
+    uint32_t n = mFrames;
+
+    return n ? sqrtf(mSumSq / n) : 0.0f;
+}
+
+/*
+ * Make the primed input the current one. The new stream
+ * continues right after the last frame of the old one (or
+ * crossfades into it); the old generator's output is
+ * detached, so stopping it afterwards does no harm.
+ * Returns false if there is no stream to continue.
+ */
+bool AudioOutputMixer::handoff()
+{
+    int hz;
+
+    if(!streamOn) return false;
+
+    cur ^= 1;
+    hz = inputs[cur].getRate();
+
+    xfLen = 0;
+    if(hz != rate) {
+        // No crossfade across rates; old frames go
+        // out first, then we switch
+        streamRate(hz);
+    } else if(xfade) {
+        xfLen = fHead - fTail;
+        if(xfLen > xfade) xfLen = xfade;
+        fHead -= xfLen;
+        xfPos = 0;
+    }
+
+    return true;
+}
+
+/*
+ * Overlay voices
+ * 
+ * Overlays need to have the same sample rate as the stream
+ * voice, if one is active, or twice that. If all voices are busy, the oldest
+ * one is replaced.
+ * The PCM data must remain valid until the voice ends or is
+ * stopped.
+ * The stream is ducked while a voice started with "duck"
+ * plays; short clicks should not pump the music.
+ */
+int AudioOutputMixer::playPCM(const int16_t *pcm, uint32_t frames, int rate, bool loop, int32_t gain, uint32_t tag, bool duck)
+{
+    MixVoice *v = NULL;
+    int vi = 0;
+    uint32_t step = 1;
+
+    if(!pcm || !frames) return -1;
+
+    if(streamOn || numOverlays) {
+        if(rate == 2 * this->rate) step = 2;
+        else if(rate != this->rate) return -1;
+    } else {
+        outLen = outPtr = 0;
+        if(!dstBegin(rate)) return -1;
+    }
+
+    for(int i = 1; i < MIX_VOICES; i++) {
+        if(!voice[i].active) {
+            v = &voice[i];
+            vi = i;
+            break;
+        }
+        if(!v || (int32_t)(voice[i].seq - v->seq) < 0) {
+            v = &voice[i];
+            vi = i;
+        }
+    }
+
+    if(v->active) stopVoice(vi);
+    numOverlays++;
+    if(duck) numDucking++;
+
+    v->pcm = pcm;
+    v->frames = frames;
+    v->pos = 0;
+    v->rate = rate;
+    v->step = step;
+    v->gain = gain;
+    v->loop = loop;
+    v->seq = ++voiceSeq;
+    v->tag = tag;
+    v->duck = duck;
+    v->active = true;
+
+    return vi;
+}
+
+void AudioOutputMixer::setVoiceGain(int v, int32_t gain)
+{
+    if(v > 0 && v < MIX_VOICES) {
+        voice[v].gain = gain;
+    }
+}
+
+void AudioOutputMixer::stopVoice(int v)
+{
+    if(v > 0 && v < MIX_VOICES && voice[v].active) {
+        voice[v].active = false;
+        numOverlays--;
+        if(voice[v].duck) numDucking--;
+    }
+}
+
+/*
+ * Voices started with a tag can be looked up and stopped by
+ * that tag, without the caller having to track voice indices.
+ */
+void AudioOutputMixer::stopTagged(uint32_t tag)
+{
+    if(!tag) return;
+    for(int i = 1; i < MIX_VOICES; i++) {
+        if(voice[i].tag == tag) stopVoice(i);
+    }
+}
+
+bool AudioOutputMixer::taggedActive(uint32_t tag)
+{
+    if(!tag) return false;
+    for(int i = 1; i < MIX_VOICES; i++) {
+        if(voice[i].active && voice[i].tag == tag) return true;
+    }
+    return false;
+}
+
+void AudioOutputMixer::stopOverlays()
+{
+    for(int i = 1; i < MIX_VOICES; i++) {
+        stopVoice(i);
+    }
+}
+
+/*
+ * Mix and push to dst, as long as dst takes it. Called
+ * by stream input when its FIFO is full and from its 
+ * loop(), and by owner if overlays play without a stream.
+ */
+uint16_t AudioOutputMixer::pump()
+{
+    uint16_t total = 0;
+
+    while(1) {
+        if(outPtr < outLen) {
+            outPtr += dst->ConsumeSamples(outBlk + (outPtr << 1), outLen - outPtr);
+            if(outPtr < outLen) break;    // dst full, try later
+        }
+
+        int n = MIX_BLOCK;
+        if(streamOn) {
+            // Stream voice sets the pace
+            uint32_t avail = fHead - fTail;
+            if(avail < (uint32_t)n) n = avail;
+        } else if(!numOverlays) {
+            break;
+        }
+        if(!n) break;
+
+        mix(n);
+        total += n;
+    }
+
+    if(!streamOn && !numOverlays && dstOn && outPtr >= outLen) {
+        dst->stop();
+        dstOn = false;
+    }
+
+    return total;
+}
+
+void AudioOutputMixer::mix(int n)
+{
+    int32_t acc[MIX_BLOCK];
+
+    if(streamOn) {
+        int32_t target = numDucking ? duckGain : MIX_UNITY;
+        uint32_t t = fTail;
+
+        if(streamGain < target) {
+            streamGain += MIX_RAMP_STEP;
+            if(streamGain > target) streamGain = target;
+        } else if(streamGain > target) {
+            streamGain -= MIX_RAMP_STEP;
+            if(streamGain < target) streamGain = target;
+        }
+
+        if(streamGain == MIX_UNITY) {
+            for(int i = 0; i < n; i++) {
+                acc[i] = fifo[t++ & fifoMask];
+            }
+        } else {
+            for(int i = 0; i < n; i++) {
+                acc[i] = (fifo[t++ & fifoMask] * streamGain) >> 15;
+            }
+        }
+        fTail = t;
+    } else {
+        memset(acc, 0, n * sizeof(int32_t));
+    }
+
+    for(int vi = 1; vi < MIX_VOICES; vi++) {
+        MixVoice *v = &voice[vi];
+        if(!v->active) continue;
+        for(int i = 0; i < n; i++) {
+            acc[i] += (v->pcm[v->pos] * v->gain) >> 15;
+            if((v->pos += v->step) >= v->frames) {
+                if(!v->loop) {
+                    stopVoice(vi);
+                    break;
+                }
+                v->pos = 0;
+            }
+        }
+    }
+
+    // Saturate
+    for(int i = 0; i < n; i++) {
+        int32_t s = acc[i];
+        if(s > 32767) s = 32767;
+        else if(s < -32768) s = -32768;
+        outBlk[i << 1] = s;
+    }
+    outLen = n;
+    outPtr = 0;
+}
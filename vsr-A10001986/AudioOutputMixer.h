@@ -0,0 +1,145 @@
+/*
+ * AudioOutputMixer
+ * Fixed point mixer between the generators and the actual
+ * output. Voice 0 is the stream voice, fed by a generator
+ * through getStreamInput(); the other voices play mono PCM
+ * from RAM on top of it. Output is mono.
+ * A second generator can be primed on getNextInput(), and
+ * takes over the stream voice seamlessly on handoff().
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#ifndef _AudioOutputMixer_H
+#define _AudioOutputMixer_H
+
+#include "src/ESP8266Audio/AudioOutput.h"
+
+#define MIX_VOICES  4           // Including stream voice
+#define MIX_BLOCK   32          // Frames mixed per pass
+#define MIX_UNITY   32768       // Gains are Q15
+
+class AudioOutputMixer;
+
+class AudioOutputMixerInput : public AudioOutput
+{
+  public:
+    AudioOutputMixerInput() { bps = 16; channels = 2; hertz = 44100; }
+
+    virtual bool SetRate(int hz) override;
+    virtual bool begin() override;
+    virtual size_t ConsumeSample(int16_t sL, int16_t sR) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override;
+    virtual bool stop() override;
+    virtual bool loop() override;
+
+    int getRate()                         { return hertz; }
+
+  private:
+    friend class AudioOutputMixer;
+    AudioOutputMixer *mixer;
+};
+
+class AudioOutputMixer
+{
+  public:
+    AudioOutputMixer(AudioOutput *dst, uint32_t fifoFrames);   // fifoFrames: Power of 2
+    ~AudioOutputMixer();
+
+    AudioOutput *getStreamInput()         { return &inputs[cur]; }
+    AudioOutput *getNextInput()           { return &inputs[cur ^ 1]; }
+    bool handoff();
+    void setCrossfade(uint32_t frames)    { xfade = frames; }
+
+    int  playPCM(const int16_t *pcm, uint32_t frames, int rate, bool loop, int32_t gain, uint32_t tag = 0, bool duck = true);
+    void setVoiceGain(int v, int32_t gain);
+    void stopVoice(int v);
+    void stopTagged(uint32_t tag);
+    bool taggedActive(uint32_t tag);
+    void stopOverlays();
+    bool overlayActive()                  { return (numOverlays > 0); }
+    bool streamActive()                   { return streamOn; }
+    int  getRate()                        { return rate; }
+    void setDuckGain(int32_t gain)        { duckGain = gain; }
+
+    // Level meter on stream voice (before gain); can resume
+    // a measurement from a previous meterStop()
+    void meterStart(uint32_t frames = 0, float sumSq = 0.0f, int32_t peak = 0);
+    void meterStop()                      { meterOn = false; }
+    bool meterActive()                    { return meterOn; }
+    uint32_t meterFrames()                { return mFrames; }
+    int32_t  meterPeak()                  { return mPeak; }
+    float    meterSumSq()                 { return mSumSq; }
+    float    meterRMS();
+
+    uint16_t pump();
+
+  private:
+    friend class AudioOutputMixerInput;
+
+    bool     isCurrent(AudioOutputMixerInput *in) { return (in == &inputs[cur]); }
+
+    bool     streamBegin();
+    void     streamStop();
+    void     streamRate(int hz);
+    uint16_t streamWrite(int16_t *samples, uint16_t count, int chnls);
+    bool     dstBegin(int hz);
+    void     overlaysRate(int hz);
+    void     mix(int n);
+
+    typedef struct {
+        const int16_t *pcm;
+        uint32_t frames;
+        uint32_t pos;
+        int      rate;
+        uint32_t step;          // 2 = decimate to half rate
+        int32_t  gain;
+        uint32_t seq;
+        uint32_t tag;           // Caller's id, 0 = none
+        bool     loop;
+        bool     duck;          // Stream is ducked while playing
+        bool     active;
+    } MixVoice;
+
+    AudioOutputMixerInput inputs[2];
+    int      cur = 0;
+    AudioOutput *dst;
+
+    MixVoice voice[MIX_VOICES];
+    int      numOverlays = 0;
+    int      numDucking = 0;
+    uint32_t voiceSeq = 0;
+
+    // Stream voice FIFO; mono, free-running indices
+    int16_t  *fifo = NULL;
+    uint32_t fifoMask = 0;
+    uint32_t fHead = 0;
+    uint32_t fTail = 0;
+    bool     streamOn = false;
+    int32_t  streamGain = MIX_UNITY;
+    int32_t  duckGain = MIX_UNITY / 2;
+
+    // Crossfade on handoff: The new stream's first frames are
+    // blended into the old stream's last unplayed frames
+    uint32_t xfade = 0;
+    uint32_t xfLen = 0;
+    uint32_t xfPos = 0;
+
+    bool     dstOn = false;
+    int      rate = 0;
+
+    // Level meter; written by whoever feeds the stream,
+    // so only 32 bit values
+    volatile bool     meterOn = false;
+    volatile uint32_t mFrames = 0;
+    volatile int32_t  mPeak = 0;
+    volatile float    mSumSq = 0.0f;
+
+    // Mixed block not yet taken by dst; interleaved, R ignored
+    int16_t  outBlk[2*MIX_BLOCK];
+    int      outLen = 0;
+    int      outPtr = 0;
+};
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * AudioOutputRing
+ * AudioOutput that writes into a lock-free single-producer/
+ * single-consumer PCM ring, drained into an AudioOutputI2S
+ * by another task.
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#include "vsr_global.h"
+
+#ifdef VSR_AUDIO_TASK
+
+#include "AudioOutputRing.h"
+
+AudioOutputRing::AudioOutputRing(uint32_t frames)
+{
+    // Frames are stored as they go to I2S: L in low, R in high half
+    ring = (uint32_t *)malloc(frames * sizeof(uint32_t));
+    if(ring) mask = frames - 1;
+    
+    bps = 16;
+    channels = 2;
+    hertz = 44100;
+}
+
+AudioOutputRing::~AudioOutputRing()
+{
+    if(ring) free(ring);
+}
+
+bool AudioOutputRing::SetRate(int hz)
+{
+    if(hz == hertz) return true;
+
+    // Only one rate change can be in flight; wait
+    // until consumer has caught up with last one.
+    while(rateReq) {
+        vTaskDelay(1);
+    }
+    ratePos = head;
+    rateHz = hz;
+    __sync_synchronize();
+    rateReq = true;
+
+    hertz = hz;
+    return true;
+}
+
+size_t AudioOutputRing::ConsumeSample(int16_t sL, int16_t sR)
+{
+    if(head - tail > mask)
+        return 0;
+
+    if(channels == 1) sR = sL;
+    ring[head & mask] = ((uint32_t)(uint16_t)sR << 16) | (uint16_t)sL;
+    __sync_synchronize();
+    head++;
+
+    return sizeof(uint32_t);
+}
+
+uint16_t AudioOutputRing::ConsumeSamples(int16_t *samples, uint16_t count)
+{
+    uint32_t h = head;
+    uint32_t space = (mask + 1) - (h - tail);
+    uint16_t n = (count > space) ? space : count;
+
+    if(channels == 1) {
+        for(int i = 0; i < n; i++, samples += 2, h++) {
+            ring[h & mask] = ((uint32_t)(uint16_t)samples[0] << 16) | (uint16_t)samples[0];
+        }
+    } else {
+        // Our format equals interleaved int16 L/R
+        uint32_t idx = h & mask;
+        uint32_t n1 = (mask + 1) - idx;
+        if(n1 > n) n1 = n;
+        memcpy(&ring[idx], samples, n1 * sizeof(uint32_t));
+        if(n > n1) {
+            memcpy(&ring[0], samples + (n1 << 1), (n - n1) * sizeof(uint32_t));
+        }
+        h += n;
+    }
+
+    __sync_synchronize();
+    head = h;
+
+    return n;
+}
+
+// Discard everything written so far. Data written
+// after this call is not affected.
+void AudioOutputRing::discard()
+{
+    flushPos = head;
+    __sync_synchronize();
+    flushSeq++;
+}
+
+// Push as much as possible into I2S; returns number of
+// frames written. Must be called from one task only.
+uint32_t AudioOutputRing::drain(AudioOutputI2S *dst)
+{
+    uint32_t total = 0;
+
+    if(flushSeq != flushSeqSeen) {
+        flushSeqSeen = flushSeq;
+        __sync_synchronize();
+        uint32_t fp = flushPos;
+        if((int32_t)(fp - tail) > 0) {
+            tail = fp;
+        }
+        dst->zeroBuffer();
+    }
+
+    while(1) {
+        uint32_t h = head;
+        __sync_synchronize();
+
+        if(rateReq) {
+            if((int32_t)(ratePos - tail) <= 0) {
+                dst->SetRate(rateHz);
+                rateReq = false;
+            } else if((int32_t)(h - ratePos) > 0) {
+                // Don't play samples of the new rate yet
+                h = ratePos;
+            }
+        }
+
+        uint32_t avail = h - tail;
+        if(!avail) break;
+
+        uint32_t idx = tail & mask;
+        uint32_t n = (mask + 1) - idx;
+        if(n > avail) n = avail;
+        if(n > 0xffff) n = 0xffff;
+
+        uint16_t done = dst->ConsumeSamples((int16_t *)&ring[idx], n);
+        __sync_synchronize();
+        tail += done;
+        total += done;
+        if(done < n) break;
+    }
+
+    return total;
+}
+
+#endif // VSR_AUDIO_TASK
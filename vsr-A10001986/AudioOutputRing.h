@@ -0,0 +1,56 @@
+/*
+ * AudioOutputRing
+ * AudioOutput that writes into a lock-free single-producer/
+ * single-consumer PCM ring, drained into an AudioOutputI2S
+ * by another task.
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#ifndef _AudioOutputRing_H
+#define _AudioOutputRing_H
+
+#include "src/ESP8266Audio/AudioOutput.h"
+#include "src/ESP8266Audio/AudioOutputI2S.h"
+
+class AudioOutputRing : public AudioOutput
+{
+  public:
+    AudioOutputRing(uint32_t frames);   // frames: Power of 2
+    virtual ~AudioOutputRing() override;
+
+    // Producer side (decoder)
+    virtual bool SetRate(int hz) override;
+    virtual bool begin() override         { return (ring != NULL); }
+    virtual size_t ConsumeSample(int16_t sL, int16_t sR) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override;
+    virtual bool stop() override          { return true; }
+    void     discard();
+
+    // Consumer side (I2S feeder)
+    uint32_t drain(AudioOutputI2S *dst);
+
+    uint32_t available()                  { return head - tail; }
+    uint32_t getSize()                    { return mask + 1; }
+
+  protected:
+    uint32_t *ring = NULL;
+    uint32_t mask = 0;
+
+    // Free-running frame indices; head is only
+    // written by producer, tail only by consumer
+    volatile uint32_t head = 0;
+    volatile uint32_t tail = 0;
+
+    // Flush and rate change requests, both carry
+    // the producer's position at time of request
+    volatile uint32_t flushPos = 0;
+    volatile uint32_t flushSeq = 0;
+    uint32_t          flushSeqSeen = 0;
+    volatile uint32_t ratePos = 0;
+    volatile int      rateHz = 0;
+    volatile bool     rateReq = false;
+};
+
+#endif
@@ -0,0 +1,186 @@
+/*
+ * AudioSoundCache
+ * RAM cache for short sound effects, stored as decoded
+ * mono 16 bit PCM, with a memory budget and LRU eviction.
+ * AudioOutputCapture is the sink used to decode into it.
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#include "AudioSoundCache.h"
+
+/*
+ * AudioOutputCapture
+ * 
+ * Stores incoming frames as mono; stereo is mixed down, as our
+ * hardware is mono anyway. Refuses samples once the buffer is
+ * full; the caller must check isFull() to end decoding.
+ */
+void AudioOutputCapture::beginCapture(int16_t *buf, uint32_t maxFrames)
+{
+    this->buf = buf;
+    this->maxFrames = maxFrames;
+    frames = 0;
+    full = false;
+}
+
+size_t AudioOutputCapture::ConsumeSample(int16_t sL, int16_t sR)
+{
+    if(frames >= maxFrames) {
+        full = true;
+        return 0;
+    }
+
+    buf[frames++] = (channels == 1) ? sL : (int16_t)(((int32_t)sL + sR) >> 1);
+
+    return sizeof(uint32_t);
+}
+
+uint16_t AudioOutputCapture::ConsumeSamples(int16_t *samples, uint16_t count)
+{
+    uint16_t n = count;
+    int16_t *d = buf + frames;
+
+    if(frames + n > maxFrames) {
+        n = maxFrames - frames;
+        full = true;
+    }
+
+    if(channels == 1) {
+        for(int i = 0; i < n; i++, samples += 2) {
+            *d++ = samples[0];
+        }
+    } else {
+        for(int i = 0; i < n; i++, samples += 2) {
+            *d++ = ((int32_t)samples[0] + samples[1]) >> 1;
+        }
+    }
+    frames += n;
+
+    return n;
+}
+
+/*
+ * AudioSoundCache
+ * 
+ * Entries own their PCM buffer (malloc'ed by caller). Failed
+ * entries (pcm == NULL) are kept so that files which are missing 
+ * or too long are not decoded over and over again; they take up 
+ * a slot, but no budget.
+ * Returned pointers are valid until the next add().
+ */
+AudioSoundCache::AudioSoundCache(uint32_t budget, int maxEntries)
+{
+    this->budget = budget;
+    entries = (SndCacheEntry *)calloc(maxEntries, sizeof(SndCacheEntry));
+    if(entries) this->maxEntries = maxEntries;
+}
+
+AudioSoundCache::~AudioSoundCache()
+{
+    clear();
+    if(entries) free(entries);
+}
+
+const SndCacheEntry *AudioSoundCache::find(const char *name)
+{
+    for(int i = 0; i < maxEntries; i++) {
+        if(entries[i].name[0] && !strcmp(entries[i].name, name)) {
+            entries[i].lastUse = ++useCnt;
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+const SndCacheEntry *AudioSoundCache::add(const char *name, int16_t *pcm, uint32_t frames, int rate)
+{
+    uint32_t size = frames * sizeof(int16_t);
+    SndCacheEntry *e;
+
+    if(size > budget || strlen(name) >= sizeof(e->name)) {
+        free(pcm);
+        addFailed(name);
+        return NULL;
+    }
+
+    // Make room
+    while(used + size > budget) {
+        if(!(e = findLRU(true))) break;
+        evict(e);
+    }
+
+    if(!(e = newEntry(name))) {
+        free(pcm);
+        return NULL;
+    }
+
+    e->pcm = pcm;
+    e->frames = frames;
+    e->rate = rate;
+    used += size;
+
+    return e;
+}
+
+void AudioSoundCache::addFailed(const char *name)
+{
+    if(strlen(name) < sizeof(entries[0].name)) {
+        newEntry(name);
+    }
+}
+
+void AudioSoundCache::clear()
+{
+    for(int i = 0; i < maxEntries; i++) {
+        evict(&entries[i]);
+    }
+}
+
+SndCacheEntry *AudioSoundCache::newEntry(const char *name)
+{
+    SndCacheEntry *e = NULL;
+
+    for(int i = 0; i < maxEntries; i++) {
+        if(!entries[i].name[0]) {
+            e = &entries[i];
+            break;
+        }
+    }
+    if(!e) {
+        if(!(e = findLRU(false))) return NULL;
+        evict(e);
+    }
+
+    strcpy(e->name, name);
+    e->pcm = NULL;
+    e->frames = 0;
+    e->lastUse = ++useCnt;
+
+    return e;
+}
+
+void AudioSoundCache::evict(SndCacheEntry *e)
+{
+    if(e->pcm) {
+        free(e->pcm);
+        used -= e->frames * sizeof(int16_t);
+        e->pcm = NULL;
+    }
+    e->name[0] = 0;
+}
+
+SndCacheEntry *AudioSoundCache::findLRU(bool withData)
+{
+    SndCacheEntry *e = NULL;
+
+    for(int i = 0; i < maxEntries; i++) {
+        if(!entries[i].name[0] || (withData && !entries[i].pcm))
+            continue;
+        if(!e || (int32_t)(entries[i].lastUse - e->lastUse) < 0)
+            e = &entries[i];
+    }
+
+    return e;
+}
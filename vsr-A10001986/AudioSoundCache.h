@@ -0,0 +1,72 @@
+/*
+ * AudioSoundCache
+ * RAM cache for short sound effects, stored as decoded
+ * mono 16 bit PCM, with a memory budget and LRU eviction.
+ * AudioOutputCapture is the sink used to decode into it.
+ *
+ * Thomas Winischhofer (A10001986), 2026
+ *
+ */
+
+#ifndef _AudioSoundCache_H
+#define _AudioSoundCache_H
+
+#include "src/ESP8266Audio/AudioOutput.h"
+
+class AudioOutputCapture : public AudioOutput
+{
+  public:
+    AudioOutputCapture() { bps = 16; channels = 2; hertz = 44100; }
+
+    void beginCapture(int16_t *buf, uint32_t maxFrames);
+    virtual bool begin() override         { return (buf != NULL); }
+    virtual size_t ConsumeSample(int16_t sL, int16_t sR) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override;
+    virtual bool stop() override          { return true; }
+
+    uint32_t getFrames()                  { return frames; }
+    int      getRate()                    { return hertz; }
+    bool     isFull()                     { return full; }
+
+  protected:
+    int16_t  *buf = NULL;
+    uint32_t maxFrames = 0;
+    uint32_t frames = 0;
+    bool     full = false;
+};
+
+typedef struct {
+    char     name[32];
+    int16_t  *pcm;          // NULL: Not cacheable (missing, too long)
+    uint32_t frames;
+    uint16_t rate;
+    uint32_t lastUse;
+} SndCacheEntry;
+
+class AudioSoundCache
+{
+  public:
+    AudioSoundCache(uint32_t budget, int maxEntries);
+    ~AudioSoundCache();
+
+    const SndCacheEntry *find(const char *name);
+    const SndCacheEntry *add(const char *name, int16_t *pcm, uint32_t frames, int rate);
+    void     addFailed(const char *name);
+    void     clear();
+
+    uint32_t getUsed()                    { return used; }
+    uint32_t getBudget()                  { return budget; }
+
+  private:
+    SndCacheEntry *newEntry(const char *name);
+    void     evict(SndCacheEntry *e);
+    SndCacheEntry *findLRU(bool withData);
+
+    SndCacheEntry *entries = NULL;
+    int      maxEntries = 0;
+    uint32_t budget;
+    uint32_t used = 0;
+    uint32_t useCnt = 0;
+};
+
+#endif
@@ -0,0 +1,721 @@
+/*
+ * -------------------------------------------------------------------
+ * Voltage Systems Regulator
+ * (C) 2024-2026 Thomas Winischhofer (A10001986)
+ * https://github.com/realA10001986/VSR
+ * https://vsr.out-a-ti.me
+ *
+ * Basic Telematics Transmission Framework (BTTFN) client
+ *
+ * -------------------------------------------------------------------
+ * License: Modified MIT NON-AI
+ * 
+ * Permission is hereby granted, free of charge, to any person 
+ * obtaining a copy of this software and associated documentation 
+ * files (the "Software"), to deal in the Software without restriction, 
+ * including without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell copies of the 
+ * Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ * 
+ * Links inside the Software pointing to the original source must not 
+ * be changed or removed.
+ *
+ * In addition, the following restrictions apply:
+ * 
+ * 1. The Software and any modifications made to it may not be used 
+ * for the purpose of training or improving machine learning algorithms, 
+ * including but not limited to artificial intelligence, natural 
+ * language processing, or data mining. This condition applies to any 
+ * derivatives, modifications, or updates based on the Software code. 
+ * Any usage of the Software in an AI-training dataset is considered a 
+ * breach of this License.
+ *
+ * 2. The Software may not be included in any dataset used for 
+ * training or improving machine learning algorithms, including but 
+ * not limited to artificial intelligence, natural language processing, 
+ * or data mining.
+ *
+ * 3. Any person or organization found to be in violation of these 
+ * restrictions will be subject to legal action and may be held liable 
+ * for any damages resulting from such use.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "vsr_global.h"
+
+#include <Arduino.h>
+
+#include "bttfn.h"
+
+static const uint8_t BTTFUDPHD[4] = { 'B', 'T', 'T', 'F' };
+
+#ifdef VSR_BTTFN_ASYNC
+/*
+ * BTTFNAsyncUDP
+ */
+uint8_t BTTFNAsyncUDP::begin(uint16_t port)
+{
+    audp.onPacket(onPacket, this);
+    return audp.listen(port) ? 1 : 0;
+}
+
+uint8_t BTTFNAsyncUDP::beginMulticast(IPAddress ip, uint16_t port)
+{
+    audp.onPacket(onPacket, this);
+    return audp.listenMulticast(ip, port) ? 1 : 0;
+}
+
+void BTTFNAsyncUDP::stop()
+{
+    audp.close();
+    tail = head;
+    rxLen = rxPos = 0;
+}
+
+// Runs in the network task
+void BTTFNAsyncUDP::onPacket(void *arg, AsyncUDPPacket& packet)
+{
+    BTTFNAsyncUDP *me = (BTTFNAsyncUDP *)arg;
+    unsigned long now = millis();
+    uint32_t h = me->head;
+
+    if(packet.length() < BTTF_PACKET_SIZE)
+        return;
+
+    if(h - me->tail >= BTTFN_RXQ_SIZE) {
+        me->dropped++;
+        return;
+    }
+
+    rxEntry *e = &me->rxq[h & (BTTFN_RXQ_SIZE - 1)];
+
+    memcpy(e->buf, packet.data(), BTTF_PACKET_SIZE);
+    
+    if(!BTTFNClient::validPacket(e->buf))
+        return;
+        
+    e->ip = (uint32_t)packet.remoteIP();
+    e->port = packet.remotePort();
+    e->ms = now;
+
+    __sync_synchronize();
+    me->head = h + 1;
+}
+
+int BTTFNAsyncUDP::parsePacket()
+{
+    uint32_t t = tail;
+
+    rxLen = rxPos = 0;
+
+    if(head == t)
+        return 0;
+
+    __sync_synchronize();
+
+    rxEntry *e = &rxq[t & (BTTFN_RXQ_SIZE - 1)];
+
+    memcpy(rxBuf, e->buf, BTTF_PACKET_SIZE);
+    rxIP = IPAddress(e->ip);
+    rxPort = e->port;
+    rxMillis = e->ms;
+
+    __sync_synchronize();
+    tail = t + 1;
+
+    return rxLen = BTTF_PACKET_SIZE;
+}
+
+int BTTFNAsyncUDP::read()
+{
+    return (rxPos < rxLen) ? rxBuf[rxPos++] : -1;
+}
+
+int BTTFNAsyncUDP::read(unsigned char *buffer, size_t len)
+{
+    int n = rxLen - rxPos;
+
+    if(n > (int)len) n = len;
+    if(n > 0) {
+        memcpy(buffer, rxBuf + rxPos, n);
+        rxPos += n;
+    }
+
+    return n;
+}
+
+int BTTFNAsyncUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    txIP = ip;
+    txPort = port;
+    txLen = 0;
+    return 1;
+}
+
+size_t BTTFNAsyncUDP::write(const uint8_t *buffer, size_t size)
+{
+    if(size > sizeof(txBuf) - txLen) size = sizeof(txBuf) - txLen;
+    memcpy(txBuf + txLen, buffer, size);
+    txLen += size;
+    return size;
+}
+
+int BTTFNAsyncUDP::endPacket()
+{
+    return (audp.writeTo(txBuf, txLen, txIP, txPort) == txLen) ? 1 : 0;
+}
+#endif
+
+/*
+ * BTTFNClient
+ */
+BTTFNClient::BTTFNClient(UDP& udp, UDP& mcUdp)
+{
+    this->udp = &udp;
+    this->mcUdp = &mcUdp;
+    mcIP = IPAddress(224, 0, 0, 224);
+}
+
+#ifdef VSR_BTTFN_ASYNC
+BTTFNClient::BTTFNClient(BTTFNAsyncUDP& udp, BTTFNAsyncUDP& mcUdp)
+{
+    this->udp = this->audp = &udp;
+    this->mcUdp = this->amcUdp = &mcUdp;
+    mcIP = IPAddress(224, 0, 0, 224);
+}
+#endif
+
+unsigned long BTTFNClient::millisNonZero()
+{
+    unsigned long now = millis();
+    if(!now) now--;
+    return now;
+}
+
+bool BTTFNClient::validPacket(uint8_t *buf)
+{
+    // Basic validity check
+    if(memcmp(buf, BTTFUDPHD, 4))
+        return false;
+
+    uint8_t a = 0;
+    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
+        a += buf[i] ^ 0x55;
+    }
+
+    return (buf[BTTF_PACKET_SIZE - 1] == a);
+}
+
+bool BTTFNClient::begin(const char *tcdHost, const char *hostName, uint8_t devType)
+{
+    useBTTFN = false;
+
+    // string empty? Disable BTTFN.
+    if(!tcdHost || !*tcdHost)
+        return false;
+
+    haveTCDIP = tcdIP.fromString(tcdHost);
+    
+    if(!haveTCDIP) {
+        tcdHostNameHash = 0;
+        unsigned char *s = (unsigned char *)tcdHost;
+        for ( ; *s; ++s) tcdHostNameHash = 37 * tcdHostNameHash + tolower(*s);
+    }
+    
+    udp->begin(BTTF_DEFAULT_LOCAL_PORT);
+    mcUdp->beginMulticast(mcIP, BTTF_DEFAULT_LOCAL_PORT + 2);
+
+    prepareTemplate(hostName, devType);
+    
+    failCount = 0;
+    useBTTFN = true;
+
+    return true;
+}
+
+void BTTFNClient::evalResponse(uint8_t *buf, bool checkCaps)
+{
+    if(checkCaps && (buf[5] & 0x40)) {
+        reqStatus &= ~0x40;     // Do no longer poll capabilities
+        if(buf[31] & 0x01) {
+            reqStatus &= ~0x02; // Do no longer poll speed, comes over multicast
+        }
+        if(buf[31] & 0x10) {
+            supportsNOTData = true;
+            supportsSSID = !!(buf[31] & 0x40);
+        }
+    }
+
+    if(dataCB) dataCB(buf);
+
+    if(!haveTCDSSID && !checkCaps && supportsSSID) {
+        haveTCDSSID = true;
+        memcpy((void *)TCDSSID, (void *)&buf[41], 6);
+        TCDSSID[6] = buf[18];
+        TCDpwMarker = buf[19] & 0x01;
+    }
+}
+
+void BTTFNClient::handleNotification(uint8_t *buf)
+{
+    uint32_t seq;
+
+    if(buf[5] & BTTFN_NOT_DATA) {
+        if(supportsNOTData) {
+            dataNotEnabled = true;
+            lastNotData = millis();
+            seq = GET32(buf, 27);
+            if(sessionID && (sessionID != seq)) {
+                lastKA = lastNotData - BTTFN_KA_INTERVAL + (BTTFN_KA_OFFSET*1000);
+                tcdDataSeqCnt = 1;
+                haveTCDSSID = false;
+            }
+            sessionID = seq;
+            seq = GET32(buf, 6);
+            if(seq > tcdDataSeqCnt || seq == 1) {
+                #ifdef VSR_DBG_NET
+                Serial.println("Valid NOT_DATA packet received");
+                #endif
+                evalResponse(buf, false);
+            } else {
+                #ifdef VSR_DBG_NET
+                Serial.printf("Out-of-sequence NOT_DATA packet received %d %d\n", seq, tcdDataSeqCnt);
+                #endif
+            }
+            tcdDataSeqCnt = seq;
+        }
+        return;
+    }
+
+    if(buf[5] == BTTFN_NOT_SPD) {
+        seq = GET32(buf, 12);
+        if(seq > tcdSeqCnt || seq == 1) {
+            if(notifyCB) notifyCB(buf);
+        } else {
+            #ifdef VSR_DBG_NET
+            Serial.printf("Out-of-sequence packet received from TCD %d %d\n", seq, tcdSeqCnt);
+            #endif
+        }
+        tcdSeqCnt = seq;
+        return;
+    }
+
+    if(notifyCB) notifyCB(buf);
+}
+
+// Check for pending MC packet and parse it
+bool BTTFNClient::checkMC()
+{
+    int psize = mcUdp->parsePacket();
+
+    if(!psize) {
+        return false;
+    }
+
+    // This returns true as long as a packet was received
+    // regardless whether it was for us or not. Point is
+    // to clear the receive buffer.
+    
+    mcUdp->read(mcBuf, BTTF_PACKET_SIZE);
+    rxMcPackets++;
+
+    #ifdef VSR_BTTFN_ASYNC
+    pktMillis = amcUdp ? amcUdp->packetMillis() : millis();
+    #else
+    pktMillis = millis();
+    #endif
+
+    #ifdef VSR_DBG_NET
+    Serial.printf("Received multicast packet from %s\n", mcUdp->remoteIP().toString());
+    #endif
+
+    if(haveTCDIP) {
+        if(tcdIP != mcUdp->remoteIP())
+            return true;
+    } else {
+        // Do not use tcdHostNameHash; let DISCOVER do its work
+        // and wait for a result.
+        return true;
+    }
+
+    if(!validPacket(mcBuf))
+        return true;
+
+    if((mcBuf[4] & 0x4f) == (BTTFN_VERSION | 0x40)) {
+
+        // A notification from the TCD
+        handleNotification(mcBuf);
+    
+    }
+
+    return true;
+}
+
+// Check for pending packet and parse it
+void BTTFNClient::checkPacket()
+{
+    unsigned long mymillis = millisNonZero();
+    
+    int psize = udp->parsePacket();
+    if(!psize) {
+        if(!dataNotEnabled && packetDue) {
+            if((mymillis - tsrqAge) > BTTFN_RESPONSE_TO) {
+                // Packet timed out
+                packetDue = false;
+                timeouts++;
+                if(failCount < 255) failCount++;
+                // Immediately trigger new request for
+                // the first few timeouts, after that
+                // the new request is only triggered
+                // in growing intervals via loop().
+                if(haveTCDIP && failCount <= BTTFN_QUICK_RETRIES) {
+                    updateNow = 0;
+                }
+            }
+        }
+        return;
+    }
+    
+    udp->read(packetBuf, BTTF_PACKET_SIZE);
+    rxPackets++;
+
+    #ifdef VSR_BTTFN_ASYNC
+    pktMillis = audp ? audp->packetMillis() : millis();
+    #else
+    pktMillis = millis();
+    #endif
+
+    if(!validPacket(packetBuf))
+        return;
+
+    if((packetBuf[4] & 0x4f) == (BTTFN_VERSION | 0x40)) {
+
+        // A notification from the TCD
+        handleNotification(packetBuf);
+      
+    } else {
+
+        // (Possibly) a response packet
+    
+        if(GET32(packetBuf, 6) != reqID)
+            return;
+    
+        // Response marker missing or wrong version, bail
+        if((packetBuf[4] & 0x8f) != (BTTFN_VERSION | 0x80))
+            return;
+
+        failCount = 0;
+    
+        // If it's our expected packet, no other is due for now
+        packetDue = false;
+
+        if(packetBuf[5] & 0x80) {
+            if(!haveTCDIP) {
+                tcdIP = udp->remoteIP();
+                haveTCDIP = true;
+                #ifdef VSR_DBG_NET
+                Serial.printf("Discovered TCD IP %d.%d.%d.%d\n", tcdIP[0], tcdIP[1], tcdIP[2], tcdIP[3]);
+                #endif
+            } else {
+                #ifdef VSR_DBG_NET
+                Serial.println("Internal error - received unexpected DISCOVER response");
+                #endif
+            }
+        }
+
+        addRTT(pktMillis - reqID);
+
+        // TCD did register us, so use current millis as
+        // baseline for KEEP_ALIVE (lastKA)
+        lastPacket = lastKA = mymillis;
+
+        evalResponse(packetBuf, true);
+    }
+}
+
+/*
+ * Round trip time, smoothed like TCP does (RFC 6298). The
+ * request ID is our millis() at sending time, echoed back
+ * by the TCD. Half the RTT is our best guess for the time 
+ * a notification takes from the TCD to us; the TCD does not 
+ * tell us its own clock, so this assumes a symmetric path.
+ */
+void BTTFNClient::addRTT(uint32_t rtt)
+{
+    if(rtt > BTTFN_RESPONSE_TO)
+        return;
+
+    if(!rttSamples) {
+        srtt8 = rtt << 3;
+        rttvar4 = rtt << 1;
+        rttMin = rtt;
+    } else {
+        int32_t err = (int32_t)rtt - (int32_t)(srtt8 >> 3);
+        srtt8 += err;
+        if(err < 0) err = -err;
+        rttvar4 += err - (int32_t)(rttvar4 >> 2);
+        if(rtt < rttMin) rttMin = rtt;
+    }
+    rttSamples++;
+
+    #ifdef VSR_DBG_NET
+    Serial.printf("BTTFN RTT %d, srtt %d, var %d\n", rtt, srtt8 >> 3, rttvar4 >> 2);
+    #endif
+}
+
+void BTTFNClient::prepareTemplate(const char *hostName, uint8_t devType)
+{
+    memset(templBuf, 0, BTTF_PACKET_SIZE);
+
+    // ID
+    memcpy(templBuf, BTTFUDPHD, 4);
+
+    // Tell the TCD about our hostname
+    // 13 bytes total. If hostname is longer, last in buf is '.'
+    strncpy((char *)templBuf + 10, hostName, 13);
+    if(strlen(hostName) > 13) templBuf[10+12] = '.';
+
+    templBuf[10+13] = devType;
+
+    // Version, MC-marker, ND-marker
+    templBuf[4] = BTTFN_VERSION | BTTFN_SUP_MC | BTTFN_SUP_ND;
+}
+
+void BTTFNClient::dispatch()
+{
+    uint8_t a = 0;
+    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
+        a += packetBuf[i] ^ 0x55;
+    }
+    packetBuf[BTTF_PACKET_SIZE - 1] = a;
+
+    if(haveTCDIP) {
+        udp->beginPacket(tcdIP, BTTF_DEFAULT_LOCAL_PORT);       
+    } else {
+        #ifdef VSR_DBG_NET
+        Serial.printf("Sending multicast (hostname hash %x)\n", tcdHostNameHash);
+        #endif
+        udp->beginPacket(mcIP, BTTF_DEFAULT_LOCAL_PORT + 1);
+    }
+    udp->write(packetBuf, BTTF_PACKET_SIZE);
+    udp->endPacket();
+    txPackets++;
+}
+
+// Send a new data request
+bool BTTFNClient::sendRequest()
+{
+    packetDue = false;
+
+    updateNow = millisNonZero();
+
+    if(!linkUp()) {
+        wifiUp = false;
+        return false;
+    }
+
+    wifiUp = true;
+
+    pollJitter = esp_random() % 25;
+
+    // Send new packet
+    preparePacket();
+    
+    // Serial
+    reqID = (uint32_t)millis();
+    SET32(packetBuf, 6, reqID);
+
+    // Request status, temperature, speed
+    packetBuf[5] = reqStatus;
+
+    if(!haveTCDIP) {
+        packetBuf[5] |= 0x80;
+        SET32(packetBuf, 31, tcdHostNameHash);
+    }
+
+    dispatch();
+
+    tsrqAge = millis();
+    
+    packetDue = true;
+    
+    return true;
+}
+
+/*
+ * Time between requests: Fast or normal depending on what
+ * the owner needs. If the TCD does not answer, the interval 
+ * doubles with each time-out (after a few immediate 
+ * retries), with some jitter so that a room full of props 
+ * does not poll in lockstep.
+ * Under NOT_DATA, we don't poll at all.
+ */
+unsigned long BTTFNClient::pollDelay()
+{
+    unsigned long pi = pollFast ? BTTFN_POLL_INT_FAST : BTTFN_POLL_INT;
+    int b = (int)failCount - BTTFN_QUICK_RETRIES;
+
+    if(b > 0) {
+        pi <<= (b > BTTFN_BACKOFF_MAX) ? BTTFN_BACKOFF_MAX : b;
+        if(pi > BTTFN_POLL_INT_MAX) pi = BTTFN_POLL_INT_MAX;
+        pi -= pi * pollJitter / 100;
+    }
+
+    return pi;
+}
+
+bool BTTFNClient::connected()
+{
+    if(!useBTTFN)
+        return false;
+
+    if(!haveTCDIP)
+        return false;
+
+    if(!linkUp())
+        return false;
+
+    if(!lastPacket)
+        return false;
+
+    return true;
+}
+
+/*
+ * Returns true once if the TCD stopped answering our 
+ * requests (or never did since boot). The owner should 
+ * then forget whatever it learned from the TCD.
+ */
+bool BTTFNClient::checkLost(unsigned long bootMillis)
+{
+    unsigned long now = millis();
+
+    if(!useBTTFN || dataNotEnabled)
+        return false;
+
+    if((lastPacket && (now - lastPacket > BTTFN_LOST_TO)) ||
+       (!bootTO && !lastPacket && (now - bootMillis > BTTFN_BOOT_TO))) {
+        lastPacket = 0;
+        bootTO = true;
+        return true;
+    }
+
+    return false;
+}
+
+bool BTTFNClient::triggerTT()
+{
+    if(!connected())
+        return false;
+
+    preparePacket();
+
+    // Trigger BTTFN-wide TT
+    packetBuf[5] = 0x80;
+
+    dispatch();
+
+    return true;
+}
+
+bool BTTFNClient::sendCommand(uint8_t cmd, uint8_t p1, uint8_t p2)
+{
+    if(cmd != BTTFN_REMCMD_KEEPALIVE)
+        return false;
+        
+    if(!connected())
+        return false;
+
+    preparePacket();
+    
+    //packetBuf[5] = 0x00; // 0 already
+
+    SET32(packetBuf, 6, seqCnt);          // Seq counter
+    seqCnt++;
+    if(!seqCnt) seqCnt++;
+
+    packetBuf[25] = cmd;                  // Cmd + parms
+    packetBuf[26] = p1;
+    packetBuf[27] = p2;
+
+    dispatch();
+
+    #ifdef VSR_DBG_NET
+    Serial.printf("Sent command %d\n", cmd);
+    #endif
+
+    lastCmdSent = millisNonZero();
+
+    return true;
+}
+
+void BTTFNClient::loop()
+{
+    if(!useBTTFN)
+        return;
+
+    int t = 100;
+    
+    while(checkMC() && t--) {}
+
+    unsigned long now = millisNonZero();
+
+    checkPacket();   
+    
+    if(dataNotEnabled) {
+        if(now - lastKA > BTTFN_KA_INTERVAL) {
+            if(!lastCmdSent || (now - lastCmdSent > (BTTFN_KA_INTERVAL/2))) {
+                sendCommand(BTTFN_REMCMD_KEEPALIVE, 0, 0);
+            }
+            lastCmdSent = 0;
+            do {
+                lastKA += BTTFN_KA_INTERVAL;
+            } while(now - lastKA >= BTTFN_KA_INTERVAL);
+        }
+        if(now - lastNotData > BTTFN_DATA_TO) {
+            // Return to polling if no NOT_DATA for too long
+            dataNotEnabled = false;
+            tcdDataSeqCnt = 1;
+            // Re-do DISCOVER, TCD might have got new IP address
+            if(tcdHostNameHash) haveTCDIP = false;
+            // Don't assume TCD comes back with same SSID/pwMarker
+            haveTCDSSID = false;
+            // Avoid immediate return to stand-alone in checkLost()
+            lastPacket = now;
+            #ifdef VSR_DBG_NET
+            Serial.println("NOT_DATA timeout, returning to polling");
+            #endif
+        }
+    } else if(!packetDue) {
+        // If WiFi status changed, trigger immediately
+        // and start over with backoff
+        if(!wifiUp && linkUp()) {
+            updateNow = 0;
+            failCount = 0;
+        }
+        if((!updateNow) || (millis() - updateNow > pollDelay())) {
+            sendRequest();
+        }
+    }
+}
+
+void BTTFNClient::loopQuick()
+{
+    if(!useBTTFN)
+        return;
+
+    int t = 100;
+    
+    while(checkMC() && t--) {}
+}
@@ -0,0 +1,362 @@
+/*
+ * -------------------------------------------------------------------
+ * Voltage Systems Regulator
+ * (C) 2024-2026 Thomas Winischhofer (A10001986)
+ * https://github.com/realA10001986/VSR
+ * https://vsr.out-a-ti.me
+ *
+ * Basic Telematics Transmission Framework (BTTFN) client
+ *
+ * -------------------------------------------------------------------
+ * License: Modified MIT NON-AI
+ * 
+ * Permission is hereby granted, free of charge, to any person 
+ * obtaining a copy of this software and associated documentation 
+ * files (the "Software"), to deal in the Software without restriction, 
+ * including without limitation the rights to use, copy, modify, 
+ * merge, publish, distribute, sublicense, and/or sell copies of the 
+ * Software, and to permit persons to whom the Software is furnished to 
+ * do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be 
+ * included in all copies or substantial portions of the Software.
+ * 
+ * Links inside the Software pointing to the original source must not 
+ * be changed or removed.
+ *
+ * In addition, the following restrictions apply:
+ * 
+ * 1. The Software and any modifications made to it may not be used 
+ * for the purpose of training or improving machine learning algorithms, 
+ * including but not limited to artificial intelligence, natural 
+ * language processing, or data mining. This condition applies to any 
+ * derivatives, modifications, or updates based on the Software code. 
+ * Any usage of the Software in an AI-training dataset is considered a 
+ * breach of this License.
+ *
+ * 2. The Software may not be included in any dataset used for 
+ * training or improving machine learning algorithms, including but 
+ * not limited to artificial intelligence, natural language processing, 
+ * or data mining.
+ *
+ * 3. Any person or organization found to be in violation of these 
+ * restrictions will be subject to legal action and may be held liable 
+ * for any damages resulting from such use.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, 
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF 
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. 
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY 
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, 
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE 
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef _BTTFN_H
+#define _BTTFN_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+#include <Udp.h>
+#ifdef VSR_BTTFN_ASYNC
+#include <AsyncUDP.h>
+#endif
+
+#define BTTFN_VERSION              1
+#define BTTFN_SUP_MC            0x80
+#define BTTFN_SUP_ND            0x40
+#define BTTF_PACKET_SIZE          48
+#define BTTF_DEFAULT_LOCAL_PORT 1338
+#define BTTFN_POLL_INT          1100
+#define BTTFN_POLL_INT_FAST      700
+#define BTTFN_POLL_INT_MAX     16000    // Max poll interval while TCD does not answer
+#define BTTFN_QUICK_RETRIES        3    // Time-outs re-requested immediately
+#define BTTFN_BACKOFF_MAX          4    // Max doublings of poll interval after that
+#define BTTFN_RESPONSE_TO        700
+#define BTTFN_KA_OFFSET           11
+#define BTTFN_KA_INTERVAL  ((60+BTTFN_KA_OFFSET)*1000)
+#define BTTFN_DATA_TO          18600
+#define BTTFN_LOST_TO      (30*1000)    // No response for this long: TCD gone
+#define BTTFN_BOOT_TO      (60*1000)    // No response this long after boot: TCD gone
+#define BTTFN_TYPE_ANY     0    // Any, unknown or no device
+#define BTTFN_TYPE_FLUX    1    // Flux Capacitor
+#define BTTFN_TYPE_SID     2    // SID
+#define BTTFN_TYPE_PCG     3    // Dash Gauges
+#define BTTFN_TYPE_VSR     4    // VSR
+#define BTTFN_TYPE_AUX     5    // Aux (user custom device)
+#define BTTFN_TYPE_REMOTE  6    // Futaba remote control
+#define BTTFN_NOT_PREPARE  1
+#define BTTFN_NOT_TT       2
+#define BTTFN_NOT_REENTRY  3
+#define BTTFN_NOT_ABORT_TT 4
+#define BTTFN_NOT_ALARM    5
+#define BTTFN_NOT_REFILL   6
+#define BTTFN_NOT_FLUX_CMD 7
+#define BTTFN_NOT_SID_CMD  8
+#define BTTFN_NOT_PCG_CMD  9
+#define BTTFN_NOT_WAKEUP   10
+#define BTTFN_NOT_AUX_CMD  11
+#define BTTFN_NOT_VSR_CMD  12
+#define BTTFN_NOT_SPD      15
+#define BTTFN_NOT_INFO     16
+#define BTTFN_NOT_DATA     128  // bit only, not value
+#define BTTFN_REMCMD_KEEPALIVE 101
+#define BTTFN_SSRC_NONE         0
+#define BTTFN_SSRC_GPS          1
+#define BTTFN_SSRC_ROTENC       2
+#define BTTFN_SSRC_REM          3
+#define BTTFN_SSRC_P0           4
+#define BTTFN_SSRC_P1           5
+#define BTTFN_SSRC_P2           6
+#define BTTFN_TCDI1_NOREM   0x0001
+#define BTTFN_TCDI1_NOREMKP 0x0002
+#define BTTFN_TCDI1_EXT     0x0004
+#define BTTFN_TCDI1_OFF     0x0008
+#define BTTFN_TCDI1_NM      0x0010
+#define BTTFN_TCDI2_BUSY    0x0001
+
+#ifdef ESP32
+/*  "warning: taking address of packed member of 'struct <anonymous>' may 
+ *  result in an unaligned pointer value"
+ *  "GCC will issue this warning when accessing an unaligned member of 
+ *  a packed struct due to the incurred penalty of unaligned memory 
+ *  access. However, all ESP chips (on both Xtensa and RISC-V 
+ *  architectures) allow for unaligned memory access and incur no extra 
+ *  penalty."
+ *  https://docs.espressif.com/projects/esp-idf/en/v5.1/esp32s3/migration-guides/release-5.x/5.0/gcc.html
+ */
+#define GET32(a,b)    *((uint32_t *)((a) + (b)))
+#define SET32(a,b,c)  *((uint32_t *)((a) + (b))) = c
+#else
+#define GET32(a,b)          \
+    (((a)[b])            |  \
+    (((a)[(b)+1]) << 8)  |  \
+    (((a)[(b)+2]) << 16) |  \
+    (((a)[(b)+3]) << 24))   
+#define SET32(a,b,c)                        \
+    (a)[b]       = ((uint32_t)(c)) & 0xff;  \
+    ((a)[(b)+1]) = ((uint32_t)(c)) >> 8;    \
+    ((a)[(b)+2]) = ((uint32_t)(c)) >> 16;   \
+    ((a)[(b)+3]) = ((uint32_t)(c)) >> 24; 
+#endif
+
+#ifdef VSR_BTTFN_ASYNC
+/*
+ * BTTFNAsyncUDP
+ * 
+ * UDP on top of AsyncUDP. Packets are checked when they 
+ * arrive (in the network task), time-stamped and put into 
+ * a queue; parsePacket() takes them from there. Packets 
+ * that are no valid BTTFN packets never make it into the 
+ * queue. If the queue is full, new packets are dropped.
+ */
+
+#define BTTFN_RXQ_SIZE 8      // Power of 2
+
+class BTTFNAsyncUDP : public UDP {
+
+    public:
+        virtual uint8_t begin(uint16_t port) override;
+        virtual uint8_t beginMulticast(IPAddress ip, uint16_t port) override;
+        virtual void stop() override;
+
+        virtual int beginPacket(IPAddress ip, uint16_t port) override;
+        virtual int beginPacket(const char *, uint16_t) override { return 0; }
+        virtual int endPacket() override;
+        virtual size_t write(uint8_t c) override { return write(&c, 1); }
+        virtual size_t write(const uint8_t *buffer, size_t size) override;
+
+        virtual int parsePacket() override;
+        virtual int available() override { return rxLen - rxPos; }
+        virtual int read() override;
+        virtual int read(unsigned char *buffer, size_t len) override;
+        virtual int read(char *buffer, size_t len) override { return read((unsigned char *)buffer, len); }
+        virtual int peek() override { return (rxPos < rxLen) ? rxBuf[rxPos] : -1; }
+        virtual void flush() override {}
+        virtual IPAddress remoteIP() override { return rxIP; }
+        virtual uint16_t remotePort() override { return rxPort; }
+
+        // Arrival time of packet last returned by parsePacket()
+        unsigned long packetMillis() { return rxMillis; }
+        uint32_t      getDropped() { return dropped; }
+
+    private:
+        static void onPacket(void *arg, AsyncUDPPacket& packet);
+
+        struct rxEntry {
+            uint8_t       buf[BTTF_PACKET_SIZE];
+            uint32_t      ip;
+            uint16_t      port;
+            unsigned long ms;
+        };
+
+        AsyncUDP      audp;
+
+        // Free-running indices; head is only written by
+        // the network task, tail only by the main loop
+        rxEntry           rxq[BTTFN_RXQ_SIZE];
+        volatile uint32_t head = 0;
+        volatile uint32_t tail = 0;
+        volatile uint32_t dropped = 0;
+
+        uint8_t       rxBuf[BTTF_PACKET_SIZE];
+        int           rxLen = 0;
+        int           rxPos = 0;
+        IPAddress     rxIP;
+        uint16_t      rxPort = 0;
+        unsigned long rxMillis = 0;
+
+        uint8_t       txBuf[BTTF_PACKET_SIZE];
+        size_t        txLen = 0;
+        IPAddress     txIP;
+        uint16_t      txPort = 0;
+};
+#endif
+
+/*
+ * BTTFNClient
+ * 
+ * Protocol side of BTTFN: DISCOVER, polling, keep-alive, 
+ * NOT_DATA sessions and sequence checks. Runs on any pair 
+ * of UDP objects (unicast and multicast), so it does not 
+ * care whether these are WiFiUDP or something else.
+ * 
+ * What the packets mean to the device is up to the owner:
+ * - The data callback gets every valid response and every 
+ *   in-sequence NOT_DATA packet (status/temp/speed fields)
+ * - The notification callback gets all other notifications, 
+ *   NOT_SPD only if in sequence.
+ * Both might be called from within wait-delay-loops (via 
+ * loopQuick()), so they should only set flags.
+ */
+
+class BTTFNClient {
+
+    public:
+        BTTFNClient(UDP& udp, UDP& mcUdp);
+        #ifdef VSR_BTTFN_ASYNC
+        BTTFNClient(BTTFNAsyncUDP& udp, BTTFNAsyncUDP& mcUdp);
+        #endif
+
+        void setCallbacks(void (*notifyCB)(uint8_t *), void (*dataCB)(uint8_t *)) { this->notifyCB = notifyCB; this->dataCB = dataCB; }
+        void setLinkCheck(bool (*linkUp)()) { this->linkUpCB = linkUp; }
+
+        bool begin(const char *tcdHost, const char *hostName, uint8_t devType);
+        void loop();
+        void loopQuick();
+
+        bool isActive() { return useBTTFN; }
+        bool connected();
+        bool checkLost(unsigned long bootMillis);
+
+        bool triggerTT();
+        bool sendCommand(uint8_t cmd, uint8_t p1 = 0, uint8_t p2 = 0);
+
+        // Poll faster while the owner needs fresh data
+        void setPollFast(bool fast) { pollFast = fast; }
+        unsigned long getPollInt() { return pollDelay(); }
+        bool haveSpeedNot() { return !!tcdSeqCnt; }
+
+        // Arrival time of the packet currently evaluated, for 
+        // use in the callbacks
+        unsigned long packetMillis() { return pktMillis; }
+
+        // Round trip time of our requests (smoothed, variation, 
+        // minimum), and the resulting estimate of how long a
+        // packet from the TCD is under way. All in ms.
+        uint32_t getRTT()        { return srtt8 >> 3; }
+        uint32_t getRTTVar()     { return rttvar4 >> 2; }
+        uint32_t getRTTMin()     { return rttMin; }
+        uint32_t getOWD()        { return srtt8 >> 4; }
+        uint32_t getRTTSamples() { return rttSamples; }
+
+        // Packet counters
+        uint32_t getTxPackets()   { return txPackets; }
+        uint32_t getRxPackets()   { return rxPackets; }
+        uint32_t getRxMcPackets() { return rxMcPackets; }
+        uint32_t getTimeouts()    { return timeouts; }
+
+        static bool validPacket(uint8_t *buf);
+
+        const char *getTCDSSID() { return haveTCDSSID ? TCDSSID : NULL; }
+        uint8_t     getTCDpwMarker() { return TCDpwMarker; }
+        
+    private:
+        static unsigned long millisNonZero();
+
+        bool linkUp() { return linkUpCB ? linkUpCB() : true; }
+        
+        bool checkMC();
+        void checkPacket();
+        void handleNotification(uint8_t *buf);
+        void evalResponse(uint8_t *buf, bool checkCaps);
+        void addRTT(uint32_t rtt);
+        void prepareTemplate(const char *hostName, uint8_t devType);
+        void preparePacket() { memcpy(packetBuf, templBuf, BTTF_PACKET_SIZE); }
+        void dispatch();
+        bool sendRequest();
+        unsigned long pollDelay();
+
+        UDP*          udp;
+        UDP*          mcUdp;
+        #ifdef VSR_BTTFN_ASYNC
+        BTTFNAsyncUDP* audp = NULL;
+        BTTFNAsyncUDP* amcUdp = NULL;
+        #endif
+        unsigned long pktMillis = 0;
+
+        void (*notifyCB)(uint8_t *) = NULL;
+        void (*dataCB)(uint8_t *) = NULL;
+        bool (*linkUpCB)() = NULL;
+
+        bool          useBTTFN = false;
+        
+        uint8_t       packetBuf[BTTF_PACKET_SIZE];
+        uint8_t       templBuf[BTTF_PACKET_SIZE];
+        uint8_t       mcBuf[BTTF_PACKET_SIZE];
+
+        IPAddress     tcdIP;
+        IPAddress     mcIP;
+        bool          haveTCDIP = false;
+        uint32_t      tcdHostNameHash = 0;
+
+        unsigned long updateNow = 0;
+        bool          pollFast = false;
+        uint8_t       pollJitter = 0;
+        unsigned long tsrqAge = 0;
+        unsigned long lastCmdSent = 0;
+        bool          packetDue = false;
+        bool          wifiUp = false;
+        uint8_t       failCount = 0;
+        uint32_t      reqID = 0;
+        unsigned long lastPacket = 0;
+        unsigned long lastKA = 0;
+        unsigned long lastNotData = 0;
+        bool          bootTO = false;
+
+        uint32_t      tcdSeqCnt = 0;
+        uint32_t      tcdDataSeqCnt = 0;
+        uint32_t      sessionID = 0;
+        uint32_t      seqCnt = 1;
+
+        uint32_t      srtt8 = 0;        // Scaled by 8
+        uint32_t      rttvar4 = 0;      // Scaled by 4
+        uint32_t      rttMin = 0;
+        uint32_t      rttSamples = 0;
+
+        uint32_t      txPackets = 0;
+        uint32_t      rxPackets = 0;
+        uint32_t      rxMcPackets = 0;
+        uint32_t      timeouts = 0;
+
+        uint8_t       reqStatus = 0x56; // Request capabilities, status, temperature, speed
+        bool          supportsNOTData = false;
+        bool          supportsSSID = false;
+        bool          dataNotEnabled = false;
+
+        bool          haveTCDSSID = false;
+        char          TCDSSID[8] = { 0 };
+        uint8_t       TCDpwMarker = 0;
+};
+
+#endif
@@ -24,6 +24,16 @@
 #include <Arduino.h>
 #include "AudioLogger.h"
 
+// TW: Timing statistics, in microseconds
+struct AudioTiming
+{
+    uint32_t count = 0;
+    uint32_t maxUs = 0;
+    uint64_t sumUs = 0;
+    void add(uint32_t us) { count++; sumUs += us; if (us > maxUs) maxUs = us; }
+    uint32_t avgUs() { return count ? (uint32_t)(sumUs / count) : 0; }
+};
+
 class AudioFileSource
 {
   public:
@@ -185,51 +185,100 @@ void AudioGeneratorMP3::desync ()
     lastBuffLen = 0;
 }
 
+// Mono: Downmix stereo inside libmad, only one channel is synthesized.
+// Can be changed while playing, takes effect with the next frame.
+void AudioGeneratorMP3::SetMonoDecode(bool mono)
+{
+  if (mono) madOptions |= MAD_OPTION_SINGLECHANNEL;
+  else      madOptions &= ~MAD_OPTION_SINGLECHANNEL;
+
+  if (madInitted) {
+    mad_stream_options(stream, madOptions);
+  }
+}
+
+// Half rate: Synthesize at half the sample rate (synth_half), which
+// halves synth cost at the expense of treble. Like mono, can be
+// changed while playing; output rate follows with the next frame.
+void AudioGeneratorMP3::SetHalfRate(bool half)
+{
+  if (half) madOptions |= MAD_OPTION_HALFSAMPLERATE;
+  else      madOptions &= ~MAD_OPTION_HALFSAMPLERATE;
+
+  if (madInitted) {
+    mad_stream_options(stream, madOptions);
+  }
+}
+
 bool AudioGeneratorMP3::DecodeNextFrame()
 {
-  if (mad_frame_decode(frame, stream) == -1) {
+  unsigned long now = micros();
+  int r = mad_frame_decode(frame, stream);
+  frameUs += micros() - now;
+  if (r == -1) {
+    // Errors 0x02xx come after a good header (eg main data
+    // missing after a seek); that frame still counts
+    if ((stream->error & 0xff00) == 0x0200) FrameDone();
     ErrorToFlow(); // Always returns CONTINUE
     return false;
   }
   nsCountMax  = MAD_NSBSAMPLES(&frame->header);
+  FrameDone();
   return true;
 }
 
-bool AudioGeneratorMP3::GetOneSample(int16_t& saL, int16_t& saR)
+// Frame position and number, and seek index entry if due
+void AudioGeneratorMP3::FrameDone()
 {
-  // If we're here, we have one decoded frame and sent 0 or more samples out
-  if (samplePtr < synth->pcm.length) {
-    saL = synth->pcm.samples[0][samplePtr];
-    saR = synth->pcm.samples[1][samplePtr];
-    samplePtr++;
-  } else {
-    samplePtr = 0;
-
-    switch ( mad_synth_frame_onens(synth, frame, nsCount++) ) {
-        case MAD_FLOW_BREAK:
-          #ifdef HAVE_AUDIO_LOGGER
-          audioLogger->printf_P(PSTR("msf1ns MAD_FLOW_BREAK\n"));
-          #endif
-        case MAD_FLOW_STOP:
-          return false; // Either way we're done
-        default:
-          break; // Do nothing
-    }
+  framePos = lastReadPos + (stream->this_frame - buff);
+  if (frameIdx && !(nextFrameNum % frameIdxStep) && nextFrameNum / frameIdxStep == (uint32_t)frameIdxCount &&
+      frameIdxCount < frameIdxMax) {
+    frameIdx[frameIdxCount++] = framePos;
+  }
+  nextFrameNum++;
+}
 
-    if (synth->pcm.samplerate != lastRate) {
-        output->SetRate(synth->pcm.samplerate);
-        lastRate = synth->pcm.samplerate;
-    }
-    if (synth->pcm.channels != lastChannels) {
-        output->SetChannels(synth->pcm.channels);
-        lastChannels = synth->pcm.channels;
-    }
+// Seek index: Note the file position of every "step"th frame
+// in idx[], from entry "count" on; "num" is the number of the
+// next frame decoded. Reset by begin().
+void AudioGeneratorMP3::SetFrameIndex(uint32_t *idx, int max, int step, int count, uint32_t num)
+{
+  frameIdx = idx;
+  frameIdxMax = max;
+  frameIdxStep = step;
+  frameIdxCount = count;
+  nextFrameNum = num;
+}
+
+bool AudioGeneratorMP3::GetOneBlock()
+{
+  // If we're here, we have one decoded frame and sent out all
+  // samples of the previous block; synthesize the next granule
+  // straight into our interleaved buffer
+  int ns = nsCountMax - nsCount;
+  if (ns > granuleNS) ns = granuleNS;
+
+  unsigned long now = micros();
+  pcmLen = mad_synth_frame_interleaved(synth, frame, nsCount, nsCount + ns, pcmBuf);
+  nsCount += ns;
+  frameUs += micros() - now;
+  if (nsCount >= nsCountMax) {
+    decodeStats.add(frameUs);
+    frameUs = 0;
+  }
+  if (!pcmLen) return false;
 
-    // for IGNORE and CONTINUE, just play what we have now
-    saL = synth->pcm.samples[0][samplePtr];
-    saR = synth->pcm.samples[1][samplePtr];
-    samplePtr++;
+  if (synth->pcm.samplerate != lastRate) {
+      output->SetRate(synth->pcm.samplerate);
+      lastRate = synth->pcm.samplerate;
   }
+  if (synth->pcm.channels != lastChannels) {
+      output->SetChannels(synth->pcm.channels);
+      lastChannels = synth->pcm.channels;
+  }
+
+  samplePtr = 0;
+
   return true;
 }
 
@@ -238,14 +287,18 @@ bool AudioGeneratorMP3::loop()
 {
   if (!running) goto done; // Nothing to do here!
 
-  // First, try and push in the stored sample.  If we can't, then punt and try later
-  if (!output->ConsumeSample(sL, sR)) goto done; // Can't send, but no error detected
-
-  // Try and stuff the buffer one sample at a time
+  // Stuff the buffer one granule at a time
   do
   {
+    // First, try and push out what is left of the current block.
+    // If the output doesn't take all of it, punt and try later
+    if (samplePtr < pcmLen) {
+      samplePtr += output->ConsumeSamples(pcmBuf + (samplePtr << 1), pcmLen - samplePtr);
+      if (samplePtr < pcmLen) goto done; // Can't send, but no error detected
+    }
+
     // Decode next frame if we're beyond the existing generated data
-    if ( (samplePtr >= synth->pcm.length) && (nsCount >= nsCountMax) ) {
+    if (nsCount >= nsCountMax) {
 retry:
       if (Input() == MAD_FLOW_STOP) {
         return false;
@@ -268,18 +321,17 @@ retry:
         }
         goto retry;
       }
-      samplePtr = 9999;
       nsCount = 0;
     }
 
-    if (!GetOneSample(sL, sR)) {
+    if (!GetOneBlock()) {
       #ifdef HAVE_AUDIO_LOGGER
-      audioLogger->printf_P(PSTR("G1S failed\n"));
+      audioLogger->printf_P(PSTR("G1B failed\n"));
       #endif
       running = false;
       goto done;
     }
-  } while (running && output->ConsumeSample(sL, sR));
+  } while (running);
 
 done:
   file->loop();
@@ -309,16 +361,15 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
 
   if (!output->begin()) return false;
 
-  // Where we are in generating one frame's data, set to invalid so we will run loop on first getsample()
-  samplePtr = 9999;
+  // Where we are in generating one frame's data, set to invalid so we will decode on first loop()
+  samplePtr = pcmLen = 0;
   nsCount = 9999;
   lastRate = 0;
   lastChannels = 0;
   //lastReadPos = 0;
   lastBuffLen = 0;
-
-  // loop starts by pushing out samples, clear them here
-  sL = sR = 0;
+  frameIdx = NULL;
+  nextFrameNum = 0;
 
   // Allocate all large memory chunks
   if (preallocateStreamSize + preallocateFrameSize + preallocateSynthSize) {
@@ -378,7 +429,7 @@ bool AudioGeneratorMP3::begin(AudioFileSource *source, AudioOutput *output)
   mad_frame_init(frame);
   mad_synth_init(synth);
   synth->pcm.length = 0;
-  mad_stream_options(stream, 0); // TODO - add options support
+  mad_stream_options(stream, madOptions);
   madInitted = true;
 
   running = true;
@@ -39,6 +39,15 @@ class AudioGeneratorMP3 : public AudioGenerator
     virtual bool stop() override;
     virtual bool isRunning() override;
     virtual void desync () override;
+    void SetMonoDecode(bool mono);
+    void SetHalfRate(bool half);
+    // File position and number of the frame currently played
+    uint32_t GetFramePos() { return framePos; }
+    uint32_t GetFrameNum() { return nextFrameNum - 1; }
+    void SetFrameIndex(uint32_t *idx, int max, int step, int count, uint32_t num);
+    int GetFrameIndexCount() { return frameIdxCount; }
+    // Time to decode and synthesize a frame
+    AudioTiming decodeStats;
 
     static constexpr int preAllocSize () { return preAllocBuffSize() + preAllocStreamSize() + preAllocFrameSize() + preAllocSynthSize(); }
     static constexpr int preAllocBuffSize () { return ((buffLen + 7) & ~7); }
@@ -56,9 +65,22 @@ class AudioGeneratorMP3 : public AudioGenerator
     void *preallocateSynthSpace = nullptr;
     int preallocateSynthSize = 0;
 
+    #ifdef MP3_MONO_DECODE
+    int madOptions = MAD_OPTION_SINGLECHANNEL;
+    #else
+    int madOptions = 0;
+    #endif
+
     static constexpr int buffLen = 0x600; // Slightly larger than largest MP3 frame
     unsigned char *buff;
     int lastReadPos;
+    uint32_t framePos = 0;
+    uint32_t nextFrameNum = 0;
+    uint32_t *frameIdx = NULL;
+    int frameIdxMax = 0;
+    int frameIdxStep = 1;
+    volatile int frameIdxCount = 0;
+    uint32_t frameUs = 0;
     int lastBuffLen;
     unsigned int lastRate;
     int lastChannels;
@@ -72,11 +94,18 @@ class AudioGeneratorMP3 : public AudioGenerator
     int nsCount;
     int nsCountMax;
 
+    // One synthesized granule (18 ns blocks), interleaved
+    // for ConsumeSamples()
+    static constexpr int granuleNS = 18;
+    int16_t pcmBuf[2*granuleNS*32];
+    int pcmLen;
+
     // The internal helpers
     enum mad_flow ErrorToFlow();
     enum mad_flow Input();
     bool DecodeNextFrame();
-    bool GetOneSample(int16_t& sL, int16_t& sR);
+    void FrameDone();
+    bool GetOneBlock();
 
   private:
     int unrecoverable = 0;
@@ -44,14 +44,17 @@ class AudioOutput
     }
     #else
     virtual bool SetGain(float f1, int mutechnls = 0) {
-              int16_t g;
-              // TW: We know the limits. Also, 4.0 would be 0, hence mute.
-              //if (f1>4.0) f1 = 4.0; if (f1<0.0) f1=0.0;
-              g = (int16_t)(f1*(1<<6));
-              if(!mutechnls)           gainF2P6_R = gainF2P6_L = g;
-              else if(mutechnls > 0) { gainF2P6_R = g; gainF2P6_L = 0; }
-              else {                   gainF2P6_L = g; gainF2P6_R = 0; }
-              gainF2P6_R <<= 10;
+              return SetGainQ14((int32_t)(f1*(1<<14)), mutechnls);
+    }
+    // TW: Gain in Q14, max 2.0 (headroom for track normalization).
+    // This only sets the target; outputs move towards it block by
+    // block (RampGain()), to avoid clicks.
+    bool SetGainQ14(int32_t g, int mutechnls = 0) {
+              if(g > (2<<14)) g = 2<<14;
+              else if(g < 0) g = 0;
+              if(!mutechnls)           gainTgtR = gainTgtL = g;
+              else if(mutechnls > 0) { gainTgtR = g; gainTgtL = 0; }
+              else {                   gainTgtL = g; gainTgtR = 0; }
               return true;
     }
     #endif
@@ -62,16 +65,17 @@ class AudioOutput
     #else
     virtual bool ConsumeSample(int16_t sL, int16_t sR) { (void)sL;(void)sR; return false; }
     #endif
-    /*
+    // TW: Block interface. "samples" holds "count" interleaved L/R frames;
+    // if channels == 1, the R slot is ignored. Returns the number of frames
+    // consumed, which might be less than count if the output is full.
     virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count)
     {
       for (uint16_t i=0; i<count; i++) {
-        if (!ConsumeSample(samples)) return i;
+        if (!ConsumeSample(samples[0], samples[1])) return i;
         samples += 2;
       }
       return count;
     }
-    */
     virtual bool stop() { return false; }
     virtual void flush() { return; }
     virtual bool loop() { return true; }
@@ -100,14 +104,29 @@ class AudioOutput
       else return (int16_t)(v&0xffff);
     }
     #else
+    // TW: Gain can be above 1.0, so saturate
     inline void AmplifyL(int16_t& s) {
-      int32_t v = (s * gainF2P6_L) >> 6;
-      // TW: We NEVER amplify, we only ever attenuate
+      int32_t v = (s * gainQ14_L) >> 14;
+      if (v > 32767) v = 32767;
+      else if (v < -32768) v = -32768;
       s = v;
     }
     inline int32_t AmplifyR(int16_t s) {
-      return (s * gainF2P6_R) & 0xffff0000;
-      // TW: We NEVER amplify, we only ever attenuate
+      int32_t v = (s * gainQ14_R) >> 14;
+      if (v > 32767) v = 32767;
+      else if (v < -32768) v = -32768;
+      return (int32_t)((uint32_t)v << 16);
+    }
+    // TW: Move gain 1/16 of the remaining distance towards
+    // target; called once per block of samples
+    inline void RampGain() {
+      int32_t d;
+      if ((d = gainTgtL - gainQ14_L)) gainQ14_L += (d >> 4) ? (d >> 4) : ((d > 0) ? 1 : -1);
+      if ((d = gainTgtR - gainQ14_R)) gainQ14_R += (d >> 4) ? (d >> 4) : ((d > 0) ? 1 : -1);
+    }
+    inline void SnapGain() {
+      gainQ14_L = gainTgtL;
+      gainQ14_R = gainTgtR;
     }
     #endif
 
@@ -118,8 +137,10 @@ class AudioOutput
     #ifndef TWESP32
     uint8_t gainF2P6; // Fixed point 2.6
     #else
-    int16_t gainF2P6_L; // Fixed point 2.6
-    int32_t gainF2P6_R; // Fixed point 2.6
+    int32_t gainQ14_L;  // Fixed point 2.14, current
+    int32_t gainQ14_R;
+    volatile int32_t gainTgtL; // Target
+    volatile int32_t gainTgtR;
     #endif
 };
 
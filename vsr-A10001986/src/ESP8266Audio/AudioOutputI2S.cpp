@@ -116,7 +116,11 @@ AudioOutputI2S::~AudioOutputI2S()
   #endif
   i2sOn = false;
   */
+  #ifdef TWESP32
+  powerDown();
+  #else
   stop();
+  #endif
 }
 
 bool AudioOutputI2S::SetRate(int hz)
@@ -125,7 +129,14 @@ bool AudioOutputI2S::SetRate(int hz)
   this->hertz = hz;
   if (i2sOn)
   {
-  #ifdef ESP32
+  #ifdef TWESP32
+      // Reprogramming the clocks stops and restarts the DMA; skip
+      // this if the driver is already running at this rate
+      if (hz != curI2SRate) {
+        i2s_set_sample_rates((i2s_port_t)portNo, AdjustI2SRate(hz));
+        curI2SRate = hz;
+      }
+  #elif defined(ESP32)
       i2s_set_sample_rates((i2s_port_t)portNo, AdjustI2SRate(hz));
   #elif defined(ESP8266)
       i2s_set_rate(AdjustI2SRate(hz));
@@ -232,12 +243,20 @@ bool AudioOutputI2S::begin(bool txDAC)
           .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1, // lowest interrupt priority
           .dma_buf_count = dma_buf_count,
           .dma_buf_len = 64,
-          .use_apll = use_apll // Use audio PLL
+          .use_apll = use_apll, // Use audio PLL
+          #ifdef TWESP32
+          .tx_desc_auto_clear = auto_clear
+          #endif
       };
       #ifdef HAVE_AUDIO_LOGGER
       audioLogger->printf("+%d %p\n", portNo, &i2s_config_dac);
       #endif
+      #ifdef TWESP32
+      // Event queue for underrun detection
+      if (i2s_driver_install((i2s_port_t)portNo, &i2s_config_dac, 8, &i2sEvents) != ESP_OK)
+      #else
       if (i2s_driver_install((i2s_port_t)portNo, &i2s_config_dac, 0, NULL) != ESP_OK)
+      #endif
       {
         #ifdef HAVE_AUDIO_LOGGER
         audioLogger->println("ERROR: Unable to install I2S driver\n");
@@ -259,7 +278,18 @@ bool AudioOutputI2S::begin(bool txDAC)
         SetPinout();
       }
       i2s_zero_dma_buffer((i2s_port_t)portNo);
+      #ifdef TWESP32
+      curI2SRate = 44100;
+      #endif
     }
+    #ifdef TWESP32
+    // Nothing playing, no need to ramp
+    SnapGain();
+    idle = false;
+    // DMA has been (or will be) running dry until the first 
+    // write; start counting underruns then
+    evArmed = false;
+    #endif
   #elif defined(ESP8266)
     (void)dma_buf_count;
     (void)use_apll;
@@ -296,16 +326,10 @@ bool AudioOutputI2S::begin(bool txDAC)
 }
 
 #ifdef TWESP32
-size_t AudioOutputI2S::ConsumeSample(int16_t msL, int16_t msR)
+inline uint32_t AudioOutputI2S::MakeI2SSample(int16_t msL, int16_t msR)
 {
     // We don't ever use 8 bit samples or the internal DAC
 
-    //return if we haven't called ::begin yet
-    if(!i2sOn)
-        return false;
-
-    uint32_t s32;
-
     if(channels == 1) msR = msL;
     #ifndef AUTO_MONO
     else {
@@ -323,12 +347,160 @@ size_t AudioOutputI2S::ConsumeSample(int16_t msL, int16_t msR)
     #endif // AUTO_MONO
 
     AmplifyL(msL);
-    s32 = ((uint32_t)AmplifyR(msR)) | (uint16_t)msL;
+    return ((uint32_t)AmplifyR(msR)) | (uint16_t)msL;
+}
+
+size_t AudioOutputI2S::ConsumeSample(int16_t msL, int16_t msR)
+{
+    //return if we haven't called ::begin yet
+    if(!i2sOn)
+        return false;
+
+    if(latArmed && (msL || msR)) {
+        latency = micros() - latStart;
+        latArmed = false;
+        latDone = true;
+    }
+
+    // No blocks here, so no ramp
+    SnapGain();
+
+    uint32_t s32 = MakeI2SSample(msL, msR);
 
     size_t i2s_bytes_written;
     i2s_write((i2s_port_t)portNo, (const char*)&s32, sizeof(uint32_t), &i2s_bytes_written, 0);
     return i2s_bytes_written;
 }
+
+uint16_t AudioOutputI2S::ConsumeSamples(int16_t *samples, uint16_t count)
+{
+    uint32_t s32[i2sBlockLen];
+    uint16_t done = 0;
+
+    //return if we haven't called ::begin yet
+    if(!i2sOn)
+        return 0;
+
+    if(latArmed)
+        checkLatency(samples, count);
+
+    checkUnderrun();
+
+    // Convert and write in chunks of one DMA buffer; stop as
+    // soon as the driver doesn't take a complete chunk.
+    while(done < count) {
+        int n = count - done;
+        if(n > i2sBlockLen) n = i2sBlockLen;
+
+        for(int i = 0; i < n; i++, samples += 2) {
+            s32[i] = MakeI2SSample(samples[0], samples[1]);
+        }
+
+        size_t i2s_bytes_written;
+        i2s_write((i2s_port_t)portNo, (const char*)s32, n * sizeof(uint32_t), &i2s_bytes_written, 0);
+        i2s_bytes_written /= sizeof(uint32_t);
+        done += i2s_bytes_written;
+        if(i2s_bytes_written < (size_t)n)
+            break;
+
+        // Step gain only per chunk actually played, so the 
+        // ramp does not depend on how often we are called
+        RampGain();
+    }
+
+    return done;
+}
+
+// Count underruns: The driver reports TX_Q_OVF when it
+// finds all DMA buffers empty. Events older than our first
+// write after begin() or rearmUnderrun() are ignored.
+void AudioOutputI2S::checkUnderrun()
+{
+    i2s_event_t ev;
+
+    if(!i2sEvents)
+        return;
+
+    if(!evArmed) {
+        xQueueReset(i2sEvents);
+        evArmed = true;
+        return;
+    }
+
+    while(xQueueReceive(i2sEvents, &ev, 0) == pdTRUE) {
+        if(ev.type == I2S_EVENT_TX_Q_OVF) underruns++;
+    }
+}
+
+void AudioOutputI2S::zeroBuffer()
+{
+    if(i2sOn) {
+        i2s_zero_dma_buffer((i2s_port_t)portNo);
+    }
+}
+
+void AudioOutputI2S::SetPersistent(bool persist)
+{
+    // Without auto-clear, the DMA would loop the last
+    // buffers while idle instead of playing silence
+    persistent = persist;
+    if(persist) auto_clear = true;
+}
+
+bool AudioOutputI2S::powerDown()
+{
+    if(!i2sOn)
+        return false;
+
+    i2s_zero_dma_buffer((i2s_port_t)portNo);
+    i2s_driver_uninstall((i2s_port_t)portNo);
+    i2sEvents = NULL;
+    i2sOn = false;
+    idle = false;
+    curI2SRate = 0;
+    return true;
+}
+
+// Latency is measured up to the point where the first
+// non-zero sample is handed to the DMA, ie it does not
+// include the DMA queue.
+void AudioOutputI2S::armLatency()
+{
+    latDone = false;
+    latStart = micros();
+    latArmed = true;
+}
+
+bool AudioOutputI2S::getLatency(uint32_t &us)
+{
+    if(!latDone)
+        return false;
+
+    us = latency;
+    latDone = false;
+    return true;
+}
+
+void AudioOutputI2S::checkLatency(const int16_t *samples, int count)
+{
+    const int16_t *end = samples + (count << 1);
+
+    if(channels == 1) {
+        for( ; samples < end; samples += 2) {
+            if(samples[0]) break;
+        }
+    } else {
+        for( ; samples < end; samples++) {
+            if(*samples) break;
+        }
+    }
+
+    if(samples < end) {
+        latency = micros() - latStart;
+        latArmed = false;
+        latDone = true;
+    }
+}
 #else
 bool AudioOutputI2S::ConsumeSample(int16_t sL, int16_t sR)
 {
@@ -394,7 +566,20 @@ bool AudioOutputI2S::stop()
   if (!i2sOn)
     return false;
 
-  #ifdef ESP32
+  #ifdef TWESP32
+    if (persistent) {
+      // Keep driver installed; with auto-clear the DMA
+      // plays silence until the next source starts
+      if (!idle) {
+        i2s_zero_dma_buffer((i2s_port_t)portNo);
+        idle = true;
+        idleNow = millis();
+      }
+      return true;
+    }
+    powerDown();
+    return true;
+  #elif defined(ESP32)
     i2s_zero_dma_buffer((i2s_port_t)portNo);
     i2s_driver_uninstall((i2s_port_t)portNo); //stop & destroy i2s driver
   #elif defined(ESP8266)
@@ -42,6 +42,7 @@ class AudioOutputI2S : public AudioOutput
     virtual bool begin() override { return begin(true); }
     #ifdef TWESP32
     virtual size_t ConsumeSample(int16_t sL, int16_t sR) override;
+    virtual uint16_t ConsumeSamples(int16_t *samples, uint16_t count) override;
     #else
     virtual bool ConsumeSample(int16_t sL, int16_t sR) override;
     #endif
@@ -51,10 +52,26 @@ class AudioOutputI2S : public AudioOutput
     bool begin(bool txDAC);
     bool SetOutputModeMono(bool mono);  // Force mono output no matter the input
     bool SetLsbJustified(bool lsbJustified);  // Allow supporting non-I2S chips, e.g. PT8211
+    #ifdef TWESP32
+    void SetAutoClear(bool autoClear) { this->auto_clear = autoClear; }  // Play silence on underrun; call before begin()
+    void SetPersistent(bool persist);   // stop() only idles, driver stays installed; call before begin()
+    bool powerDown();                   // Uninstall driver, also in persistent mode
+    bool isIdle() { return i2sOn && idle; }
+    unsigned long idleSince() { return idleNow; }
+    void zeroBuffer();
+    void armLatency();                  // Start measuring time to first non-zero sample
+    bool getLatency(uint32_t &us);      // True once per completed measurement
+    uint32_t getUnderruns() { return underruns; }   // DMA ran dry while playing
+    void rearmUnderrun() { evArmed = false; }       // Was idle; count from next write
+    #endif
 
   protected:
     bool SetPinout();
     virtual int AdjustI2SRate(int hz) { return hz; }
+    #ifdef TWESP32
+    inline uint32_t MakeI2SSample(int16_t msL, int16_t msR);
+    static constexpr int i2sBlockLen = 64;  // frames per i2s_write(), = dma_buf_len
+    #endif
     uint8_t portNo;
     int output_mode;
     bool mono;
@@ -62,6 +79,22 @@ class AudioOutputI2S : public AudioOutput
     bool i2sOn;
     int dma_buf_count;
     int use_apll;
+    bool auto_clear = false;
+    #ifdef TWESP32
+    bool persistent = false;
+    bool idle = false;
+    unsigned long idleNow = 0;
+    int curI2SRate = 0;
+    volatile bool latArmed = false;
+    volatile bool latDone = false;
+    uint32_t latStart = 0;
+    uint32_t latency = 0;
+    void checkLatency(const int16_t *samples, int count);
+    QueueHandle_t i2sEvents = NULL;
+    volatile bool evArmed = false;
+    volatile uint32_t underruns = 0;
+    void checkUnderrun();
+    #endif
     // We can restore the old values and free up these pins when in NoDAC mode
     uint32_t orig_bck;
     uint32_t orig_ws;
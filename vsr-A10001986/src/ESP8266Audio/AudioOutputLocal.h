@@ -5,5 +5,9 @@
 // Audio hardware does mono conversion
 #define AUTO_MONO
 
+// Decode MP3 in mono: Channels are downmixed before IMDCT/synthesis,
+// saving CPU time. Default for AudioGeneratorMP3::SetMonoDecode().
+#define MP3_MONO_DECODE
+
 // If not AUTO_MONO: Force mono output
 //#define FORCE_MONO
\ No newline at end of file
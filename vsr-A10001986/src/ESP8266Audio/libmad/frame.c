@@ -499,4 +499,6 @@ void mad_frame_mute(struct mad_frame *frame)
 	frame->overlap[1][sb][s] = 0;
     }
   }
+
+  frame->ovl_mixed = 0;
 }
@@ -71,6 +71,7 @@ struct mad_frame {
 
   mad_fixed_t sbsample[2][36][32];	/* synthesis subband filter samples */
   mad_fixed_t overlap[2][32][18];	/* Layer III block overlap data */
+  int ovl_mixed;			/* overlap[0] holds downmix (SINGLECHANNEL) */
 
   mad_fixed_t xr_raw[576*2];
   mad_fixed_t tmp[576];
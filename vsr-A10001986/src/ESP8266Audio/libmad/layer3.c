@@ -2413,6 +2413,19 @@ void III_freqinver(mad_fixed_t sample[18][32], unsigned int sb)
 # endif
 }
 
+/*
+   NAME:	III_downmix()
+   DESCRIPTION:	average two channels' values into the first
+*/
+static
+void III_downmix(mad_fixed_t *a, mad_fixed_t const *b, unsigned int n)
+{
+  while (n--) {
+    *a = (*a >> 1) + (*b++ >> 1);
+    ++a;
+  }
+}
+
 /*
    NAME:	III_decode()
    DESCRIPTION:	decode frame main_data
@@ -2425,6 +2438,7 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
   mad_fixed_t *xr[2]; // Moved from stack to dynheap
 //  mad_fixed_t *xr_raw; // [2][576]
   unsigned int sfreqi, ngr, gr;
+  int single;
 //  xr_raw = (mad_fixed_t*)malloc(sizeof(mad_fixed_t) * 2 * 576);
 //  if (!xr_raw)
 //    return MAD_ERROR_NOMEM;
@@ -2448,6 +2462,22 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
       sfreqi += 3;
   }
 
+  /*
+     SINGLECHANNEL: Where both channels of a granule use the same block
+     layout, IMDCT and overlap-add are linear, so we downmix the spectrum
+     and only transform channel 0; overlap[0] then holds the downmix of
+     both channels' overlap data (ovl_mixed). Otherwise, both channels are
+     transformed (starting from the mixed overlap data) and the subband
+     samples are downmixed. Synthesis then only processes channel 0.
+  */
+  single = (nch == 2 &&
+            (frame->options & MAD_OPTION_SINGLECHANNEL) == MAD_OPTION_SINGLECHANNEL);
+
+  if (!single && nch == 2 && frame->ovl_mixed) {
+    memcpy(frame->overlap[1], frame->overlap[0], sizeof(frame->overlap[0]));
+    frame->ovl_mixed = 0;
+  }
+
   /* scalefactors, Huffman decoding, requantization */
 
   ngr = (header->flags & MAD_FLAG_LSF_EXT) ? 1 : 2;
@@ -2455,7 +2485,7 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
   for (gr = 0; gr < ngr; ++gr) {
     struct granule *granule = &si->gr[gr];
     unsigned int const *sfbwidth[2];
-    unsigned int ch;
+    unsigned int ch, tnch;
     enum mad_error error;
 
     for (ch = 0; ch < nch; ++ch) {
@@ -2496,9 +2526,30 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
       }
     }
 
+    /* single channel downmix */
+
+    tnch = nch;
+
+    if (single) {
+      if (granule->ch[0].block_type == granule->ch[1].block_type &&
+          (granule->ch[0].flags & mixed_block_flag) ==
+          (granule->ch[1].flags & mixed_block_flag)) {
+        III_downmix(xr[0], xr[1], 576);
+        if (!frame->ovl_mixed) {
+          III_downmix(&frame->overlap[0][0][0], &frame->overlap[1][0][0], 32 * 18);
+          frame->ovl_mixed = 1;
+        }
+        tnch = 1;
+      }
+      else if (frame->ovl_mixed) {
+        memcpy(frame->overlap[1], frame->overlap[0], sizeof(frame->overlap[0]));
+        frame->ovl_mixed = 0;
+      }
+    }
+
     /* reordering, alias reduction, IMDCT, overlap-add, frequency inversion */
 
-    for (ch = 0; ch < nch; ++ch) {
+    for (ch = 0; ch < tnch; ++ch) {
       struct channel const *channel = &granule->ch[ch];
       mad_fixed_t (*sample)[32] = &frame->sbsample[ch][18 * gr];
       unsigned int sb, l, i, sblimit;
@@ -2591,6 +2642,9 @@ enum mad_error III_decode(struct mad_bitptr *ptr, struct mad_frame *frame,
           III_freqinver(sample, sb);
       }
     }
+
+    if (single && tnch == 2)
+      III_downmix(&frame->sbsample[0][18 * gr][0], &frame->sbsample[1][18 * gr][0], 18 * 32);
   }
 
 //  free(xr_raw);
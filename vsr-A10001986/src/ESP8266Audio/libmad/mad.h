@@ -716,12 +716,12 @@ struct mad_stream {
 
 enum {
   MAD_OPTION_IGNORECRC      = 0x0001,	/* ignore CRC errors */
-  MAD_OPTION_HALFSAMPLERATE = 0x0002	/* generate PCM at 1/2 sample rate */
+  MAD_OPTION_HALFSAMPLERATE = 0x0002,	/* generate PCM at 1/2 sample rate */
 # if 0  /* not yet implemented */
   MAD_OPTION_LEFTCHANNEL    = 0x0010,	/* decode left channel only */
   MAD_OPTION_RIGHTCHANNEL   = 0x0020,	/* decode right channel only */
-  MAD_OPTION_SINGLECHANNEL  = 0x0030	/* combine channels */
 # endif
+  MAD_OPTION_SINGLECHANNEL  = 0x0030	/* combine channels (Layer III) */
 };
 
 void mad_stream_init(struct mad_stream *);
@@ -791,6 +791,7 @@ struct mad_frame {
 
   mad_fixed_t sbsample[2][36][32];	/* synthesis subband filter samples */
   mad_fixed_t overlap[2][32][18];	/* Layer III block overlap data */
+  int ovl_mixed;			/* overlap[0] holds downmix (SINGLECHANNEL) */
 
   mad_fixed_t xr_raw[576*2];
   mad_fixed_t tmp[576];
@@ -896,6 +897,7 @@ void mad_synth_mute(struct mad_synth *);
 
 enum mad_flow mad_synth_frame(struct mad_synth *, struct mad_frame const *, enum mad_flow (*output_func)(void *s, struct mad_header const *, struct mad_pcm *), void *cbdata );
 enum mad_flow mad_synth_frame_onens(struct mad_synth *synth, struct mad_frame const *frame, unsigned int ns);
+int mad_synth_frame_interleaved(struct mad_synth *synth, struct mad_frame const *frame, unsigned int startns, unsigned int endns, int16_t *out);
 
 # endif
 
@@ -578,10 +578,12 @@ void synth_full(struct mad_synth *, struct mad_frame const *,
 static
 enum mad_flow synth_full(struct mad_synth *synth, struct mad_frame const *frame,
                 unsigned int nch, unsigned int startns, unsigned int endns,
-                enum mad_flow (*output_func)(void *s, struct mad_header const *, struct mad_pcm *), void *cbdata)
+                enum mad_flow (*output_func)(void *s, struct mad_header const *, struct mad_pcm *), void *cbdata,
+                int16_t *out)
 {
   unsigned int phase, ch, s, sb, pe, po;
   int16_t *pcm1, *pcm2;
+  unsigned int st = out ? 2 : 1;
   mad_fixed_t (*filter)[2][2][16][8];
   mad_fixed_t const (*sbsample)[36][32];
   register mad_fixed_t (*fe)[8], (*fx)[8], (*fo)[8];
@@ -595,7 +597,8 @@ enum mad_flow synth_full(struct mad_synth *synth, struct mad_frame const *frame,
       sbsample = &frame->sbsample[ch];
       filter   = &synth->filter[ch];
       phase    = (synth->phase + start ) % 16;
-      pcm1     = synth->pcm.samples[ch];// + start * 32;
+      /* into interleaved "out", or per ns into synth->pcm */
+      pcm1     = out ? out + (start - startns) * 32 * 2 + ch : synth->pcm.samples[ch];
 
       for (s = start; s <= start; ++s) {
         dct32((*sbsample)[s], phase >> 1,
@@ -633,9 +636,10 @@ enum mad_flow synth_full(struct mad_synth *synth, struct mad_frame const *frame,
         MLA(hi, lo, (*fe)[6], ptr[ 4]);
         MLA(hi, lo, (*fe)[7], ptr[ 2]);
 
-        *pcm1++ = scale(SHIFT(MLZ(hi, lo)));
+        *pcm1 = scale(SHIFT(MLZ(hi, lo)));
+        pcm1 += st;
 
-        pcm2 = pcm1 + 30;
+        pcm2 = pcm1 + 30 * st;
 
         for (sb = 1; sb < 16; ++sb) {
           ++fe;
@@ -664,7 +668,8 @@ enum mad_flow synth_full(struct mad_synth *synth, struct mad_frame const *frame,
           MLA(hi, lo, (*fe)[1], ptr[14]);
           MLA(hi, lo, (*fe)[0], ptr[ 0]);
 
-          *pcm1++ = scale(SHIFT(MLZ(hi, lo)));
+          *pcm1 = scale(SHIFT(MLZ(hi, lo)));
+          pcm1 += st;
 
           ptr = *Dptr - pe;
           ML0(hi, lo, (*fe)[0], ptr[31 - 16]);
@@ -686,7 +691,8 @@ enum mad_flow synth_full(struct mad_synth *synth, struct mad_frame const *frame,
           MLA(hi, lo, (*fo)[1], ptr[31 - 14]);
           MLA(hi, lo, (*fo)[0], ptr[31 - 16]);
 
-          *pcm2-- = scale(SHIFT(MLZ(hi, lo)));
+          *pcm2 = scale(SHIFT(MLZ(hi, lo)));
+          pcm2 -= st;
 
           ++fo;
         }
@@ -704,7 +710,7 @@ enum mad_flow synth_full(struct mad_synth *synth, struct mad_frame const *frame,
         MLA(hi, lo, (*fo)[7], ptr[ 2]);
 
         *pcm1 = scale(SHIFT(-MLZ(hi, lo)));
-        pcm1 += 16;
+        pcm1 += 16 * st;
 
         phase = (phase + 1) % 16;
       }
@@ -725,10 +731,12 @@ enum mad_flow synth_full(struct mad_synth *synth, struct mad_frame const *frame,
 static
 enum mad_flow synth_half(struct mad_synth *synth, struct mad_frame const *frame,
                 unsigned int nch, unsigned int startns, unsigned int endns,
-                enum mad_flow (*output_func)(void *s, struct mad_header const *, struct mad_pcm *), void *cbdata )
+                enum mad_flow (*output_func)(void *s, struct mad_header const *, struct mad_pcm *), void *cbdata,
+                int16_t *out )
 {
   unsigned int phase, ch, s, sb, pe, po;
   int16_t *pcm1, *pcm2;
+  unsigned int st = out ? 2 : 1;
   mad_fixed_t (*filter)[2][2][16][8];
   mad_fixed_t const (*sbsample)[36][32];
   register mad_fixed_t (*fe)[8], (*fx)[8], (*fo)[8];
@@ -741,7 +749,8 @@ enum mad_flow synth_half(struct mad_synth *synth, struct mad_frame const *frame,
       sbsample = &frame->sbsample[ch];
       filter   = &synth->filter[ch];
       phase    = (synth->phase + start) % 16;
-      pcm1     = synth->pcm.samples[ch];// + start * 32;
+      /* into interleaved "out", or per ns into synth->pcm */
+      pcm1     = out ? out + (start - startns) * 16 * 2 + ch : synth->pcm.samples[ch];
 
       for (s = start; s <= start; ++s) {
         dct32((*sbsample)[s], phase >> 1,
@@ -779,9 +788,10 @@ enum mad_flow synth_half(struct mad_synth *synth, struct mad_frame const *frame,
         MLA(hi, lo, (*fe)[6], ptr[ 4]);
         MLA(hi, lo, (*fe)[7], ptr[ 2]);
 
-        *pcm1++ = scale(SHIFT(MLZ(hi, lo)));
+        *pcm1 = scale(SHIFT(MLZ(hi, lo)));
+        pcm1 += st;
 
-        pcm2 = pcm1 + 14;
+        pcm2 = pcm1 + 14 * st;
 
         for (sb = 1; sb < 16; ++sb) {
           ++fe;
@@ -811,7 +821,8 @@ enum mad_flow synth_half(struct mad_synth *synth, struct mad_frame const *frame,
             MLA(hi, lo, (*fe)[1], ptr[14]);
             MLA(hi, lo, (*fe)[0], ptr[ 0]);
 
-            *pcm1++ = scale(SHIFT(MLZ(hi, lo)));
+            *pcm1 = scale(SHIFT(MLZ(hi, lo)));
+            pcm1 += st;
 
             ptr = *Dptr - po;
             ML0(hi, lo, (*fo)[7], ptr[31 -  2]);
@@ -833,7 +844,8 @@ enum mad_flow synth_half(struct mad_synth *synth, struct mad_frame const *frame,
             MLA(hi, lo, (*fe)[6], ptr[31 -  4]);
             MLA(hi, lo, (*fe)[7], ptr[31 -  2]);
 
-            *pcm2-- = scale(SHIFT(MLZ(hi, lo)));
+            *pcm2 = scale(SHIFT(MLZ(hi, lo)));
+            pcm2 -= st;
           }
 
           ++fo;
@@ -852,7 +864,7 @@ enum mad_flow synth_half(struct mad_synth *synth, struct mad_frame const *frame,
         MLA(hi, lo, (*fo)[7], ptr[ 2]);
 
         *pcm1 = scale(SHIFT(-MLZ(hi, lo)));
-        pcm1 += 8;
+        pcm1 += 8 * st;
 
         phase = (phase + 1) % 16;
         
@@ -874,9 +886,12 @@ enum mad_flow mad_synth_frame(struct mad_synth *synth, struct mad_frame const *f
 //void mad_synth_frame(struct mad_synth *synth, struct mad_frame const *frame)
 {
   unsigned int nch, ns;
-  enum mad_flow (*synth_frame)(struct mad_synth *, struct mad_frame const *, unsigned int, unsigned int, unsigned int, enum mad_flow (*output_func)(), void *);
+  enum mad_flow (*synth_frame)(struct mad_synth *, struct mad_frame const *, unsigned int, unsigned int, unsigned int, enum mad_flow (*output_func)(), void *, int16_t *);
 
   nch = MAD_NCHANNELS(&frame->header);
+  if ((frame->options & MAD_OPTION_SINGLECHANNEL) == MAD_OPTION_SINGLECHANNEL &&
+      frame->header.layer == MAD_LAYER_III)
+    nch = 1;  /* layer III decoder has downmixed into channel 0 */
   ns  = MAD_NSBSAMPLES(&frame->header);
 
   synth->pcm.samplerate = frame->header.samplerate;
@@ -892,7 +907,7 @@ enum mad_flow mad_synth_frame(struct mad_synth *synth, struct mad_frame const *f
     synth_frame = synth_half;
   }
 
-  enum mad_flow ret = synth_frame(synth, frame, nch, 0, ns, output_func, cbdata);
+  enum mad_flow ret = synth_frame(synth, frame, nch, 0, ns, output_func, cbdata, NULL);
 
   synth->phase = (synth->phase + ns) % 16;
 
@@ -904,9 +919,12 @@ enum mad_flow mad_synth_frame(struct mad_synth *synth, struct mad_frame const *f
 enum mad_flow mad_synth_frame_onens(struct mad_synth *synth, struct mad_frame const *frame, unsigned int ns)
 {
   unsigned int nch; //, ns;
-  enum mad_flow (*synth_frame)(struct mad_synth *, struct mad_frame const *, unsigned int, unsigned int, unsigned int, enum mad_flow (*output_func)(), void *);
+  enum mad_flow (*synth_frame)(struct mad_synth *, struct mad_frame const *, unsigned int, unsigned int, unsigned int, enum mad_flow (*output_func)(), void *, int16_t *);
 
   nch = MAD_NCHANNELS(&frame->header);
+  if ((frame->options & MAD_OPTION_SINGLECHANNEL) == MAD_OPTION_SINGLECHANNEL &&
+      frame->header.layer == MAD_LAYER_III)
+    nch = 1;  /* layer III decoder has downmixed into channel 0 */
 //  ns  = MAD_NSBSAMPLES(&frame->header);
 
   synth->pcm.samplerate = frame->header.samplerate;
@@ -921,10 +939,51 @@ enum mad_flow mad_synth_frame_onens(struct mad_synth *synth, struct mad_frame co
 
     synth_frame = synth_half;
   }
-  enum mad_flow ret = synth_frame(synth, frame, nch, ns, ns+1, NULL, NULL);
+  enum mad_flow ret = synth_frame(synth, frame, nch, ns, ns+1, NULL, NULL, NULL);
 
   if (ns==MAD_NSBSAMPLES(&frame->header)-1)
     synth->phase = (synth->phase + MAD_NSBSAMPLES(&frame->header)) % 16;
 
   return ret;
 }
+
+/*
+   NAME:	synth->frame_interleaved()
+   DESCRIPTION:	synthesize ns [startns, endns) of the frame straight into
+		"out" as interleaved L/R int16 frames (with one channel,
+		only L slots are written). Returns number of frames
+		written; synth->pcm holds rate, channels and per-ns length.
+*/
+int mad_synth_frame_interleaved(struct mad_synth *synth, struct mad_frame const *frame, unsigned int startns, unsigned int endns, int16_t *out)
+{
+  unsigned int nch, ns;
+  enum mad_flow (*synth_frame)(struct mad_synth *, struct mad_frame const *, unsigned int, unsigned int, unsigned int, enum mad_flow (*output_func)(), void *, int16_t *);
+
+  nch = MAD_NCHANNELS(&frame->header);
+  if ((frame->options & MAD_OPTION_SINGLECHANNEL) == MAD_OPTION_SINGLECHANNEL &&
+      frame->header.layer == MAD_LAYER_III)
+    nch = 1;  /* layer III decoder has downmixed into channel 0 */
+  ns  = MAD_NSBSAMPLES(&frame->header);
+  if (endns > ns) endns = ns;
+  if (startns >= endns) return 0;
+
+  synth->pcm.samplerate = frame->header.samplerate;
+  synth->pcm.channels   = nch;
+  synth->pcm.length     = 32;
+
+  synth_frame = synth_full;
+
+  if (frame->options & MAD_OPTION_HALFSAMPLERATE) {
+    synth->pcm.samplerate /= 2;
+    synth->pcm.length     /= 2;
+
+    synth_frame = synth_half;
+  }
+
+  synth_frame(synth, frame, nch, startns, endns, NULL, NULL, out);
+
+  if (endns == ns)
+    synth->phase = (synth->phase + ns) % 16;
+
+  return (endns - startns) * synth->pcm.length;
+}
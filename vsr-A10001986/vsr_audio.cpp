@@ -60,9 +60,15 @@
 
 #include "AudioFileSourceLoop.h"
 #include "AudioGeneratorWAVLoop.h"
+#include "AudioGeneratorPCM.h"
+#include "AudioSoundCache.h"
+#include "AudioOutputMixer.h"
 
 #include "src/ESP8266Audio/AudioGeneratorMP3.h"
 #include "src/ESP8266Audio/AudioOutputI2S.h"
+#ifdef VSR_AUDIO_TASK
+#include "AudioOutputRing.h"
+#endif
 
 #include "vsrdisplay.h"
 #include "vsr_main.h"
@@ -72,12 +78,149 @@
 
 static AudioGeneratorMP3 *mp3;
 static AudioGeneratorWAVLoop *wav;
+static AudioGeneratorPCM *pcm;
 
 static AudioFileSourceFSLoop *myFS0L;
 static AudioFileSourceSDLoop *mySD0L;
+static AudioFileSourceFSLoop *myFS1L;   // Second set for appended file
+static AudioFileSourceSDLoop *mySD1L;
+
+// Generator feeding the stream voice, and generator primed
+// for the appended file; plus the file source set they use.
+static AudioGenerator *curGen = NULL;
+static AudioGenerator *nextGen = NULL;
+static int            curSet = 0;
+static int            nextSet = 0;
+static bool           curMusic = false;   // PA_MUSIC
+static bool           nextMusic = false;
+
+// Position (frame) where music was last stopped, and track 
+// (mpCurrIdx) to resume there if music was interrupted
+static volatile uint32_t musStopPos = 0;
+static int            mpResumeIdx = -1;
+
+#define GL_IDLE         0
+#define GL_RUNNING      1
+#define GL_ENDED        2
+#define GL_HANDOFF      3
 
 static AudioOutputI2S *out;
 
+// Decoder arena: Allocated once in audio_setup(), so that playing
+// sounds does not churn the heap. Holds the mp3 decoder state, the
+// wav buffer, and the read-ahead buffers of both file source sets.
+#define AA_MP3_SIZE     AudioGeneratorMP3::preAllocSize()
+#define AA_WAV_SIZE     1024
+#define AA_SRC_SIZE     (2 * AFSL_CHUNK)
+#define AA_SIZE         (AA_MP3_SIZE + AA_WAV_SIZE + 2 * AA_SRC_SIZE)
+
+static uint8_t *audioArena = NULL;
+
+// Heap watch, sampled whenever a sound ends
+static uint32_t heapPlays = 0;
+static uint32_t heapMinFree = 0xffffffff;
+static uint32_t heapMinBlock = 0xffffffff;
+
+// Interval between audio loop iterations while playing; histogram
+// buckets (ms): <1 <2 <5 <10 <20 <50 <100 more
+#define AST_HIST        8
+static const uint8_t  loopHistMs[AST_HIST - 1] = { 1, 2, 5, 10, 20, 50, 100 };
+static AudioTiming    loopStats;
+static uint32_t       loopHist[AST_HIST] = { 0 };
+static unsigned long  loopLast = 0;
+
+// Mixer: Stream voice FIFO size (frames; power of 2), and
+// stream gain while overlays are playing (Q15)
+#define MIX_FIFO        256
+#define MIX_DUCK        (MIX_UNITY * 4 / 10)
+
+// Crossfade (frames) when an appended file takes over; 0 = none
+#define AP_XFADE        0
+
+static AudioOutputMixer *mixer;
+
+// I2S driver stays installed between sounds (and plays silence);
+// it is only uninstalled after being idle for this long (ms)
+#define I2S_IDLE_PWRDOWN 30000
+
+// I2S DMA buffers (64 frames each)
+#define I2S_DMA_BUFS    32
+#define I2S_DMA_FRAMES  (I2S_DMA_BUFS * 64)
+
+// CPU budget governor: Music is synthesized at half the sample 
+// rate while we are under pressure. Load is the percentage of
+// buffered audio (DMA, or ring in task mode) used up between 
+// refills; it is averaged with fast attack and slow decay.
+#define GOV_HI          50      // Switch to half rate above this (%)
+#define GOV_LO          20      // Back to full rate below this (%)...
+#define GOV_HOLD        5000    // ...for this long (ms)
+
+static bool          govHalf = false;
+static uint32_t      govLoad = 0;     // %, Q4
+static bool          govLow = false;
+static unsigned long govLowNow = 0;
+#ifndef VSR_AUDIO_TASK
+static bool          govTiming = false;
+static unsigned long govLastLoop = 0;
+#endif
+
+// Sound effect cache: Total budget (bytes), number of 
+// entries, max length of one sound (frames; 16 bit mono),
+// which is half the budget, so one sound can't push out
+// all others. The cache is only filled at setup.
+#define SC_BUDGET       VSR_SNDCACHE_SIZE
+#define SC_ENTRIES      16
+#define SC_MAXFRAMES    (SC_BUDGET / 2 / sizeof(int16_t))
+
+static AudioSoundCache    *sndCache;
+#ifdef VSR_AUDIO_TASK
+// Lookups (which update LRU state) come from audio task and main thread
+static SemaphoreHandle_t  scLock;
+#define SC_LOCK()   xSemaphoreTake(scLock, portMAX_DELAY)
+#define SC_UNLOCK() xSemaphoreGive(scLock)
+#else
+#define SC_LOCK()
+#define SC_UNLOCK()
+#endif
+
+static const char *scPreload[] = {
+    "/button.mp3", "/buttonl.mp3", "/button_bad.mp3", "/volchg.mp3", NULL
+};
+
+#ifdef VSR_AUDIO_TASK
+// Decoder task writes into ring, feeder task drains ring into I2S
+#define AT_RING_FRAMES  2048    // ~46ms at 44.1kHz; power of 2
+#define AT_QUEUE_LEN    8
+#define AT_CORE         0       // Arduino loop() runs on core 1
+#define AT_DEC_PRIO     3
+#define AT_FEED_PRIO    4
+#define AT_DEC_STACK    8192
+#define AT_FEED_STACK   2048
+
+#define AT_PLAY         1
+#define AT_STOP         2
+#define AT_STOPMP3      3
+#define AT_NOLOOP       4
+#define AT_MIX          5
+#define AT_APPEND       6
+#define AT_STOPKEY      7
+
+typedef struct {
+    uint8_t  cmd;
+    uint32_t flags;
+    int32_t  arg;       // AT_PLAY: start pos; AT_MIX: gain; AT_APPEND: sequence; AT_STOPKEY: key
+    char     fn[256];
+} AudioTaskCmd;
+
+static AudioOutputRing *ring;
+static QueueHandle_t   atQueue;
+static volatile int    atPending = 0;
+static volatile bool   atMP3Running = false;
+static volatile bool   atWAVRunning = false;
+static uint32_t        atPrimedSeq = 0;
+static volatile uint32_t atAppendedSeq = 0;
+#endif
+
 bool audioInitDone = false;
 bool audioMute = false;
 
@@ -86,32 +229,75 @@ bool            mpActive = false;
 static uint16_t *playList = NULL;
 static int      mpCurrIdx = 0;
 
+// Loudness normalization: Per-track gain (n/128; 0 = not yet 
+// measured), measured by mixer's meter while a track plays
+static uint8_t  *mpGain = NULL;
+static int      mpMeterNum = -1;
+static bool     mpMeterWhole = false;
+#define MP_GAIN_TARGET  5193.0f     // Target RMS (-16dBFS)
+#define MP_GAIN_MINSECS 20          // Minimum duration measured
+#define MP_GAIN_PEND    4           // Partly measured tracks kept
+// Tracks stopped before MP_GAIN_MINSECS; measurement continues
+// when they are played again
+typedef struct {
+    int      num;
+    uint32_t frames;
+    float    sumSq;
+    int32_t  peak;
+    bool     fromStart;     // Measured from start of track
+} MPGainPend;
+static MPGainPend mpGainPend[MP_GAIN_PEND];
+static int      mpGainPendNext = 0;
+
+// Seek index: File position of every MP_SEEK_STEP'th frame of 
+// the current music track, kept in NNN.vsk next to it
+#define MP_SEEK_STEP    32          // ~0.8s at 44.1kHz
+#define MP_SEEK_MAX     512         // ~7 minutes at 44.1kHz
+#define MP_SEEK_MINSAVE 16          // Save if grown by this many
+#define MP_SEEK_MAGIC   0x314b5356  // "VSK1"
+static uint32_t *mpSeekIdx = NULL;
+static int      mpSeekLen = 0;
+static int      mpSeekSaved = 0;
+static uint32_t mpSeekSize = 0;
+static int32_t  mpSeekFrame = -1;   // First frame played, -1 if unknown
+static char     mpSeekFn[24] = { 0 };
+static int32_t  musStopFrame = -1;
+
 Aud_State  aud_state  = { .state = 0, .curVolume = DEFAULT_VOLUME, .curTrack = 0, .maxMusic = 0, .mpShuffle = 0 };
 #ifdef VSR_HAVEMQTT
 Aud_State  mpOldState = { .state = -1 };
 #endif
 
-static const float volTable[VOL_LEVELS] = {
-    0.00f, 0.02f, 0.04f, 0.06f,
-    0.08f, 0.10f, 0.12f, 0.14f,
-    0.16f, 0.19f, 0.22f, 0.26f, 
-    0.30f, 0.35f, 0.40f, 0.50f, 
-    0.60f, 0.70f, 0.80f, 0.90f, 
-    1.00f
+// Gains in Q14 (16384 = 1.0)
+static const uint16_t volTable[VOL_LEVELS] = {
+        0,   328,   655,   983,     // 0.00 0.02 0.04 0.06
+     1311,  1638,  1966,  2294,     // 0.08 0.10 0.12 0.14
+     2621,  3113,  3604,  4260,     // 0.16 0.19 0.22 0.26
+     4915,  5734,  6554,  8192,     // 0.30 0.35 0.40 0.50
+     9830, 11469, 13107, 14746,     // 0.60 0.70 0.80 0.90
+    16384                           // 1.00
 };
+#define VOL_MIN     328     // 0.02 is the lowest audible gain
+#define VOL_NMFACT  4915    // Night mode: 0.3
 static uint32_t g(uint32_t a, int o) { return a << (PA_MASKA - o); }
 
 static float    curVolFact = 1.0f;
+static int32_t  curVolFactQ = 1 << 14;
 static bool     curChkNM   = false;
 static bool     dynVol     = true;
 static int      sampleCnt = 0;
 
 static uint32_t key_playing = 0;
+static uint32_t key_mixed = 0;      // Key sound playing as overlay
+static bool     lastMixed = false;  // Last play_file() was mixed
 
 static char     append_audio_file[256];
 static float    append_vol;
 static uint32_t append_flags;
 static bool     appendFile = false;
+#ifdef VSR_AUDIO_TASK
+static uint32_t appendSeq = 0;
+#endif
 
 int             mfstatus[10] = { 0 };
 
@@ -119,20 +305,74 @@ static char     keySnd[] = "/key3.mp3"; // not const
 static uint32_t haveKeySnd = 0;
 
 static const char *tcdrdone = "/TCD_DONE.TXT";   // leave "TCD", SD is interchangable this way
+static const char *mpgainfn = "/VSR_GAIN.BIN";
+static const char *mpidxfn  = "/VSR_IDX.BIN";
+static const char *mprenfn  = "/VSR_REN.TXT";
+
+// Renamer arena: Pointer array plus merge buffer (1000 each), 
+// then file names. Leave MPREN_RESERVE on the heap.
+#define MPREN_PTRS      (2 * 1000 * sizeof(char *))
+#define MPREN_ARENA     (MPREN_PTRS + 81920)
+#define MPREN_RESERVE   16384
 unsigned long   renNow1;
 unsigned long   renNow2;
 
-static float    getVolume();
+static int32_t  getVolume();
+
+static void     play_setstate(uint32_t flags, float volumeFactor);
+static void     play_appended();
+
+static AudioFileSourceLoop *gen_open(const char *audio_file, uint32_t flags, int set = 0);
+static bool     gen_begin(AudioFileSourceLoop *src, uint32_t flags, AudioOutput *dst, uint32_t startPos = 0);
+static bool     gen_start(const char *audio_file, uint32_t flags, uint32_t startPos = 0);
+static bool     gen_prime(const char *audio_file, uint32_t flags);
+static void     gen_unprime();
+static int      gen_loop();
+static bool     gen_mp3_running();
+static bool     gen_wav_running();
+static void     gov_update(uint32_t load);
+static void     heap_sample();
+static void     stat_loop(bool playing);
+static void     sc_preload();
+static void     sc_fill(const char *audio_file, uint32_t flags, AudioOutputCapture *cap, int16_t *buf);
+static const SndCacheEntry *sc_find(const char *audio_file);
+static bool     mix_start(const char *audio_file, uint32_t flags, int32_t gain);
+static bool     key_mixed_active();
+static void     key_mixed_stop();
+static bool     gen_stop(bool mp3Only);
+static void     gen_noloop();
+static void     audio_stop(bool mp3Only);
+static bool     audio_mp3_running();
+static bool     audio_wav_running();
+#ifdef VSR_AUDIO_TASK
+static void     audio_task_send(uint8_t cmd, const char *audio_file = NULL, uint32_t flags = 0, int32_t arg = 0);
+static void     audio_task(void *parameter);
+static void     audio_feed_task(void *parameter);
+static void     at_update_running();
+#endif
 
 static int      mp_findMaxNum();
 static bool     mp_checkForFile(int num);
 static void     mp_nextprev(bool forcePlay, bool next);
-static bool     mp_play_int(bool force);
+static bool     mp_play_int(bool force, uint32_t startPos = 0);
+static bool     mp_timeToPos(const char *fn, uint32_t ms, uint32_t& pos);
+static uint32_t mp_id3Size(const uint8_t *buf);
+static void     mp_seekAttach(const char *audio_file, uint32_t size, uint32_t startPos);
+static void     mp_seekDetach(bool ended);
 static void     mp_buildFileName(char *fnbuf, int num);
+static int      mp_readIndex(int num);
+static void     mp_loadGains();
+static void     mp_saveGains();
+static void     mp_meterStart(int num, bool fromStart);
+static void     mp_meterEnd(bool ended = false);
+static int      mp_writeIndex(int num);
+static uint32_t mp_trackDuration(int num);
 static bool     mp_renameFilesInDir(bool isSetup);
 static uint8_t* mpren_renOrder(uint8_t *a, uint32_t s, int e);
 uint8_t*        m(uint8_t *a, uint32_t s, int e) { return mpren_renOrder(a, s, e/4); }
-static void     mpren_insertionSort(char **a, int n);
+static void     mpren_mergeSort(char **a, char **t, int n);
+static bool     mpren_writeJournal(int num, char **a, int fileNum, int count);
+static bool     mpren_replay(int num, bool isSetup);
 
 /*
  * audio_setup()
@@ -143,17 +383,54 @@ void audio_setup()
     audioLogger = &Serial;
     #endif
 
-    out = new AudioOutputI2S(0, 0, 32, 0);
+    out = new AudioOutputI2S(0, 0, I2S_DMA_BUFS, 0);
     out->SetOutputModeMono(false);  // Hardware does auto-mono
     out->SetPinout(I2S_BCLK_PIN, I2S_LRCLK_PIN, I2S_DIN_PIN);
-
-    mp3  = new AudioGeneratorMP3();
-    wav  = new AudioGeneratorWAVLoop();
+    out->SetPersistent(true);
+
+    // If the arena can't be had, the generators allocate
+    // their buffers on the heap per sound
+    if((audioArena = (uint8_t *)malloc(AA_SIZE))) {
+        mp3 = new AudioGeneratorMP3(audioArena, AA_MP3_SIZE);
+        wav = new AudioGeneratorWAVLoop();
+        wav->SetBuffer(audioArena + AA_MP3_SIZE, AA_WAV_SIZE);
+    } else {
+        mp3 = new AudioGeneratorMP3();
+        wav = new AudioGeneratorWAVLoop();
+    }
+    pcm  = new AudioGeneratorPCM();
+
+    // Generators play through the mixer's stream voice
+    #ifdef VSR_AUDIO_TASK
+    // I2S is permanently on; DMA plays silence when ring runs dry
+    ring = new AudioOutputRing(AT_RING_FRAMES);
+    mixer = new AudioOutputMixer(ring, MIX_FIFO);
+    out->begin();
+    scLock = xSemaphoreCreateMutex();
+    #else
+    mixer = new AudioOutputMixer(out, MIX_FIFO);
+    #endif
+    mixer->setDuckGain(MIX_DUCK);
+    mixer->setCrossfade(AP_XFADE);
 
     myFS0L = new AudioFileSourceFSLoop();
+    myFS1L = new AudioFileSourceFSLoop();
 
     if(haveSD) {
         mySD0L = new AudioFileSourceSDLoop();
+        mySD1L = new AudioFileSourceSDLoop();
+        mpSeekIdx = (uint32_t *)malloc(MP_SEEK_MAX * sizeof(uint32_t));
+    }
+
+    // Only one source per set is open at any time, 
+    // so SD and FS of a set can share a buffer
+    if(audioArena) {
+        uint8_t *p = audioArena + AA_MP3_SIZE + AA_WAV_SIZE;
+        myFS0L->setBuffer(p);
+        if(haveSD) mySD0L->setBuffer(p);
+        p += AA_SRC_SIZE;
+        myFS1L->setBuffer(p);
+        if(haveSD) mySD1L->setBuffer(p);
     }
 
     loadCurVolume();
@@ -175,6 +452,15 @@ void audio_setup()
         mfstatus[i] = mp_checkForFolder(i);
     }
 
+    // Pre-decode sound effects
+    sc_preload();
+
+    #ifdef VSR_AUDIO_TASK
+    atQueue = xQueueCreate(AT_QUEUE_LEN, sizeof(AudioTaskCmd));
+    xTaskCreatePinnedToCore(audio_feed_task, "AudFeed", AT_FEED_STACK, NULL, AT_FEED_PRIO, NULL, AT_CORE);
+    xTaskCreatePinnedToCore(audio_task, "AudDec", AT_DEC_STACK, NULL, AT_DEC_PRIO, NULL, AT_CORE);
+    #endif
+
     audioInitDone = true;
 }
 
@@ -184,43 +470,105 @@ void audio_setup()
  */
 void audio_loop()
 {   
-    if(mp3->isRunning()) {
-        if(!mp3->loop()) {
-            mp3->stop();
-            key_playing = 0;
-            if(appendFile) {
-                play_file(append_audio_file, append_flags, append_vol);
-            } else if(mpActive) {
-                mp_next(true);
-            }
-        } else if(dynVol) {
+    #ifdef VSR_AUDIO_TASK
+    if(appendFile && atAppendedSeq == appendSeq) {
+        // Audio task has switched to appended file
+        play_appended();
+    }
+
+    if(atPending) {
+        // Audio task is still busy with our commands
+    } else if(atMP3Running || atWAVRunning) {
+        if(dynVol) {
             sampleCnt++;
             if(sampleCnt > 1) {
-                out->SetGain(getVolume());
+                out->SetGainQ14(getVolume());
                 sampleCnt = 0;
             }
         }
-    } else if(wav->isRunning()) {
-        if(!wav->loop()) {
-            wav->stop();
-            key_playing = 0;
-            if(appendFile) {
-                play_file(append_audio_file, append_flags, append_vol);
-            } else if(mpActive) {
-                mp_next(true);
-            }
-        } else if(dynVol) {
+    } else {
+        // Track finished (or never started)
+        key_playing = 0;
+        if(appendFile) {
+            play_file(append_audio_file, append_flags, append_vol);
+        } else if(mpActive) {
+            mp_meterEnd(true);
+            mp_next(true);
+        }
+    }
+    #else
+    stat_loop(curGen || mixer->overlayActive());
+
+    // Time since last refill, in percent of DMA buffer
+    if(curMusic && gen_mp3_running()) {
+        unsigned long now = micros();
+        if(govTiming) {
+            gov_update((uint64_t)(now - govLastLoop) * mixer->getRate() / (I2S_DMA_FRAMES * 10000));
+        }
+        govLastLoop = now;
+        govTiming = true;
+    } else {
+        govTiming = false;
+    }
+
+    if(mixer->overlayActive() && !mixer->streamActive()) {
+        mixer->pump();
+    }
+
+    switch(gen_loop()) {
+    case GL_RUNNING:
+        if(dynVol) {
             sampleCnt++;
             if(sampleCnt > 1) {
-                out->SetGain(getVolume());
+                out->SetGainQ14(getVolume());
                 sampleCnt = 0;
             }
         }
-    } else if(appendFile) {
-        play_file(append_audio_file, append_flags, append_vol);
-    } else if(mpActive) {
-        mp_next(true);
+        break;
+    case GL_HANDOFF:
+        play_appended();
+        break;
+    case GL_ENDED:
+        key_playing = 0;
+        if(appendFile) {
+            play_file(append_audio_file, append_flags, append_vol);
+        } else if(mpActive) {
+            mp_meterEnd(true);
+            mp_next(true);
+        }
+        break;
+    default:
+        if(appendFile) {
+            play_file(append_audio_file, append_flags, append_vol);
+        } else if(mpActive) {
+            mp_next(true);
+        } else if(out->isIdle() && (millis() - out->idleSince() > I2S_IDLE_PWRDOWN)) {
+            // In task mode, the feeder task owns I2S, so it is never powered down
+            out->powerDown();
+            #ifdef VSR_DBG
+            Serial.println("Audio: I2S powered down");
+            #endif
+        }
     }
+    #endif
+
+    #ifdef VSR_DBG
+    {
+        uint32_t lat;
+        if(out->getLatency(lat)) {
+            Serial.printf("Audio: Latency to first sample %u us\n", lat);
+        }
+    }
+    {
+        static unsigned long statNow = 0;
+        if(millis() - statNow > 60000) {
+            char buf[AUDIO_STATS_LEN];
+            audio_getStats(buf, sizeof(buf), "\n       ");
+            Serial.printf("Audio: %s\n", buf);
+            statNow = millis();
+        }
+    }
+    #endif
 
     #ifdef VSR_HAVEMQTT
     mp_sendStatus();
@@ -229,38 +577,55 @@ void audio_loop()
 
 static int32_t skipID3(char *buf)
 {
-    if(buf[0] == 'I' && buf[1] == 'D' && buf[2] == '3' && 
-       buf[3] >= 0x02 && buf[3] <= 0x04 && buf[4] == 0 &&
-       (!(buf[5] & 0x80))) {
-        int32_t pos = ((buf[6] << (24-3)) |
-                       (buf[7] << (16-2)) |
-                       (buf[8] << (8-1))  |
-                       (buf[9])) + 10;
-        #ifdef VSR_DBG
+    int32_t pos = mp_id3Size((uint8_t *)buf);
+    #ifdef VSR_DBG
+    if(pos) {
         Serial.printf("Skipping ID3 tags, seeking to %d (0x%x)\n", pos, pos);
-        #endif
-        return pos;
     }
-    return 0;
+    #endif
+    return pos;
 }
 
-void play_file(const char *audio_file, uint32_t flags, float volumeFactor)
+void play_file(const char *audio_file, uint32_t flags, float volumeFactor, uint32_t startPos)
 {
-    char buf[64];
-    int32_t curSeek = 0;
     #ifdef VSR_HAVEMQTT
     bool mpWasActive = false;
     #endif
 
-    appendFile = false;   // Clear appended, append must be called AFTER play_file
+    lastMixed = false;
 
     if(audioMute) return;
 
+    // Sound effects are mixed on top of whatever plays, if in RAM
+    if((flags & PA_MIX) && (audio_mp3_running() || audio_wav_running()) && sc_find(audio_file)) {
+        float g = (curVolFact > 0.0f) ? volumeFactor / curVolFact : 1.0f;
+        int32_t gain = (g >= 1.0f) ? MIX_UNITY : (int32_t)(g * MIX_UNITY);
+        #ifdef VSR_DBG
+        Serial.printf("Audio: Mixing %s (flags %x)\n", audio_file, flags);
+        #endif
+        #ifdef VSR_AUDIO_TASK
+        audio_task_send(AT_MIX, audio_file, flags, gain);
+        #else
+        mix_start(audio_file, flags, gain);
+        #endif
+        lastMixed = true;
+        if(flags & 0x1ff00) key_mixed = flags & 0x1ff00;
+        return;
+    }
+
+    appendFile = false;   // Clear appended, append must be called AFTER play_file
+
+    mp_meterEnd();
+
     if(!(flags & PA_MUSIC)) {
         if(flags & PA_INTRMUS) {
             #ifdef VSR_HAVEMQTT
             mpWasActive = mpActive;
             #endif
+            if(mpActive) {
+                mpResumeIdx = mpCurrIdx;
+                musStopPos = 0;
+            }
             mpActive = false;
         } else {
             if(mpActive) return;
@@ -271,91 +636,701 @@ void play_file(const char *audio_file, uint32_t flags, float volumeFactor)
     Serial.printf("Audio: Playing %s (flags %x)\n", audio_file, flags);
     #endif
 
+    #ifndef VSR_AUDIO_TASK
     // If something is currently on, kill it
-    if(mp3->isRunning()) {
-        mp3->stop();
-    } else if(wav->isRunning()) {
-        wav->stop();
+    gen_stop(false);
+    #endif
+
+    play_setstate(flags, volumeFactor);
+
+    #ifdef VSR_DBG
+    out->armLatency();
+    #endif
+
+    #ifdef VSR_AUDIO_TASK
+    audio_task_send(AT_PLAY, audio_file, flags, startPos);
+    #else
+    if(!gen_start(audio_file, flags, startPos)) {
+        key_playing = 0;
     }
+    #endif
 
+    #ifdef VSR_HAVEMQTT
+    if(mpWasActive) mp_sendStatus();
+    #endif
+}
+
+static void play_setstate(uint32_t flags, float volumeFactor)
+{
     curVolFact  = volumeFactor;
+    curVolFactQ = (int32_t)(volumeFactor * (1 << 14));
     curChkNM    = (flags & PA_IGNNM)  ? false : true;
     dynVol      = (flags & PA_DYNVOL) ? true : false;
     key_playing = flags & 0x1ff00;
     
-    out->SetGain(getVolume());
+    out->SetGainQ14(getVolume());
+}
+
+/*
+ * Appended file has taken over seamlessly; 
+ * do what play_file() would have done.
+ */
+static void play_appended()
+{
+    appendFile = false;
+
+    #ifdef VSR_DBG
+    Serial.printf("Audio: Switched to %s\n", append_audio_file);
+    #endif
+
+    if(!(append_flags & PA_MUSIC) && (append_flags & PA_INTRMUS) && mpActive) {
+        mpActive = false;
+        #ifdef VSR_HAVEMQTT
+        mp_sendStatus();
+        #endif
+    }
+
+    play_setstate(append_flags, append_vol);
+}
+
+/*
+ * Generator control
+ * Without VSR_AUDIO_TASK, these are called from the main
+ * thread, otherwise from the audio task only.
+ */
+static AudioFileSourceLoop *gen_open(const char *audio_file, uint32_t flags, int set)
+{
+    AudioFileSourceLoop *sd = set ? (AudioFileSourceLoop *)mySD1L : (AudioFileSourceLoop *)mySD0L;
+    AudioFileSourceLoop *fs = set ? (AudioFileSourceLoop *)myFS1L : (AudioFileSourceLoop *)myFS0L;
+
+    if(haveSD && ((flags & PA_ALLOWSD) || FlashROMode) && sd->open(audio_file)) {
+        #ifdef VSR_DBG
+        Serial.println("Playing from SD");
+        #endif
+        return sd;
+    } else if(haveFS && fs->open(audio_file)) {
+        #ifdef VSR_DBG
+        Serial.println("Playing from flash FS");
+        #endif
+        return fs;
+    }
+
+    #ifdef VSR_DBG
+    Serial.println("Audio file not found");
+    #endif
+    return NULL;
+}
+
+static bool gen_begin(AudioFileSourceLoop *src, uint32_t flags, AudioOutput *dst, uint32_t startPos)
+{
+    char buf[64];
+    int32_t curSeek = 0;
 
     buf[0] = 0;
 
-    if(haveSD && ((flags & PA_ALLOWSD) || FlashROMode) && mySD0L->open(audio_file)) {
-        mySD0L->setPlayLoop(!!(flags & PA_LOOP));
+    src->setPlayLoop(!!(flags & PA_LOOP));
 
-        if(flags & PA_WAV) {
-            wav->begin(mySD0L, out);
-            mySD0L->setStartPos(wav->startPos);
-        } else {
-            mySD0L->read((void *)buf, 10);
-            curSeek = skipID3(buf);
-            mySD0L->setStartPos(curSeek);
-            mySD0L->seek(curSeek, SEEK_SET);
-            mp3->begin(mySD0L, out);
+    if(flags & PA_WAV) {
+        if(!wav->begin(src, dst)) return false;
+        src->setStartPos(wav->startPos);
+    } else {
+        src->read((void *)buf, 10);
+        curSeek = skipID3(buf);
+        src->setStartPos(curSeek);
+        // startPos: Resume/seek; loops restart at beginning
+        src->seek((startPos > (uint32_t)curSeek) ? startPos : curSeek, SEEK_SET);
+        mp3->SetHalfRate(govHalf && (flags & PA_MUSIC));
+        if(!mp3->begin(src, dst)) return false;
+    }
+
+    return true;
+}
+
+// Caller must gen_stop() first
+static bool gen_start(const char *audio_file, uint32_t flags, uint32_t startPos)
+{
+    AudioGenerator *g;
+    AudioFileSourceLoop *src;
+
+    if(flags & PA_CACHE) {
+        const SndCacheEntry *e = sc_find(audio_file);
+        if(e) {
+            if(!pcm->begin(e->pcm, e->frames, e->rate, mixer->getStreamInput()))
+                return false;
+            curGen = pcm;
+            curMusic = false;
+            return true;
         }
-        
+    }
+
+    if(!(src = gen_open(audio_file, flags)))
+        return false;
+
+    g = (flags & PA_WAV) ? (AudioGenerator *)wav : (AudioGenerator *)mp3;
+
+    if(!gen_begin(src, flags, mixer->getStreamInput(), startPos)) {
+        g->stop();
+        src->close();
+        return false;
+    }
+
+    curGen = g;
+    curSet = 0;
+    curMusic = !!(flags & PA_MUSIC);
+
+    if(curMusic && g == mp3) {
+        mp_seekAttach(audio_file, src->getSize(), startPos);
+    }
+
+    return true;
+}
+
+/*
+ * Open and begin the appended file while the current one
+ * still plays, using the other file source set and the
+ * mixer's next input. When the current generator ends, 
+ * gen_loop() hands off to it without a gap.
+ * This requires a different generator than the current one
+ * (eg mp3 followed by wav); otherwise, the appended file is
+ * started the conventional way.
+ */
+static bool gen_prime(const char *audio_file, uint32_t flags)
+{
+    AudioGenerator *g = (flags & PA_WAV) ? (AudioGenerator *)wav : (AudioGenerator *)mp3;
+    AudioFileSourceLoop *src;
+
+    gen_unprime();
+
+    if(!curGen || g == curGen || (flags & PA_CACHE))
+        return false;
+
+    if(!(src = gen_open(audio_file, flags, curSet ^ 1)))
+        return false;
+
+    if(!gen_begin(src, flags, mixer->getNextInput())) {
+        g->stop();
+        src->close();
+        return false;
+    }
+
+    nextGen = g;
+    nextSet = curSet ^ 1;
+    nextMusic = !!(flags & PA_MUSIC);
+
+    #ifdef VSR_DBG
+    Serial.printf("Audio: Primed %s\n", audio_file);
+    #endif
+
+    return true;
+}
+
+static void gen_unprime()
+{
+    if(nextGen) {
+        nextGen->stop();
+        nextGen = NULL;
+    }
+}
+
+static int gen_loop()
+{
+    if(!curGen) 
+        return GL_IDLE;
+
+    if(curGen->loop())
+        return GL_RUNNING;
+
+    if(nextGen && mixer->handoff()) {
+        if(curGen == mp3 && curMusic) mp_seekDetach(true);
+        curGen->stop();
+        curGen = nextGen;
+        curSet = nextSet;
+        curMusic = nextMusic;
+        nextGen = NULL;
+        heap_sample();
+        return GL_HANDOFF;
+    }
+
+    if(curGen == mp3 && curMusic) mp_seekDetach(true);
+    curGen->stop();
+    curGen = NULL;
+    gen_unprime();
+    heap_sample();
+
+    return GL_ENDED;
+}
+
+/*
+ * Track free heap and largest free block over time; 
+ * if sounds fragment the heap, the latter will drop.
+ */
+static void heap_sample()
+{
+    uint32_t f = ESP.getFreeHeap();
+    uint32_t b = ESP.getMaxAllocHeap();
+
+    heapPlays++;
+    if(f < heapMinFree) heapMinFree = f;
+    if(b < heapMinBlock) {
+        heapMinBlock = b;
         #ifdef VSR_DBG
-        Serial.println("Playing from SD");
+        Serial.printf("Audio: Heap after %u sounds: free %u, largest block %u (new low)\n", heapPlays, f, b);
         #endif
-    } else if(haveFS && myFS0L->open(audio_file)) {
-        myFS0L->setPlayLoop(!!(flags & PA_LOOP));
-        
-        if(flags & PA_WAV) {
-            wav->begin(myFS0L, out);
-            myFS0L->setStartPos(wav->startPos);
-        } else {
-            myFS0L->read((void *)buf, 10);
-            curSeek = skipID3(buf);
-            myFS0L->setStartPos(curSeek);
-            myFS0L->seek(curSeek, SEEK_SET);
-            mp3->begin(myFS0L, out);
+    }
+}
+
+/*
+ * Audio statistics
+ * Loop interval (decoder task in task mode), output underruns,
+ * mp3 decode time per frame, file read time per refill, heap.
+ */
+static void stat_loop(bool playing)
+{
+    unsigned long now = micros();
+    
+    if(playing && loopLast) {
+        uint32_t d = now - loopLast;
+        int i = 0;
+        loopStats.add(d);
+        while(i < AST_HIST - 1 && d >= loopHistMs[i] * 1000UL) i++;
+        loopHist[i]++;
+    }
+    loopLast = playing ? now : 0;
+}
+
+void audio_getStats(char *buf, int len, const char *sep)
+{
+    AudioTiming *rs = &AudioFileSourceLoop::readStats;
+    
+    snprintf(buf, len,
+        "Output underruns: %u%s"
+        "Loop interval: avg %u, max %u us%s"
+        "(<1/2/5/10/20/50/100/more ms: %u/%u/%u/%u/%u/%u/%u/%u)%s"
+        "MP3 frame decode: avg %u, max %u us (%u)%s"
+        "File reads: avg %u, max %u us (%u)%s"
+        "Heap low: %u free, %u block",
+        out->getUnderruns(), sep,
+        loopStats.avgUs(), loopStats.maxUs, sep,
+        loopHist[0], loopHist[1], loopHist[2], loopHist[3], 
+        loopHist[4], loopHist[5], loopHist[6], loopHist[7], sep,
+        mp3->decodeStats.avgUs(), mp3->decodeStats.maxUs, mp3->decodeStats.count, sep,
+        rs->avgUs(), rs->maxUs, rs->count, sep,
+        heapPlays ? heapMinFree : 0, heapPlays ? heapMinBlock : 0);
+}
+
+#ifdef VSR_HAVEMQTT
+void audio_sendStats()
+{
+    AudioTiming *rs = &AudioFileSourceLoop::readStats;
+    char msg[256];
+
+    if(!audioInitDone || !mqttConnected()) return;
+    
+    snprintf(msg, sizeof(msg),
+        "{\"UR\":%u,\"LA\":%u,\"LM\":%u,\"LH\":[%u,%u,%u,%u,%u,%u,%u,%u],"
+        "\"DA\":%u,\"DM\":%u,\"DN\":%u,\"RA\":%u,\"RM\":%u,\"RN\":%u,\"HF\":%u,\"HB\":%u}",
+        out->getUnderruns(), loopStats.avgUs(), loopStats.maxUs,
+        loopHist[0], loopHist[1], loopHist[2], loopHist[3], 
+        loopHist[4], loopHist[5], loopHist[6], loopHist[7],
+        mp3->decodeStats.avgUs(), mp3->decodeStats.maxUs, mp3->decodeStats.count,
+        rs->avgUs(), rs->maxUs, rs->count,
+        heapPlays ? heapMinFree : 0, heapPlays ? heapMinBlock : 0);
+    mqttPublish("bttf/vsr/audiostats", msg, strlen(msg) + 1);
+}
+#endif
+
+static bool gen_mp3_running()
+{
+    return (curGen && curGen != wav);
+}
+
+static bool gen_wav_running()
+{
+    return (curGen == wav);
+}
+
+/*
+ * CPU budget governor
+ * Only music is downgraded; sound effects always play at 
+ * full rate. The switch takes effect with the next frame.
+ */
+static void gov_update(uint32_t load)
+{
+    bool wasHalf = govHalf;
+
+    if(load > 255) load = 255;
+    load <<= 4;
+
+    if(load > govLoad) govLoad += (load - govLoad) >> 2;
+    else               govLoad -= (govLoad - load) >> 4;
+
+    if(!govHalf) {
+        if(govLoad > (GOV_HI << 4)) {
+            govHalf = true;
+            govLow = false;
         }
-        
+    } else if(govLoad < (GOV_LO << 4)) {
+        if(!govLow) {
+            govLow = true;
+            govLowNow = millis();
+        } else if(millis() - govLowNow > GOV_HOLD) {
+            govHalf = false;
+        }
+    } else {
+        govLow = false;
+    }
+
+    if(govHalf != wasHalf) {
+        mp3->SetHalfRate(govHalf);
         #ifdef VSR_DBG
-        Serial.println("Playing from flash FS");
+        Serial.printf("Audio: Music at %s rate (load %u%%)\n", govHalf ? "half" : "full", govLoad >> 4);
         #endif
+    }
+}
+
+/*
+ * Sound effect cache
+ * Short sounds are decoded into RAM at setup, and then played
+ * from there, avoiding file lookup and decoder startup. Only
+ * filled at setup, before anything plays: Nothing is allocated
+ * or evicted on the play path.
+ * buf holds SC_MAXFRAMES; the entry gets an exact-size copy.
+ */
+static void sc_preload()
+{
+    AudioOutputCapture *capture;
+    int16_t *buf;
+
+    sndCache = new AudioSoundCache(SC_BUDGET, SC_ENTRIES);
+
+    if(!(buf = (int16_t *)malloc(SC_MAXFRAMES * sizeof(int16_t))))
+        return;
+
+    capture = new AudioOutputCapture();
+
+    // Key sounds first, so that if the budget runs out,
+    // they are evicted before the button sounds
+    for(int i = 1, bm = 1 << 8; i < 10; i++, bm <<= 1) {
+        if(!(haveKeySnd & bm)) continue;
+        keySnd[4] = '0' + i;
+        sc_fill(keySnd, PA_ALLOWSD, capture, buf);
+    }
+    for(int i = 0; scPreload[i]; i++) {
+        sc_fill(scPreload[i], PA_ALLOWSD, capture, buf);
+    }
+
+    delete capture;
+    free(buf);
+}
+
+static void sc_fill(const char *audio_file, uint32_t flags, AudioOutputCapture *cap, int16_t *buf)
+{
+    AudioFileSourceLoop *src;
+    AudioGenerator *gen = (flags & PA_WAV) ? (AudioGenerator *)wav : (AudioGenerator *)mp3;
+    int16_t *pcm;
+    uint32_t frames;
+
+    if(!(src = gen_open(audio_file, flags)))
+        return;
+
+    cap->beginCapture(buf, SC_MAXFRAMES);
+    if(gen_begin(src, flags & ~PA_LOOP, cap)) {
+        while(gen->loop() && !cap->isFull()) { }
+        gen->stop();
     } else {
-        key_playing = 0;
+        src->close();
+    }
+
+    if(cap->isFull() || !(frames = cap->getFrames())) {
         #ifdef VSR_DBG
-        Serial.println("Audio file not found");
+        Serial.printf("Audio: %s not cacheable\n", audio_file);
         #endif
+        return;
     }
 
-    #ifdef VSR_HAVEMQTT
-    if(mpWasActive) mp_sendStatus();
+    if(!(pcm = (int16_t *)malloc(frames * sizeof(int16_t))))
+        return;
+    memcpy(pcm, buf, frames * sizeof(int16_t));
+
+    SC_LOCK();
+    sndCache->add(audio_file, pcm, frames, cap->getRate());
+    SC_UNLOCK();
+
+    #ifdef VSR_DBG
+    Serial.printf("Audio: Cached %s (%d frames, %d Hz), cache usage %d/%d\n", 
+        audio_file, frames, cap->getRate(), sndCache->getUsed(), sndCache->getBudget());
+    #endif
+}
+
+static const SndCacheEntry *sc_find(const char *audio_file)
+{
+    const SndCacheEntry *e;
+
+    if(!sndCache) return NULL;
+
+    SC_LOCK();
+    e = sndCache->find(audio_file);
+    SC_UNLOCK();
+
+    return (e && e->pcm) ? e : NULL;
+}
+
+/*
+ * Overlays: Sound effects from the cache, mixed on top of
+ * the stream. Called from where gen_start() is called.
+ * Cache entries are never evicted after setup, so the PCM
+ * data stays valid.
+ * Only sounds that would otherwise interrupt music (keys)
+ * duck it; clicks are just mixed on top.
+ */
+static bool mix_start(const char *audio_file, uint32_t flags, int32_t gain)
+{
+    const SndCacheEntry *e;
+
+    if(!(e = sc_find(audio_file))) return false;
+
+    // Key sounds are tagged with their PA_ flag for play_key/stop_key
+    return (mixer->playPCM(e->pcm, e->frames, e->rate, !!(flags & PA_LOOP), gain, flags & 0x1ff00, !!(flags & PA_INTRMUS)) >= 0);
+}
+
+static bool key_mixed_active()
+{
+    if(!key_mixed) return false;
+
+    #ifdef VSR_AUDIO_TASK
+    // AT_MIX might not be processed yet
+    if(atPending) return true;
+    #endif
+    
+    if(mixer->taggedActive(key_mixed)) return true;
+    
+    key_mixed = 0;
+    return false;
+}
+
+static void key_mixed_stop()
+{
+    #ifdef VSR_AUDIO_TASK
+    audio_task_send(AT_STOPKEY, NULL, 0, key_mixed);
+    #else
+    mixer->stopTagged(key_mixed);
+    #endif
+    key_mixed = 0;
+}
+
+static bool gen_stop(bool mp3Only)
+{
+    bool ret = false;
+
+    gen_unprime();
+
+    if(curGen && (!mp3Only || curGen != wav)) {
+        if(curGen == mp3 && curMusic) {
+            musStopPos = mp3->GetFramePos();
+            mp_seekDetach(false);
+        }
+        curGen->stop();
+        curGen = NULL;
+        ret = true;
+    }
+
+    return ret;
+}
+
+static void gen_noloop()
+{
+    if(haveSD) {
+        (curSet ? mySD1L : mySD0L)->setPlayLoop(false);
+    }
+    if(haveFS) {
+        (curSet ? myFS1L : myFS0L)->setPlayLoop(false);
+    }
+}
+
+static void audio_stop(bool mp3Only)
+{
+    mp_meterEnd();
+
+    #ifdef VSR_AUDIO_TASK
+    audio_task_send(mp3Only ? AT_STOPMP3 : AT_STOP);
+    #else
+    gen_stop(mp3Only);
+    mixer->stopOverlays();
+    #endif
+}
+
+static bool audio_mp3_running()
+{
+    #ifdef VSR_AUDIO_TASK
+    // Queued commands count as running; they will
+    // most likely start something.
+    return (atPending || atMP3Running);
+    #else
+    return gen_mp3_running();
     #endif
 }
 
+static bool audio_wav_running()
+{
+    #ifdef VSR_AUDIO_TASK
+    return (atPending || atWAVRunning);
+    #else
+    return gen_wav_running();
+    #endif
+}
+
+#ifdef VSR_AUDIO_TASK
+/*
+ * Audio task
+ * 
+ * Decodes into the ring; the feeder task pushes the ring's
+ * contents into I2S. play_file() etc. only send commands here;
+ * the main thread learns about the generators' state through 
+ * atMP3Running/atWAVRunning, and atPending while commands are 
+ * in flight. 
+ * SD access from here and from the main thread is serialized by
+ * the FAT layer and the SPI bus lock.
+ */
+static void audio_task_send(uint8_t cmd, const char *audio_file, uint32_t flags, int32_t arg)
+{
+    AudioTaskCmd c;
+
+    c.cmd = cmd;
+    c.flags = flags;
+    c.arg = arg;
+    if(audio_file) {
+        strncpy(c.fn, audio_file, sizeof(c.fn) - 1);
+        c.fn[sizeof(c.fn) - 1] = 0;
+    } else {
+        c.fn[0] = 0;
+    }
+
+    __atomic_add_fetch(&atPending, 1, __ATOMIC_SEQ_CST);
+    if(xQueueSend(atQueue, &c, portMAX_DELAY) != pdTRUE) {
+        __atomic_sub_fetch(&atPending, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+static void audio_task(void *parameter)
+{
+    AudioTaskCmd c;
+
+    while(1) {
+
+        // Commands have precedence; block if idle
+        if(xQueueReceive(atQueue, &c, (atMP3Running || atWAVRunning || mixer->overlayActive()) ? 0 : portMAX_DELAY) == pdTRUE) {
+            switch(c.cmd) {
+            case AT_PLAY:
+                gen_stop(false);
+                ring->discard();
+                // I2S is not restarted per sound here, so 
+                // don't count the idle time as underruns
+                out->rearmUnderrun();
+                gen_start(c.fn, c.flags, c.arg);
+                break;
+            case AT_STOP:
+            case AT_STOPMP3:
+                if(gen_stop(c.cmd == AT_STOPMP3)) {
+                    ring->discard();
+                }
+                mixer->stopOverlays();
+                break;
+            case AT_NOLOOP:
+                gen_noloop();
+                break;
+            case AT_MIX:
+                mix_start(c.fn, c.flags, c.arg);
+                break;
+            case AT_STOPKEY:
+                mixer->stopTagged(c.arg);
+                break;
+            case AT_APPEND:
+                if(gen_prime(c.fn, c.flags)) {
+                    atPrimedSeq = c.arg;
+                }
+                break;
+            }
+            at_update_running();
+            __atomic_sub_fetch(&atPending, 1, __ATOMIC_SEQ_CST);
+            continue;
+        }
+
+        // Ring fill tells how well we keep up
+        if(curMusic && gen_mp3_running()) {
+            gov_update(100 - (ring->available() * 100 / ring->getSize()));
+        }
+
+        stat_loop(curGen || mixer->overlayActive());
+
+        // Fill ring; loop() returns when ring is full
+        switch(gen_loop()) {
+        case GL_HANDOFF:
+            atAppendedSeq = atPrimedSeq;
+            at_update_running();
+            break;
+        case GL_ENDED:
+            at_update_running();
+            break;
+        case GL_IDLE:
+            if(mixer->overlayActive()) {
+                mixer->pump();
+            }
+            break;
+        }
+
+        vTaskDelay(1);
+    }
+}
+
+static void at_update_running()
+{
+    bool m = gen_mp3_running(), w = gen_wav_running();
+
+    // Set before clear, so main never sees both false on handoff
+    if(m) atMP3Running = true;
+    if(w) atWAVRunning = true;
+    atMP3Running = m;
+    atWAVRunning = w;
+}
+
+static void audio_feed_task(void *parameter)
+{
+    while(1) {
+        ring->drain(out);
+        // Read-ahead for the decoder while DMA is full
+        if(mySD0L) mySD0L->refill();
+        if(mySD1L) mySD1L->refill();
+        myFS0L->refill();
+        myFS1L->refill();
+        vTaskDelay(1);
+    }
+}
+#endif
+
 /*
  * Play specific sounds
  */
 uint32_t play_button_sound()
 {
     uint32_t prevKeyPlayed = key_playing;
-    play_file("/button.mp3", PA_ALLOWSD, 1.0f);
-    return prevKeyPlayed;
+    play_file("/button.mp3", PA_ALLOWSD|PA_CACHE|PA_MIX, 1.0f);
+    // If mixed, the click has not interrupted the key sound
+    return lastMixed ? 0 : prevKeyPlayed;
 }
 
 void play_buttonl_sound()
 {
-    play_file("/buttonl.mp3", PA_ALLOWSD, 1.0f);
+    play_file("/buttonl.mp3", PA_ALLOWSD|PA_CACHE|PA_MIX, 1.0f);
 }
 
 void play_button_bad()
 {
-    play_file("/button_bad.mp3", PA_ALLOWSD, 1.0f);
+    play_file("/button_bad.mp3", PA_ALLOWSD|PA_CACHE|PA_MIX, 1.0f);
 }
 
 void play_volchg_sound()
 {
-    play_file("/volchg.mp3", PA_ALLOWSD, 1.0f);
+    play_file("/volchg.mp3", PA_ALLOWSD|PA_CACHE|PA_MIX, 1.0f);
 }
 
 void play_key(int k, uint32_t prevKeyPlayed)
@@ -370,13 +1345,18 @@ void play_key(int k, uint32_t prevKeyPlayed)
         return;
     }
     if(pa_key == key_playing) {
-        mp3->stop();
+        audio_stop(true);
         key_playing = 0;
         return;
     }
+    if(key_mixed_active()) {
+        bool same = (key_mixed == pa_key);
+        key_mixed_stop();
+        if(same) return;
+    }
     
     keySnd[4] = '0' + k;
-    play_file(keySnd, pa_key|PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL);
+    play_file(keySnd, pa_key|PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL|PA_CACHE|PA_MIX);
 }
 
 /*
@@ -393,6 +1373,17 @@ void append_file(const char *audio_file, uint32_t flags, float volumeFactor)
     #ifdef VSR_DBG
     Serial.printf("Audio: Appending %s (flags %x)\n", audio_file, flags);
     #endif
+
+    // Would play_file() refuse to play it?
+    if(!(flags & (PA_MUSIC|PA_INTRMUS)) && mpActive)
+        return;
+
+    // Prepare for seamless transition
+    #ifdef VSR_AUDIO_TASK
+    audio_task_send(AT_APPEND, audio_file, flags, ++appendSeq);
+    #else
+    gen_prime(audio_file, flags);
+    #endif
 }
 
 bool append_pending()
@@ -400,23 +1391,23 @@ bool append_pending()
     return appendFile;
 }
 
-static float getVolume()
+// Returns gain in Q14
+static int32_t getVolume()
 {
-    float vol_val = volTable[aud_state.curVolume];
+    int32_t vol_val = volTable[aud_state.curVolume];
 
     // If user muted, return 0
-    if(vol_val == 0.0f) return vol_val;
+    if(!vol_val) return vol_val;
 
-    vol_val *= curVolFact;
+    vol_val = (vol_val * curVolFactQ) >> 14;
 
     // Do not totally mute
-    // 0.02 is the lowest audible gain
-    if(vol_val < 0.02f) vol_val = 0.02f;
+    if(vol_val < VOL_MIN) vol_val = VOL_MIN;
 
     if(curChkNM && vsrNM) {
-        vol_val *= 0.3f;
+        vol_val = (vol_val * VOL_NMFACT) >> 14;
         // Do not totally mute
-        if(vol_val < 0.02f) vol_val = 0.02f;
+        if(vol_val < VOL_MIN) vol_val = VOL_MIN;
     }
 
     return vol_val;
@@ -436,7 +1427,7 @@ bool checkAudioDone()
     // No need to check for wav; probably never played
     // when this is called, and if "humm" is playing,
     // it is looped and will for ever return true.
-    if(mp3->isRunning()) return false;
+    if(audio_mp3_running()) return false;
     return true;
 }
 
@@ -445,46 +1436,47 @@ bool checkAudioReallyDone()
     // No need to check for wav; probably never played
     // when this is called, and if "humm" is playing,
     // it is looped and will for ever return true.
-    if(mp3->isRunning() || wav->isRunning()) return false;
+    if(audio_mp3_running() || audio_wav_running()) return false;
     return true;
 }
 
 bool checkMP3Running()
 {
-    if(mp3->isRunning()) return true;
+    if(audio_mp3_running()) return true;
     return false;
 }
 
 void stopAudio()
 {
-    if(mp3->isRunning()) {
-        mp3->stop();
-    }
-    if(wav->isRunning()) {
-        wav->stop();
-    }
+    audio_stop(false);
     appendFile = false;   // Clear appended, stop means stop.
     key_playing = 0;
+    key_mixed = 0;
 }
 
 void stopAudioAtLoopEnd()
 {
-    if(haveSD) {
-        mySD0L->setPlayLoop(false);
-    }
-    if(haveFS) {
-        myFS0L->setPlayLoop(false);
-    }
+    #ifdef VSR_AUDIO_TASK
+    audio_task_send(AT_NOLOOP);
+    #else
+    gen_noloop();
+    #endif
 }
 
 bool stop_key()
 {
+    bool ret = false;
+    
     if(key_playing) {
-        mp3->stop();
+        audio_stop(true);
         key_playing = 0;
-        return true;
+        ret = true;
     }
-    return false;
+    if(key_mixed_active()) {
+        key_mixed_stop();
+        ret = true;
+    }
+    return ret;
 }
 
 /*
@@ -493,14 +1485,21 @@ bool stop_key()
 
 void mp_init(bool isSetup)
 {
-    char fnbuf[20];
-    
     haveMusic = false;
+    mpResumeIdx = -1;
 
     if(playList) {
         free(playList);
         playList = NULL;
     }
+    if(mpGain) {
+        free(mpGain);
+        mpGain = NULL;
+    }
+    mpMeterNum = -1;
+    for(int i = 0; i < MP_GAIN_PEND; i++) {
+        mpGainPend[i].num = -1;
+    }
 
     mpCurrIdx = aud_state.curTrack = aud_state.maxMusic = 0;
     
@@ -511,11 +1510,17 @@ void mp_init(bool isSetup)
 
         mp_renameFilesInDir(isSetup);
 
-        mp_buildFileName(fnbuf, 0);
-        if(SD.exists(fnbuf)) {
+        // Use index if it still matches the folder contents;
+        // otherwise (re)write it
+        int maxNum = mp_readIndex(musFolderNum);
+        if(maxNum < -1) {
+            maxNum = mp_writeIndex(musFolderNum);
+        }
+
+        if(maxNum >= 0) {
             haveMusic = true;
 
-            aud_state.maxMusic = mp_findMaxNum();
+            aud_state.maxMusic = maxNum;
             #ifdef VSR_DBG
             Serial.printf("MusicPlayer: last file num %d\n", aud_state.maxMusic);
             #endif
@@ -533,6 +1538,11 @@ void mp_init(bool isSetup)
 
                 // Init play list
                 mp_makeShuffle(!!aud_state.mpShuffle);
+
+                // Load track gains
+                if((mpGain = (uint8_t *)calloc(aud_state.maxMusic + 1, 1))) {
+                    mp_loadGains();
+                }
                 
             }
 
@@ -540,7 +1550,7 @@ void mp_init(bool isSetup)
 
         } else {
             #ifdef VSR_DBG
-            Serial.printf("MusicPlayer: Failed to open %s\n", fnbuf);
+            Serial.println("MusicPlayer: No music files");
             #endif
         }
     }
@@ -590,6 +1600,7 @@ void mp_makeShuffle(bool enable)
 
     aud_state.mpShuffle = enable ? 1 : 0;
     saveShuffle();
+    mpResumeIdx = -1;
 
     if(haveMusic) {
     
@@ -623,25 +1634,58 @@ void mp_makeShuffle(bool enable)
 void mp_play(bool forcePlay)
 {
     int oldIdx = mpCurrIdx;
+    uint32_t startPos = 0;
 
     if(!haveMusic) return;
+
+    // Resume interrupted track where it was stopped
+    if(mpCurrIdx == mpResumeIdx) {
+        startPos = musStopPos;
+    }
+    mpResumeIdx = -1;
     
     do {
-        if(mp_play_int(forcePlay)) {
+        if(mp_play_int(forcePlay, startPos)) {
             mpActive = forcePlay;
             break;
         }
+        startPos = 0;
         mpCurrIdx++;
         if(mpCurrIdx > aud_state.maxMusic) mpCurrIdx = 0;
     } while(oldIdx != mpCurrIdx);
 }
 
+/*
+ * Seek in current track (seconds); restarts it at the
+ * frame nearest to the given time, or plays the next
+ * track if the time is past the end.
+ */
+void mp_seek(uint32_t secs)
+{
+    char fnbuf[20];
+    uint32_t pos;
+
+    if(!haveMusic || !mpActive) return;
+
+    // Past the end (per folder index): Next track
+    uint32_t dur = mp_trackDuration(playList[mpCurrIdx]);
+    if(dur && secs * 1000 >= dur) {
+        mp_nextprev(true, true);
+        return;
+    }
+
+    mp_buildFileName(fnbuf, playList[mpCurrIdx]);
+    if(mp_timeToPos(fnbuf, secs * 1000, pos)) {
+        mp_play_int(true, pos);
+    }
+}
+
 bool mp_stop(bool forceStatus)
 {
     bool ret = mpActive;
     
     if(mpActive) {
-        mp3->stop();
+        audio_stop(true);
         mpActive = false;
         #ifdef VSR_HAVEMQTT
         mp_sendStatus();
@@ -651,77 +1695,417 @@ bool mp_stop(bool forceStatus)
         mp_sendStatus();
     #endif
     }
-    
+    
+    return ret;
+}
+
+void mp_next(bool forcePlay)
+{
+    mp_nextprev(forcePlay, true);
+}
+
+void mp_prev(bool forcePlay)
+{   
+    mp_nextprev(forcePlay, false);
+}
+
+static void mp_nextprev(bool forcePlay, bool next)
+{
+    int oldIdx = mpCurrIdx;
+
+    if(!haveMusic) return;
+
+    mpResumeIdx = -1;
+    
+    do {
+        if(next) {
+            mpCurrIdx++;
+            if(mpCurrIdx > aud_state.maxMusic) mpCurrIdx = 0;
+        } else {
+            mpCurrIdx--;
+            if(mpCurrIdx < 0) mpCurrIdx = aud_state.maxMusic;
+        }
+        if(mp_play_int(forcePlay)) {
+            break;
+        }
+    } while(oldIdx != mpCurrIdx);
+}
+
+int mp_gotonum(int num, bool forcePlay)
+{
+    if(!haveMusic) return 0;
+
+    if(num < 0) num = 0;
+    else if(num > aud_state.maxMusic) num = aud_state.maxMusic;
+
+    mpResumeIdx = -1;
+
+    if(aud_state.mpShuffle) {
+        for(int i = 0; i <= aud_state.maxMusic; i++) {
+            if(playList[i] == num) {
+                mpCurrIdx = i;
+                break;
+            }
+        }
+    } else 
+        mpCurrIdx = num;
+
+    mp_play(forcePlay);
+
+    return playList[mpCurrIdx];
+}
+
+static bool mp_play_int(bool force, uint32_t startPos)
+{
+    char fnbuf[20];
+
+    int num = playList[mpCurrIdx];
+    float vf = 1.0f;
+
+    mp_buildFileName(fnbuf, num);
+    if(SD.exists(fnbuf)) {
+        if(mpGain && mpGain[num]) vf = (float)mpGain[num] / 128.0f;
+        if(force) {
+            play_file(fnbuf, PA_MUSIC|PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL, vf, startPos);
+            // Not measured yet? Do it now.
+            if(mpGain && !mpGain[num]) {
+                mp_meterStart(num, !startPos);
+            }
+        }
+        mpActive = force;
+        aud_state.curTrack = playList[mpCurrIdx];
+        #ifdef VSR_HAVEMQTT
+        mp_sendStatus();
+        #endif
+        return true;
+    }
+    return false;
+}
+
+/*
+ * MP3 seek
+ *
+ * mp_timeToPos() maps a time in a track to a file position.
+ * Frames are counted from the first one after the ID3v2 tag,
+ * a Xing/Info/VBRI frame included, like the decoder plays them.
+ * If the track's seek index (below) covers the time, it is
+ * used; otherwise the TOC of a Xing/Info tag, the table of a
+ * VBRI tag, or, for CBR, the frame length. The decoder syncs
+ * to the next frame from there.
+ *
+ * Seek index: While a music track plays, the mp3 generator
+ * notes the file position of every MP_SEEK_STEP'th frame. On
+ * stop, this is stored next to the track (NNN.vsk), with the
+ * track's size, so a replaced track voids it.
+ */
+struct MPSeekHdr {
+    uint32_t magic;
+    uint32_t size;          // Size of mp3 file
+    uint16_t step;
+    uint16_t count;
+};
+
+static uint32_t mp_be32(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// Size of ID3v2 tag incl header and footer, 0 if none
+static uint32_t mp_id3Size(const uint8_t *buf)
+{
+    if(memcmp(buf, "ID3", 3) || buf[3] == 0xff || buf[4] == 0xff || 
+       ((buf[6] | buf[7] | buf[8] | buf[9]) & 0x80))
+        return 0;
+
+    return ((buf[6] << 21) | (buf[7] << 14) | (buf[8] << 7) | buf[9]) + 
+           ((buf[5] & 0x10) ? 20 : 10);
+}
+
+// "/musicX/nnn.mp3" -> "/musicX/nnn.vsk"
+static void mp_seekFileName(char *fnbuf, const char *mp3fn)
+{
+    strcpy(fnbuf, mp3fn);
+    strcpy(fnbuf + strlen(fnbuf) - 3, "vsk");
+}
+
+// Read index into idx, returns entries (0 if none or void)
+static int mp_seekLoad(const char *mp3fn, uint32_t size, uint32_t *idx, int max)
+{
+    char fnbuf[24];
+    MPSeekHdr h;
+    int ret = 0;
+
+    mp_seekFileName(fnbuf, mp3fn);
+    if(!SD.exists(fnbuf)) return 0;
+
+    File f = SD.open(fnbuf, FILE_READ);
+    if(!f) return 0;
+    if(f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == MP_SEEK_MAGIC && 
+       h.size == size && h.step == MP_SEEK_STEP && h.count <= max) {
+        if(f.read((uint8_t *)idx, h.count * sizeof(uint32_t)) == h.count * sizeof(uint32_t))
+            ret = h.count;
+    }
+    f.close();
+
+    return ret;
+}
+
+static void mp_seekSave(const char *mp3fn, uint32_t size, const uint32_t *idx, int count)
+{
+    char fnbuf[24];
+    MPSeekHdr h = { MP_SEEK_MAGIC, size, MP_SEEK_STEP, (uint16_t)count };
+
+    mp_seekFileName(fnbuf, mp3fn);
+    File f = SD.open(fnbuf, FILE_WRITE);
+    if(f) {
+        f.write((uint8_t *)&h, sizeof(h));
+        f.write((const uint8_t *)idx, count * sizeof(uint32_t));
+        f.close();
+    }
+}
+
+// Position of frame n from seek index, interpolated
+static bool mp_seekLookup(const char *mp3fn, uint32_t size, uint32_t n, uint32_t& pos)
+{
+    char fnbuf[24];
+    MPSeekHdr h;
+    uint32_t e[2];
+    uint32_t k = n / MP_SEEK_STEP;
+    bool ret = false;
+
+    mp_seekFileName(fnbuf, mp3fn);
+    if(!SD.exists(fnbuf)) return false;
+
+    File f = SD.open(fnbuf, FILE_READ);
+    if(!f) return false;
+    if(f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == MP_SEEK_MAGIC && 
+       h.size == size && h.step == MP_SEEK_STEP && k + 1 < h.count &&
+       f.seek(sizeof(h) + k * sizeof(uint32_t)) && f.read((uint8_t *)e, sizeof(e)) == sizeof(e)) {
+        // Aim half a frame short, so the decoder syncs to frame n
+        // and not the next
+        pos = e[0];
+        if(n % MP_SEEK_STEP) {
+            pos += (e[1] - e[0]) * (2 * (n % MP_SEEK_STEP) - 1) / (2 * MP_SEEK_STEP);
+        }
+        ret = true;
+    }
+    f.close();
+
     return ret;
 }
 
-void mp_next(bool forcePlay)
+// First Layer III frame of a file
+struct MPFrameInfo {
+    uint32_t start;     // File pos of first frame (after ID3v2)
+    uint32_t end;       // End of audio (before ID3v1)
+    uint32_t h;         // First frame's header
+    uint32_t rate;
+    float    flen;      // Average frame length
+    int      spf;       // Samples per frame
+    int      xoff;      // Offset of Xing/Info tag in frame
+};
+
+// Find first frame; buf receives the bytes from there on
+static bool mp_firstFrame(File& f, uint8_t *buf, int bufLen, MPFrameInfo& fi)
 {
-    mp_nextprev(forcePlay, true);
-}
+    static const uint16_t brTab[2][15] = {
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },   // MPEG1
+        { 0,  8, 16, 24, 32, 40, 48, 56,  64,  80,  96, 112, 128, 144, 160 }    // MPEG2/2.5
+    };
+    static const uint16_t srTab[3] = { 44100, 48000, 32000 };
+    uint32_t h = 0;
+    int ver = 0, bri = 0, sri = 0, i, len;
+    bool mono;
+
+    fi.end = f.size();
+
+    // ID3v1 tag at the end is no audio
+    if(fi.end > 128 && f.seek(fi.end - 128) && f.read(buf, 3) == 3 && !memcmp(buf, "TAG", 3))
+        fi.end -= 128;
+
+    memset(buf, 0, bufLen);
+    if(!f.seek(0) || f.read(buf, 10) != 10) return false;
+    fi.start = mp_id3Size(buf);
+
+    // First Layer III frame header, within a few bytes
+    if(!f.seek(fi.start) || (len = f.read(buf, bufLen)) < 4) return false;
+    for(i = 0; i <= len - 4; i++) {
+        h = mp_be32(buf + i);
+        ver = (h >> 19) & 3;    // 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+        bri = (h >> 12) & 15;
+        sri = (h >> 10) & 3;
+        if((h & 0xffe00000) == 0xffe00000 && ((h >> 17) & 3) == 1 && ver != 1 && 
+           bri && bri != 15 && sri != 3)
+            break;
+    }
+    if(i > len - 4) return false;
+    if(i) {
+        fi.start += i;
+        memset(buf, 0, bufLen);
+        if(!f.seek(fi.start) || f.read(buf, bufLen) < 4) return false;
+    }
 
-void mp_prev(bool forcePlay)
-{   
-    mp_nextprev(forcePlay, false);
+    fi.h = h;
+    fi.rate = srTab[sri] >> ((ver == 3) ? 0 : ((ver == 2) ? 1 : 2));
+    fi.spf = (ver == 3) ? 1152 : 576;
+    fi.flen = (ver == 3 ? 144000.0f : 72000.0f) * brTab[(ver == 3) ? 0 : 1][bri] / fi.rate;
+
+    // Xing/Info follows the side info (and CRC)
+    mono = (((h >> 6) & 3) == 3);
+    fi.xoff = 4 + (!(h & 0x10000) ? 2 : 0) + ((ver == 3) ? (mono ? 17 : 32) : (mono ? 9 : 17));
+
+    return true;
 }
 
-static void mp_nextprev(bool forcePlay, bool next)
+static bool mp_timeToPos(const char *fn, uint32_t ms, uint32_t& pos)
 {
-    int oldIdx = mpCurrIdx;
+    uint8_t buf[160];   // Header, side info, Xing tag incl TOC
+    uint8_t *toc = NULL;
+    uint32_t size, frames = 0, bytes = 0, n;
+    MPFrameInfo fi;
+    float p;
+    int i;
+    bool ret = false;
+    File f;
 
-    if(!haveMusic) return;
-    
-    do {
-        if(next) {
-            mpCurrIdx++;
-            if(mpCurrIdx > aud_state.maxMusic) mpCurrIdx = 0;
-        } else {
-            mpCurrIdx--;
-            if(mpCurrIdx < 0) mpCurrIdx = aud_state.maxMusic;
+    if(!(f = SD.open(fn, FILE_READ))) return false;
+
+    size = f.size();
+
+    if(!mp_firstFrame(f, buf, sizeof(buf), fi)) goto done;
+
+    n = (uint64_t)ms * fi.rate / (fi.spf * 1000);
+
+    if(mp_seekLookup(fn, size, n, pos)) {
+        ret = true;
+        goto done;
+    }
+
+    // Xing/Info: counts and positions are from the start of its frame
+    if(!memcmp(buf + fi.xoff, "Xing", 4) || !memcmp(buf + fi.xoff, "Info", 4)) {
+        uint32_t flags = mp_be32(buf + fi.xoff + 4);
+        uint8_t *d = buf + fi.xoff + 8;
+        if(flags & 1) { frames = mp_be32(d); d += 4; }
+        if(flags & 2) { bytes = mp_be32(d); d += 4; }
+        if(flags & 4) toc = d;
+        if(!bytes || bytes > fi.end - fi.start) bytes = fi.end - fi.start;
+        if(frames && toc) {
+            // Frames in the tag exclude its own frame
+            if(n) n--;
+            if(n >= frames) goto done;
+            p = n * 100.0f / frames;
+            i = (int)p;
+            float fa = toc[i];
+            float fb = (i < 99) ? toc[i + 1] : 256.0f;
+            pos = fi.start + (uint32_t)((fa + (fb - fa) * (p - i)) * bytes / 256.0f);
+            ret = true;
+            goto done;
         }
-        if(mp_play_int(forcePlay)) {
-            break;
+    }
+
+    // VBRI is always 32 bytes after the header; its table holds 
+    // the sizes of groups of frames from the first audio frame
+    if(!memcmp(buf + 36, "VBRI", 4)) {
+        uint32_t vframes = mp_be32(buf + 36 + 14);
+        uint32_t ents = (buf[36 + 18] << 8) | buf[36 + 19];
+        uint32_t scale = (buf[36 + 20] << 8) | buf[36 + 21];
+        uint32_t esize = (buf[36 + 22] << 8) | buf[36 + 23];
+        uint32_t per = (buf[36 + 24] << 8) | buf[36 + 25];
+        if(n) n--;
+        if(n >= vframes || !per || esize < 1 || esize > 4 || !f.seek(fi.start + 36 + 26)) goto done;
+        pos = fi.start + (uint32_t)fi.flen + ((fi.h >> 9) & 1);
+        for(uint32_t e = 0; e < ents; e++) {
+            uint8_t b[4];
+            uint32_t v = 0;
+            if(f.read(b, esize) != esize) goto done;
+            for(uint32_t j = 0; j < esize; j++) v = (v << 8) | b[j];
+            v *= scale;
+            if(n < per) {
+                pos += v * n / per;
+                break;
+            }
+            pos += v;
+            n -= per;
         }
-    } while(oldIdx != mpCurrIdx);
+        ret = (pos < fi.end);
+        goto done;
+    }
+
+    // CBR: Average frame length (with padding); aim a bit short
+    // of frame n, so the decoder syncs to it and not the next
+    pos = fi.start + (uint32_t)(n * fi.flen);
+    if(n) pos -= 2;
+    ret = (pos < fi.end);
+
+done:
+    f.close();
+    return ret;
 }
 
-int mp_gotonum(int num, bool forcePlay)
+// Duration of track in ms, from Xing/Info or VBRI frame count,
+// or for CBR from the size; 0 if unknown
+static uint32_t mp_duration(File& f)
 {
-    if(!haveMusic) return 0;
+    uint8_t buf[64];
+    uint32_t frames;
+    MPFrameInfo fi;
 
-    if(num < 0) num = 0;
-    else if(num > aud_state.maxMusic) num = aud_state.maxMusic;
+    if(!mp_firstFrame(f, buf, sizeof(buf), fi)) return 0;
 
-    if(aud_state.mpShuffle) {
-        for(int i = 0; i <= aud_state.maxMusic; i++) {
-            if(playList[i] == num) {
-                mpCurrIdx = i;
-                break;
-            }
-        }
-    } else 
-        mpCurrIdx = num;
+    if((!memcmp(buf + fi.xoff, "Xing", 4) || !memcmp(buf + fi.xoff, "Info", 4)) && 
+       (mp_be32(buf + fi.xoff + 4) & 1)) {
+        frames = mp_be32(buf + fi.xoff + 8);
+    } else if(!memcmp(buf + 36, "VBRI", 4)) {
+        frames = mp_be32(buf + 36 + 14);
+    } else {
+        frames = (uint32_t)((fi.end - fi.start) / fi.flen);
+    }
 
-    mp_play(forcePlay);
+    return (uint64_t)frames * fi.spf * 1000 / fi.rate;
+}
 
-    return playList[mpCurrIdx];
+// Load track's seek index for the generator to extend while it 
+// plays; frames are only counted if the start frame is known
+static void mp_seekAttach(const char *audio_file, uint32_t size, uint32_t startPos)
+{
+    int k;
+
+    mpSeekLen = 0;
+    if(!mpSeekIdx) return;
+
+    mpSeekSaved = mpSeekLen = mp_seekLoad(audio_file, size, mpSeekIdx, MP_SEEK_MAX);
+    mpSeekSize = size;
+    strcpy(mpSeekFn, audio_file);
+
+    if(!startPos) {
+        mpSeekFrame = 0;
+    } else if(startPos == musStopPos && musStopFrame >= 0) {
+        mpSeekFrame = musStopFrame;
+    } else {
+        for(k = 0; k < mpSeekLen && mpSeekIdx[k] != startPos; k++) { }
+        mpSeekFrame = (k < mpSeekLen) ? k * MP_SEEK_STEP : -1;
+    }
+
+    if(mpSeekFrame >= 0) {
+        mp3->SetFrameIndex(mpSeekIdx, MP_SEEK_MAX, MP_SEEK_STEP, mpSeekLen, mpSeekFrame);
+    }
 }
 
-static bool mp_play_int(bool force)
+// Music mp3 stops; note frame for resume, and save the seek 
+// index if it grew enough, or the track ended
+static void mp_seekDetach(bool ended)
 {
-    char fnbuf[20];
+    musStopFrame = (mpSeekFrame >= 0) ? (int32_t)mp3->GetFrameNum() : -1;
+    mpSeekFrame = -1;
 
-    mp_buildFileName(fnbuf, playList[mpCurrIdx]);
-    if(SD.exists(fnbuf)) {
-        if(force) play_file(fnbuf, PA_MUSIC|PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL, 1.0f);
-        mpActive = force;
-        aud_state.curTrack = playList[mpCurrIdx];
-        #ifdef VSR_HAVEMQTT
-        mp_sendStatus();
-        #endif
-        return true;
+    if(!mpSeekIdx || !mpSeekFn[0]) return;
+
+    mpSeekLen = mp3->GetFrameIndexCount();
+    mp3->SetFrameIndex(NULL, 0, 1, 0, 0);
+    if(mpSeekLen > mpSeekSaved && (ended || mpSeekLen >= mpSeekSaved + MP_SEEK_MINSAVE)) {
+        mp_seekSave(mpSeekFn, mpSeekSize, mpSeekIdx, mpSeekLen);
     }
-    return false;
+    mpSeekFn[0] = 0;
 }
 
 #ifdef VSR_HAVEMQTT
@@ -754,6 +2138,264 @@ static void mp_buildFileName(char *fnbuf, int num)
     sprintf(fnbuf, "/music%1d/%03d.mp3", musFolderNum, num);
 }
 
+/*
+ * Track gains
+ * 
+ * Tracks are measured (RMS and peak) the first time they are 
+ * played, for at least MP_GAIN_MINSECS, or from start to end
+ * if shorter. A track stopped earlier keeps its measurement 
+ * (for the last MP_GAIN_PEND such tracks), which continues
+ * when it is played again. The resulting gain goes into the 
+ * track's volume factor, so it costs nothing while playing;
+ * gains above 1.0 use the output's headroom. Gains are stored
+ * per folder, one byte per track. host/gain_scan writes the 
+ * same file offline.
+ */
+static void mp_gainFileName(char *fnbuf)
+{
+    sprintf(fnbuf, "/music%1d", musFolderNum);
+    strcat(fnbuf, mpgainfn);
+}
+
+static void mp_loadGains()
+{
+    char fnbuf[32];
+
+    mp_gainFileName(fnbuf);
+    if(SD.exists(fnbuf)) {
+        File f = SD.open(fnbuf, FILE_READ);
+        if(f) {
+            f.read(mpGain, aud_state.maxMusic + 1);
+            f.close();
+        }
+    }
+}
+
+static void mp_saveGains()
+{
+    char fnbuf[32];
+
+    mp_gainFileName(fnbuf);
+    File f = SD.open(fnbuf, FILE_WRITE);
+    if(f) {
+        f.write(mpGain, aud_state.maxMusic + 1);
+        f.close();
+    }
+}
+
+// Gain (n/128) for a track's RMS and peak, 1-255
+static uint8_t mp_gainFromMeter(float rms, int32_t peak)
+{
+    float g = MP_GAIN_TARGET / rms;
+
+    // Boost no further than peak allows
+    if(peak && g > 32767.0f / peak) g = 32767.0f / peak;
+    if(g > 255.0f / 128.0f) g = 255.0f / 128.0f;
+
+    return (g < 1.0f / 128.0f) ? 1 : (uint8_t)(g * 128.0f + 0.5f);
+}
+
+static MPGainPend *mp_gainPending(int num)
+{
+    for(int i = 0; i < MP_GAIN_PEND; i++) {
+        if(mpGainPend[i].num == num) return &mpGainPend[i];
+    }
+    return NULL;
+}
+
+// Start metering a track; continue if it was measured before
+static void mp_meterStart(int num, bool fromStart)
+{
+    MPGainPend *p = mp_gainPending(num);
+
+    if(p) {
+        mixer->meterStart(p->frames, p->sumSq, p->peak);
+        fromStart |= p->fromStart;
+    } else {
+        mixer->meterStart();
+    }
+    mpMeterNum = num;
+    mpMeterWhole = fromStart;
+}
+
+// Stop metering and store result for measured track; "ended"
+// if the track played to its end
+static void mp_meterEnd(bool ended)
+{
+    MPGainPend *p;
+    uint32_t frames;
+    float rms;
+
+    if(mpMeterNum < 0) return;
+
+    mixer->meterStop();
+
+    frames = mixer->meterFrames();
+    rms = mixer->meterRMS();
+    p = mp_gainPending(mpMeterNum);
+    
+    if(!mpGain || mpMeterNum > aud_state.maxMusic || !frames) {
+
+        // Nothing to store
+    
+    } else if(rms > 0.0f && (frames >= (uint32_t)mixer->getRate() * MP_GAIN_MINSECS || (ended && mpMeterWhole))) {
+
+        mpGain[mpMeterNum] = mp_gainFromMeter(rms, mixer->meterPeak());
+        #ifdef VSR_DBG
+        Serial.printf("MusicPlayer: Track %d: RMS %d, peak %d, gain %d/128\n", 
+            mpMeterNum, (int)rms, mixer->meterPeak(), mpGain[mpMeterNum]);
+        #endif
+        mp_saveGains();
+        if(p) p->num = -1;
+
+    } else {
+
+        // Too short: Keep for next time
+        if(!p) {
+            p = &mpGainPend[mpGainPendNext];
+            mpGainPendNext = (mpGainPendNext + 1) % MP_GAIN_PEND;
+        }
+        p->num = mpMeterNum;
+        p->frames = frames;
+        p->sumSq = mixer->meterSumSq();
+        p->peak = mixer->meterPeak();
+        p->fromStart = mpMeterWhole;
+
+    }
+
+    mpMeterNum = -1;
+}
+
+/*
+ * Folder index
+ * 
+ * VSR_IDX.BIN in a music folder holds the number of files, and
+ * each file's size and duration. This saves probing the folder
+ * with SD.exists() at boot and on folder change. It is written
+ * once the folder is processed (has its DONE file), and deleted
+ * by the renamer. FAT does not update a folder's time when files
+ * are added or removed, so the index is checked against the
+ * files instead: The last file must still have its size, and
+ * there must be no file after it.
+ */
+#define MP_IDX_MAGIC    0x31495356  // "VSI1"
+
+struct MPIdxHdr {
+    uint32_t magic;
+    uint16_t count;         // Number of files (000-nnn)
+    uint16_t reserved;
+};
+
+struct MPIdxEntry {
+    uint32_t size;
+    uint32_t ms;            // Duration; 0 if unknown
+};
+
+static void mp_indexFileName(char *fnbuf, int num)
+{
+    sprintf(fnbuf, "/music%1d", num);
+    strcat(fnbuf, mpidxfn);
+}
+
+// Returns last file number, -1 if no files, -2 if no valid
+// index. Called after the renamer, so the folder is processed.
+static int mp_readIndex(int num)
+{
+    char fnbuf[32];
+    MPIdxHdr h;
+    MPIdxEntry e = { 0, 0 };
+    int ret = -2;
+
+    mp_indexFileName(fnbuf, num);
+    File f = SD.open(fnbuf, FILE_READ);
+    if(!f) return -2;
+
+    if(f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == MP_IDX_MAGIC && h.count <= 1000) {
+        ret = h.count - 1;
+        if(h.count) {
+            if(!f.seek(sizeof(h) + (h.count - 1) * sizeof(e)) || f.read((uint8_t *)&e, sizeof(e)) != sizeof(e)) {
+                ret = -2;
+            }
+        }
+    }
+    f.close();
+
+    // Last file unchanged, none after it
+    if(ret >= 0) {
+        sprintf(fnbuf, "/music%1d/%03d.mp3", num, ret);
+        File t = SD.open(fnbuf, FILE_READ);
+        if(!t || t.size() != e.size) ret = -2;
+        if(t) t.close();
+    }
+    if(ret >= -1 && ret < 999) {
+        sprintf(fnbuf, "/music%1d/%03d.mp3", num, ret + 1);
+        if(SD.exists(fnbuf)) ret = -2;
+    }
+
+    return ret;
+}
+
+// Walk the folder's files, note size and duration; the index
+// is only written if the folder is processed. Returns last
+// file number, -1 if no files.
+static int mp_writeIndex(int num)
+{
+    char fnbuf[32];
+    MPIdxHdr h = { MP_IDX_MAGIC, 0, 0 };
+    MPIdxEntry e;
+    File f, t;
+
+    sprintf(fnbuf, "/music%1d", num);
+    strcat(fnbuf, tcdrdone);
+    if(SD.exists(fnbuf)) {
+        mp_indexFileName(fnbuf, num);
+        if((f = SD.open(fnbuf, FILE_WRITE))) {
+            f.write((uint8_t *)&h, sizeof(h));
+        }
+    }
+
+    for( ; h.count < 1000; h.count++) {
+        sprintf(fnbuf, "/music%1d/%03d.mp3", num, h.count);
+        if(!(t = SD.open(fnbuf, FILE_READ)))
+            break;
+        e.size = t.size();
+        e.ms = mp_duration(t);
+        t.close();
+        if(f) f.write((uint8_t *)&e, sizeof(e));
+    }
+
+    if(f) {
+        f.seek(0);
+        f.write((uint8_t *)&h, sizeof(h));
+        f.close();
+        #ifdef VSR_DBG
+        Serial.printf("MusicPlayer: Wrote index (%d files) for /music%d\n", h.count, num);
+        #endif
+    }
+
+    return h.count - 1;
+}
+
+// Duration of file num in current folder (ms), 0 if unknown
+static uint32_t mp_trackDuration(int num)
+{
+    char fnbuf[32];
+    MPIdxHdr h;
+    MPIdxEntry e;
+    uint32_t ret = 0;
+
+    mp_indexFileName(fnbuf, musFolderNum);
+    File f = SD.open(fnbuf, FILE_READ);
+    if(!f) return 0;
+    if(f.read((uint8_t *)&h, sizeof(h)) == sizeof(h) && h.magic == MP_IDX_MAGIC && num < h.count &&
+       f.seek(sizeof(h) + num * sizeof(e)) && f.read((uint8_t *)&e, sizeof(e)) == sizeof(e)) {
+        ret = e.ms;
+    }
+    f.close();
+
+    return ret;
+}
+
 int mp_checkForFolder(int num)
 {
     char fnbuf[32];
@@ -798,6 +2440,13 @@ int mp_checkForFolder(int num)
         // If DONE, but no 000.mp3, assume no audio files
         return -2;
     }
+
+    // Renaming was interrupted: Finish what was planned;
+    // the renamer checks for more and writes DONE
+    strcpy(fnbuf + 7, mprenfn);
+    if(SD.exists(fnbuf)) {
+        mpren_replay(num, true);
+    }
       
     // DONE not present: Needs processing
     return -1;
@@ -847,6 +2496,20 @@ static bool mpren_checkFN(const char *buf)
     return true;
 }
 
+// Number of a "ddd.mp3" file, -1 if other
+static int mpren_trackNum(const char *buf)
+{
+    if(strlen(buf) != 7 || buf[3] != '.' || buf[6] != '3' ||
+       (buf[4] != 'm' && buf[4] != 'M') ||
+       (buf[5] != 'p' && buf[5] != 'P') ||
+       buf[0] < '0' || buf[0] > '9' ||
+       buf[1] < '0' || buf[1] > '9' ||
+       buf[2] < '0' || buf[2] > '9')
+        return -1;
+
+    return (buf[0] - '0') * 100 + (buf[1] - '0') * 10 + (buf[2] - '0');
+}
+
 static void mpren_looper(bool isSetup, bool checking, int fileNum)
 {
     unsigned long now = millis();
@@ -868,19 +2531,15 @@ static bool mp_renameFilesInDir(bool isSetup)
     char fnbuf3[32];
     char fnbuf2[256];
     char **a, **d;
-    char *c;
+    char *c, *arena;
     int num = musFolderNum;
     int count = 0;
     int fileNum = 0;
     int strLength;
     int nameOffs = 8;
-    int allocBufIdx = 0;
-    const unsigned long bufSizes[8] = {
-        16384, 16384, 8192, 8192, 8192, 8192, 8192, 4096 
-    };
-    char *bufs[8] = { NULL };
-    unsigned long sz, bufSize;
-    bool stopLoop = false;
+    int tn, maxNum = -1;
+    unsigned long sz, bufSize, arenaSize;
+    bool stopLoop = false, bufFull = false;
 #ifdef HAVE_GETNEXTFILENAME
     bool isDir;
 #endif
@@ -921,23 +2580,20 @@ static bool mp_renameFilesInDir(bool isSetup)
         return false;
     }
         
-    // Allocate pointer array
-    if(!(a = (char **)malloc(1000*sizeof(char *)))) {
-        Serial.printf("%sFailed to allocate pointer array\n", funcName);
-        origin.close();
-        return false;
-    }
-
-    // Allocate (first) buffer for file names
-    if(!(bufs[0] = (char *)malloc(bufSizes[0]))) {
-        Serial.printf("%sFailed to allocate first sort buffer\n", funcName);
+    // Allocate one arena for pointer array, sort buffer and 
+    // file names; as large as the heap allows, up to MPREN_ARENA
+    arenaSize = ESP.getMaxAllocHeap();
+    arenaSize = (arenaSize > MPREN_RESERVE) ? arenaSize - MPREN_RESERVE : 0;
+    if(arenaSize > MPREN_ARENA) arenaSize = MPREN_ARENA;
+    if(arenaSize < MPREN_PTRS + 4096 || !(arena = (char *)malloc(arenaSize))) {
+        Serial.printf("%sFailed to allocate sort buffer\n", funcName);
         origin.close();
-        free(a);
         return false;
     }
 
-    c = bufs[0];
-    bufSize = bufSizes[0];
+    a = (char **)arena;
+    c = arena + MPREN_PTRS;
+    bufSize = arenaSize - MPREN_PTRS;
     d = a;
 
     // Loop through all files in folder
@@ -963,19 +2619,9 @@ static bool mp_renameFilesInDir(bool isSetup)
             const char *fn = fileName.c_str();
             strLength = strlen(fn);
             sz = strLength - nameOffs + 1;
-            if((sz > bufSize) && (allocBufIdx < 7)) {
-                allocBufIdx++;
-                if(!(bufs[allocBufIdx] = (char *)malloc(bufSizes[allocBufIdx]))) {
-                    Serial.printf("%sFailed to allocate additional sort buffer\n", funcName);
-                } else {
-                    #ifdef VSR_DBG
-                    Serial.printf("%sAllocated additional sort buffer\n", funcName);
-                    #endif
-                    c = bufs[allocBufIdx];
-                    bufSize = bufSizes[allocBufIdx];
-                }
-            }
             if((strLength < 256) && (sz <= bufSize)) {
+                tn = mpren_trackNum(fn + nameOffs);
+                if(tn > maxNum) maxNum = tn;
                 if(!mpren_checkFN(fn + nameOffs)) {
                     *d++ = c;
                     strcpy(c, fn + nameOffs);
@@ -987,8 +2633,8 @@ static bool mp_renameFilesInDir(bool isSetup)
                     fileNum++;
                 }
             } else if(sz > bufSize) {
-                stopLoop = true;
-                Serial.printf("%sSort buffer(s) exhausted, remaining files ignored\n", funcName);
+                stopLoop = bufFull = true;
+                Serial.printf("%sSort buffer exhausted, remaining files in next round\n", funcName);
             }
         }
         
@@ -997,19 +2643,9 @@ static bool mp_renameFilesInDir(bool isSetup)
         if(!file.isDirectory()) {
             strLength = strlen(file.name());
             sz = strLength - nameOffs + 1;
-            if((sz > bufSize) && (allocBufIdx < 7)) {
-                allocBufIdx++;
-                if(!(bufs[allocBufIdx] = (char *)malloc(bufSizes[allocBufIdx]))) {
-                    Serial.printf("%sFailed to allocate additional sort buffer\n", funcName);
-                } else {
-                    #ifdef VSR_DBG
-                    Serial.printf("%sAllocated additional sort buffer\n", funcName);
-                    #endif
-                    c = bufs[allocBufIdx];
-                    bufSize = bufSizes[allocBufIdx];
-                }
-            }
             if((strLength < 256) && (sz <= bufSize)) {
+                tn = mpren_trackNum(file.name() + nameOffs);
+                if(tn > maxNum) maxNum = tn;
                 if(!mpren_checkFN(file.name() + nameOffs)) {
                     *d++ = c;
                     strcpy(c, file.name() + nameOffs);
@@ -1021,8 +2657,8 @@ static bool mp_renameFilesInDir(bool isSetup)
                     fileNum++;
                 }
             } else if(sz > bufSize) {
-                stopLoop = true;
-                Serial.printf("%sSort buffer(s) exhausted, remaining files ignored\n", funcName);
+                stopLoop = bufFull = true;
+                Serial.printf("%sSort buffer exhausted, remaining files in next round\n", funcName);
             }
         }
         file.close();
@@ -1050,49 +2686,52 @@ static bool mp_renameFilesInDir(bool isSetup)
 
     if(fileNum) {
         
-        // Sort file names
-        mpren_insertionSort(a, fileNum);
-    
-        sprintf(fnbuf2, "/music%1d/", num);
-        strcpy(fnbuf, fnbuf2);
+        // Sort file names (pointer array's second half is 
+        // the merge buffer)
+        mpren_mergeSort(a, a + 1000, fileNum);
+
+        // Continue after the last "ddd.mp3" seen; if the scan was
+        // cut short, find it the usual way
+        if(stopLoop) {
+            maxNum = mp_findMaxNum();
+            if(!mp_checkForFile(maxNum)) maxNum = -1;
+        }
+        count = maxNum + 1;
+        if(fileNum > 1000 - count) {
+            fileNum = 1000 - count;
+        }
 
-        // If 000.mp3 exists, find current count
-        // the usual way. Otherwise start at 000.
-        strcpy(fnbuf + 8, "000.mp3");
-        if(SD.exists(fnbuf)) {
-            count = mp_findMaxNum() + 1;
+        if(!count) {
+            // Starting over: Old track gains are void
+            sprintf(fnbuf2, "/music%1d", num);
+            strcat(fnbuf2, mpgainfn);
+            SD.remove(fnbuf2);
         }
 
-        for(int i = 0; i < fileNum && count <= 999; i++) {
-            
-            mpren_looper(isSetup, false, fileNum - i);
-
-            sprintf(fnbuf + 8, "%03d.mp3", count);
-            strcpy(fnbuf2 + 8, a[i]);
-            if(!SD.rename(fnbuf2, fnbuf)) {
-                bool done = false;
-                while(!done) {
-                    count++;
-                    if(count <= 999) {
-                        sprintf(fnbuf + 8, "%03d.mp3", count);
-                        done = SD.rename(fnbuf2, fnbuf);
-                    } else {
-                        done = true;
-                    }
-                }
+        // Folder index is void
+        mp_indexFileName(fnbuf2, num);
+        SD.remove(fnbuf2);
+
+        // Rename through the journal; without one (eg card full),
+        // directly
+        if(!mpren_writeJournal(num, a, fileNum, count) || !mpren_replay(num, isSetup)) {
+            sprintf(fnbuf2, "/music%1d/", num);
+            strcpy(fnbuf, fnbuf2);
+            for(int i = 0; i < fileNum; i++) {
+                mpren_looper(isSetup, false, fileNum - i);
+                sprintf(fnbuf + 8, "%03d.mp3", (count + i) % 1000);
+                strcpy(fnbuf2 + 8, a[i]);
+                SD.rename(fnbuf2, fnbuf);
             }
-            #ifdef VSR_DBG
-            Serial.printf("%sRenamed '%s' to '%s'\n", funcName, fnbuf2, fnbuf);
-            #endif
-            
-            count++;
         }
     }
 
-    for(int i = 0; i <= allocBufIdx; i++) {
-        if(bufs[i]) free(bufs[i]);
+    free(arena);
+
+    // More files than the buffer held: Next round
+    if(bufFull && fileNum && count + fileNum <= 999) {
+        return mp_renameFilesInDir(isSetup);
     }
-    free(a);
 
     // Write "DONE" file
     if((origin = SD.open(fnbuf3, FILE_WRITE))) {
@@ -1107,7 +2746,99 @@ static bool mp_renameFilesInDir(bool isSetup)
 }
 
 /*
- * Insertion Sort for file names
+ * Rename journal
+ *
+ * Before renaming, the renamer writes the plan to VSR_REN.TXT:
+ * A line "VSRREN <n>", then "<ddd><name>" per file, then "END".
+ * Replaying it renames each file still there, so it can be 
+ * repeated after a power loss at any point; mp_checkForFolder()
+ * does this for folders without DONE file, and the renamer
+ * then finds the files done. The journal is gone before the 
+ * DONE file is written, so a stale one never meets new files.
+ */
+static bool mpren_writeJournal(int num, char **a, int fileNum, int count)
+{
+    char fnbuf[32];
+
+    sprintf(fnbuf, "/music%1d", num);
+    strcat(fnbuf, mprenfn);
+
+    File f = SD.open(fnbuf, FILE_WRITE);
+    if(!f) return false;
+
+    // If the card fills up, "END" is missing and
+    // mpren_replay() refuses it
+    f.printf("VSRREN %d\n", fileNum);
+    for(int i = 0; i < fileNum; i++) {
+        f.printf("%03d%s\n", count + i, a[i]);
+    }
+    f.print("END\n");
+    f.close();
+
+    return true;
+}
+
+// Returns false if there is no complete journal
+static bool mpren_replay(int num, bool isSetup)
+{
+    char fnbuf[32];
+    char from[8 + 3 + 256], to[20];
+    char buf[512];
+    int len = 0, pos = 0, ll = 0, n = 0, fileNum = 0;
+    bool ret = false;
+
+    sprintf(fnbuf, "/music%1d", num);
+    strcat(fnbuf, mprenfn);
+
+    File f = SD.open(fnbuf, FILE_READ);
+    if(!f) return false;
+
+    // Complete: Header and end marker
+    if(f.size() > 4 && f.seek(f.size() - 4) && f.read((uint8_t *)buf, 4) == 4 && !memcmp(buf, "END\n", 4) &&
+       f.seek(0) && (len = f.read((uint8_t *)buf, sizeof(buf) - 1)) > 7 && !memcmp(buf, "VSRREN ", 7)) {
+
+        buf[len] = 0;
+        fileNum = atoi(buf + 7);
+        while(pos < len && buf[pos++] != '\n') { }
+
+        sprintf(from, "/music%1d/", num);
+        strcpy(to, from);
+
+        for(;;) {
+            if(pos == len) {
+                if((len = f.read((uint8_t *)buf, sizeof(buf))) <= 0) break;
+                pos = 0;
+            }
+            char ch = buf[pos++];
+            if(ch != '\n') {
+                if(ll < 3 + 255) from[8 + ll++] = ch;
+                continue;
+            }
+            if(ll > 3) {
+                from[8 + ll] = 0;
+                memcpy(to + 8, from + 8, 3);
+                strcpy(to + 11, ".mp3");
+                memmove(from + 8, from + 11, ll - 3 + 1);
+                mpren_looper(isSetup, false, fileNum - n++);
+                // Already renamed: Source is gone
+                SD.rename(from, to);
+                #ifdef VSR_DBG
+                Serial.printf("MusicPlayer/Renamer: Renamed '%s' to '%s'\n", from, to);
+                #endif
+            }
+            ll = 0;
+        }
+        ret = true;
+    }
+    f.close();
+
+    SD.remove(fnbuf);
+
+    return ret;
+}
+
+/*
+ * Merge Sort for file names
  */
 
 static unsigned char mpren_toUpper(char a)
@@ -1128,32 +2859,40 @@ static uint8_t* mpren_renOrder(uint8_t *a, uint32_t s, int e)
     return a;
 }
 
+// Case-insensitive; if one name is a prefix of the other,
+// they count as equal
 static bool mpren_strGT(const char *a, const char *b)
 {
-    int aa = strlen(a);
-    int bb = strlen(b);
-    int cc = aa < bb ? aa : bb;
-
-    for(int i = 0; i < cc; i++) {
+    for( ; *a && *b; a++, b++) {
         unsigned char aaa = mpren_toUpper(*a);
         unsigned char bbb = mpren_toUpper(*b);
         if(aaa < bbb) return false;
         if(aaa > bbb) return true;
-        a++; b++;
     }
 
     return false;
 }
 
-static void mpren_insertionSort(char **a, int n)
+// Bottom-up, stable; t: buffer for n pointers
+static void mpren_mergeSort(char **a, char **t, int n)
 {
-    for(int i = 1; i < n; i++) {
-        char *k = a[i];
-        int j = i - 1;
-        while(j >= 0 && mpren_strGT(a[j], k)) {
-            a[j+1] = a[j];
-            j--;
+    char **src = a, **dst = t, **x;
+
+    for(int w = 1; w < n; w <<= 1) {
+        for(int lo = 0; lo < n; lo += 2 * w) {
+            int mid = (lo + w < n) ? lo + w : n;
+            int hi = (lo + 2 * w < n) ? lo + 2 * w : n;
+            int i = lo, j = mid, k = lo;
+            while(i < mid && j < hi) {
+                dst[k++] = mpren_strGT(src[i], src[j]) ? src[j++] : src[i++];
+            }
+            while(i < mid) dst[k++] = src[i++];
+            while(j < hi)  dst[k++] = src[j++];
         }
-        a[j + 1] = k;
+        x = src; src = dst; dst = x;
+    }
+
+    if(src != a) {
+        memcpy(a, src, n * sizeof(char *));
     }
 }
@@ -66,13 +66,15 @@
 #define PA_IGNNM   0x0010
 #define PA_WAV     0x0020
 #define PA_MUSIC   0x0040
+#define PA_MIX     0x0080   // Mix on top of current sound if in cache
 // upper 8 bits all taken
+#define PA_CACHE   0x20000  // Play from RAM (sound effect cache)
 #define PA_MASKA   (PA_LOOP|PA_INTRMUS|PA_ALLOWSD|PA_DYNVOL|PA_IGNNM)
 
 void audio_setup();
 void audio_loop();
 
-void play_file(const char *audio_file, uint32_t flags, float volumeFactor = 1.0f);
+void play_file(const char *audio_file, uint32_t flags, float volumeFactor = 1.0f, uint32_t startPos = 0);
 void append_file(const char *audio_file, uint32_t flags, float volumeFactor = 1.0f);
 
 uint32_t play_button_sound();
@@ -95,6 +97,7 @@ void     mp_play(bool forcePlay = true);
 bool     mp_stop(bool forceStatus = false);
 void     mp_next(bool forcePlay = false);
 void     mp_prev(bool forcePlay = false);
+void     mp_seek(uint32_t secs);
 int      mp_gotonum(int num, bool force = false);
 void     mp_makeShuffle(bool enable);
 int      mp_checkForFolder(int num);
@@ -103,6 +106,12 @@ uint8_t* m(uint8_t *a, uint32_t s, int e);
 void     mp_sendStatus(int force = 0);
 #endif
 
+#define AUDIO_STATS_LEN 320
+void audio_getStats(char *buf, int len, const char *sep);
+#ifdef VSR_HAVEMQTT
+void audio_sendStats();
+#endif
+
 typedef struct {
     int state;
     int curVolume;
@@ -35,6 +35,23 @@
 // Uncomment for HomeAssistant MQTT protocol support
 #define VSR_HAVEMQTT
 
+// Uncomment to decode audio in a separate task (on core 0), feeding
+// I2S through a PCM ring buffer. Keeps audio going while the main 
+// loop is blocked by WiFi, I2C or file operations. Experimental.
+//#define VSR_AUDIO_TASK
+
+// Receive BTTFN packets through AsyncUDP: Packets are checked and
+// time-stamped on arrival (in the network task), and queued for the
+// main loop. Network-triggered time travels then stay in sync with
+// the TCD even if the main loop was busy when the packet came in.
+// Comment out to poll WiFiUDP from the main loop instead.
+#define VSR_BTTFN_ASYNC
+
+// RAM for pre-decoded sound effects (button, volume and key sounds),
+// in bytes; 1s of 44.1kHz sound takes 88200 bytes. Sounds that don't
+// fit are played from file as usual.
+#define VSR_SNDCACHE_SIZE (64*1024)
+
 // External time travel lead time, as defined by TCD firmware
 // If VSR is connected to TCD by wire, and the option "Signal Time Travel 
 // without 5s lead" is set on the TCD, the VSR option "TCD signals without 
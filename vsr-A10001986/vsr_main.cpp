@@ -67,6 +67,7 @@
 #include "vsr_settings.h"
 #include "vsr_audio.h"
 #include "vsr_wifi.h"
+#include "bttfn.h"
 
 // i2c slave addresses
 
@@ -153,6 +154,8 @@ bool networkAbort      = false;
 bool networkAlarm      = false;
 uint16_t networkLead   = ETTO_LEAD;
 uint16_t networkP1     = 6600;
+unsigned long networkTTAt = 0;
+unsigned long networkReentryAt = 0;
 
 static bool tcdIsBusy  = false;
 bool        vsrBusy    = false;
@@ -235,122 +238,34 @@ bool                 FPBUnitIsOn = true;
 bool                 blockScan = false;
 
 // BTTF network
-#define BTTFN_VERSION              1
-#define BTTFN_SUP_MC            0x80
-#define BTTFN_SUP_ND            0x40
-#define BTTF_PACKET_SIZE          48
-#define BTTF_DEFAULT_LOCAL_PORT 1338
-#define BTTFN_POLL_INT          1100
-#define BTTFN_POLL_INT_FAST      700
-#define BTTFN_RESPONSE_TO        700
-#define BTTFN_KA_OFFSET           11
-#define BTTFN_KA_INTERVAL  ((60+BTTFN_KA_OFFSET)*1000)
-#define BTTFN_DATA_TO          18600
-#define BTTFN_TYPE_ANY     0    // Any, unknown or no device
-#define BTTFN_TYPE_FLUX    1    // Flux Capacitor
-#define BTTFN_TYPE_SID     2    // SID
-#define BTTFN_TYPE_PCG     3    // Dash Gauges
-#define BTTFN_TYPE_VSR     4    // VSR
-#define BTTFN_TYPE_AUX     5    // Aux (user custom device)
-#define BTTFN_TYPE_REMOTE  6    // Futaba remote control
-#define BTTFN_NOT_PREPARE  1
-#define BTTFN_NOT_TT       2
-#define BTTFN_NOT_REENTRY  3
-#define BTTFN_NOT_ABORT_TT 4
-#define BTTFN_NOT_ALARM    5
-#define BTTFN_NOT_REFILL   6
-#define BTTFN_NOT_FLUX_CMD 7
-#define BTTFN_NOT_SID_CMD  8
-#define BTTFN_NOT_PCG_CMD  9
-#define BTTFN_NOT_WAKEUP   10
-#define BTTFN_NOT_AUX_CMD  11
-#define BTTFN_NOT_VSR_CMD  12
-#define BTTFN_NOT_SPD      15
-#define BTTFN_NOT_INFO     16
-#define BTTFN_NOT_DATA     128  // bit only, not value
-#define BTTFN_REMCMD_KEEPALIVE 101
-#define BTTFN_SSRC_NONE         0
-#define BTTFN_SSRC_GPS          1
-#define BTTFN_SSRC_ROTENC       2
-#define BTTFN_SSRC_REM          3
-#define BTTFN_SSRC_P0           4
-#define BTTFN_SSRC_P1           5
-#define BTTFN_SSRC_P2           6
-#define BTTFN_TCDI1_NOREM   0x0001
-#define BTTFN_TCDI1_NOREMKP 0x0002
-#define BTTFN_TCDI1_EXT     0x0004
-#define BTTFN_TCDI1_OFF     0x0008
-#define BTTFN_TCDI1_NM      0x0010
-#define BTTFN_TCDI2_BUSY    0x0001
-static const uint8_t BTTFUDPHD[4] = { 'B', 'T', 'T', 'F' };
-static bool          useBTTFN = false;
+#ifdef VSR_BTTFN_ASYNC
+static BTTFNAsyncUDP bttfUDP;
+static BTTFNAsyncUDP bttfMcUDP;
+#else
 static WiFiUDP       bttfUDP;
-static UDP*          vsrUDP;
 static WiFiUDP       bttfMcUDP;
-static UDP*          vsrMcUDP;
-static byte          BTTFUDPBuf[BTTF_PACKET_SIZE];
-static byte          BTTFUDPTBuf[BTTF_PACKET_SIZE];
-static unsigned long BTTFNUpdateNow = 0;
-static unsigned long bttfnVSRPollInt = BTTFN_POLL_INT;
-static unsigned long BTTFNTSRQAge = 0;
-static unsigned long BTTFNLastCmdSent = 0;
-static bool          BTTFNPacketDue = false;
-static bool          BTTFNWiFiUp = false;
-static uint8_t       BTTFNfailCount = 0;
-static uint32_t      BTTFUDPID = 0;
-static unsigned long lastBTTFNpacket = 0;
-static unsigned long lastBTTFNKA = 0;
-static unsigned long bttfnLastNotData = 0;
-static bool          BTTFNBootTO = false;
-static bool          haveTCDIP = false;
-static IPAddress     bttfnTcdIP;
-static uint32_t      bttfnTCDSeqCnt = 0;
-static uint32_t      bttfnTCDDataSeqCnt = 0;
-static uint32_t      bttfnSessionID = 0;
-int                  bttfnHaveTCDSSID = 0;
-char                 TCDSSID[8] = { 0 };
-uint8_t              TCDpwMarker = 0;
-static uint8_t       bttfnReqStatus = 0x56; // Request capabilities, status, temperature, speed
-static bool          TCDSupportsNOTData = false;
-static bool          TCDSupportsSSID = false;
-static bool          bttfnDataNotEnabled = false;
-static uint32_t      tcdHostNameHash = 0;
-static byte          BTTFMCBuf[BTTF_PACKET_SIZE];
-static IPAddress     bttfnMcIP(224, 0, 0, 224);
-static uint32_t      bttfnSeqCnt = 1;
-
-static int      iCmdIdx = 0;
-static int      oCmdIdx = 0;
-static uint32_t commandQueue[16] = { 0 };
-
-#ifdef ESP32
-/*  "warning: taking address of packed member of 'struct <anonymous>' may 
- *  result in an unaligned pointer value"
- *  "GCC will issue this warning when accessing an unaligned member of 
- *  a packed struct due to the incurred penalty of unaligned memory 
- *  access. However, all ESP chips (on both Xtensa and RISC-V 
- *  architectures) allow for unaligned memory access and incur no extra 
- *  penalty."
- *  https://docs.espressif.com/projects/esp-idf/en/v5.1/esp32s3/migration-guides/release-5.x/5.0/gcc.html
- */
-#define GET32(a,b)    *((uint32_t *)((a) + (b)))
-#define SET32(a,b,c)  *((uint32_t *)((a) + (b))) = c
-#else
-#define GET32(a,b)          \
-    (((a)[b])            |  \
-    (((a)[(b)+1]) << 8)  |  \
-    (((a)[(b)+2]) << 16) |  \
-    (((a)[(b)+3]) << 24))   
-#define SET32(a,b,c)                        \
-    (a)[b]       = ((uint32_t)(c)) & 0xff;  \
-    ((a)[(b)+1]) = ((uint32_t)(c)) >> 8;    \
-    ((a)[(b)+2]) = ((uint32_t)(c)) >> 16;   \
-    ((a)[(b)+3]) = ((uint32_t)(c)) >> 24; 
 #endif
+static BTTFNClient   bttfn(bttfUDP, bttfMcUDP);
+static bool          useBTTFN = false;
+
+// Remote command queue (BTTFN, MQTT)
+// Written by addCmdQueue(), read by execute_remote_command(); 
+// both run in the main loop, but the former might be called 
+// while the latter executes a command (nested myloop()).
+#define CMDQ_SIZE        32     // Power of 2
+#define CMDQ_BUDGET       4     // Max commands executed per main_loop()
+#define CMDQ_TIME_BUDGET 50     // ... or this many ms, whichever comes first
+static uint32_t          commandQueue[CMDQ_SIZE] = { 0 };
+static int16_t           commandDelta[CMDQ_SIZE] = { 0 };
+static volatile uint32_t cmdHead = 0;   // Free-running, written by addCmdQueue()
+static volatile uint32_t cmdTail = 0;   // Free-running, written by execute_remote_command()
+static uint32_t          cmdOverflows = 0;
+static uint32_t          cmdCoalesced = 0;
 
 static void setTTOUT(uint8_t stat);
+static unsigned long reentryStart(unsigned long now);
 
-static void execute_remote_command();
+static void execute_remote_commands();
 
 static void play_startup();
 static void displayButtonMode();
@@ -375,11 +290,6 @@ static void myloop();
 
 static void bttfn_setup();
 static void bttfn_loop_quick();
-static bool bttfn_checkmc();
-static void BTTFNCheckPacket();
-static bool BTTFNSendRequest();
-static void BTTFNPreparePacketTemplate();
-static void BTTFNSendPacket();
 
 void main_boot()
 {
@@ -594,8 +504,8 @@ void main_loop()
     bool forceDispUpd = false;
     bool wheelsChanged = false;
 
-    // Reset polling interval; will be overruled below if applicable
-    bttfnVSRPollInt = BTTFN_POLL_INT;
+    // Reset polling speed; will be overruled below if applicable
+    bttfn.setPollFast(false);
 
     // Follow TCD fake power
     if(useFPO && (tcdFPO != fpoOld)) {
@@ -686,7 +596,7 @@ void main_loop()
 
     // Execute remote commands from TCD or MQTT
     if(FPBUnitIsOn) {
-        execute_remote_command();
+        execute_remote_commands();
     }
 
     // Update temp sensor reading
@@ -756,7 +666,7 @@ void main_loop()
             networkTimeTravel = false;
             if(!networkAbort) {
                 /*if(!ignTT)*/ ssEnd();
-                timeTravel(networkTCDTT, networkLead, networkP1);
+                timeTravel(networkTCDTT, networkLead, networkP1, networkTTAt);
             }
         }
     } else {
@@ -843,7 +753,7 @@ void main_loop()
                         TTP0 = false;
                         TTP2 = true;
 
-                        TTstart = now;
+                        TTstart = reentryStart(now);
                       
                     }
 
@@ -868,7 +778,7 @@ void main_loop()
                         play_file("/ttend.mp3", PA_INTRMUS|PA_ALLOWSD, TT_V_LEV);
                     }
 
-                    TTstart = now;
+                    TTstart = reentryStart(now);
                     
                 }
             }
@@ -1130,8 +1040,9 @@ void main_loop()
                         vsrdisplay.show();
                         prevGPSSpeed = gpsSpeed;
                     }
-                    if(!bttfnTCDSeqCnt) {
-                        bttfnVSRPollInt = BTTFN_POLL_INT_FAST;
+                    // Speed not pushed by TCD: Poll it fast
+                    if(!bttfn.haveSpeedNot()) {
+                        bttfn.setPollFast(true);
                     }
                     break;
                 case LDM_TEMP:
@@ -1227,16 +1138,12 @@ void main_loop()
     
     // If network is interrupted, return to stand-alone
     if(useBTTFN) {
-        if( !bttfnDataNotEnabled &&
-            ((lastBTTFNpacket && (now - lastBTTFNpacket > 30*1000)) ||
-             (!BTTFNBootTO && !lastBTTFNpacket && (now - powerupMillis > 60*1000))) ) {
+        if(bttfn.checkLost(powerupMillis)) {
             tcdNM = false;
             tcdFPO = false;
             gpsSpeed = -1;
             TCDtemperature = -32768;
             haveTCDTemp = false;
-            lastBTTFNpacket = 0;
-            BTTFNBootTO = true;
         }
     }
 
@@ -1284,8 +1191,10 @@ static void chgVolume(int d)
 
     int nv = aud_state.curVolume + d;
 
-    if(nv < 0 || nv > VOL_LEVELS - 1) {
-        nv = aud_state.curVolume;
+    if(nv < 0) {
+        nv = 0;
+    } else if(nv > VOL_LEVELS - 1) {
+        nv = VOL_LEVELS - 1;
     }
 
     sprintf(buf, "%3d", nv);
@@ -1318,7 +1227,11 @@ void decreaseVolume()
  * 
  */
 
-void timeTravel(bool TCDtriggered, uint16_t P0Dur, uint16_t P1Dur)
+/*
+ * TTanchor: When the TCD signalled the TT (our millis()), if 
+ * known. P0 then counts from there instead of from now.
+ */
+void timeTravel(bool TCDtriggered, uint16_t P0Dur, uint16_t P1Dur, unsigned long TTanchor)
 {
     if(TTrunning)
         return;
@@ -1329,7 +1242,7 @@ void timeTravel(bool TCDtriggered, uint16_t P0Dur, uint16_t P1Dur)
 
     setTTOUT(LOW);
 
-    TTstart = millis();
+    TTstart = TTanchor ? TTanchor : millis();
 
     if(TCDtriggered && ignTT) {
         TTrunningIOonly = true;
@@ -1384,7 +1297,7 @@ void timeTravel(bool TCDtriggered, uint16_t P0Dur, uint16_t P1Dur)
     }
     
     #ifdef VSR_DBG
-    Serial.printf("P0 duration is %d\n", P0duration);
+    Serial.printf("P0 duration is %d (%d ms passed)\n", P0duration, millis() - TTstart);
     Serial.printf("TTFDelay %d  TTFInt %d\n", TTFDelay, TTFInt);
     #endif
 }
@@ -1592,6 +1505,20 @@ static void wakeup()
     doWakeup = false;
 }
 
+/*
+ * P2 counts from when the TCD sent re-entry/abort, if 
+ * known, otherwise from now. Like the lead in P0.
+ */
+static unsigned long reentryStart(unsigned long now)
+{
+    if(networkTCDTT && (networkReentry || networkAbort) && networkReentryAt) {
+        if((long)(now - networkReentryAt) > 0) {
+            return networkReentryAt;
+        }
+    }
+    return now;
+}
+
 static void setTTOUT(uint8_t stat)
 {
     digitalWrite(TT_OUT_PIN, stat);
@@ -1600,9 +1527,73 @@ static void setTTOUT(uint8_t stat)
     #endif
 }
 
-static void execute_remote_command()
+/*
+ * Commands that set something (as opposed to doing
+ * something) can be merged with a directly preceding 
+ * one of the same kind. The last one wins, except for 
+ * volume up/down, which add up.
+ */
+enum {
+    CMDC_NONE = 0,
+    CMDC_DISPMODE,
+    CMDC_MUSFOLDER,
+    CMDC_VOLUME,
+    CMDC_BRIGHTNESS,
+    CMDC_VOLUPDOWN
+};
+
+static int cmdClass(uint32_t command)
+{
+    if(command >= 10 && command <= 19)                    return CMDC_DISPMODE;
+    if(command >= 50 && command <= 59)                    return CMDC_MUSFOLDER;
+    if(command >= 300 && command <= 300 + VOL_LEVELS - 1) return CMDC_VOLUME;
+    if(command >= 400 && command <= 415)                  return CMDC_BRIGHTNESS;
+    if(command == 1015 || command == 1016)                return CMDC_VOLUPDOWN;
+    return CMDC_NONE;
+}
+
+void addCmdQueue(uint32_t command)
 {
-    uint32_t command = commandQueue[oCmdIdx];
+    uint32_t h = cmdHead;
+    int      cc;
+
+    if(!command) return;
+
+    // Try to merge with the newest pending command
+    if((h != cmdTail) && (cc = cmdClass(command)) && 
+       (cc == cmdClass(commandQueue[(h - 1) & (CMDQ_SIZE - 1)]))) {
+        uint32_t l = (h - 1) & (CMDQ_SIZE - 1);
+        cmdCoalesced++;
+        if(cc == CMDC_VOLUPDOWN) {
+            commandDelta[l] += (command == 1015) ? 1 : -1;
+            if(!commandDelta[l]) {
+                // Up and down cancelled out
+                cmdHead = h - 1;
+            }
+        } else {
+            commandQueue[l] = command;
+        }
+        return;
+    }
+
+    if(h - cmdTail >= CMDQ_SIZE) {
+        cmdOverflows++;
+        #ifdef VSR_DBG
+        Serial.printf("Command queue full, dropped %d\n", command);
+        #endif
+        return;
+    }
+
+    commandQueue[h & (CMDQ_SIZE - 1)] = command;
+    commandDelta[h & (CMDQ_SIZE - 1)] = (command == 1015) ? 1 : ((command == 1016) ? -1 : 0);
+    cmdHead = h + 1;
+}
+
+static bool execute_remote_command()
+{
+    uint32_t t = cmdTail;
+    uint32_t command;
+    int      delta;
     bool     injected = false;
 
     // We are only called if ON
@@ -1611,12 +1602,14 @@ static void execute_remote_command()
     // No command execution during timed sequences
     // ssActive checked by individual command
 
-    if(!command || TTrunning)
-        return;
+    if(t == cmdHead || TTrunning)
+        return false;
 
-    commandQueue[oCmdIdx] = 0;
-    oCmdIdx++;
-    oCmdIdx &= 0x0f;
+    // Take it off the queue before executing it; the
+    // command might run myloop(), adding new ones
+    command = commandQueue[t & (CMDQ_SIZE - 1)];
+    delta = commandDelta[t & (CMDQ_SIZE - 1)];
+    cmdTail = t + 1;
 
     if(command & 0x80000000) {
         injected = true;
@@ -1627,7 +1620,7 @@ static void execute_remote_command()
         } else if(command >= 8000000 && command <= 8999999) {
             command -= 8000000;
         }
-        if(!command) return;
+        if(!command) return true;
     }
 
     if(command < 10) {                                // 800x
@@ -1801,10 +1794,9 @@ static void execute_remote_command()
                 stop_key();
                 break;
             case 15:
-                increaseVolume();
-                break;
             case 16:
-                decreaseVolume();
+                // Net sum of subsequent VOLUME_UP/_DOWN
+                chgVolume(delta);
                 break;
             }
 
@@ -1841,11 +1833,26 @@ static void execute_remote_command()
             if((command / 1000) == 888) {
                 uint16_t num = command - 888000;
                 num = mp_gotonum(num, true);
+            } else if((command / 10000) == 887) {   // (MQTT) seek in current song
+                mp_seek(command - 8870000);
             }
             break;
         }
 
     }
+
+    return true;
+}
+
+static void execute_remote_commands()
+{
+    unsigned long now = millis();
+    int budget = CMDQ_BUDGET;
+
+    while(budget-- && (millis() - now < CMDQ_TIME_BUDGET)) {
+        if(!execute_remote_command())
+            break;
+    }
 }
 
 void display_ip()
@@ -2009,44 +2016,19 @@ unsigned long millisNonZero()
 
 /*
  * Basic Telematics Transmission Framework (BTTFN)
+ * 
+ * Protocol handling is in BTTFNClient; here we only 
+ * evaluate what the TCD tells us.
  */
 
-static bool check_packet(uint8_t *buf)
-{
-    // Basic validity check
-    if(memcmp(buf, BTTFUDPHD, 4))
-        return false;
-
-    uint8_t a = 0;
-    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
-        a += buf[i] ^ 0x55;
-    }
-
-    return (buf[BTTF_PACKET_SIZE - 1] == a);
-}
-
-void addCmdQueue(uint32_t command)
+static bool bttfn_wifiUp()
 {
-    if(!command) return;
-
-    commandQueue[iCmdIdx] = command;
-    iCmdIdx++;
-    iCmdIdx &= 0x0f;
+    return (WiFi.status() == WL_CONNECTED);
 }
 
-static void bttfn_eval_response(uint8_t *buf, bool checkCaps)
+// Status data from response or NOT_DATA packet
+static void bttfn_eval_data(uint8_t *buf)
 {
-    if(checkCaps && (buf[5] & 0x40)) {
-        bttfnReqStatus &= ~0x40;     // Do no longer poll capabilities
-        if(buf[31] & 0x01) {
-            bttfnReqStatus &= ~0x02; // Do no longer poll speed, comes over multicast
-        }
-        if(buf[31] & 0x10) {
-            TCDSupportsNOTData = true;
-            TCDSupportsSSID = !!(buf[31] & 0x40);
-        }
-    }
-    
     if(buf[5] & 0x02) {
         gpsSpeed = (int16_t)(buf[18] | (buf[19] << 8));
         if(gpsSpeed > 88) gpsSpeed = 88;
@@ -2069,81 +2051,37 @@ static void bttfn_eval_response(uint8_t *buf, bool checkCaps)
         tcdNM = false;
         tcdFPO = false;
     }
-
-    if(!bttfnHaveTCDSSID && !checkCaps && TCDSupportsSSID) {
-        bttfnHaveTCDSSID = 1;
-        memcpy((void *)TCDSSID, (void *)&buf[41], 6);
-        TCDSSID[6] = buf[18];
-        TCDpwMarker = buf[19] & 0x01;
-    }
 }
 
 static void handle_tcd_notification(uint8_t *buf)
 {
-    uint32_t seqCnt;
-
     // Note: This might be called while we are in a
     // wait-delay-loop. Best to just set flags here
     // that are evaluated synchronously (=later).
     // Do not stuff that messes with display, input,
     // etc.
-
-    if(buf[5] & BTTFN_NOT_DATA) {
-        if(TCDSupportsNOTData) {
-            bttfnDataNotEnabled = true;
-            bttfnLastNotData = millis();
-            seqCnt = GET32(buf, 27);
-            if(bttfnSessionID && (bttfnSessionID != seqCnt)) {
-                lastBTTFNKA = bttfnLastNotData - BTTFN_KA_INTERVAL + (BTTFN_KA_OFFSET*1000);
-                bttfnTCDDataSeqCnt = 1;
-                bttfnHaveTCDSSID = 0;
-            }
-            bttfnSessionID = seqCnt;
-            seqCnt = GET32(buf, 6);
-            if(seqCnt > bttfnTCDDataSeqCnt || seqCnt == 1) {
-                #ifdef VSR_DBG_NET
-                Serial.println("Valid NOT_DATA packet received");
-                #endif
-                bttfn_eval_response(buf, false);
-            } else {
-                #ifdef VSR_DBG_NET
-                Serial.printf("Out-of-sequence NOT_DATA packet received %d %d\n", seqCnt, bttfnTCDDataSeqCnt);
-                #endif
-            }
-            bttfnTCDDataSeqCnt = seqCnt;
-        }
-        return;
-    }
     
     switch(buf[5]) {
     case BTTFN_NOT_SPD:
-        seqCnt = GET32(buf, 12);
-        if(seqCnt > bttfnTCDSeqCnt || seqCnt == 1) {
-            switch(buf[8] | (buf[9] << 8)) {
-            case BTTFN_SSRC_GPS:
-                spdIsRotEnc = false;
-                break;
-            case BTTFN_SSRC_P1:
-                // If packets come out-of-order, we might
-                // get this one before TTrunning, and we
-                // don't want a switch to usingGPSS only 
-                // because of P1 speed
-                if(!TTrunning) return;
-                // fall through
-            default:
-                spdIsRotEnc = true;
-            }
-            gpsSpeed = (int16_t)(buf[6] | (buf[7] << 8));
-            if(gpsSpeed > 88) gpsSpeed = 88;
-            #ifdef VSR_DBG_NET
-            Serial.printf("TCD sent speed %d\n", gpsSpeed);
-            #endif
-        } else {
-            #ifdef VSR_DBG_NET
-            Serial.printf("Out-of-sequence packet received from TCD %d %d\n", seqCnt, bttfnTCDSeqCnt);
-            #endif
+        switch(buf[8] | (buf[9] << 8)) {
+        case BTTFN_SSRC_GPS:
+            spdIsRotEnc = false;
+            break;
+        case BTTFN_SSRC_P1:
+            // If packets come out-of-order, we might
+            // get this one before TTrunning, and we
+            // don't want a switch to usingGPSS only 
+            // because of P1 speed
+            if(!TTrunning) return;
+            // fall through
+        default:
+            spdIsRotEnc = true;
         }
-        bttfnTCDSeqCnt = seqCnt;
+        gpsSpeed = (int16_t)(buf[6] | (buf[7] << 8));
+        if(gpsSpeed > 88) gpsSpeed = 88;
+        #ifdef VSR_DBG_NET
+        Serial.printf("TCD sent speed %d\n", gpsSpeed);
+        #endif
         break;
     case BTTFN_NOT_PREPARE:
         // Prepare for TT. Comes at some undefined point,
@@ -2160,6 +2098,9 @@ static void handle_tcd_notification(uint8_t *buf)
         if(!TCDconnected && !TTrunning && !TTrunningIOonly && !vsrBusy) {
             networkLead = buf[6] | (buf[7] << 8);
             networkP1 = buf[8] | (buf[9] << 8);
+            // Lead counts from when the TCD sent the packet
+            networkTTAt = bttfn.packetMillis() - bttfn.getOWD();
+            networkReentryAt = 0;
             networkReentry = false;
             networkAbort = false;
             networkTimeTravel = true;
@@ -2170,6 +2111,7 @@ static void handle_tcd_notification(uint8_t *buf)
         // Start re-entry (if TT currently running)
         // Ignore command if TCD is connected by wire
         if(!TCDconnected && (TTrunning || TTrunningIOonly || networkTimeTravel) && networkTCDTT) {
+            networkReentryAt = bttfn.packetMillis() - bttfn.getOWD();
             networkReentry = true;
         }
         break;
@@ -2177,6 +2119,9 @@ static void handle_tcd_notification(uint8_t *buf)
         // Abort TT (if TT currently running)
         // Ignore command if TCD is connected by wire
         if(!TCDconnected && (TTrunning || TTrunningIOonly || networkTimeTravel) && networkTCDTT) {
+            if(!networkReentry) {
+                networkReentryAt = bttfn.packetMillis() - bttfn.getOWD();
+            }
             networkAbort = true;
         }
         break;
@@ -2205,350 +2150,52 @@ static void handle_tcd_notification(uint8_t *buf)
     }
 }
 
-// Check for pending MC packet and parse it
-static bool bttfn_checkmc()
-{
-    int psize = vsrMcUDP->parsePacket();
-
-    if(!psize) {
-        return false;
-    }
-
-    // This returns true as long as a packet was received
-    // regardless whether it was for us or not. Point is
-    // to clear the receive buffer.
-    
-    vsrMcUDP->read(BTTFMCBuf, BTTF_PACKET_SIZE);
-
-    #ifdef VSR_DBG_NET
-    Serial.printf("Received multicast packet from %s\n", vsrMcUDP->remoteIP().toString());
-    #endif
-
-    if(haveTCDIP) {
-        if(bttfnTcdIP != vsrMcUDP->remoteIP())
-            return true;
-    } else {
-        // Do not use tcdHostNameHash; let DISCOVER do its work
-        // and wait for a result.
-        return true;
-    }
-
-    if(!check_packet(BTTFMCBuf))
-        return true;
-
-    if((BTTFMCBuf[4] & 0x4f) == (BTTFN_VERSION | 0x40)) {
-
-        // A notification from the TCD
-        handle_tcd_notification(BTTFMCBuf);
-    
-    }
-
-    return true;
-}
-
-// Check for pending packet and parse it
-static void BTTFNCheckPacket()
-{
-    unsigned long mymillis = millisNonZero();
-    
-    int psize = vsrUDP->parsePacket();
-    if(!psize) {
-        if(!bttfnDataNotEnabled && BTTFNPacketDue) {
-            if((mymillis - BTTFNTSRQAge) > BTTFN_RESPONSE_TO) {
-                // Packet timed out
-                BTTFNPacketDue = false;
-                // Immediately trigger new request for
-                // the first 10 timeouts, after that
-                // the new request is only triggered
-                // in greater intervals via bttfn_loop().
-                if(haveTCDIP && BTTFNfailCount < 10) {
-                    BTTFNfailCount++;
-                    BTTFNUpdateNow = 0;
-                }
-            }
-        }
-        return;
-    }
-    
-    vsrUDP->read(BTTFUDPBuf, BTTF_PACKET_SIZE);
-
-    if(!check_packet(BTTFUDPBuf))
-        return;
-
-    if((BTTFUDPBuf[4] & 0x4f) == (BTTFN_VERSION | 0x40)) {
-
-        // A notification from the TCD
-        handle_tcd_notification(BTTFUDPBuf);
-      
-    } else {
-
-        // (Possibly) a response packet
-    
-        if(GET32(BTTFUDPBuf, 6) != BTTFUDPID)
-            return;
-    
-        // Response marker missing or wrong version, bail
-        if((BTTFUDPBuf[4] & 0x8f) != (BTTFN_VERSION | 0x80))
-            return;
-
-        BTTFNfailCount = 0;
-    
-        // If it's our expected packet, no other is due for now
-        BTTFNPacketDue = false;
-
-        if(BTTFUDPBuf[5] & 0x80) {
-            if(!haveTCDIP) {
-                bttfnTcdIP = vsrUDP->remoteIP();
-                haveTCDIP = true;
-                #ifdef VSR_DBG_NET
-                Serial.printf("Discovered TCD IP %d.%d.%d.%d\n", bttfnTcdIP[0], bttfnTcdIP[1], bttfnTcdIP[2], bttfnTcdIP[3]);
-                #endif
-            } else {
-                #ifdef VSR_DBG_NET
-                Serial.println("Internal error - received unexpected DISCOVER response");
-                #endif
-            }
-        }
-
-        // TCD did register us, so use current millis as
-        // baseline for KEEP_ALIVE (lastBTTFNKA)
-        lastBTTFNpacket = lastBTTFNKA = mymillis;
-
-        bttfn_eval_response(BTTFUDPBuf, true);
-    }
-}
-
-static void BTTFNPreparePacketTemplate()
-{
-    memset(BTTFUDPTBuf, 0, BTTF_PACKET_SIZE);
-
-    // ID
-    memcpy(BTTFUDPTBuf, BTTFUDPHD, 4);
-
-    // Tell the TCD about our hostname
-    // 13 bytes total. If hostname is longer, last in buf is '.'
-    memcpy(BTTFUDPTBuf + 10, settings.hostName, 13);
-    if(strlen(settings.hostName) > 13) BTTFUDPTBuf[10+12] = '.';
-
-    BTTFUDPTBuf[10+13] = BTTFN_TYPE_VSR;
-
-    // Version, MC-marker, ND-marker
-    BTTFUDPTBuf[4] = BTTFN_VERSION | BTTFN_SUP_MC | BTTFN_SUP_ND;
-}
-
-static void BTTFNPreparePacket()
-{
-    memcpy(BTTFUDPBuf, BTTFUDPTBuf, BTTF_PACKET_SIZE);               
-}
-
-static void BTTFNDispatch()
-{
-    uint8_t a = 0;
-    for(int i = 4; i < BTTF_PACKET_SIZE - 1; i++) {
-        a += BTTFUDPBuf[i] ^ 0x55;
-    }
-    BTTFUDPBuf[BTTF_PACKET_SIZE - 1] = a;
-
-    if(haveTCDIP) {
-        vsrUDP->beginPacket(bttfnTcdIP, BTTF_DEFAULT_LOCAL_PORT);       
-    } else {
-        #ifdef VSR_DBG_NET
-        Serial.printf("Sending multicast (hostname hash %x)\n", tcdHostNameHash);
-        #endif
-        vsrUDP->beginPacket(bttfnMcIP, BTTF_DEFAULT_LOCAL_PORT + 1);
-    }
-    vsrUDP->write(BTTFUDPBuf, BTTF_PACKET_SIZE);
-    vsrUDP->endPacket();
-}
-
-// Send a new data request
-static bool BTTFNSendRequest()
-{
-    BTTFNPacketDue = false;
-
-    BTTFNUpdateNow = millisNonZero();
-
-    if(WiFi.status() != WL_CONNECTED) {
-        BTTFNWiFiUp = false;
-        return false;
-    }
-
-    BTTFNWiFiUp = true;
-
-    // Send new packet
-    BTTFNPreparePacket();
-    
-    // Serial
-    BTTFUDPID = (uint32_t)millis();
-    SET32(BTTFUDPBuf, 6, BTTFUDPID);
-
-    // Request status, temperature, speed
-    BTTFUDPBuf[5] = bttfnReqStatus;
-
-    if(!haveTCDIP) {
-        BTTFUDPBuf[5] |= 0x80;
-        SET32(BTTFUDPBuf, 31, tcdHostNameHash);
-    }
-
-    BTTFNDispatch();
-
-    BTTFNTSRQAge = millis();
-    
-    BTTFNPacketDue = true;
-    
-    return true;
-}
-
-static bool bttfn_connected()
-{
-    if(!useBTTFN)
-        return false;
-
-    if(!haveTCDIP)
-        return false;
-
-    if(WiFi.status() != WL_CONNECTED)
-        return false;
-
-    if(!lastBTTFNpacket)
-        return false;
-
-    return true;
-}
-
 bool bttfn_trigger_tt()
 {
-    if(!bttfn_connected())
-        return false;
-
     if(TTrunning || tcdIsBusy)
         return false;
 
-    BTTFNPreparePacket();
-
-    // Trigger BTTFN-wide TT
-    BTTFUDPBuf[5] = 0x80;
-
-    BTTFNDispatch();
-
-    return true;
+    return bttfn.triggerTT();
 }
 
-static bool bttfn_send_command(uint8_t cmd, uint8_t p1, uint8_t p2)
+const char *bttfn_getTCDSSID(uint8_t *pwMarker)
 {
-    if(cmd != BTTFN_REMCMD_KEEPALIVE)
-        return false;
-        
-    if(!bttfn_connected())
-        return false;
-
-    BTTFNPreparePacket();
+    if(pwMarker) *pwMarker = bttfn.getTCDpwMarker();
     
-    //BTTFUDPBuf[5] = 0x00; // 0 already
-
-    SET32(BTTFUDPBuf, 6, bttfnSeqCnt);         // Seq counter
-    bttfnSeqCnt++;
-    if(!bttfnSeqCnt) bttfnSeqCnt++;
-
-    BTTFUDPBuf[25] = cmd;                      // Cmd + parms
-    BTTFUDPBuf[26] = p1;
-    BTTFUDPBuf[27] = p2;
-
-    BTTFNDispatch();
+    return bttfn.getTCDSSID();
+}
 
-    #ifdef VSR_DBG_NET
-    Serial.printf("Sent command %d\n", cmd);
-    #endif
+#ifdef VSR_HAVEMQTT
+void bttfn_sendStats()
+{
+    char msg[192];
 
-    BTTFNLastCmdSent = millisNonZero();
+    if(!useBTTFN || !mqttConnected()) return;
 
-    return true;
+    snprintf(msg, sizeof(msg), "{\"RTT\":%u,\"RV\":%u,\"RM\":%u,\"OWD\":%u,\"N\":%u,\"QO\":%u,\"QC\":%u,"
+        "\"TX\":%u,\"RX\":%u,\"MC\":%u,\"TO\":%u,\"PI\":%u}",
+        bttfn.getRTT(), bttfn.getRTTVar(), bttfn.getRTTMin(), bttfn.getOWD(), bttfn.getRTTSamples(),
+        cmdOverflows, cmdCoalesced,
+        bttfn.getTxPackets(), bttfn.getRxPackets(), bttfn.getRxMcPackets(), bttfn.getTimeouts(),
+        (uint32_t)bttfn.getPollInt());
+    mqttPublish("bttf/vsr/bttfnstats", msg, strlen(msg) + 1);
 }
+#endif
 
 static void bttfn_setup()
 {
-    useBTTFN = false;
-
-    // string empty? Disable BTTFN.
-    if(!settings.tcdIP[0])
-        return;
-
-    haveTCDIP = isIp(settings.tcdIP);
-    
-    if(!haveTCDIP) {
-        tcdHostNameHash = 0;
-        unsigned char *s = (unsigned char *)settings.tcdIP;
-        for ( ; *s; ++s) tcdHostNameHash = 37 * tcdHostNameHash + tolower(*s);
-    } else {
-        bttfnTcdIP.fromString(settings.tcdIP);
-    }
+    bttfn.setCallbacks(handle_tcd_notification, bttfn_eval_data);
+    bttfn.setLinkCheck(bttfn_wifiUp);
     
-    vsrUDP = &bttfUDP;
-    vsrUDP->begin(BTTF_DEFAULT_LOCAL_PORT);
-
-    vsrMcUDP = &bttfMcUDP;
-    vsrMcUDP->beginMulticast(bttfnMcIP, BTTF_DEFAULT_LOCAL_PORT + 2);
-
-    BTTFNPreparePacketTemplate();
-    
-    BTTFNfailCount = 0;
-    useBTTFN = true;
+    useBTTFN = bttfn.begin(settings.tcdIP, settings.hostName, BTTFN_TYPE_VSR);
 }
 
 void bttfn_loop()
 {
-    if(!useBTTFN)
-        return;
-
-    int t = 100;
-    
-    while(bttfn_checkmc() && t--) {}
-
-    unsigned long now = millisNonZero();
-
-    BTTFNCheckPacket();   
-    
-    if(bttfnDataNotEnabled) {
-        if(now - lastBTTFNKA > BTTFN_KA_INTERVAL) {
-            if(!BTTFNLastCmdSent || (now - BTTFNLastCmdSent > (BTTFN_KA_INTERVAL/2))) {
-                bttfn_send_command(BTTFN_REMCMD_KEEPALIVE, 0, 0);
-            }
-            BTTFNLastCmdSent = 0;
-            do {
-                lastBTTFNKA += BTTFN_KA_INTERVAL;
-            } while(now - lastBTTFNKA >= BTTFN_KA_INTERVAL);
-        }
-        if(now - bttfnLastNotData > BTTFN_DATA_TO) {
-            // Return to polling if no NOT_DATA for too long
-            bttfnDataNotEnabled = false;
-            bttfnTCDDataSeqCnt = 1;
-            // Re-do DISCOVER, TCD might have got new IP address
-            if(tcdHostNameHash) haveTCDIP = false;
-            // Don't assume TCD comes back with same SSID/pwMarker
-            bttfnHaveTCDSSID = 0;
-            // Avoid immediate return to stand-alone in main_loop()
-            lastBTTFNpacket = now;
-            #ifdef VSR_DBG_NET
-            Serial.println("NOT_DATA timeout, returning to polling");
-            #endif
-        }
-    } else if(!BTTFNPacketDue) {
-        // If WiFi status changed, trigger immediately
-        if(!BTTFNWiFiUp && (WiFi.status() == WL_CONNECTED)) {
-            BTTFNUpdateNow = 0;
-        }
-        if((!BTTFNUpdateNow) || (millis() - BTTFNUpdateNow > bttfnVSRPollInt)) {
-            BTTFNSendRequest();
-        }
-    }
+    bttfn.loop();
 }
 
 static void bttfn_loop_quick()
 {
-    if(!useBTTFN)
-        return;
-
-    int t = 100;
-    
-    while(bttfn_checkmc() && t--) {}
+    bttfn.loopQuick();
 }
@@ -71,7 +71,7 @@ void flushDelayedSave();
 void increaseVolume();
 void decreaseVolume();
 
-void timeTravel(bool TCDtriggered, uint16_t P0Dur = P0_DUR, uint16_t P1Dur = 0);
+void timeTravel(bool TCDtriggered, uint16_t P0Dur = P0_DUR, uint16_t P1Dur = 0, unsigned long TTanchor = 0);
 
 void displaySysMsg(const char *msg, unsigned long timeout);
 
@@ -100,6 +100,10 @@ unsigned long millisNonZero();
 void addCmdQueue(uint32_t command);
 void bttfn_loop();
 bool bttfn_trigger_tt();
+const char *bttfn_getTCDSSID(uint8_t *pwMarker = NULL);
+#ifdef VSR_HAVEMQTT
+void bttfn_sendStats();
+#endif
 
 // LED display modes
 enum {
@@ -146,6 +150,8 @@ extern bool networkAbort;
 extern bool networkAlarm;
 extern uint16_t networkLead;
 extern uint16_t networkP1;
+extern unsigned long networkTTAt;
+extern unsigned long networkReentryAt;
 
 extern bool doPrepareTT;
 extern bool doWakeup;
@@ -156,8 +162,4 @@ extern bool ssActive;
 
 extern bool blockScan;
 
-extern int     bttfnHaveTCDSSID;
-extern char    TCDSSID[];
-extern uint8_t TCDpwMarker;
-
 #endif
@@ -179,6 +179,7 @@ static const char *wmBuildBestApChnl(const char *dest, int op);
 
 static const char *wmBuildMusicFolder(const char *dest, int op);
 static const char *wmBuildHaveSD(const char *dest, int op);
+static const char *wmBuildAudioStats(const char *dest, int op);
 
 #ifdef VSR_HAVEMQTT
 static const char *wmBuildMQTTprot(const char *dest, int op);
@@ -277,6 +278,7 @@ WiFiManagerParameter custom_TCDpresent("TCDpres", "TCD connected by wire", setti
 WiFiManagerParameter custom_noETTOL("uEtNL", "TCD signals Time Travel without 5s lead", settings.noETTOLead, "class='mt5 ml20'", WFM_LABEL_AFTER|WFM_IS_CHKBOX);
 
 WiFiManagerParameter custom_haveSD(wmBuildHaveSD, WFM_SECTS);
+WiFiManagerParameter custom_audStats(wmBuildAudioStats);
 WiFiManagerParameter custom_CfgOnSD("CfgOnSD", "Save secondary settings on SD<br><span>Check this to avoid flash wear</span>", settings.CfgOnSD, "class='mt5'", WFM_LABEL_AFTER|WFM_IS_CHKBOX);
 //WiFiManagerParameter custom_sdFrq("sdFrq", "4MHz SD clock speed<br><span>Checking this might help in case of SD card problems</span>", settings.sdFreq, "style='margin-top:12px'", WFM_LABEL_AFTER|WFM_IS_CHKBOX);
 WiFiManagerParameter custom_upd("upd", "Show update notifications on power-up", settings.upd, "", WFM_LABEL_AFTER|WFM_IS_CHKBOX|WFM_FOOT);
@@ -496,7 +498,8 @@ void wifi_setup()
       &custom_TCDpresent,   // 2
       &custom_noETTOL, 
       
-      &custom_haveSD,       // 3
+      &custom_haveSD,       // 4
+      &custom_audStats,
       &custom_CfgOnSD,
       //&custom_sdFrq,
       &custom_upd,
@@ -1680,7 +1683,8 @@ static const char *wmBuildTCDAPList(const char *dest, int op)
         return NULL;
     }
 
-    unsigned int l = STRLEN(tcdList) + 4 + (bttfnHaveTCDSSID ? strlen(TCDSSID) : 0);
+    const char *TCDSSID = bttfn_getTCDSSID();
+    unsigned int l = STRLEN(tcdList) + 4 + (TCDSSID ? strlen(TCDSSID) : 0);
 
     if(op == WM_CP_LEN) {
         wmLenBuf = l;
@@ -1689,7 +1693,7 @@ static const char *wmBuildTCDAPList(const char *dest, int op)
 
     char *str = (char *)malloc(l);
 
-    sprintf(str, tcdList, bttfnHaveTCDSSID ? TCDSSID : "");
+    sprintf(str, tcdList, TCDSSID ? TCDSSID : "");
 
     return str;
 }
@@ -1701,7 +1705,10 @@ static const char *wmBuildTCDSSID(const char *dest, int op)
         return NULL;
     }
 
-    if(!bttfnHaveTCDSSID)
+    uint8_t TCDpwMarker;
+    const char *TCDSSID = bttfn_getTCDSSID(&TCDpwMarker);
+
+    if(!TCDSSID)
         return NULL;
 
     unsigned int l = STRLEN(tcdSSIDp) + (TCDpwMarker ? STRLEN(tcdAPPW2) : STRLEN(tcdAPPW1)) + 4;
@@ -1800,6 +1807,32 @@ static const char *wmBuildHaveSD(const char *dest, int op)
     return buildBanner(haveNoSD, col_r, op);
 }
 
+static const char *wmBuildAudioStats(const char *dest, int op)
+{
+    if(op == WM_CP_DESTROY) {
+        if(dest) free((void *)dest);
+        return NULL;
+    }
+
+    if(!audioInitDone)
+        return NULL;
+
+    // Stats change; reserve max length
+    unsigned int l = STRLEN(bannerStart) + 7 + STRLEN(bannerMid) + AUDIO_STATS_LEN + 6 + 4;
+
+    if(op == WM_CP_LEN) {
+        wmLenBuf = l;
+        return (const char *)&wmLenBuf;
+    }
+
+    char buf[AUDIO_STATS_LEN];
+    char *str = (char *)malloc(l);
+    audio_getStats(buf, sizeof(buf), "<br>");
+    sprintf(str, bannerGen, bannerStart, col_gr, bannerMid, buf);
+
+    return str;
+}
+
 #ifdef VSR_HAVEMQTT
 static const char *wmBuildMQTTprot(const char *dest, int op)
 {
@@ -2393,6 +2426,9 @@ static void mqttCallback(char *topic, byte *payload, unsigned int length)
       "\x01" "VOLUME_DOWN",      // 16
       "\x01" "VOLUME_SET_",      // 17  VOLUME_SET_0..VOLUME_SET_100
       "\xc1" "MP_REQSTATUS",     // 18  executed even while off or busy
+      "\x01" "MP_SEEK_",         // 19  MP_SEEK_0..MP_SEEK_9999 (seconds)
+      "\xc1" "AUDIO_STATS",      // 20  executed even while off or busy
+      "\xc1" "BTTFN_STATS",      // 21  executed even while off or busy
       NULL
     };
     static const char *cmdList2[] = {
@@ -2452,6 +2488,8 @@ static void mqttCallback(char *topic, byte *payload, unsigned int length)
                 networkTCDTT = true;
                 networkReentry = false;
                 networkAbort = false;
+                networkTTAt = 0;
+                networkReentryAt = 0;
                 if(strlen(tempBuf) == 20) {
                     networkLead = a2i(&tempBuf[11]);
                     networkP1 = a2i(&tempBuf[16]);
@@ -2465,6 +2503,7 @@ static void mqttCallback(char *topic, byte *payload, unsigned int length)
             // Start re-entry (if TT currently running)
             // Ignore command if TCD is connected by wire
             if(!TCDconnected && (TTrunning || TTrunningIOonly) && networkTCDTT) {
+                networkReentryAt = 0;
                 networkReentry = true;
             }
             break;
@@ -2472,6 +2511,7 @@ static void mqttCallback(char *topic, byte *payload, unsigned int length)
             // Ignore command if TCD is connected by wire
             // (mainly because this is no network-triggered TT)
             if(!TCDconnected && (TTrunning || TTrunningIOonly) && networkTCDTT) {
+                if(!networkReentry) networkReentryAt = 0;
                 networkAbort = true;
             }
             break;
@@ -2553,6 +2593,20 @@ static void mqttCallback(char *topic, byte *payload, unsigned int length)
         case 18:
             mp_sendStatus(1);
             break; 
+        case 19:
+            if(tblen > j && tempBuf[j] >= '0' && tempBuf[j] <= '9') {
+                int p = atoi(tempBuf+j);
+                if(p >= 0 && p <= 9999) {
+                    addCmdQueue(8870000 + p);
+                }
+            }
+            break;
+        case 20:
+            audio_sendStats();
+            break;
+        case 21:
+            bttfn_sendStats();
+            break;
         default:
             addCmdQueue(1000 + i);
         }